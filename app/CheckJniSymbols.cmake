@@ -0,0 +1,35 @@
+# Fails the build when a native method of VideoRenderer.java has no exported JNI symbol in the
+# library. A definition whose parameters differ from its declaration in VideoRendererJNI.h compiles
+# into a C++ overload with a mangled name, which Java only finds at runtime, with an
+# UnsatisfiedLinkError.
+#   cmake -DNM=<nm> -DLIBRARY=<libmedia-lib.so> -DJAVA_SOURCE=<VideoRenderer.java> -P CheckJniSymbols.cmake
+
+execute_process(COMMAND ${NM} -D --defined-only ${LIBRARY}
+        OUTPUT_VARIABLE SYMBOLS
+        RESULT_VARIABLE RESULT)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NM} could not list the symbols of ${LIBRARY}")
+endif ()
+
+file(READ ${JAVA_SOURCE} SOURCE)
+string(REGEX MATCHALL "native[ \t\r\n]+[A-Za-z0-9_.<>]+(\\[\\])?[ \t\r\n]+[A-Za-z0-9_]+[ \t\r\n]*\\(" DECLARATIONS
+        "${SOURCE}")
+if (NOT DECLARATIONS)
+    message(FATAL_ERROR "No native methods found in ${JAVA_SOURCE}")
+endif ()
+
+set(MISSING)
+foreach (DECLARATION ${DECLARATIONS})
+    string(REGEX REPLACE ".*[ \t\r\n]([A-Za-z0-9_]+)[ \t\r\n]*\\($" "\\1" METHOD "${DECLARATION}")
+    # Overloaded natives would be exported with their signatures appended, VideoRenderer has none.
+    set(SYMBOL Java_com_media_camera_preview_render_VideoRenderer_${METHOD})
+    if (NOT SYMBOLS MATCHES "[ \t]T ${SYMBOL}\n")
+        list(APPEND MISSING ${SYMBOL})
+    endif ()
+endforeach ()
+
+if (MISSING)
+    string(REPLACE ";" "\n  " MISSING "${MISSING}")
+    message(FATAL_ERROR "Native methods of ${JAVA_SOURCE} not exported by ${LIBRARY}, check their "
+            "declarations in VideoRendererJNI.h:\n  ${MISSING}")
+endif ()
@@ -1,6 +1,10 @@
 #include "CommonUtils.h"
+#include "PixelKernels.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 void load_identity(float *m) {
     for (int i = 0; i < 16; ++i) {
@@ -49,3 +53,234 @@ void mat4f_load_scale_mat(float *m, int rotation, size_t surfaceWidth, size_t su
     m[0] = mirrorX ? scaleX : -scaleX;
     m[5] = mirrorY ? scaleY : -scaleY;
 }
+
+void mat4f_multiply(float *m, const float *a, const float *b) {
+    float product[16];
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                sum += a[i * 4 + row] * b[column * 4 + i];
+            }
+            product[column * 4 + row] = sum;
+        }
+    }
+
+    std::copy(product, product + 16, m);
+}
+
+// Region edges, extended outwards to a multiple of alignment and clipped to [0, size].
+static void align_region(float begin, float end, size_t apron, size_t alignment, size_t size, size_t &x,
+                         size_t &width) {
+    float first = std::floor(begin) - (float) apron;
+    float last = std::ceil(end) + (float) apron;
+
+    size_t alignedBegin = first <= 0.0f ? 0 : (size_t) first / alignment * alignment;
+    size_t alignedEnd = last >= (float) size ? size : ((size_t) last + alignment - 1) / alignment * alignment;
+    alignedEnd = std::min(alignedEnd, size);
+
+    x = std::min(alignedBegin, alignedEnd);
+    width = alignedEnd - x;
+}
+
+frame_region visible_frame_region(const float *rotation, const float *scale, float zoom, float *centerX,
+                                  float *centerY, size_t frameWidth, size_t frameHeight, size_t apron,
+                                  size_t alignment) {
+    // Half the extent of the rotated and scaled view along each frame axis, its bounding box for
+    // rotations other than multiples of 90 degrees.
+    float c = std::fabs(rotation[0]);
+    float s = std::fabs(rotation[1]);
+    float scaleX = std::fabs(scale[0]);
+    float scaleY = std::fabs(scale[5]);
+    zoom = std::max(zoom, 1.0f);
+
+    float halfWidth = 0.5f * (c * scaleX + s * scaleY) / zoom;
+    float halfHeight = 0.5f * (s * scaleX + c * scaleY) / zoom;
+
+    *centerX = halfWidth >= 0.5f ? 0.5f : std::min(std::max(*centerX, halfWidth), 1.0f - halfWidth);
+    *centerY = halfHeight >= 0.5f ? 0.5f : std::min(std::max(*centerY, halfHeight), 1.0f - halfHeight);
+
+    frame_region region{};
+    align_region((*centerX - halfWidth) * (float) frameWidth, (*centerX + halfWidth) * (float) frameWidth, apron,
+                 alignment, frameWidth, region.x, region.width);
+    align_region((*centerY - halfHeight) * (float) frameHeight, (*centerY + halfHeight) * (float) frameHeight,
+                 apron, alignment, frameHeight, region.y, region.height);
+
+    return region;
+}
+
+void mat4f_load_crop_mat(float *m, float zoom, float centerX, float centerY, size_t frameWidth,
+                         size_t frameHeight, const frame_region &region) {
+    load_identity(m);
+
+    if (!region.width || !region.height) return;
+
+    zoom = std::max(zoom, 1.0f);
+
+    m[0] = (float) frameWidth / (zoom * (float) region.width);
+    m[5] = (float) frameHeight / (zoom * (float) region.height);
+    m[12] = (centerX * (float) frameWidth - (float) region.x) / (float) region.width - 0.5f;
+    m[13] = (centerY * (float) frameHeight - (float) region.y) / (float) region.height - 0.5f;
+}
+
+void mat4f_load_yuv_to_rgb_mat(float *m) {
+    static const float kYuvToRgb[16] = {
+            1.0f, 0.0f, 1.403f, -0.5f * 1.403f,
+            1.0f, -0.344f, -0.714f, 0.5f * (0.344f + 0.714f),
+            1.0f, 1.770f, 0.0f, -0.5f * 1.770f,
+            0.0f, 0.0f, 0.0f, 1.0f,
+    };
+
+    for (int i = 0; i < 16; i++) {
+        m[i] = kYuvToRgb[i];
+    }
+}
+
+// Fixed point scale of the YUV to RGB coefficients.
+static const int kYuvToRgbShift = 14;
+
+static inline uint8_t clamp_yuv_to_rgb(int32_t value) {
+    value >>= kYuvToRgbShift;
+
+    return (uint8_t) (value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+void yuv420_to_rgba(const uint8_t *y, size_t strideY, const uint8_t *u, const uint8_t *v, size_t strideUV,
+                    size_t uvPixelStride, size_t width, size_t height, const float *colorMatrix,
+                    uint8_t *rgba, size_t strideRGBA) {
+    const float scale = (float) (1 << kYuvToRgbShift);
+    int32_t k[3][4];
+
+    // Inputs are 8-bit code values, so the constant column is scaled by 255 too.
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            k[row][col] = (int32_t) lroundf(colorMatrix[row * 4 + col] * scale);
+        }
+        k[row][3] = (int32_t) lroundf(colorMatrix[row * 4 + 3] * 255.0f * scale) + (1 << (kYuvToRgbShift - 1));
+    }
+
+    for (size_t row = 0; row < height; row++) {
+        const uint8_t *pY = y + row * strideY;
+        const uint8_t *pU = u + row / 2 * strideUV;
+        const uint8_t *pV = v + row / 2 * strideUV;
+        uint8_t *pRGBA = rgba + row * strideRGBA;
+
+        for (size_t col = 0; col < width; col++) {
+            int32_t Y = pY[col];
+            int32_t U = pU[col / 2 * uvPixelStride];
+            int32_t V = pV[col / 2 * uvPixelStride];
+
+            pRGBA[0] = clamp_yuv_to_rgb(k[0][0] * Y + k[0][1] * U + k[0][2] * V + k[0][3]);
+            pRGBA[1] = clamp_yuv_to_rgb(k[1][0] * Y + k[1][1] * U + k[1][2] * V + k[1][3]);
+            pRGBA[2] = clamp_yuv_to_rgb(k[2][0] * Y + k[2][1] * U + k[2][2] * V + k[2][3]);
+            pRGBA[3] = 255;
+            pRGBA += 4;
+        }
+    }
+}
+
+// BT.601 luma weights and the inverse chroma scales of mat4f_load_yuv_to_rgb_mat(), in Q14.
+static const int32_t kRgbToY[3] = {4899, 9617, 1868};
+static const int32_t kBToU = 9257;
+static const int32_t kRToV = 11678;
+
+static inline uint8_t clamp_rgb_to_yuv(int32_t value) {
+    value = (value + (1 << (kYuvToRgbShift - 1))) >> kYuvToRgbShift;
+
+    return (uint8_t) (value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+void rgba_to_yuv420(const uint8_t *rgba, size_t strideRGBA, size_t width, size_t height, uint8_t *y,
+                    size_t strideY, uint8_t *u, uint8_t *v, size_t strideUV) {
+    for (size_t row = 0; row < height; row += 2) {
+        const uint8_t *pRGBA[2] = {rgba + row * strideRGBA, rgba + (row + 1) * strideRGBA};
+        uint8_t *pY[2] = {y + row * strideY, y + (row + 1) * strideY};
+        uint8_t *pU = u + row / 2 * strideUV;
+        uint8_t *pV = v + row / 2 * strideUV;
+
+        for (size_t col = 0; col < width; col += 2) {
+            // Sums over the 2x2 block, in Q14 times 4.
+            int32_t sumY = 0;
+            int32_t sumR = 0;
+            int32_t sumB = 0;
+
+            for (int i = 0; i < 2; i++) {
+                for (size_t x = col; x < col + 2; x++) {
+                    const uint8_t *p = pRGBA[i] + x * 4;
+                    int32_t luma = kRgbToY[0] * p[0] + kRgbToY[1] * p[1] + kRgbToY[2] * p[2];
+
+                    pY[i][x] = clamp_rgb_to_yuv(luma);
+                    sumY += luma;
+                    sumR += p[0] << kYuvToRgbShift;
+                    sumB += p[2] << kYuvToRgbShift;
+                }
+            }
+
+            // u = (b - y) / 1.770 + 0.5, v = (r - y) / 1.403 + 0.5, from the block means.
+            int64_t diffB = (int64_t) (sumB - sumY) * kBToU >> (kYuvToRgbShift + 2);
+            int64_t diffR = (int64_t) (sumR - sumY) * kRToV >> (kYuvToRgbShift + 2);
+            pU[col / 2] = clamp_rgb_to_yuv((int32_t) diffB + (128 << kYuvToRgbShift));
+            pV[col / 2] = clamp_rgb_to_yuv((int32_t) diffR + (128 << kYuvToRgbShift));
+        }
+    }
+}
+
+void copy_plane(uint8_t *dst, size_t dstStride, const uint8_t *src, size_t srcStride, size_t width,
+                size_t height) {
+    if (dstStride == width && srcStride == width) {
+        memcpy(dst, src, width * height);
+        return;
+    }
+
+    for (size_t row = 0; row < height; row++) {
+        memcpy(dst, src, width);
+
+        dst += dstStride;
+        src += srcStride;
+    }
+}
+
+void split_uv_plane(uint8_t *u, uint8_t *v, size_t dstStride, const uint8_t *uv, size_t srcStride, size_t width,
+                    size_t height) {
+    const pixel_kernels &kernels = pixel_kernels_best();
+    for (size_t row = 0; row < height; row++) {
+        kernels.split_uv(uv + row * srcStride, u + row * dstStride, v + row * dstStride, width);
+    }
+}
+
+size_t gaussian_linear_kernel(float radius, float *offsets, float *weights, size_t maxTaps) {
+    if (maxTaps == 0) return 0;
+
+    // Merged pairs need 1 + ceil(r / 2) taps, clamp the radius to what fits.
+    int r = std::min((int) ceilf(radius), (int) (2 * (maxTaps - 1)));
+    if (r <= 0) {
+        offsets[0] = 0.0f;
+        weights[0] = 1.0f;
+        return 1;
+    }
+
+    float sigma = (float) r / 3.0f;
+    std::vector<float> discrete((size_t) r + 1);
+    float sum = 0.0f;
+
+    for (int k = 0; k <= r; ++k) {
+        discrete[k] = expf(-(float) (k * k) / (2.0f * sigma * sigma));
+        sum += k == 0 ? discrete[k] : 2.0f * discrete[k];
+    }
+
+    offsets[0] = 0.0f;
+    weights[0] = discrete[0] / sum;
+
+    size_t taps = 1;
+    for (int k = 1; k <= r; k += 2) {
+        float w1 = discrete[k] / sum;
+        float w2 = k + 1 <= r ? discrete[k + 1] / sum : 0.0f;
+
+        weights[taps] = w1 + w2;
+        offsets[taps] = ((float) k * w1 + (float) (k + 1) * w2) / (w1 + w2);
+        taps++;
+    }
+
+    return taps;
+}
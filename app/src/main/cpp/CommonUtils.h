@@ -2,6 +2,7 @@
 #define _COMMON_UTILS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 void load_identity(float *m);
 
@@ -10,4 +11,56 @@ void mat4f_load_rotate_mat(float *m, float rotation);
 void mat4f_load_scale_mat(float *m, int rotation, size_t surfaceWidth, size_t surfaceHeight,
                           size_t frameWidth, size_t frameHeight, bool mirrorX, bool mirror);
 
+// m = a * b, column-major like the matrices above.
+void mat4f_multiply(float *m, const float *a, const float *b);
+
+// Pixels of a frame, x and y from its top left corner.
+struct frame_region {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+// Part of a frame shown by the rotate and scale matrices above, zoomed zoom (1 or more) times around
+// (*centerX, *centerY) in normalized frame coordinates. The centre is clamped so that the view stays
+// inside the frame. The region grows by apron pixels on each side for filter taps, and it is aligned to
+// alignment pixels, an even number, and clipped to the frame.
+frame_region visible_frame_region(const float *rotation, const float *scale, float zoom, float *centerX,
+                                  float *centerY, size_t frameWidth, size_t frameHeight, size_t apron,
+                                  size_t alignment);
+
+// Maps the centred coordinates the rotate and scale matrices produce into a texture holding only region,
+// zoomed zoom times around (centerX, centerY). Goes in front of the rotation.
+void mat4f_load_crop_mat(float *m, float zoom, float centerX, float centerY, size_t frameWidth,
+                         size_t frameHeight, const frame_region &region);
+
+// Row-major YUV to RGB conversion, rgb = m * (y, u, v, 1) with chroma centered at 0.5.
+// Coefficients are those the shaders always used (BT.601, full range).
+void mat4f_load_yuv_to_rgb_mat(float *m);
+
+// Converts 4:2:0 YUV to RGBA with a matrix from mat4f_load_yuv_to_rgb_mat(). Chroma samples are
+// uvPixelStride bytes apart in their rows: 1 for planar (I420), 2 for semi-planar (NV12, v = u + 1).
+void yuv420_to_rgba(const uint8_t *y, size_t strideY, const uint8_t *u, const uint8_t *v, size_t strideUV,
+                    size_t uvPixelStride, size_t width, size_t height, const float *colorMatrix,
+                    uint8_t *rgba, size_t strideRGBA);
+
+// Converts RGBA to I420 with the inverse of mat4f_load_yuv_to_rgb_mat(), chroma averaged over each
+// 2x2 block. width and height must be even.
+void rgba_to_yuv420(const uint8_t *rgba, size_t strideRGBA, size_t width, size_t height, uint8_t *y,
+                    size_t strideY, uint8_t *u, uint8_t *v, size_t strideUV);
+
+// Copies height rows of width bytes, in one block when neither plane has row padding.
+void copy_plane(uint8_t *dst, size_t dstStride, const uint8_t *src, size_t srcStride, size_t width,
+                size_t height);
+
+// Splits height rows of width interleaved chroma pairs (NV12, u first) into U and V planes.
+void split_uv_plane(uint8_t *u, uint8_t *v, size_t dstStride, const uint8_t *uv, size_t srcStride, size_t width,
+                    size_t height);
+
+// Fills offsets/weights (in texels) with a normalized Gaussian kernel spanning [-radius, radius],
+// adjacent taps merged so that one bilinear fetch covers two texels. Returns the number of taps,
+// tap 0 is the center and every other tap is applied at +/- its offset.
+size_t gaussian_linear_kernel(float radius, float *offsets, float *weights, size_t maxTaps);
+
 #endif //_COMMON_UTILS_H_
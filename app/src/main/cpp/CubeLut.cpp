@@ -0,0 +1,216 @@
+#include "CubeLut.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static const size_t kMaxCubeSize = 64;
+
+static float clamp01(float value) {
+    return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+CubeLut::CubeLut() : m_size(0) {
+
+}
+
+bool CubeLut::load(const char *data, size_t length) {
+    std::string text(data, length);
+    std::vector<float> table;
+    size_t size = 0;
+
+    const char *line = text.c_str();
+    while (*line) {
+        const char *next = strchr(line, '\n');
+        size_t lineLength = next ? (size_t) (next - line) : strlen(line);
+        std::string entry(line, lineLength);
+        line = next ? next + 1 : line + lineLength;
+
+        const char *p = entry.c_str();
+        while (*p == ' ' || *p == '\t') p++;
+
+        if (*p == '\0' || *p == '\r' || *p == '#') continue;
+
+        if (!strncmp(p, "LUT_3D_SIZE", 11)) {
+            size = (size_t) strtoul(p + 11, nullptr, 10);
+            if (size < 2 || size > kMaxCubeSize) {
+                LOGE("Unsupported LUT_3D_SIZE %zu", size);
+                return false;
+            }
+            table.reserve(size * size * size * 3);
+        } else if (!strncmp(p, "DOMAIN_MIN", 10) || !strncmp(p, "DOMAIN_MAX", 10)) {
+            float expected = p[8] == 'I' ? 0.0f : 1.0f;
+            char *end = const_cast<char *>(p + 10);
+            for (int i = 0; i < 3; ++i) {
+                if (strtof(end, &end) != expected) {
+                    LOGE("Unsupported LUT domain");
+                    return false;
+                }
+            }
+        } else if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '.') {
+            char *end = const_cast<char *>(p);
+            for (int i = 0; i < 3; ++i) {
+                table.push_back(strtof(end, &end));
+            }
+        } else if (!strncmp(p, "LUT_1D_SIZE", 11)) {
+            LOGE("1D LUTs are not supported");
+            return false;
+        }
+        // TITLE and unknown keywords are ignored.
+    }
+
+    if (!size || table.size() != size * size * size * 3) {
+        LOGE("Malformed LUT, size %zu with %zu values", size, table.size());
+        return false;
+    }
+
+    m_size = size;
+    m_table = std::move(table);
+
+    return true;
+}
+
+void CubeLut::generate(size_t size,
+                       const std::function<void(const float in[3], float out[3])> &fn) {
+    m_size = size;
+    m_table.resize(size * size * size * 3);
+
+    auto last = (float) (size - 1);
+    float *entry = m_table.data();
+
+    for (size_t b = 0; b < size; ++b) {
+        for (size_t g = 0; g < size; ++g) {
+            for (size_t r = 0; r < size; ++r, entry += 3) {
+                float in[3] = {(float) r / last, (float) g / last, (float) b / last};
+                fn(in, entry);
+            }
+        }
+    }
+}
+
+size_t CubeLut::size() const {
+    return m_size;
+}
+
+const float *CubeLut::at(size_t r, size_t g, size_t b) const {
+    return &m_table[((b * m_size + g) * m_size + r) * 3];
+}
+
+void CubeLut::toTiledRGBA(std::vector<uint8_t> &rgba) const {
+    size_t width = m_size * m_size;
+    rgba.resize(width * m_size * 4);
+
+    for (size_t g = 0; g < m_size; ++g) {
+        uint8_t *row = &rgba[g * width * 4];
+        for (size_t b = 0; b < m_size; ++b) {
+            for (size_t r = 0; r < m_size; ++r) {
+                const float *color = at(r, g, b);
+                uint8_t *texel = row + (b * m_size + r) * 4;
+                texel[0] = (uint8_t) (clamp01(color[0]) * 255.0f + 0.5f);
+                texel[1] = (uint8_t) (clamp01(color[1]) * 255.0f + 0.5f);
+                texel[2] = (uint8_t) (clamp01(color[2]) * 255.0f + 0.5f);
+                texel[3] = 255;
+            }
+        }
+    }
+}
+
+void CubeLut::toRGBA(std::vector<uint8_t> &rgba) const {
+    size_t count = m_size * m_size * m_size;
+    rgba.resize(count * 4);
+
+    // The table is in texture order already.
+    for (size_t i = 0; i < count; ++i) {
+        const float *color = &m_table[i * 3];
+        uint8_t *texel = &rgba[i * 4];
+        texel[0] = (uint8_t) (clamp01(color[0]) * 255.0f + 0.5f);
+        texel[1] = (uint8_t) (clamp01(color[1]) * 255.0f + 0.5f);
+        texel[2] = (uint8_t) (clamp01(color[2]) * 255.0f + 0.5f);
+        texel[3] = 255;
+    }
+}
+
+void CubeLut::apply(const float in[3], float out[3]) const {
+    auto last = (float) (m_size - 1);
+
+    float fr = clamp01(in[0]) * last;
+    float fg = clamp01(in[1]) * last;
+    float fb = clamp01(in[2]) * last;
+
+    auto r0 = std::min((size_t) fr, m_size - 2);
+    auto g0 = std::min((size_t) fg, m_size - 2);
+    auto b0 = std::min((size_t) fb, m_size - 2);
+
+    float dr = fr - (float) r0;
+    float dg = fg - (float) g0;
+    float db = fb - (float) b0;
+
+    // Split the cell into six tetrahedra along the main diagonal, pick the one containing
+    // the sample and walk c000 -> c111 through its two intermediate corners.
+    const float *c000 = at(r0, g0, b0);
+    const float *c111 = at(r0 + 1, g0 + 1, b0 + 1);
+    const float *c1, *c2;
+    float w1, w2, w3;
+
+    if (dr > dg) {
+        if (dg > db) {
+            c1 = at(r0 + 1, g0, b0);
+            c2 = at(r0 + 1, g0 + 1, b0);
+            w1 = dr;
+            w2 = dg;
+            w3 = db;
+        } else if (dr > db) {
+            c1 = at(r0 + 1, g0, b0);
+            c2 = at(r0 + 1, g0, b0 + 1);
+            w1 = dr;
+            w2 = db;
+            w3 = dg;
+        } else {
+            c1 = at(r0, g0, b0 + 1);
+            c2 = at(r0 + 1, g0, b0 + 1);
+            w1 = db;
+            w2 = dr;
+            w3 = dg;
+        }
+    } else {
+        if (db > dg) {
+            c1 = at(r0, g0, b0 + 1);
+            c2 = at(r0, g0 + 1, b0 + 1);
+            w1 = db;
+            w2 = dg;
+            w3 = dr;
+        } else if (db > dr) {
+            c1 = at(r0, g0 + 1, b0);
+            c2 = at(r0, g0 + 1, b0 + 1);
+            w1 = dg;
+            w2 = db;
+            w3 = dr;
+        } else {
+            c1 = at(r0, g0 + 1, b0);
+            c2 = at(r0 + 1, g0 + 1, b0);
+            w1 = dg;
+            w2 = dr;
+            w3 = db;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        out[i] = (1.0f - w1) * c000[i] + (w1 - w2) * c1[i] + (w2 - w3) * c2[i] + w3 * c111[i];
+    }
+}
+
+void CubeLut::apply(uint8_t *rgba, size_t pixelCount) const {
+    const float kNormalize = 1.0f / 255.0f;
+
+    for (size_t i = 0; i < pixelCount; ++i, rgba += 4) {
+        float in[3] = {rgba[0] * kNormalize, rgba[1] * kNormalize, rgba[2] * kNormalize};
+        float out[3];
+        apply(in, out);
+
+        rgba[0] = (uint8_t) (clamp01(out[0]) * 255.0f + 0.5f);
+        rgba[1] = (uint8_t) (clamp01(out[1]) * 255.0f + 0.5f);
+        rgba[2] = (uint8_t) (clamp01(out[2]) * 255.0f + 0.5f);
+    }
+}
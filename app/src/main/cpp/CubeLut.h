@@ -0,0 +1,41 @@
+#ifndef _CUBE_LUT_H_
+#define _CUBE_LUT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 3D color lookup table in the Adobe/Resolve .cube layout, red varying fastest.
+class CubeLut {
+public:
+    CubeLut();
+
+    // Parses .cube text, only the default [0, 1] domain is supported.
+    bool load(const char *data, size_t length);
+
+    // Samples fn at every lattice point, for color transforms that are pure functions of RGB.
+    void generate(size_t size, const std::function<void(const float in[3], float out[3])> &fn);
+
+    size_t size() const;
+
+    // Lays the cube out as size() tiles of size() x size() side by side, one tile per blue slice,
+    // red along x and green along y. Width is size() * size(), height is size().
+    void toTiledRGBA(std::vector<uint8_t> &rgba) const;
+
+    // Lays the cube out as a size()^3 3D texture, red along x, green along y and blue along z.
+    void toRGBA(std::vector<uint8_t> &rgba) const;
+
+    // Tetrahedral interpolation, reference for the GPU lookup and the software path.
+    void apply(const float in[3], float out[3]) const;
+
+    void apply(uint8_t *rgba, size_t pixelCount) const;
+
+private:
+    const float *at(size_t r, size_t g, size_t b) const;
+
+    size_t m_size;
+    std::vector<float> m_table;
+};
+
+#endif //_CUBE_LUT_H_
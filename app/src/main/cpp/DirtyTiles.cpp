@@ -0,0 +1,153 @@
+#include "DirtyTiles.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// True when any of the width x height samples of a and b are more than threshold apart. Rows are
+// compared 16 samples at a time and the search stops at the first row that differs.
+static bool block_differs(const uint8_t *a, size_t strideA, const uint8_t *b, size_t strideB, size_t width,
+                          size_t height, uint8_t threshold) {
+    for (size_t row = 0; row < height; row++) {
+        const uint8_t *pA = a + row * strideA;
+        const uint8_t *pB = b + row * strideB;
+        size_t x = 0;
+
+#if defined(__ARM_NEON)
+        uint8x16_t limit = vdupq_n_u8(threshold);
+        uint8x16_t above = vdupq_n_u8(0);
+        for (; x + 16 <= width; x += 16) {
+            above = vorrq_u8(above, vcgtq_u8(vabdq_u8(vld1q_u8(pA + x), vld1q_u8(pB + x)), limit));
+        }
+
+        uint64x2_t lanes = vreinterpretq_u64_u8(above);
+        if (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) return true;
+#elif defined(__SSE2__)
+        __m128i limit = _mm_set1_epi8((char) threshold);
+        __m128i zero = _mm_setzero_si128();
+        __m128i above = zero;
+        for (; x + 16 <= width; x += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *) (pA + x));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (pB + x));
+            // Unsigned |a - b| from two saturating differences, then whatever exceeds the limit.
+            __m128i difference = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            above = _mm_or_si128(above, _mm_subs_epu8(difference, limit));
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(above, zero)) != 0xFFFF) return true;
+#endif
+
+        for (; x < width; x++) {
+            int difference = (int) pA[x] - (int) pB[x];
+            if (difference > threshold || -difference > threshold) return true;
+        }
+    }
+
+    return false;
+}
+
+DirtyTiles::DirtyTiles() : m_width(0), m_height(0), m_semiPlanar(false), m_columns(0), m_rows(0) {
+
+}
+
+void DirtyTiles::reset() {
+    m_width = 0;
+    m_height = 0;
+    m_columns = 0;
+    m_rows = 0;
+
+    std::vector<uint8_t>().swap(m_luma);
+    std::vector<uint8_t>().swap(m_chroma);
+    m_dirty.clear();
+}
+
+void DirtyTiles::tileRect(size_t column, size_t row, size_t &x, size_t &y, size_t &width, size_t &height) const {
+    x = column * kTileSize;
+    y = row * kTileSize;
+    width = std::min(kTileSize, m_width - x);
+    height = std::min(kTileSize, m_height - y);
+}
+
+size_t DirtyTiles::update(const video_frame &planes, const frame_region &region, int threshold) {
+    bool semiPlanar = planes.pixel_stride_uv == 2;
+    bool changed = region.width != m_width || region.height != m_height || semiPlanar != m_semiPlanar;
+
+    if (changed) {
+        m_width = region.width;
+        m_height = region.height;
+        m_semiPlanar = semiPlanar;
+        m_columns = (m_width + kTileSize - 1) / kTileSize;
+        m_rows = (m_height + kTileSize - 1) / kTileSize;
+
+        m_luma.resize(m_width * m_height);
+        m_chroma.resize(2 * (m_width / 2) * (m_height / 2));
+        m_dirty.assign(m_columns * m_rows, 1);
+    }
+
+    // A full threshold would hide every change, and a first frame is copied whatever it holds.
+    auto limit = (uint8_t) std::min(std::max(threshold, 0), 254);
+    if (changed) limit = 0;
+
+    std::atomic<size_t> dirty{0};
+    JobSystem::instance().parallelFor(m_rows, [&](size_t begin, size_t end) {
+        size_t count = 0;
+
+        for (size_t row = begin; row < end; row++) {
+            for (size_t column = 0; column < m_columns; column++) {
+                bool tileChanged = updateTile(planes, region, column, row, limit) || changed;
+                m_dirty[row * m_columns + column] = (uint8_t) tileChanged;
+                if (tileChanged) count++;
+            }
+        }
+
+        dirty.fetch_add(count, std::memory_order_relaxed);
+    });
+
+    return dirty.load(std::memory_order_relaxed);
+}
+
+bool DirtyTiles::updateTile(const video_frame &planes, const frame_region &region, size_t column, size_t row,
+                            uint8_t threshold) {
+    size_t x, y, width, height;
+    tileRect(column, row, x, y, width, height);
+
+    const uint8_t *srcY = planes.y + (region.y + y) * planes.stride_y + region.x + x;
+    uint8_t *dstY = m_luma.data() + y * m_width + x;
+
+    // Chroma samples under the tile, each chroma row holds both planes when they are interleaved.
+    size_t chromaX = x / 2;
+    size_t chromaY = y / 2;
+    size_t chromaWidth = (x + width) / 2 - chromaX;
+    size_t chromaHeight = (y + height) / 2 - chromaY;
+    size_t regionChromaWidth = m_width / 2;
+    size_t srcOffset = (region.y / 2 + chromaY) * planes.stride_uv + (region.x / 2 + chromaX) * planes.pixel_stride_uv;
+
+    const uint8_t *srcU = (m_semiPlanar ? std::min(planes.u, planes.v) : planes.u) + srcOffset;
+    const uint8_t *srcV = planes.v + srcOffset;
+    size_t dstStride = m_semiPlanar ? 2 * regionChromaWidth : regionChromaWidth;
+    uint8_t *dstU = m_chroma.data() + chromaY * dstStride + (m_semiPlanar ? 2 * chromaX : chromaX);
+    uint8_t *dstV = dstU + regionChromaWidth * (m_height / 2);
+    size_t rowBytes = m_semiPlanar ? 2 * chromaWidth : chromaWidth;
+
+    bool changed = block_differs(srcY, planes.stride_y, dstY, m_width, width, height, threshold) ||
+                   block_differs(srcU, planes.stride_uv, dstU, dstStride, rowBytes, chromaHeight, threshold) ||
+                   (!m_semiPlanar &&
+                    block_differs(srcV, planes.stride_uv, dstV, dstStride, rowBytes, chromaHeight, threshold));
+
+    if (!changed) return false;
+
+    copy_plane(dstY, m_width, srcY, planes.stride_y, width, height);
+    copy_plane(dstU, dstStride, srcU, planes.stride_uv, rowBytes, chromaHeight);
+    if (!m_semiPlanar) {
+        copy_plane(dstV, dstStride, srcV, planes.stride_uv, rowBytes, chromaHeight);
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef _DIRTY_TILES_H_
+#define _DIRTY_TILES_H_
+
+#include "CommonUtils.h"
+#include "FrameRef.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Tiles of a frame region that changed since the last region it was given, for uploading only
+// those. Luma tiles are kTileSize pixels square and carry the chroma samples they cover. A copy of
+// the samples last seen in each tile is kept to compare against.
+class DirtyTiles {
+public:
+    static const size_t kTileSize = 64;
+
+    DirtyTiles();
+
+    // Drops the copy, the next update() marks every tile.
+    void reset();
+
+    // Marks the tiles of region in planes that moved by more than threshold in any sample since the
+    // last call, and returns how many did. Every tile is marked when the region size or the chroma
+    // layout changed.
+    size_t update(const video_frame &planes, const frame_region &region, int threshold);
+
+    size_t columns() const {
+        return m_columns;
+    }
+
+    size_t rows() const {
+        return m_rows;
+    }
+
+    size_t count() const {
+        return m_columns * m_rows;
+    }
+
+    bool isDirty(size_t column, size_t row) const {
+        return m_dirty[row * m_columns + column] != 0;
+    }
+
+    // Pixels of a tile in the region, the last column and row may be narrower.
+    void tileRect(size_t column, size_t row, size_t &x, size_t &y, size_t &width, size_t &height) const;
+
+private:
+    // Compares and copies one tile, returns true when it changed.
+    bool updateTile(const video_frame &planes, const frame_region &region, size_t column, size_t row,
+                    uint8_t threshold);
+
+    size_t m_width;
+    size_t m_height;
+    bool m_semiPlanar;
+    size_t m_columns;
+    size_t m_rows;
+
+    // Samples last seen, luma and chroma packed at the region size. Semi-planar chroma stays
+    // interleaved, planar chroma is U then V.
+    std::vector<uint8_t> m_luma;
+    std::vector<uint8_t> m_chroma;
+    std::vector<uint8_t> m_dirty;
+};
+
+#endif //_DIRTY_TILES_H_
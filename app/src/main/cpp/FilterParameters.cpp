@@ -0,0 +1,91 @@
+#include "FilterParameters.h"
+
+// Blur, radius in pixels, limited by kMaxBlurTaps.
+static const filter_parameter kBlurParameters[] = {
+        {"radius", 8.0f, 0.0f, 30.0f},
+};
+
+// Swirl, radius in pixels and angle in radians.
+static const filter_parameter kSwirlParameters[] = {
+        {"radius", 200.0f, 1.0f, 4096.0f},
+        {"angle",  0.8f,   -4.0f, 4.0f},
+};
+
+// Magnifying Glass, radius as a fraction of the frame height.
+static const filter_parameter kMagnifierParameters[] = {
+        {"radius",  0.5f, 0.01f, 1.0f},
+        {"minZoom", 0.4f, 0.0f,  2.0f},
+        {"maxZoom", 0.6f, 0.0f,  2.0f},
+};
+
+// Fish Eye, aperture in degrees.
+static const filter_parameter kFishEyeParameters[] = {
+        {"aperture", 158.0f, 1.0f, 179.0f},
+};
+
+// Lichtenstein-esque, dots across the frame width.
+static const filter_parameter kDotParameters[] = {
+        {"dotCount", 75.0f, 2.0f, 500.0f},
+};
+
+// Triangles mosaic, tiles across and down the frame.
+static const filter_parameter kTriangleParameters[] = {
+        {"tilesX", 40.0f, 1.0f, 500.0f},
+        {"tilesY", 20.0f, 1.0f, 500.0f},
+};
+
+// Pixelation, cells across and down the frame.
+static const filter_parameter kPixelationParameters[] = {
+        {"pixelCount", 100.0f, 2.0f, 1000.0f},
+};
+
+// Cross Stitching, stitches across the frame width, invert is 0 or 1.
+static const filter_parameter kStitchParameters[] = {
+        {"stitchCount", 35.0f, 2.0f, 500.0f},
+        {"invert",      0.0f,  0.0f, 1.0f},
+};
+
+// Toonify
+static const filter_parameter kToonParameters[] = {
+        {"edgeThreshold", 0.2f, 0.0f, 1.0f},
+        {"edgeGain",      5.0f, 0.0f, 50.0f},
+};
+
+// Emboss
+static const filter_parameter kEmbossParameters[] = {
+        {"strength", 5.0f, 0.0f, 50.0f},
+};
+
+struct filter_parameter_list {
+    const filter_parameter *parameters;
+    size_t count;
+};
+
+#define PARAMETER_LIST(list) {list, sizeof(list) / sizeof(list[0])}
+
+// Indexed like the fragment shaders of GLVideoRendererYUV420Filter.
+static const filter_parameter_list kFilterParameters[] = {
+        {nullptr, 0},
+        PARAMETER_LIST(kBlurParameters),
+        PARAMETER_LIST(kSwirlParameters),
+        PARAMETER_LIST(kMagnifierParameters),
+        PARAMETER_LIST(kFishEyeParameters),
+        PARAMETER_LIST(kDotParameters),
+        PARAMETER_LIST(kTriangleParameters),
+        PARAMETER_LIST(kPixelationParameters),
+        PARAMETER_LIST(kStitchParameters),
+        PARAMETER_LIST(kToonParameters),
+        {nullptr, 0},
+        PARAMETER_LIST(kEmbossParameters),
+        {nullptr, 0},
+};
+
+const filter_parameter *filter_parameters(size_t filter, size_t &count) {
+    if (filter >= sizeof(kFilterParameters) / sizeof(kFilterParameters[0])) {
+        count = 0;
+        return nullptr;
+    }
+
+    count = kFilterParameters[filter].count;
+    return kFilterParameters[filter].parameters;
+}
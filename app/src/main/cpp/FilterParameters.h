@@ -0,0 +1,21 @@
+#ifndef _FILTER_PARAMETERS_H_
+#define _FILTER_PARAMETERS_H_
+
+#include <cstddef>
+
+static const size_t kMaxFilters = 16;
+static const size_t kMaxFilterParameters = 4;
+
+// A runtime tunable of a filter. Shader filters read it from the float uniform of the same name,
+// the distortion filters pass it to WarpMap. Changing one never rebuilds a program.
+struct filter_parameter {
+    const char *name;
+    float value;
+    float min;
+    float max;
+};
+
+// Parameters of the filter at index filter, in the order values are passed to setFilterParameters().
+const filter_parameter *filter_parameters(size_t filter, size_t &count);
+
+#endif //_FILTER_PARAMETERS_H_
@@ -0,0 +1,117 @@
+#include "FilterTables.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float kThermalColors[3][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 1.0f, 0.0f},
+        {1.0f, 0.0f, 0.0f},
+};
+
+static const float kHueLevels[] = {0.0f, 140.0f, 160.0f, 240.0f, 240.0f, 360.0f};
+static const float kSatLevels[] = {0.0f, 0.15f, 0.3f, 0.45f, 0.6f, 0.8f, 1.0f};
+static const float kValLevels[] = {0.0f, 0.3f, 0.6f, 1.0f};
+
+void thermal_palette(uint8_t *rgba, size_t count) {
+    for (size_t i = 0; i < count; ++i, rgba += 4) {
+        float lum = (float) i / (float) (count - 1);
+        int idx = lum < 0.5f ? 0 : 1;
+        float t = (lum - (float) idx * 0.5f) / 0.5f;
+
+        for (int c = 0; c < 3; ++c) {
+            float value = kThermalColors[idx][c] + (kThermalColors[idx + 1][c] - kThermalColors[idx][c]) * t;
+            rgba[c] = (uint8_t) (value * 255.0f + 0.5f);
+        }
+        rgba[3] = 255;
+    }
+}
+
+// Upper bound of the level bracket containing value.
+template<size_t N>
+static float nearest_level(float value, const float (&levels)[N]) {
+    for (size_t i = 0; i < N - 1; ++i) {
+        if (value >= levels[i] && value <= levels[i + 1]) {
+            return levels[i + 1];
+        }
+    }
+    return value;
+}
+
+static void rgb_to_hsv(const float rgb[3], float hsv[3]) {
+    float r = rgb[0], g = rgb[1], b = rgb[2];
+    float minv = std::min(std::min(r, g), b);
+    float maxv = std::max(std::max(r, g), b);
+    float delta = maxv - minv;
+
+    hsv[2] = maxv;
+    if (maxv == 0.0f || delta == 0.0f) {
+        hsv[1] = 0.0f;
+        hsv[0] = -1.0f;
+        return;
+    }
+
+    hsv[1] = delta / maxv;
+    if (r == maxv) {
+        hsv[0] = (g - b) / delta;
+    } else if (g == maxv) {
+        hsv[0] = 2.0f + (b - r) / delta;
+    } else {
+        hsv[0] = 4.0f + (r - g) / delta;
+    }
+
+    hsv[0] *= 60.0f;
+    if (hsv[0] < 0.0f) hsv[0] += 360.0f;
+}
+
+static void hsv_to_rgb(const float hsv[3], float rgb[3]) {
+    float h = hsv[0], s = hsv[1], v = hsv[2];
+
+    if (s == 0.0f) {
+        rgb[0] = rgb[1] = rgb[2] = v;
+        return;
+    }
+
+    h /= 60.0f;
+    auto i = (int) floorf(h);
+    float f = h - (float) i;
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - s * f);
+    float t = v * (1.0f - s * (1.0f - f));
+
+    switch (i % 6) {
+        case 0:
+            rgb[0] = v, rgb[1] = t, rgb[2] = p;
+            break;
+        case 1:
+            rgb[0] = q, rgb[1] = v, rgb[2] = p;
+            break;
+        case 2:
+            rgb[0] = p, rgb[1] = v, rgb[2] = t;
+            break;
+        case 3:
+            rgb[0] = p, rgb[1] = q, rgb[2] = v;
+            break;
+        case 4:
+            rgb[0] = t, rgb[1] = p, rgb[2] = v;
+            break;
+        default:
+            rgb[0] = v, rgb[1] = p, rgb[2] = q;
+            break;
+    }
+}
+
+void toon_quantize(const float in[3], float out[3]) {
+    float hsv[3];
+    rgb_to_hsv(in, hsv);
+
+    hsv[0] = nearest_level(hsv[0], kHueLevels);
+    hsv[1] = nearest_level(hsv[1], kSatLevels);
+    hsv[2] = nearest_level(hsv[2], kValLevels);
+
+    hsv_to_rgb(hsv, out);
+}
+
+void toon_quantization_lut(CubeLut &lut, size_t size) {
+    lut.generate(size, toon_quantize);
+}
@@ -0,0 +1,20 @@
+#ifndef _FILTER_TABLES_H_
+#define _FILTER_TABLES_H_
+
+#include "CubeLut.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Lookup tables for the filters whose color math is a pure function of the input color,
+// generated once on the CPU so the shaders reduce to texture fetches.
+
+// Predator Thermal palette indexed by luminance, count RGBA texels.
+void thermal_palette(uint8_t *rgba, size_t count);
+
+// Toonify HSV quantization, RGB to quantized RGB.
+void toon_quantize(const float in[3], float out[3]);
+
+void toon_quantization_lut(CubeLut &lut, size_t size);
+
+#endif //_FILTER_TABLES_H_
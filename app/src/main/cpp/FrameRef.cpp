@@ -0,0 +1,176 @@
+#include "FrameRef.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Frames kept for reuse, enough for the render queue and one frame on each side of it.
+static const size_t kMaxFreeFrames = 6;
+
+struct FrameRef::shared_frame {
+    std::atomic<int> refs;
+    video_frame planes;
+    FrameFormat format;
+    ColorSpace colorSpace;
+    int64_t timestamp;
+    release_callback release;
+
+    // Pooled frames only, the planes point into storage.
+    std::vector<uint8_t> storage;
+    std::shared_ptr<FramePool::free_list> pool;
+};
+
+struct FramePool::free_list {
+    ~free_list() {
+        for (auto *frame: frames) delete frame;
+    }
+
+    void recycle(FrameRef::shared_frame *frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frames.size() < kMaxFreeFrames) {
+                frames.push_back(frame);
+                return;
+            }
+        }
+
+        delete frame;
+    }
+
+    std::mutex mutex;
+    std::vector<FrameRef::shared_frame *> frames;
+};
+
+FrameRef::FrameRef() : m_frame(nullptr) {
+
+}
+
+FrameRef::~FrameRef() {
+    reset();
+}
+
+FrameRef::FrameRef(FrameRef &&other) noexcept: m_frame(other.m_frame) {
+    other.m_frame = nullptr;
+}
+
+FrameRef &FrameRef::operator=(FrameRef &&other) noexcept {
+    if (this != &other) {
+        reset();
+        m_frame = other.m_frame;
+        other.m_frame = nullptr;
+    }
+
+    return *this;
+}
+
+FrameRef FrameRef::wrap(const video_frame &planes, int64_t timestamp, const release_callback &release,
+                        ColorSpace colorSpace) {
+    FrameFormat format = fI420;
+    if (planes.pixel_stride_uv == 2) format = planes.v < planes.u ? fNV21 : fNV12;
+
+    return wrap(planes, format, colorSpace, timestamp, release);
+}
+
+FrameRef FrameRef::wrap(const video_frame &planes, FrameFormat format, ColorSpace colorSpace, int64_t timestamp,
+                        const release_callback &release) {
+    auto *frame = new shared_frame();
+    frame->refs.store(1, std::memory_order_relaxed);
+    frame->planes = planes;
+    frame->format = format;
+    frame->colorSpace = colorSpace;
+    frame->timestamp = timestamp;
+    frame->release = release;
+
+    return FrameRef(frame);
+}
+
+FrameRef FrameRef::share() const {
+    if (m_frame) m_frame->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return FrameRef(m_frame);
+}
+
+void FrameRef::reset() {
+    if (!m_frame) return;
+
+    shared_frame *frame = m_frame;
+    m_frame = nullptr;
+
+    // Whoever drops the last reference sees every write made through the others.
+    if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    if (frame->release) {
+        frame->release();
+        frame->release = nullptr;
+    }
+
+    std::shared_ptr<FramePool::free_list> pool = std::move(frame->pool);
+    if (pool) {
+        pool->recycle(frame);
+    } else {
+        delete frame;
+    }
+}
+
+const video_frame &FrameRef::planes() const {
+    return m_frame->planes;
+}
+
+FrameFormat FrameRef::format() const {
+    return m_frame->format;
+}
+
+ColorSpace FrameRef::colorSpace() const {
+    return m_frame->colorSpace;
+}
+
+int64_t FrameRef::timestamp() const {
+    return m_frame->timestamp;
+}
+
+bool FrameRef::isPacked() const {
+    const video_frame &planes = m_frame->planes;
+
+    return m_frame->format == fI420 && planes.stride_y == planes.width && planes.stride_uv == planes.width / 2;
+}
+
+FramePool::FramePool() : m_freeList(std::make_shared<free_list>()) {
+
+}
+
+FramePool::~FramePool() = default;
+
+FrameRef FramePool::acquire(size_t width, size_t height, int64_t timestamp, ColorSpace colorSpace) {
+    FrameRef::shared_frame *frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_freeList->mutex);
+        if (!m_freeList->frames.empty()) {
+            frame = m_freeList->frames.back();
+            m_freeList->frames.pop_back();
+        }
+    }
+
+    if (!frame) frame = new FrameRef::shared_frame();
+
+    size_t sizeY = width * height;
+    size_t sizeUV = width / 2 * (height / 2);
+    frame->storage.resize(sizeY + 2 * sizeUV);
+
+    video_frame &planes = frame->planes;
+    planes.width = width;
+    planes.height = height;
+    planes.stride_y = width;
+    planes.stride_uv = width / 2;
+    planes.pixel_stride_uv = 1;
+    planes.y = frame->storage.data();
+    planes.u = planes.y + sizeY;
+    planes.v = planes.u + sizeUV;
+
+    frame->refs.store(1, std::memory_order_relaxed);
+    frame->format = fI420;
+    frame->colorSpace = colorSpace;
+    frame->timestamp = timestamp;
+    frame->pool = m_freeList;
+
+    return FrameRef(frame);
+}
@@ -0,0 +1,114 @@
+#ifndef _FRAME_REF_H_
+#define _FRAME_REF_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Views of the planes of a 4:2:0 frame. Chroma samples are pixel_stride_uv bytes apart in their
+// rows: 1 for planar (I420), 2 for semi-planar (NV12 with v = u + 1, NV21 with u = v + 1).
+struct video_frame {
+    size_t width;
+    size_t height;
+    size_t stride_y;
+    size_t stride_uv;
+    size_t pixel_stride_uv;
+    uint8_t *y;
+    uint8_t *u;
+    uint8_t *v;
+};
+
+enum FrameFormat {
+    fI420, fNV12, fNV21
+};
+
+// Matrix and range the samples were encoded with. Camera YUV_420_888 output is full range BT.601.
+enum ColorSpace {
+    csBT601Full, csBT601Limited, csBT709Limited
+};
+
+class FramePool;
+
+// Shared, immutable 4:2:0 frame. Move-only, share() hands out another reference to the same planes,
+// and the release callback or the owning pool gets them back when the last reference goes, on
+// whichever thread drops it.
+class FrameRef {
+public:
+    typedef std::function<void()> release_callback;
+
+    FrameRef();
+
+    ~FrameRef();
+
+    FrameRef(FrameRef &&other) noexcept;
+
+    FrameRef &operator=(FrameRef &&other) noexcept;
+
+    FrameRef(const FrameRef &) = delete;
+
+    FrameRef &operator=(const FrameRef &) = delete;
+
+    // Planes owned elsewhere, valid until release is called. Unless it is given, the format is I420
+    // for a pixel stride of 1, and NV21 when interleaved chroma starts from v, NV12 otherwise.
+    static FrameRef wrap(const video_frame &planes, int64_t timestamp, const release_callback &release,
+                         ColorSpace colorSpace = csBT601Full);
+
+    static FrameRef wrap(const video_frame &planes, FrameFormat format, ColorSpace colorSpace, int64_t timestamp,
+                         const release_callback &release);
+
+    FrameRef share() const;
+
+    void reset();
+
+    explicit operator bool() const { return m_frame != nullptr; }
+
+    const video_frame &planes() const;
+
+    size_t width() const { return planes().width; }
+
+    size_t height() const { return planes().height; }
+
+    FrameFormat format() const;
+
+    ColorSpace colorSpace() const;
+
+    // Capture time in nanoseconds, the sensor timestamp for camera frames.
+    int64_t timestamp() const;
+
+    // True when the planes are I420 without row padding, as a single glTexImage2D() per plane needs.
+    bool isPacked() const;
+
+private:
+    friend class FramePool;
+
+    struct shared_frame;
+
+    explicit FrameRef(shared_frame *frame) : m_frame(frame) {
+
+    }
+
+    shared_frame *m_frame;
+};
+
+// Packed I420 frames to fill in, recycled once every reference is gone. Frames keep the pool's free
+// list alive, so they may outlive the pool.
+class FramePool {
+public:
+    FramePool();
+
+    ~FramePool();
+
+    // Planes of the returned frame are written before it is shared, a recycled frame is reused
+    // when there is one.
+    FrameRef acquire(size_t width, size_t height, int64_t timestamp, ColorSpace colorSpace = csBT601Full);
+
+private:
+    friend class FrameRef;
+
+    struct free_list;
+
+    std::shared_ptr<free_list> m_freeList;
+};
+
+#endif //_FRAME_REF_H_
@@ -0,0 +1,308 @@
+#include "GLFrameStats.h"
+#include "GLShaders.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+// Every reduction pass averages 8x8 texels, the atlas takes two of them to reach one texel per zone.
+static const GLsizei kAtlasSize = 256;
+static const GLsizei kMiddleSize = 32;
+static const GLsizei kZoneGrid = 4;
+
+// Units 0-6 belong to the renderers, the reduction passes sample from the next one.
+static const GLenum kAtlasUnit = GL_TEXTURE7;
+
+static const float kVertices[8] = {
+        -1.0f, -1.0f,
+        1.0f, -1.0f,
+        -1.0f, 1.0f,
+        1.0f, 1.0f,
+};
+
+static const float kTextureCoords[8] = {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+};
+
+struct vertex_attrib {
+    GLint enabled;
+    GLint size;
+    GLint type;
+    GLint normalized;
+    GLint stride;
+    GLint buffer;
+    void *pointer;
+};
+
+// What update() changes of the renderer's state: program, target, texture bindings and the
+// vertex attributes of the stats programs.
+struct gl_state {
+    GLint program;
+    GLint framebuffer;
+    GLint viewport[4];
+    GLint activeTexture;
+    GLint texture0;
+    GLint textureAtlas;
+    GLint arrayBuffer;
+    vertex_attrib attribs[GLFrameStats::kMaxAttribs];
+};
+
+static void save_state(gl_state &state) {
+    glGetIntegerv(GL_CURRENT_PROGRAM, &state.program);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &state.framebuffer);
+    glGetIntegerv(GL_VIEWPORT, state.viewport);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &state.activeTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &state.texture0);
+    glActiveTexture(kAtlasUnit);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &state.textureAtlas);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &state.arrayBuffer);
+}
+
+static void save_attribs(gl_state &state, const GLuint *attribs, size_t attribCount) {
+    for (size_t i = 0; i < attribCount; i++) {
+        vertex_attrib &attrib = state.attribs[i];
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attrib.enabled);
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_SIZE, &attrib.size);
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_TYPE, &attrib.type);
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &attrib.normalized);
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attrib.stride);
+        glGetVertexAttribiv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &attrib.buffer);
+        glGetVertexAttribPointerv(attribs[i], GL_VERTEX_ATTRIB_ARRAY_POINTER, &attrib.pointer);
+    }
+}
+
+static void restore_state(const gl_state &state, const GLuint *attribs, size_t attribCount) {
+    for (size_t i = 0; i < attribCount; i++) {
+        const vertex_attrib &attrib = state.attribs[i];
+        glBindBuffer(GL_ARRAY_BUFFER, (GLuint) attrib.buffer);
+        glVertexAttribPointer(attribs[i], attrib.size, (GLenum) attrib.type, (GLboolean) attrib.normalized,
+                              attrib.stride, attrib.pointer);
+        if (attrib.enabled) {
+            glEnableVertexAttribArray(attribs[i]);
+        } else {
+            glDisableVertexAttribArray(attribs[i]);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint) state.arrayBuffer);
+
+    glActiveTexture(kAtlasUnit);
+    glBindTexture(GL_TEXTURE_2D, (GLuint) state.textureAtlas);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, (GLuint) state.texture0);
+    glActiveTexture((GLenum) state.activeTexture);
+    glViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint) state.framebuffer);
+    glUseProgram((GLuint) state.program);
+}
+
+static void draw_quad(GLuint program) {
+    auto position = (GLuint) glGetAttribLocation(program, "position");
+    auto texcoord = (GLuint) glGetAttribLocation(program, "texcoord");
+
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
+    glEnableVertexAttribArray(position);
+    glVertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, 0, kTextureCoords);
+    glEnableVertexAttribArray(texcoord);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+GLFrameStats::GLFrameStats()
+        : m_atlasProgram(0), m_reduceProgram(0), m_texelStepLocation(-1), m_attribs(), m_attribCount(0),
+          m_atlasFramebuffer(0), m_atlasTexture(0), m_middleFramebuffer(0), m_middleTexture(0), m_framebuffers(),
+          m_textures(), m_fences(), m_first(0), m_pending(0), m_initialized(false), m_supported(false),
+          m_display(EGL_NO_DISPLAY), m_createSync(nullptr), m_destroySync(nullptr), m_clientWaitSync(nullptr) {
+
+}
+
+GLFrameStats::~GLFrameStats() {
+    reset();
+}
+
+void GLFrameStats::reset() {
+    if (!m_initialized) return;
+
+    for (size_t i = 0; i < kSlotCount; i++) {
+        if (m_fences[i] != EGL_NO_SYNC_KHR) {
+            m_destroySync(m_display, m_fences[i]);
+            m_fences[i] = EGL_NO_SYNC_KHR;
+        }
+
+        delete_framebuffer(m_framebuffers[i], m_textures[i]);
+    }
+
+    delete_framebuffer(m_atlasFramebuffer, m_atlasTexture);
+    delete_framebuffer(m_middleFramebuffer, m_middleTexture);
+    // Not in use outside update(), deleted without touching the renderer's program.
+    glDeleteProgram(m_atlasProgram);
+    glDeleteProgram(m_reduceProgram);
+    m_atlasProgram = 0;
+    m_reduceProgram = 0;
+
+    m_first = 0;
+    m_pending = 0;
+    m_initialized = false;
+    m_supported = false;
+}
+
+bool GLFrameStats::init() {
+    m_atlasProgram = start_program(kVertexShaderStats, kFragmentShaderStatsAtlas);
+    m_reduceProgram = start_program(kVertexShaderStats, kFragmentShaderStatsReduce);
+    if (!finish_program(m_atlasProgram) || !finish_program(m_reduceProgram)) {
+        LOGE("Could not build GPU stats programs.");
+        return false;
+    }
+
+    glActiveTexture(kAtlasUnit);
+    bool created = create_framebuffer(kAtlasSize, kAtlasSize, m_atlasFramebuffer, m_atlasTexture) &&
+                   create_framebuffer(kMiddleSize, kMiddleSize, m_middleFramebuffer, m_middleTexture);
+
+    for (size_t i = 0; created && i < kSlotCount; i++) {
+        created = create_framebuffer(kZoneGrid, kZoneGrid, m_framebuffers[i], m_textures[i]);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    if (!created) {
+        LOGE("Could not create GPU stats targets.");
+        return false;
+    }
+
+    m_attribCount = 0;
+    for (GLuint program: {m_atlasProgram, m_reduceProgram}) {
+        for (const char *name: {"position", "texcoord"}) {
+            auto location = (GLuint) glGetAttribLocation(program, name);
+            if (std::find(m_attribs, m_attribs + m_attribCount, location) == m_attribs + m_attribCount) {
+                m_attribs[m_attribCount++] = location;
+            }
+        }
+    }
+
+    glUseProgram(m_atlasProgram);
+    glUniform1i(glGetUniformLocation(m_atlasProgram, "s_textureY"), 0);
+    glUseProgram(m_reduceProgram);
+    glUniform1i(glGetUniformLocation(m_reduceProgram, "s_texture"), (GLint) (kAtlasUnit - GL_TEXTURE0));
+    m_texelStepLocation = glGetUniformLocation(m_reduceProgram, "texelStep");
+
+    // Without fences slots are read once every one is in flight, which may wait on the GPU.
+    m_display = eglGetCurrentDisplay();
+    if (has_extension(eglQueryString(m_display, EGL_EXTENSIONS), "EGL_KHR_fence_sync")) {
+        m_createSync = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+        m_destroySync = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+        m_clientWaitSync = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+    }
+
+    if (!m_createSync || !m_destroySync || !m_clientWaitSync) {
+        m_createSync = nullptr;
+        m_destroySync = nullptr;
+        m_clientWaitSync = nullptr;
+    }
+
+    check_gl_error("Create GPU stats");
+
+    return true;
+}
+
+bool GLFrameStats::update(GLuint textureY, gpu_luma_stats &stats) {
+    TRACE_SCOPE("gpu stats");
+
+    if (m_initialized && !m_supported) return false;
+
+    // Set back at the end, so that the renderer carries on with its program and attributes.
+    gl_state state{};
+    save_state(state);
+
+    if (!m_initialized) {
+        m_supported = init();
+        m_initialized = true;
+    }
+
+    if (!m_supported) {
+        restore_state(state, m_attribs, 0);
+        return false;
+    }
+
+    save_attribs(state, m_attribs, m_attribCount);
+
+    bool read = false;
+    if (m_pending && isReady()) {
+        readSlot(m_first, stats);
+        m_first = (m_first + 1) % kSlotCount;
+        m_pending--;
+        read = true;
+    }
+
+    size_t slot = (m_first + m_pending) % kSlotCount;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_atlasFramebuffer);
+    glViewport(0, 0, kAtlasSize, kAtlasSize);
+    glUseProgram(m_atlasProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureY);
+    draw_quad(m_atlasProgram);
+
+    // Each pixel of the 4x4 target ends up with the mean of its zone.
+    glActiveTexture(kAtlasUnit);
+    glUseProgram(m_reduceProgram);
+    reduce(m_atlasTexture, kAtlasSize, m_middleFramebuffer, kMiddleSize);
+    reduce(m_middleTexture, kMiddleSize, m_framebuffers[slot], kZoneGrid);
+
+    restore_state(state, m_attribs, m_attribCount);
+
+    if (m_createSync) {
+        m_fences[slot] = m_createSync(m_display, EGL_SYNC_FENCE_KHR, nullptr);
+    }
+    m_pending++;
+
+    check_gl_error("GPU stats");
+
+    return read;
+}
+
+void GLFrameStats::reduce(GLuint texture, GLsizei size, GLuint framebuffer, GLsizei targetSize) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, targetSize, targetSize);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform2f(m_texelStepLocation, 1.0f / (float) size, 1.0f / (float) size);
+    draw_quad(m_reduceProgram);
+}
+
+bool GLFrameStats::isReady() const {
+    if (m_pending == kSlotCount) return true;
+
+    EGLSyncKHR fence = m_fences[m_first];
+    return fence != EGL_NO_SYNC_KHR && m_clientWaitSync(m_display, fence, 0, 0) == EGL_CONDITION_SATISFIED_KHR;
+}
+
+void GLFrameStats::readSlot(size_t slot, gpu_luma_stats &stats) {
+    if (m_fences[slot] != EGL_NO_SYNC_KHR) {
+        m_destroySync(m_display, m_fences[slot]);
+        m_fences[slot] = EGL_NO_SYNC_KHR;
+    }
+
+    // Target rows start with the top of the frame, which the textures hold in their first row.
+    uint8_t pixels[kZoneGrid * kZoneGrid * 4];
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffers[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, kZoneGrid, kZoneGrid, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    // The averages went through 8-bit targets, so the bins are renormalized.
+    float sum = 0.0f;
+    float marked = 0.0f;
+    for (size_t i = 0; i < gpu_luma_stats::kZoneCount; i++) {
+        stats.zoneMeans[i] = pixels[i * 4];
+        stats.histogram[i] = pixels[i * 4 + 1];
+        sum += stats.zoneMeans[i];
+        marked += stats.histogram[i];
+    }
+
+    stats.mean = sum / (float) gpu_luma_stats::kZoneCount;
+    for (float &bin: stats.histogram) {
+        bin = marked > 0.0f ? bin / marked : 0.0f;
+    }
+}
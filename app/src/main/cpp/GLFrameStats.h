@@ -0,0 +1,74 @@
+#ifndef _GL_FRAME_STATS_H_
+#define _GL_FRAME_STATS_H_
+
+#include "GLUtils.h"
+#include "VideoRenderer.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstddef>
+
+// gpu_luma_stats of the Y texture through reduction passes: one pass draws a 256x256 atlas of luma
+// and histogram bin marks, two more average it 8x8 at a time down to 32x32 and then to 4x4. ES leaves
+// the glGenerateMipmap() filter to the driver and it rounds at every level, so it isn't used.
+// Targets are read kSlotCount - 1 frames later, or as soon as an EGL fence says the GPU is done with
+// them, so the render thread never waits on glReadPixels().
+class GLFrameStats {
+public:
+    // Vertex attributes of the two stats programs, whose state update() keeps.
+    static const size_t kMaxAttribs = 4;
+
+    GLFrameStats();
+
+    // Deletes the GL objects, with the context that created them current.
+    ~GLFrameStats();
+
+    // Queues the reduction of textureY. The program, framebuffer, viewport, texture bindings and vertex
+    // attributes it changes are set back. Returns true with the
+    // results of an earlier frame once they are in.
+    bool update(GLuint textureY, gpu_luma_stats &stats);
+
+    // Deletes the GL objects and drops the results in flight, update() creates them again. The
+    // program in use stays.
+    void reset();
+
+private:
+    static const size_t kSlotCount = 3;
+
+    bool init();
+
+    // Draws the 8x8 means of a size x size texture into a targetSize x targetSize framebuffer, with the
+    // reduce program in use.
+    void reduce(GLuint texture, GLsizei size, GLuint framebuffer, GLsizei targetSize);
+
+    // True when the GPU finished the oldest slot, or when every slot is in flight.
+    bool isReady() const;
+
+    void readSlot(size_t slot, gpu_luma_stats &stats);
+
+    GLuint m_atlasProgram;
+    GLuint m_reduceProgram;
+    GLint m_texelStepLocation;
+    GLuint m_attribs[kMaxAttribs];
+    size_t m_attribCount;
+    GLuint m_atlasFramebuffer;
+    GLuint m_atlasTexture;
+    GLuint m_middleFramebuffer;
+    GLuint m_middleTexture;
+    GLuint m_framebuffers[kSlotCount];
+    GLuint m_textures[kSlotCount];
+    EGLSyncKHR m_fences[kSlotCount];
+    // Slots in flight start at m_first.
+    size_t m_first;
+    size_t m_pending;
+    bool m_initialized;
+    bool m_supported;
+
+    EGLDisplay m_display;
+    PFNEGLCREATESYNCKHRPROC m_createSync;
+    PFNEGLDESTROYSYNCKHRPROC m_destroySync;
+    PFNEGLCLIENTWAITSYNCKHRPROC m_clientWaitSync;
+};
+
+#endif //_GL_FRAME_STATS_H_
@@ -0,0 +1,108 @@
+#include "GLGpuTimer.h"
+#include "Log.h"
+
+#include <EGL/egl.h>
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+#ifndef GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_EXT 0x8866
+#endif
+
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+#define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+
+GLGpuTimer::GLGpuTimer()
+        : m_queries(), m_first(0), m_pending(0), m_discard(0), m_active(false), m_initialized(false),
+          m_supported(false), m_genQueries(nullptr), m_deleteQueries(nullptr), m_beginQuery(nullptr),
+          m_endQuery(nullptr), m_getQueryObjectuiv(nullptr), m_getQueryObjectui64v(nullptr) {
+
+}
+
+GLGpuTimer::~GLGpuTimer() {
+    if (m_supported) {
+        m_deleteQueries(kQueryCount, m_queries);
+    }
+}
+
+void GLGpuTimer::begin() {
+    if (!m_initialized) {
+        m_supported = init();
+        m_initialized = true;
+    }
+
+    // Every query still in flight, this frame goes untimed.
+    if (!m_supported || m_active || m_pending == kQueryCount) return;
+
+    m_beginQuery(GL_TIME_ELAPSED_EXT, m_queries[(m_first + m_pending) % kQueryCount]);
+    m_active = true;
+}
+
+bool GLGpuTimer::end(int64_t &nanoseconds) {
+    if (!m_active) return false;
+
+    m_endQuery(GL_TIME_ELAPSED_EXT);
+    m_active = false;
+    m_pending++;
+
+    // A frequency change or similar happened, nothing in flight can be trusted.
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        m_discard = m_pending;
+    }
+
+    GLuint available = GL_FALSE;
+    m_getQueryObjectuiv(m_queries[m_first], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available) return false;
+
+    GLuint64 elapsed = 0;
+    m_getQueryObjectui64v(m_queries[m_first], GL_QUERY_RESULT_EXT, &elapsed);
+    m_first = (m_first + 1) % kQueryCount;
+    m_pending--;
+
+    if (m_discard) {
+        m_discard--;
+        return false;
+    }
+
+    nanoseconds = (int64_t) elapsed;
+
+    return true;
+}
+
+bool GLGpuTimer::init() {
+    auto extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (!has_extension(extensions, "GL_EXT_disjoint_timer_query")) {
+        LOGI("GPU timing unavailable, GL_EXT_disjoint_timer_query is not supported.");
+        return false;
+    }
+
+    m_genQueries = (GenQueriesProc) eglGetProcAddress("glGenQueriesEXT");
+    m_deleteQueries = (DeleteQueriesProc) eglGetProcAddress("glDeleteQueriesEXT");
+    m_beginQuery = (BeginQueryProc) eglGetProcAddress("glBeginQueryEXT");
+    m_endQuery = (EndQueryProc) eglGetProcAddress("glEndQueryEXT");
+    m_getQueryObjectuiv = (GetQueryObjectuivProc) eglGetProcAddress("glGetQueryObjectuivEXT");
+    m_getQueryObjectui64v = (GetQueryObjectui64vProc) eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+    if (!m_genQueries || !m_deleteQueries || !m_beginQuery || !m_endQuery || !m_getQueryObjectuiv ||
+        !m_getQueryObjectui64v) {
+        LOGE("Could not load GL_EXT_disjoint_timer_query functions.");
+        return false;
+    }
+
+    m_genQueries(kQueryCount, m_queries);
+
+    // Clears a disjoint flag left from before the first query.
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    return true;
+}
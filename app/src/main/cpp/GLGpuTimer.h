@@ -0,0 +1,53 @@
+#ifndef _GL_GPU_TIMER_H_
+#define _GL_GPU_TIMER_H_
+
+#include "GLUtils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// GPU time of the commands between begin() and end(), through GL_EXT_disjoint_timer_query.
+// Results are read a few frames later so that the render thread never waits for them. Does
+// nothing where the extension is missing.
+class GLGpuTimer {
+public:
+    GLGpuTimer();
+
+    // Deletes the queries, with the context that created them current.
+    ~GLGpuTimer();
+
+    void begin();
+
+    // Ends the query begun last and returns true with the time of an earlier one once it is in.
+    bool end(int64_t &nanoseconds);
+
+private:
+    typedef void (GL_APIENTRYP GenQueriesProc)(GLsizei n, GLuint *ids);
+    typedef void (GL_APIENTRYP DeleteQueriesProc)(GLsizei n, const GLuint *ids);
+    typedef void (GL_APIENTRYP BeginQueryProc)(GLenum target, GLuint id);
+    typedef void (GL_APIENTRYP EndQueryProc)(GLenum target);
+    typedef void (GL_APIENTRYP GetQueryObjectuivProc)(GLuint id, GLenum pname, GLuint *params);
+    typedef void (GL_APIENTRYP GetQueryObjectui64vProc)(GLuint id, GLenum pname, GLuint64 *params);
+
+    static const size_t kQueryCount = 4;
+
+    bool init();
+
+    GLuint m_queries[kQueryCount];
+    // Queries in flight start at m_first, results of the first m_discard of them are undefined.
+    size_t m_first;
+    size_t m_pending;
+    size_t m_discard;
+    bool m_active;
+    bool m_initialized;
+    bool m_supported;
+
+    GenQueriesProc m_genQueries;
+    DeleteQueriesProc m_deleteQueries;
+    BeginQueryProc m_beginQuery;
+    EndQueryProc m_endQuery;
+    GetQueryObjectuivProc m_getQueryObjectuiv;
+    GetQueryObjectui64vProc m_getQueryObjectui64v;
+};
+
+#endif //_GL_GPU_TIMER_H_
@@ -0,0 +1,393 @@
+#include "GLShaderCompiler.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <chrono>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (GL_APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+// How long the worker waits for more work before checking again on the programs the driver is
+// still compiling on its own threads.
+static const std::chrono::milliseconds kCompletionPollInterval(2);
+
+GLShaderCompiler::GLShaderCompiler()
+        : m_display(EGL_NO_DISPLAY), m_sharedContext(EGL_NO_CONTEXT), m_context(EGL_NO_CONTEXT),
+          m_surface(EGL_NO_SURFACE), m_createSync(nullptr), m_destroySync(nullptr),
+          m_clientWaitSync(nullptr), m_parallelCompile(false), m_stop(false), m_started(false),
+          m_running(false) {
+
+}
+
+GLShaderCompiler::~GLShaderCompiler() {
+    stop();
+}
+
+bool GLShaderCompiler::start() {
+    EGLContext current = eglGetCurrentContext();
+    if (current == EGL_NO_CONTEXT) return false;
+
+    if (m_worker.joinable()) {
+        if (current == m_sharedContext) return m_running;
+
+        // The render thread got a new context, programs of the old share group are gone with it.
+        stop();
+    }
+
+    m_display = eglGetCurrentDisplay();
+
+    EGLint configId = 0;
+    EGLint version = 2;
+    eglQueryContext(m_display, current, EGL_CONFIG_ID, &configId);
+    eglQueryContext(m_display, current, EGL_CONTEXT_CLIENT_VERSION, &version);
+
+    const EGLint configAttribs[] = {EGL_CONFIG_ID, configId, EGL_NONE};
+    EGLConfig config;
+    EGLint count = 0;
+    if (!eglChooseConfig(m_display, configAttribs, &config, 1, &count) || !count) {
+        LOGE("Could not find the render context config (0x%x).", eglGetError());
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE};
+    m_context = eglCreateContext(m_display, config, current, contextAttribs);
+    if (m_context == EGL_NO_CONTEXT) {
+        LOGE("Could not create shared context (0x%x).", eglGetError());
+        return false;
+    }
+
+    const char *extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+
+    // The worker never draws to a surface, a pbuffer is only needed to make the context current.
+    if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        m_surface = eglCreatePbufferSurface(m_display, config, pbufferAttribs);
+
+        if (m_surface == EGL_NO_SURFACE) {
+            LOGE("Could not create pbuffer for shared context (0x%x).", eglGetError());
+            stop();
+            return false;
+        }
+    }
+
+    if (has_extension(extensions, "EGL_KHR_fence_sync")) {
+        m_createSync = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+        m_destroySync = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+        m_clientWaitSync = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+    }
+
+    if (!m_createSync || !m_destroySync || !m_clientWaitSync) {
+        m_createSync = nullptr;
+        m_destroySync = nullptr;
+        m_clientWaitSync = nullptr;
+    }
+
+    m_sharedContext = current;
+    m_stop = false;
+    m_started = false;
+    m_worker = std::thread(&GLShaderCompiler::workerLoop, this);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return m_started; });
+    }
+
+    if (!m_running) {
+        stop();
+        return false;
+    }
+
+    LOGI("Shader compile worker started%s.", m_parallelCompile ? ", driver compiles in parallel" : "");
+
+    return true;
+}
+
+void GLShaderCompiler::stop() {
+    if (m_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+
+        m_worker.join();
+    }
+
+    if (m_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(m_display, m_context);
+        m_context = EGL_NO_CONTEXT;
+    }
+
+    if (m_surface != EGL_NO_SURFACE) {
+        eglDestroySurface(m_display, m_surface);
+        m_surface = EGL_NO_SURFACE;
+    }
+
+    m_jobs.clear();
+    m_building.clear();
+    m_cancelled.clear();
+    m_sharedContext = EGL_NO_CONTEXT;
+    m_running = false;
+}
+
+bool GLShaderCompiler::isRunning() const {
+    return m_running;
+}
+
+void GLShaderCompiler::submit(uint32_t key, Request request) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // A cancelled build of the same program is still good.
+        if (m_cancelled.erase(key) || m_building.count(key) || m_finished.count(key)) return;
+
+        for (auto &job: m_jobs) {
+            if (job.key == key) {
+                job.request = std::move(request);
+                return;
+            }
+        }
+
+        m_jobs.push_back({key, std::move(request)});
+    }
+    m_condition.notify_all();
+}
+
+bool GLShaderCompiler::take(uint32_t key, Result &result) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_finished.find(key);
+    if (it == m_finished.end()) return false;
+
+    if (it->second.sync != EGL_NO_SYNC_KHR) {
+        if (m_clientWaitSync(m_display, it->second.sync, 0, 0) == EGL_TIMEOUT_EXPIRED_KHR) return false;
+
+        m_destroySync(m_display, it->second.sync);
+    }
+
+    result = it->second.result;
+    m_finished.erase(it);
+
+    return true;
+}
+
+void GLShaderCompiler::cancel(uint32_t key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if (it->key == key) {
+            m_jobs.erase(it);
+            break;
+        }
+    }
+
+    if (m_building.count(key)) {
+        m_cancelled.insert(key);
+    }
+
+    // Deleted by the worker, whose context issued the program, without waiting here.
+    auto it = m_finished.find(key);
+    if (it != m_finished.end()) {
+        m_retired.push_back(it->second);
+        m_finished.erase(it);
+        m_condition.notify_all();
+    }
+}
+
+GLShaderCompiler::Result GLShaderCompiler::build(const Request &request) {
+    Build build = startBuild(0, request);
+
+    return finishBuild(build);
+}
+
+GLShaderCompiler::Build GLShaderCompiler::startBuild(uint32_t key, Request request) {
+    TRACE_SCOPE("start build");
+
+    Build build{key, std::move(request), 0, 0};
+
+    build.reference = start_program(build.request.vertex.c_str(), build.request.fragment.c_str());
+    if (!build.request.variant.empty()) {
+        build.variant = start_program(build.request.vertex.c_str(), build.request.variant.c_str());
+    }
+
+    return build;
+}
+
+GLShaderCompiler::Result GLShaderCompiler::finishBuild(Build &build) {
+    TRACE_SCOPE("finish build");
+
+    Result result{0, false, false};
+    bool linked = finish_program(build.reference);
+
+    if (!build.request.variant.empty()) {
+        result.checked = true;
+
+        if (finish_program(build.variant) && linked && build.request.check &&
+            build.request.check(build.reference, build.variant)) {
+            delete_program(build.reference);
+            result.program = build.variant;
+            result.passed = true;
+
+            return result;
+        }
+
+        delete_program(build.variant);
+    }
+
+    result.program = build.reference;
+
+    return result;
+}
+
+bool GLShaderCompiler::isCompleted(const Build &build) const {
+    if (!m_parallelCompile) return true;
+
+    GLint reference = GL_TRUE;
+    GLint variant = GL_TRUE;
+    if (build.reference) glGetProgramiv(build.reference, GL_COMPLETION_STATUS_KHR, &reference);
+    if (build.variant) glGetProgramiv(build.variant, GL_COMPLETION_STATUS_KHR, &variant);
+
+    return reference == GL_TRUE && variant == GL_TRUE;
+}
+
+void GLShaderCompiler::publish(uint32_t key, const Result &result) {
+    Finished finished{result, EGL_NO_SYNC_KHR};
+
+    if (m_createSync) {
+        finished.sync = m_createSync(m_display, EGL_SYNC_FENCE_KHR, nullptr);
+    }
+
+    // The fence only signals once submitted, without one wait for the commands right here.
+    if (finished.sync != EGL_NO_SYNC_KHR) {
+        glFlush();
+    } else {
+        glFinish();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_building.erase(key);
+
+    if (m_cancelled.erase(key)) {
+        deleteFinished(finished);
+        return;
+    }
+
+    auto it = m_finished.find(key);
+    if (it != m_finished.end()) {
+        deleteFinished(it->second);
+    }
+    m_finished[key] = finished;
+}
+
+void GLShaderCompiler::deleteFinished(Finished &finished) {
+    // On the worker the deletion is ordered after the commands that built the program, the fence
+    // is not waited for. No program is in use on this context.
+    if (finished.sync != EGL_NO_SYNC_KHR) {
+        m_destroySync(m_display, finished.sync);
+        finished.sync = EGL_NO_SYNC_KHR;
+    }
+
+    if (finished.result.program) {
+        glDeleteProgram(finished.result.program);
+        finished.result.program = 0;
+    }
+}
+
+void GLShaderCompiler::workerLoop() {
+    bool current = eglMakeCurrent(m_display, m_surface, m_surface, m_context) == EGL_TRUE;
+
+    if (current) {
+        auto extensions = (const char *) glGetString(GL_EXTENSIONS);
+        auto maxCompilerThreads = has_extension(extensions, "GL_KHR_parallel_shader_compile")
+                                  ? (MaxShaderCompilerThreadsProc) eglGetProcAddress("glMaxShaderCompilerThreadsKHR")
+                                  : nullptr;
+
+        if (maxCompilerThreads) {
+            // Let the driver pick how many of its threads to use.
+            maxCompilerThreads(0xFFFFFFFF);
+        }
+        m_parallelCompile = maxCompilerThreads != nullptr;
+    } else {
+        LOGE("Could not make shared context current (0x%x).", eglGetError());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_started = true;
+        m_running = current;
+    }
+    m_condition.notify_all();
+
+    if (!current) return;
+
+    std::deque<Build> building;
+    bool finished = false;
+
+    for (;;) {
+        std::deque<Finished> retired;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto pending = [this]() { return m_stop || !m_jobs.empty() || !m_retired.empty(); };
+
+            if (building.empty()) {
+                m_condition.wait(lock, pending);
+            } else if (!finished) {
+                // Parallel compiles signal nothing when done, they are checked again after a while
+                // unless there is other work first.
+                m_condition.wait_for(lock, kCompletionPollInterval, pending);
+            }
+
+            if (m_stop) break;
+
+            // Everything queued is issued at once, the driver may compile it in parallel.
+            while (!m_jobs.empty()) {
+                m_building.insert(m_jobs.front().key);
+                building.push_back(startBuild(m_jobs.front().key, std::move(m_jobs.front().request)));
+                m_jobs.pop_front();
+            }
+
+            retired.swap(m_retired);
+        }
+
+        for (auto &program: retired) {
+            deleteFinished(program);
+        }
+
+        finished = false;
+
+        for (auto it = building.begin(); it != building.end();) {
+            if (!isCompleted(*it)) {
+                ++it;
+                continue;
+            }
+
+            publish(it->key, finishBuild(*it));
+            it = building.erase(it);
+            finished = true;
+        }
+    }
+
+    for (auto &build: building) {
+        delete_program(build.reference);
+        delete_program(build.variant);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &program: m_finished) {
+            deleteFinished(program.second);
+        }
+        m_finished.clear();
+
+        for (auto &program: m_retired) {
+            deleteFinished(program);
+        }
+        m_retired.clear();
+    }
+
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
@@ -0,0 +1,122 @@
+#ifndef _GL_SHADER_COMPILER_H_
+#define _GL_SHADER_COMPILER_H_
+
+#include "GLUtils.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// Compiles and links programs on a worker thread with its own EGL context in the share group of
+// the render thread's context, so that switching filters never stalls a frame. Programs are handed
+// over behind a fence once the worker's commands for them completed.
+class GLShaderCompiler {
+public:
+    struct Request {
+        std::string vertex;
+        std::string fragment;
+        // Optional lower precision variant of fragment, kept instead of it when check() accepts it.
+        std::string variant;
+        // Runs on the worker with both programs linked.
+        std::function<bool(GLuint reference, GLuint variant)> check;
+    };
+
+    struct Result {
+        GLuint program;
+        // Whether the variant was checked and whether it is the one in program.
+        bool checked;
+        bool passed;
+    };
+
+    GLShaderCompiler();
+
+    ~GLShaderCompiler();
+
+    // Starts the worker sharing the context current on the calling thread, which must be the one
+    // calling take(). Returns false when there is none or no shared context could be made current.
+    bool start();
+
+    void stop();
+
+    bool isRunning() const;
+
+    // Queues a build under key, replacing one with the same key that hasn't started yet.
+    void submit(uint32_t key, Request request);
+
+    // Returns true once the build under key finished and can be used on the calling thread.
+    // result.program is 0 when the build failed.
+    bool take(uint32_t key, Result &result);
+
+    // Drops the build under key. A program already finished is deleted by the worker, so this never
+    // waits for the GPU.
+    void cancel(uint32_t key);
+
+    // Builds on the calling thread, for when the worker isn't running.
+    static Result build(const Request &request);
+
+private:
+    struct Job {
+        uint32_t key;
+        Request request;
+    };
+
+    struct Build {
+        uint32_t key;
+        Request request;
+        GLuint reference;
+        GLuint variant;
+    };
+
+    struct Finished {
+        Result result;
+        EGLSyncKHR sync;
+    };
+
+    static Build startBuild(uint32_t key, Request request);
+
+    static Result finishBuild(Build &build);
+
+    bool isCompleted(const Build &build) const;
+
+    void publish(uint32_t key, const Result &result);
+
+    // Worker only, see cancel().
+    void deleteFinished(Finished &finished);
+
+    void workerLoop();
+
+    EGLDisplay m_display;
+    EGLContext m_sharedContext;
+    EGLContext m_context;
+    EGLSurface m_surface;
+
+    PFNEGLCREATESYNCKHRPROC m_createSync;
+    PFNEGLDESTROYSYNCKHRPROC m_destroySync;
+    PFNEGLCLIENTWAITSYNCKHRPROC m_clientWaitSync;
+    // Set when the driver compiles on its own threads, see KHR_parallel_shader_compile.
+    bool m_parallelCompile;
+
+    std::thread m_worker;
+    std::deque<Job> m_jobs;
+    std::set<uint32_t> m_building;
+    std::set<uint32_t> m_cancelled;
+    std::map<uint32_t, Finished> m_finished;
+    // Finished builds cancelled since, for the worker to delete.
+    std::deque<Finished> m_retired;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop;
+    bool m_started;
+    bool m_running;
+};
+
+#endif //_GL_SHADER_COMPILER_H_
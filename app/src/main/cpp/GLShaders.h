@@ -1,6 +1,11 @@
 #ifndef _GL_SHADER_H_
 #define _GL_SHADER_H_
 
+// YUV to RGB conversion goes through the colorMatrix uniform, see mat4f_load_yuv_to_rgb_mat().
+// Fragment shaders are written against a highp default. Texture coordinates and anything measured
+// in texels are declared highp explicitly, so the mediump variant built by shader_with_precision()
+// only drops the precision of the color math.
+
 // Vertex shader.
 static const char kVertexShader[] =
     "#version 100\n\
@@ -19,179 +24,200 @@ static const char kVertexShader[] =
 static const char kFragmentShader[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
+    uniform mat4 colorMatrix;\
     void main() {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, v_texcoord).r;\
         u = texture2D(s_textureU, v_texcoord).r;\
         v = texture2D(s_textureV, v_texcoord).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         gl_FragColor = vec4(r, g, b, 1.0);\
     }";
 
-// Blur Filter
-static const char kFragmentShader1[] =
+// Pixel shader, YUV420 to RGB conversion graded through a 3D LUT stored as a 2D texture of
+// lutSize blue slices, see CubeLut::toTiledRGBA(). Tetrahedral like CubeLut::apply(): the cell is
+// split along its diagonal, the sorted fractions pick the two corners between c000 and c111 and
+// the four texels are fetched at their centers from a nearest-sampled texture. Ties break x, y, z
+// so that exactly one axis comes first.
+static const char kFragmentShaderLut[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    vec4 YuvToRgb(vec2 uv) {\
-        float y, u, v, r, g, b;\
-        y = texture2D(s_textureY, uv).r;\
-        u = texture2D(s_textureU, uv).r;\
-        v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
-        return vec4(r, g, b, 1.0);\
+    uniform mat4 colorMatrix;\
+    uniform lowp sampler2D s_lut;\
+    uniform highp float lutSize;\
+    vec3 LutTexel(highp vec3 cell) {\
+        highp vec2 uv = vec2((cell.b * lutSize + cell.r + 0.5) / (lutSize * lutSize), (cell.g + 0.5) / lutSize);\
+        return texture2D(s_lut, uv).rgb;\
+    }\
+    vec3 LookupLut(vec3 color) {\
+        highp vec3 scaled = clamp(color, 0.0, 1.0) * (lutSize - 1.0);\
+        highp vec3 base = min(floor(scaled), lutSize - 2.0);\
+        vec3 f = scaled - base;\
+        vec3 g = vec3(step(f.yz, f.xy), 1.0 - step(f.z, f.x));\
+        vec3 l = 1.0 - g;\
+        vec3 i1 = min(g, l.zxy);\
+        vec3 i2 = max(g, l.zxy);\
+        float w1 = dot(f, i1);\
+        float w12 = dot(f, i2);\
+        float w3 = f.x + f.y + f.z - w12;\
+        return (1.0 - w1) * LutTexel(base) + (2.0 * w1 - w12) * LutTexel(base + i1) +\
+               (w12 - w1 - w3) * LutTexel(base + i2) + w3 * LutTexel(base + 1.0);\
     }\
     void main() {\
-        vec4 sample0, sample1, sample2, sample3;\
-        float blurStep = 0.5;\
-        float step = blurStep / 100.0;\
-        sample0 = YuvToRgb(vec2(v_texcoord.x - step, v_texcoord.y - step));\
-        sample1 = YuvToRgb(vec2(v_texcoord.x + step, v_texcoord.y + step));\
-        sample2 = YuvToRgb(vec2(v_texcoord.x + step, v_texcoord.y - step));\
-        sample3 = YuvToRgb(vec2(v_texcoord.x - step, v_texcoord.y + step));\
-        gl_FragColor = (sample0 + sample1 + sample2 + sample3) / 4.0;\
+        float y, u, v, r, g, b;\
+        y = texture2D(s_textureY, v_texcoord).r;\
+        u = texture2D(s_textureU, v_texcoord).r;\
+        v = texture2D(s_textureV, v_texcoord).r;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
+        gl_FragColor = vec4(LookupLut(vec3(r, g, b)), 1.0);\
     }";
 
-// Swirl Filter
-static const char kFragmentShader2[] =
-    "#version 100\n\
+// GLES3 vertex shader, the same transform for the programs that need a 300 es fragment shader.
+static const char kVertexShader3[] =
+    "#version 300 es\n\
+    out vec2 v_texcoord; \
+    in vec4 position; \
+    in vec4 texcoord; \
+    uniform mat4 scale; \
+    uniform mat4 rotation; \
+    void main() { \
+        vec4 transformed = rotation * scale * vec4(texcoord.xy - 0.5, 0.0, 1.0); \
+        v_texcoord = transformed.xy + 0.5; \
+        gl_Position = position; \
+    }";
+
+// kFragmentShaderLut for GLES3, the cube is a 3D texture laid out by CubeLut::toRGBA() and the four
+// corners are texel fetches, no coordinate math per fetch.
+static const char kFragmentShaderLut3D[] =
+    "#version 300 es\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    in highp vec2 v_texcoord;\
+    out vec4 fragColor;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
+    uniform mat4 colorMatrix;\
+    uniform lowp sampler3D s_lut;\
+    uniform highp float lutSize;\
+    vec3 LutTexel(highp vec3 cell) {\
+        return texelFetch(s_lut, ivec3(cell), 0).rgb;\
+    }\
+    vec3 LookupLut(vec3 color) {\
+        highp vec3 scaled = clamp(color, 0.0, 1.0) * (lutSize - 1.0);\
+        highp vec3 base = min(floor(scaled), lutSize - 2.0);\
+        vec3 f = scaled - base;\
+        vec3 g = vec3(step(f.yz, f.xy), 1.0 - step(f.z, f.x));\
+        vec3 l = 1.0 - g;\
+        vec3 i1 = min(g, l.zxy);\
+        vec3 i2 = max(g, l.zxy);\
+        float w1 = dot(f, i1);\
+        float w12 = dot(f, i2);\
+        float w3 = f.x + f.y + f.z - w12;\
+        return (1.0 - w1) * LutTexel(base) + (2.0 * w1 - w12) * LutTexel(base + i1) +\
+               (w12 - w1 - w3) * LutTexel(base + i2) + w3 * LutTexel(base + 1.0);\
+    }\
     void main() {\
-        float radius = 200.0;\
-        float angle = 0.8;\
-        vec2 center = vec2(texSize.x / 2.0, texSize.y / 2.0);\
-        vec2 tc = v_texcoord * texSize;\
-        tc -= center;\
-        float dist = length(tc);\
-        if (dist < radius) {\
-            float percent = (radius - dist) / radius;\
-            float theta = percent * percent * angle * 8.0;\
-            float s = sin(theta);\
-            float c = cos(theta);\
-            tc = vec2(dot(tc, vec2(c, -s)), dot(tc, vec2(s, c)));\
-        }\
-        tc += center;\
         float y, u, v, r, g, b;\
-        y = texture2D(s_textureY, tc / texSize).r;\
-        u = texture2D(s_textureU, tc / texSize).r;\
-        v = texture2D(s_textureV, tc / texSize).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
-        gl_FragColor = vec4(r, g, b, 1.0);\
+        y = texture(s_textureY, v_texcoord).r;\
+        u = texture(s_textureU, v_texcoord).r;\
+        v = texture(s_textureV, v_texcoord).r;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
+        fragColor = vec4(LookupLut(vec3(r, g, b)), 1.0);\
     }";
 
-// Magnifying Glass Filter
-static const char kFragmentShader3[] =
+// Blur Filter, horizontal pass. Separable Gaussian, each tap is a bilinear fetch covering two
+// texels, offsets/weights come from gaussian_linear_kernel(). Array size matches kMaxBlurTaps.
+static const char kFragmentShader1[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    vec4 YuvToRgb(vec2 uv) {\
-        float y, u, v, r, g, b;\
-        y = texture2D(s_textureY, uv).r;\
-        u = texture2D(s_textureU, uv).r;\
-        v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
-        return vec4(r, g, b, 1.0);\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texelStep;\
+    uniform float offsets[16];\
+    uniform float weights[16];\
+    uniform int tapCount;\
+    vec3 SampleYuv(highp vec2 uv) {\
+        return vec3(texture2D(s_textureY, uv).r, texture2D(s_textureU, uv).r, texture2D(s_textureV, uv).r);\
     }\
     void main() {\
-        float circleRadius = float(0.5);\
-        float minZoom = 0.4;\
-        float maxZoom = 0.6;\
-        vec2 center = vec2(texSize.x / 2.0, texSize.y / 2.0);\
-        vec2 uv = v_texcoord;\
-        uv.x *= (texSize.x / texSize.y);\
-        vec2 realCenter = vec2(0.0, 0.0);\
-        realCenter.x = (center.x / texSize.x) * (texSize.x / texSize.y);\
-        realCenter.y = center.y / texSize.y;\
-        float maxX = realCenter.x + circleRadius;\
-        float minX = realCenter.x - circleRadius;\
-        float maxY = realCenter.y + circleRadius;\
-        float minY = realCenter.y - circleRadius;\
-        if (uv.x > minX && uv.x < maxX && uv.y > minY && uv.y < maxY) {\
-            float relX = uv.x - realCenter.x;\
-            float relY = uv.y - realCenter.y;\
-            float ang =  atan(relY, relX);\
-            float dist = sqrt(relX * relX + relY * relY);\
-            if (dist <= circleRadius) {\
-                float newRad = dist * ((maxZoom * dist / circleRadius) + minZoom);\
-                float newX = realCenter.x + cos(ang) * newRad;\
-                newX *= (texSize.y / texSize.x);\
-                float newY = realCenter.y + sin(ang) * newRad;\
-                gl_FragColor = YuvToRgb(vec2(newX, newY));\
-            } else {\
-                gl_FragColor = YuvToRgb(v_texcoord);\
-            }\
-        } else {\
-            gl_FragColor = YuvToRgb(v_texcoord);\
+        vec3 yuv = SampleYuv(v_texcoord) * weights[0];\
+        for (int i = 1; i < 16; i++) {\
+            if (i >= tapCount) break;\
+            highp vec2 offset = texelStep * offsets[i];\
+            yuv += (SampleYuv(v_texcoord + offset) + SampleYuv(v_texcoord - offset)) * weights[i];\
         }\
+        gl_FragColor = vec4((vec4(yuv, 1.0) * colorMatrix).rgb, 1.0);\
     }";
 
-// Fish Eye Filter
-static const char kFragmentShader4[] =
+// Blur Filter, vertical pass over the RGB output of the horizontal pass.
+static const char kFragmentShaderBlurVertical[] =
+    "#version 100\n \
+    precision highp float; \
+    varying highp vec2 v_texcoord;\
+    uniform lowp sampler2D s_texture;\
+    uniform highp vec2 texelStep;\
+    uniform float offsets[16];\
+    uniform float weights[16];\
+    uniform int tapCount;\
+    void main() {\
+        vec3 color = texture2D(s_texture, v_texcoord).rgb * weights[0];\
+        for (int i = 1; i < 16; i++) {\
+            if (i >= tapCount) break;\
+            highp vec2 offset = texelStep * offsets[i];\
+            color += (texture2D(s_texture, v_texcoord + offset).rgb +\
+                      texture2D(s_texture, v_texcoord - offset).rgb) * weights[i];\
+        }\
+        gl_FragColor = vec4(color, 1.0);\
+    }";
+
+// Swirl, Magnifying Glass and Fish Eye Filters. The distortion is precomputed by WarpMap on a
+// lattice of warpSize points spanning the frame, each texel holds the source coordinate as 16-bit
+// fixed point over [-0.5, 1.5], u in RG and v in BA. Packed values can't be filtered by the
+// texture unit, the four lattice points around the pixel are decoded and blended here.
+static const char kFragmentShaderWarp[] =
     "#version 100\n\
-    precision highp float;\
-    const float PI = 3.1415926535;\
-    varying vec2 v_texcoord;\
+    precision highp float; \
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
+    uniform mat4 colorMatrix;\
+    uniform mediump sampler2D s_warp;\
+    uniform highp vec2 warpSize;\
+    highp vec2 WarpCoord(highp vec2 point) {\
+        highp vec4 bytes = floor(texture2D(s_warp, (point + 0.5) / warpSize) * 255.0 + 0.5);\
+        return vec2(bytes.r * 256.0 + bytes.g, bytes.b * 256.0 + bytes.a) / 65535.0 * 2.0 - 0.5;\
+    }\
     void main() {\
-        float aperture = 158.0;\
-        float apertureHalf = 0.5 * aperture * (PI / 180.0);\
-        float maxFactor = sin(apertureHalf);\
-        vec2 uv;\
-        vec2 xy = 2.0 * v_texcoord.xy - 1.0;\
-        float d = length(xy);\
-        if (d < (2.0 - maxFactor)) {\
-            d = length(xy * maxFactor);\
-            float z = sqrt(1.0 - d * d);\
-            float r = atan(d, z) / PI;\
-            float phi = atan(xy.y, xy.x);\
-            uv.x = r * cos(phi) + 0.5;\
-            uv.y = r * sin(phi) + 0.5;\
-        } else {\
-            uv = v_texcoord.xy;\
-        }\
+        highp vec2 point = clamp(v_texcoord, 0.0, 1.0) * (warpSize - 1.0);\
+        highp vec2 base = min(floor(point), warpSize - 2.0);\
+        highp vec2 f = point - base;\
+        highp vec2 uv = mix(mix(WarpCoord(base), WarpCoord(base + vec2(1.0, 0.0)), f.x),\
+                            mix(WarpCoord(base + vec2(0.0, 1.0)), WarpCoord(base + 1.0), f.x), f.y);\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         gl_FragColor = vec4(r, g, b, 1.0);\
     }";
 
@@ -199,28 +225,28 @@ static const char kFragmentShader4[] =
 static const char kFragmentShader5[] =
     "#version 100\n\
     precision highp float;\
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    uniform highp float dotCount;\
     void main() {\
-        float size = texSize.x / 75.0;\
-        float radius = size * 0.5;\
-        vec2 fragCoord = v_texcoord * texSize.xy;\
-        vec2 quadPos = floor(fragCoord.xy / size) * size;\
-        vec2 quad = quadPos/texSize.xy;\
-        vec2 quadCenter = (quadPos + size/2.0);\
-        float dist = length(quadCenter - fragCoord.xy);\
+        highp float size = texSize.x / dotCount;\
+        highp float radius = size * 0.5;\
+        highp vec2 fragCoord = v_texcoord * texSize.xy;\
+        highp vec2 quadPos = floor(fragCoord.xy / size) * size;\
+        highp vec2 quad = quadPos/texSize.xy;\
+        highp vec2 quadCenter = (quadPos + size/2.0);\
+        highp float dist = length(quadCenter - fragCoord.xy);\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, quad).r;\
         u = texture2D(s_textureU, quad).r;\
         v = texture2D(s_textureV, quad).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         if (dist > radius) {\
             gl_FragColor = vec4(0.25);\
         } else {\
@@ -232,27 +258,28 @@ static const char kFragmentShader5[] =
 static const char kFragmentShader6[] =
     "#version 100\n\
     precision highp float;\
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    vec4 YuvToRgb(vec2 uv) {\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    uniform highp float tilesX;\
+    uniform highp float tilesY;\
+    vec4 YuvToRgb(highp vec2 uv) {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         return vec4(r, g, b, 1.0);\
     }\
     void main() {\
-        vec2 tileNum = vec2(40.0, 20.0);\
-        vec2 uv = v_texcoord;\
-        vec2 uv2 = floor(uv * tileNum) / tileNum;\
+        highp vec2 tileNum = vec2(tilesX, tilesY);\
+        highp vec2 uv = v_texcoord;\
+        highp vec2 uv2 = floor(uv * tileNum) / tileNum;\
         uv -= uv2;\
         uv *= tileNum;\
         vec3 color = YuvToRgb(uv2 + vec2(step(1.0 - uv.y, uv.x) / (2.0 * tileNum.x), \
@@ -264,27 +291,27 @@ static const char kFragmentShader6[] =
 static const char kFragmentShader7[] =
     "#version 100\n\
     precision highp float;\
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    uniform highp float pixelCount;\
     void main() {\
-        vec2 pixelSize = vec2(texSize.x/100.0, texSize.y/100.0);\
-        vec2 uv = v_texcoord.xy;\
-        float dx = pixelSize.x*(1./texSize.x);\
-        float dy = pixelSize.y*(1./texSize.y);\
-        vec2 coord = vec2(dx*floor(uv.x/dx),\
+        highp vec2 pixelSize = vec2(texSize.x/pixelCount, texSize.y/pixelCount);\
+        highp vec2 uv = v_texcoord.xy;\
+        highp float dx = pixelSize.x*(1./texSize.x);\
+        highp float dy = pixelSize.y*(1./texSize.y);\
+        highp vec2 coord = vec2(dx*floor(uv.x/dx),\
         dy*floor(uv.y/dy));\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, coord).r;\
         u = texture2D(s_textureU, coord).r;\
         v = texture2D(s_textureV, coord).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         gl_FragColor = vec4(r, g, b, 1.0);\
     }";
 
@@ -292,44 +319,44 @@ static const char kFragmentShader7[] =
 static const char kFragmentShader8[] =
     "#version 100\n\
     precision highp float;\
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    vec4 YuvToRgb(vec2 uv) {\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    uniform highp float stitchCount;\
+    uniform float invert;\
+    vec4 YuvToRgb(highp vec2 uv) {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         return vec4(r, g, b, 1.0);\
     }\
-    vec4 CrossStitching(vec2 uv) {\
-        float stitchSize = texSize.x / 35.0;\
-        int invert = 0;\
+    vec4 CrossStitching(highp vec2 uv) {\
+        highp float stitchSize = texSize.x / stitchCount;\
         vec4 color = vec4(0.0);\
-        float size = stitchSize;\
-        vec2 cPos = uv * texSize.xy;\
-        vec2 tlPos = floor(cPos / vec2(size, size));\
+        highp float size = stitchSize;\
+        highp vec2 cPos = uv * texSize.xy;\
+        highp vec2 tlPos = floor(cPos / vec2(size, size));\
         tlPos *= size;\
         int remX = int(mod(cPos.x, size));\
         int remY = int(mod(cPos.y, size));\
         if (remX == 0 && remY == 0)\
             tlPos = cPos;\
-        vec2 blPos = tlPos;\
+        highp vec2 blPos = tlPos;\
         blPos.y += (size - 1.0);\
         if ((remX == remY) || (((int(cPos.x) - int(blPos.x)) == (int(blPos.y) - int(cPos.y))))) {\
-            if (invert == 1)\
+            if (invert > 0.5)\
                 color = vec4(0.2, 0.15, 0.05, 1.0);\
             else\
                 color = YuvToRgb(tlPos * vec2(1.0 / texSize.x, 1.0 / texSize.y)) * 1.4;\
         } else {\
-            if (invert == 1)\
+            if (invert > 0.5)\
                 color = YuvToRgb(tlPos * vec2(1.0 / texSize.x, 1.0 / texSize.y)) * 1.4;\
             else\
                 color = vec4(0.0, 0.0, 0.0, 1.0);\
@@ -340,135 +367,46 @@ static const char kFragmentShader8[] =
         gl_FragColor = CrossStitching(v_texcoord);\
     }";
 
-// Toonify Filter
+// Toonify Filter. HSV quantization is baked into a nearest-sampled 3D table by
+// toon_quantization_lut(), only the edge detection runs per pixel.
 static const char kFragmentShader9[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    const int kHueLevCount = 6;\
-    const int kSatLevCount = 7;\
-    const int kValLevCount = 4;\
-    float hueLevels[kHueLevCount];\
-    float satLevels[kSatLevCount];\
-    float valLevels[kValLevCount];\
-    float edge_thres = 0.2;\
-    float edge_thres2 = 5.0;\
-    vec4 YuvToRgb(vec2 uv) {\
+    uniform mat4 colorMatrix;\
+    uniform lowp sampler2D s_quantization;\
+    uniform highp float quantizationSize;\
+    uniform highp vec2 texSize;\
+    uniform float edgeThreshold;\
+    uniform float edgeGain;\
+    vec4 YuvToRgb(highp vec2 uv) {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         return vec4(r, g, b, 1.0);\
     }\
-    vec3 RGBtoHSV(float r, float g, float b) {\
-        float minv, maxv, delta;\
-        vec3 res;\
-        minv = min(min(r, g), b);\
-        maxv = max(max(r, g), b);\
-        res.z = maxv;\
-        delta = maxv - minv;\
-        if (maxv != 0.0)\
-            res.y = delta / maxv;\
-        else {\
-            res.y = 0.0;\
-            res.x = -1.0;\
-            return res;\
-        }\
-        if (r == maxv)\
-            res.x = ( g - b ) / delta;\
-        else if (g == maxv)\
-            res.x = 2.0 + ( b - r ) / delta;\
-        else\
-            res.x = 4.0 + ( r - g ) / delta;\
-        res.x = res.x * 60.0;\
-        if(res.x < 0.0)\
-            res.x = res.x + 360.0;\
-        return res;\
-    }\
-    vec3 HSVtoRGB(float h, float s, float v ) {\
-        int i;\
-        float f, p, q, t;\
-        vec3 res;\
-        if(s == 0.0) {\
-            res.x = v;\
-            res.y = v;\
-            res.z = v;\
-            return res;\
-        }\
-        h /= 60.0;\
-        i = int(floor( h ));\
-        f = h - float(i);\
-        p = v * ( 1.0 - s );\
-        q = v * ( 1.0 - s * f );\
-        t = v * ( 1.0 - s * ( 1.0 - f ) );\
-        if (i == 0) {\
-                res.x = v;\
-                res.y = t;\
-                res.z = p;\
-        } else if (i == 1) {\
-                res.x = q;\
-                res.y = v;\
-                res.z = p;\
-        } else if (i == 2) {\
-                res.x = p;\
-                res.y = v;\
-                res.z = t;\
-        } else if (i == 3) {\
-                res.x = p;\
-                res.y = q;\
-                res.z = v;\
-        } else if (i == 4) {\
-                res.x = t;\
-                res.y = p;\
-                res.z = v;\
-        } else if (i == 5) {\
-                res.x = v;\
-                res.y = p;\
-                res.z = q;\
-        }\
-        return res;\
-    }\
-    float nearestLevel(float col, int mode) {\
-        int levCount;\
-        if (mode==0) levCount = kHueLevCount;\
-        if (mode==1) levCount = kSatLevCount;\
-        if (mode==2) levCount = kValLevCount;\
-        for (int i=0; i<levCount-1; i++ ) {\
-            if (mode==0) {\
-                if (col >= hueLevels[i] && col <= hueLevels[i+1]) {\
-                    return hueLevels[i+1];\
-                }\
-            }\
-            if (mode==1) {\
-                if (col >= satLevels[i] && col <= satLevels[i+1]) {\
-                    return satLevels[i+1];\
-                }\
-            }\
-            if (mode==2) {\
-                if (col >= valLevels[i] && col <= valLevels[i+1]) {\
-                    return valLevels[i+1];\
-                }\
-            }\
-        }\
+    vec3 Quantize(vec3 color) {\
+        vec3 cell = floor(clamp(color, 0.0, 1.0) * (quantizationSize - 1.0) + 0.5);\
+        highp vec2 uv = vec2((cell.b * quantizationSize + cell.r + 0.5) / (quantizationSize * quantizationSize),\
+                       (cell.g + 0.5) / quantizationSize);\
+        return texture2D(s_quantization, uv).rgb;\
     }\
     float avgIntensity(vec4 pix) {\
         return (pix.r + pix.g + pix.b)/3.;\
     }\
-    vec4 getPixel(vec2 coords, float dx, float dy) {\
+    vec4 getPixel(highp vec2 coords, highp float dx, highp float dy) {\
         return YuvToRgb(coords + vec2(dx, dy));\
     }\
-    float IsEdge(in vec2 coords) {\
-        float dxtex = 1.0 / float(texSize.x);\
-        float dytex = 1.0 / float(texSize.y);\
+    float IsEdge(in highp vec2 coords) {\
+        highp float dxtex = 1.0 / float(texSize.x);\
+        highp float dytex = 1.0 / float(texSize.y);\
         float pix[9];\
         int k = -1;\
         float delta;\
@@ -479,94 +417,67 @@ static const char kFragmentShader9[] =
             }\
         }\
         delta = (abs(pix[1]-pix[7]) + abs(pix[5]-pix[3]) + abs(pix[0]-pix[8])+ abs(pix[2]-pix[6]))/4.;\
-        return clamp(edge_thres2*delta,0.0,1.0);\
+        return clamp(edgeGain*delta,0.0,1.0);\
     }\
     void main() {\
-        hueLevels[0] = 0.0;\
-        hueLevels[1] = 140.0;\
-        hueLevels[2] = 160.0;\
-        hueLevels[3] = 240.0;\
-        hueLevels[4] = 240.0;\
-        hueLevels[5] = 360.0;\
-        satLevels[0] = 0.0;\
-        satLevels[1] = 0.15;\
-        satLevels[2] = 0.3;\
-        satLevels[3] = 0.45;\
-        satLevels[4] = 0.6;\
-        satLevels[5] = 0.8;\
-        satLevels[6] = 1.0;\
-        valLevels[0] = 0.0;\
-        valLevels[1] = 0.3;\
-        valLevels[2] = 0.6;\
-        valLevels[3] = 1.0;\
-        vec2 uv = v_texcoord;\
+        highp vec2 uv = v_texcoord;\
         vec3 color = YuvToRgb(uv).rgb;\
-        vec3 vHSV =  RGBtoHSV(color.r, color.g, color.b);\
-        vHSV.x = nearestLevel(vHSV.x, 0);\
-        vHSV.y = nearestLevel(vHSV.y, 1);\
-        vHSV.z = nearestLevel(vHSV.z, 2);\
         float edg = IsEdge(uv);\
-        vec3 vRGB = (edg >= edge_thres) ? vec3(0.0,0.0,0.0) : HSVtoRGB(vHSV.x,vHSV.y,vHSV.z);\
-        gl_FragColor = vec4(vRGB.x, vRGB.y, vRGB.z, 1.0);\
+        vec3 vRGB = Quantize(color) * (1.0 - step(edgeThreshold, edg));\
+        gl_FragColor = vec4(vRGB, 1.0);\
     }";
 
-// Predator Thermal Vision Filter
+// Predator Thermal Vision Filter, luminance indexes a palette from thermal_palette().
 static const char kFragmentShader10[] =
     "#version 100\n\
     precision highp float;\
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
+    uniform mat4 colorMatrix;\
+    uniform lowp sampler2D s_palette;\
+    uniform float paletteSize;\
     void main() {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, v_texcoord).r;\
         u = texture2D(s_textureU, v_texcoord).r;\
         v = texture2D(s_textureV, v_texcoord).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
-        vec3 color = vec3(r, g, b);\
-        vec2 uv = v_texcoord.xy;\
-        vec3 colors[3];\
-        colors[0] = vec3(0.,0.,1.);\
-        colors[1] = vec3(1.,1.,0.);\
-        colors[2] = vec3(1.,0.,0.);\
-        float lum = (color.r + color.g + color.b)/3.;\
-        int idx = (lum < 0.5) ? 0 : 1;\
-        vec3 rgb = mix(colors[idx],colors[idx+1],(lum-float(idx)*0.5)/0.5);\
-        gl_FragColor = vec4(rgb, 1.0);\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
+        float lum = clamp((r + g + b)/3., 0.0, 1.0);\
+        float x = (lum * (paletteSize - 1.0) + 0.5) / paletteSize;\
+        gl_FragColor = vec4(texture2D(s_palette, vec2(x, 0.5)).rgb, 1.0);\
     }";
 
 // Emboss Filter
 static const char kFragmentShader11[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    vec4 YuvToRgb(vec2 uv) {\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    uniform float strength;\
+    vec4 YuvToRgb(highp vec2 uv) {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         return vec4(r, g, b, 1.0);\
     }\
     void main() {\
         vec4 color;\
         color.rgb = vec3(0.5);\
-        vec2 onePixel = vec2(1.0 / texSize.x, 1.0 / texSize.y);\
-        color -= YuvToRgb(v_texcoord - onePixel) * 5.0;\
-        color += YuvToRgb(v_texcoord + onePixel) * 5.0;\
+        highp vec2 onePixel = vec2(1.0 / texSize.x, 1.0 / texSize.y);\
+        color -= YuvToRgb(v_texcoord - onePixel) * strength;\
+        color += YuvToRgb(v_texcoord + onePixel) * strength;\
         color.rgb = vec3((color.r + color.g + color.b) / 3.0);\
         gl_FragColor = vec4(color.rgb, 1.0);\
     }";
@@ -575,26 +486,25 @@ static const char kFragmentShader11[] =
 static const char kFragmentShader12[] =
     "#version 100\n \
     precision highp float; \
-    varying vec2 v_texcoord;\
+    varying highp vec2 v_texcoord;\
     uniform lowp sampler2D s_textureY;\
     uniform lowp sampler2D s_textureU;\
     uniform lowp sampler2D s_textureV;\
-    uniform vec2 texSize;\
-    vec4 YuvToRgb(vec2 uv) {\
+    uniform mat4 colorMatrix;\
+    uniform highp vec2 texSize;\
+    vec4 YuvToRgb(highp vec2 uv) {\
         float y, u, v, r, g, b;\
         y = texture2D(s_textureY, uv).r;\
         u = texture2D(s_textureU, uv).r;\
         v = texture2D(s_textureV, uv).r;\
-        u = u - 0.5;\
-        v = v - 0.5;\
-        r = y + 1.403 * v;\
-        g = y - 0.344 * u - 0.714 * v;\
-        b = y + 1.770 * u;\
+        r = dot(vec4(y, u, v, 1.0), colorMatrix[0]);\
+        g = dot(vec4(y, u, v, 1.0), colorMatrix[1]);\
+        b = dot(vec4(y, u, v, 1.0), colorMatrix[2]);\
         return vec4(r, g, b, 1.0);\
     }\
     void main() {\
-        vec2 pos = v_texcoord.xy;\
-        vec2 onePixel = vec2(1, 1) / texSize;\
+        highp vec2 pos = v_texcoord.xy;\
+        highp vec2 onePixel = vec2(1, 1) / texSize;\
         vec4 color = vec4(0);\
         mat3 edgeDetectionKernel = mat3(\
             -1, -1, -1,\
@@ -603,7 +513,7 @@ static const char kFragmentShader12[] =
         );\
         for(int i = 0; i < 3; i++) {\
             for(int j = 0; j < 3; j++) {\
-                vec2 samplePos = pos + vec2(i - 1 , j - 1) * onePixel;\
+                highp vec2 samplePos = pos + vec2(i - 1 , j - 1) * onePixel;\
                 vec4 sampleColor = YuvToRgb(samplePos);\
                 sampleColor *= edgeDetectionKernel[i][j];\
                 color += sampleColor;\
@@ -612,4 +522,49 @@ static const char kFragmentShader12[] =
         gl_FragColor = vec4(color.rgb, 1.0);\
     }";
 
+// GPU luma statistics, see GLFrameStats. Both passes draw the full quad without a transform.
+static const char kVertexShaderStats[] =
+    "#version 100\n\
+    varying vec2 v_texcoord; \
+    attribute vec4 position; \
+    attribute vec4 texcoord; \
+    void main() { \
+        v_texcoord = texcoord.xy; \
+        gl_Position = position; \
+    }";
+
+// Fills the statistics atlas: R is luma over the whole texture, G marks in each of 4x4 tiles the
+// samples of a 64x64 grid over the texture that fall in the tile's 16 code value bin. The tile
+// averages of G are then the histogram and those of R the zone means.
+static const char kFragmentShaderStatsAtlas[] =
+    "#version 100\n \
+    precision highp float; \
+    varying highp vec2 v_texcoord;\
+    uniform lowp sampler2D s_textureY;\
+    void main() {\
+        float luma = texture2D(s_textureY, v_texcoord).r;\
+        highp vec2 tile = floor(v_texcoord * 4.0);\
+        float code = floor(texture2D(s_textureY, fract(v_texcoord * 4.0)).r * 255.0 + 0.5);\
+        float bin = floor(code / 16.0);\
+        float marked = 1.0 - step(0.5, abs(bin - (tile.y * 4.0 + tile.x)));\
+        gl_FragColor = vec4(luma, marked, 0.0, 1.0);\
+    }";
+
+// Averages 8x8 texels into one, 16 bilinear fetches on the corners between texel pairs.
+static const char kFragmentShaderStatsReduce[] =
+    "#version 100\n \
+    precision highp float; \
+    varying highp vec2 v_texcoord;\
+    uniform lowp sampler2D s_texture;\
+    uniform highp vec2 texelStep;\
+    void main() {\
+        vec4 sum = vec4(0.0);\
+        for (int y = -3; y <= 3; y += 2) {\
+            for (int x = -3; x <= 3; x += 2) {\
+                sum += texture2D(s_texture, v_texcoord + vec2(float(x), float(y)) * texelStep);\
+            }\
+        }\
+        gl_FragColor = sum / 16.0;\
+    }";
+
 #endif //_GL_SHADER_H_
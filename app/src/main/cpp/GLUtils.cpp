@@ -2,6 +2,7 @@
 #include "Log.h"
 
 #include <cstdlib>
+#include <cstring>
 
 void check_gl_error(const char *op) {
     for (GLint error = glGetError(); error; error = glGetError()) {
@@ -9,6 +10,17 @@ void check_gl_error(const char *op) {
     }
 }
 
+bool has_extension(const char *extensions, const char *name) {
+    if (!extensions) return false;
+
+    size_t length = strlen(name);
+    for (const char *p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+    }
+
+    return false;
+}
+
 GLuint load_shader(GLenum shaderType, const char *pSource) {
     GLuint shader = glCreateShader(shaderType);
     if (shader) {
@@ -84,3 +96,122 @@ void delete_program(GLuint &program) {
         program = 0;
     }
 }
+
+GLuint start_program(const char *pVertexSource, const char *pFragmentSource) {
+    GLuint program = glCreateProgram();
+    if (!program) return 0;
+
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint pixelShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(vertexShader, 1, &pVertexSource, nullptr);
+    glShaderSource(pixelShader, 1, &pFragmentSource, nullptr);
+    glCompileShader(vertexShader);
+    glCompileShader(pixelShader);
+
+    // Compile errors surface in the link log, querying the shaders here would wait for them.
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, pixelShader);
+    glLinkProgram(program);
+
+    // Only flagged for deletion while attached, the program keeps them alive.
+    glDeleteShader(vertexShader);
+    glDeleteShader(pixelShader);
+
+    return program;
+}
+
+bool finish_program(GLuint &program) {
+    if (!program) return false;
+
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+
+    if (linkStatus != GL_TRUE) {
+        GLint bufLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &bufLength);
+        if (bufLength) {
+            char *buf = (char *) malloc((size_t) bufLength);
+            if (buf) {
+                glGetProgramInfoLog(program, bufLength, nullptr, buf);
+                LOGE("Could not link program:\n%s\n", buf);
+                free(buf);
+            }
+        }
+
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    GLuint shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+    for (GLsizei i = 0; i < count; i++) {
+        glDetachShader(program, shaders[i]);
+    }
+
+    return true;
+}
+
+ShaderPrecision fragment_precision() {
+    GLint range[2];
+    GLint mediumPrecision = 0;
+    GLint highPrecision = 0;
+    glGetShaderPrecisionFormat(GL_FRAGMENT_SHADER, GL_MEDIUM_FLOAT, range, &mediumPrecision);
+    glGetShaderPrecisionFormat(GL_FRAGMENT_SHADER, GL_HIGH_FLOAT, range, &highPrecision);
+
+    // Only worth it where mediump is actually narrower, many desktop-class GPUs run both as fp32.
+    return mediumPrecision >= 10 && mediumPrecision < highPrecision ? pMediump : pHighp;
+}
+
+std::string shader_with_precision(const char *pSource, ShaderPrecision precision) {
+    static const char kHighp[] = "precision highp float;";
+    static const char kMediump[] = "precision mediump float;";
+
+    std::string source(pSource);
+    size_t pos = source.find(kHighp);
+
+    if (precision == pMediump && pos != std::string::npos) {
+        source.replace(pos, sizeof(kHighp) - 1, kMediump);
+    }
+
+    return source;
+}
+
+// Creates an RGBA framebuffer with a texture color attachment, texture is bound to the active unit.
+bool create_framebuffer(GLsizei width, GLsizei height, GLuint &framebuffer, GLuint &texture) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOGE("Framebuffer incomplete (0x%x)\n", status);
+        delete_framebuffer(framebuffer, texture);
+        return false;
+    }
+
+    return true;
+}
+
+void delete_framebuffer(GLuint &framebuffer, GLuint &texture) {
+    if (framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+
+    if (texture) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+}
@@ -2,6 +2,11 @@
 #define _H_GL_UTILS_
 
 #include <GLES3/gl3.h>
+#include <string>
+
+enum ShaderPrecision {
+    pHighp, pMediump
+};
 
 GLuint load_shader(GLenum shaderType, const char *pSource);
 
@@ -10,6 +15,25 @@ GLuint create_program(const char *pVertexSource, const char *pFragmentSource, GL
 
 void delete_program(GLuint &program);
 
+// Issues the compile and link of a program without waiting for either, see finish_program().
+GLuint start_program(const char *pVertexSource, const char *pFragmentSource);
+
+// Waits for the link started by start_program(), deletes the program and returns false if it failed.
+bool finish_program(GLuint &program);
+
+bool create_framebuffer(GLsizei width, GLsizei height, GLuint &framebuffer, GLuint &texture);
+
+void delete_framebuffer(GLuint &framebuffer, GLuint &texture);
+
+// Default float precision fragment shaders should use on this device.
+ShaderPrecision fragment_precision();
+
+// Rewrites the default float precision statement of a fragment shader.
+std::string shader_with_precision(const char *pSource, ShaderPrecision precision);
+
+// Whether name appears as a whole word in a space separated extension string, which may be null.
+bool has_extension(const char *extensions, const char *name);
+
 void check_gl_error(const char *op);
 
 #endif // _H_GL_UTILS_
@@ -2,6 +2,10 @@
 #include "GLShaders.h"
 #include "CommonUtils.h"
 #include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdlib>
 
 // Vertices for a full screen quad.
 static const float kVertices[8] = {
@@ -19,11 +23,17 @@ static const float kTextureCoords[8] = {
         1.0f, 1.0f, // Top right.
 };
 
+// Error bounds for the precision check, in 8-bit code values.
+static const float kMaxMeanPrecisionError = 0.5f;
+static const int kMaxP99PrecisionError = 2;
+
+// Luma pixels kept around the view, a chroma texel plus one for bilinear fetches at the edge.
+static const size_t kRegionApron = 4;
+
 GLVideoRendererYUV420::GLVideoRendererYUV420()
-        : m_program(0), m_vertexShader(0),
-          m_pixelShader(0), m_pDataY(nullptr),
-          m_pDataU(nullptr), m_pDataV(nullptr),
-          m_sizeY(0), m_sizeU(0), m_sizeV(0),
+        : m_program(0), m_programHighPrecision(false), m_programFilter(0), m_targetFramebuffer(0),
+          m_targetTexture(0), m_pDataY(nullptr),
+          m_pDataU(nullptr), m_pDataV(nullptr), m_textureWidth(0), m_textureHeight(0),
           m_textureIdY(0), m_textureIdU(0), m_textureIdV(0),
           m_vertexPos(0), m_rotationLoc(0), m_scaleLoc(0),
           m_textureLoc(0), m_textureYLoc(0), m_textureULoc(0),
@@ -32,107 +42,206 @@ GLVideoRendererYUV420::GLVideoRendererYUV420()
 }
 
 GLVideoRendererYUV420::~GLVideoRendererYUV420() {
+    // The worker may still be checking a program with this renderer's uploadParameters().
+    m_compiler.stop();
+
+    for (auto &built: m_builtPrograms) {
+        delete_program(built.second);
+    }
+
     deleteTextures();
     delete_program(m_program);
+    delete_framebuffer(m_targetFramebuffer, m_targetTexture);
 }
 
 void GLVideoRendererYUV420::init(ANativeWindow *window, AAssetManager *assetManager, size_t width,
                                  size_t height) {
     m_surfaceWidth = width;
     m_surfaceHeight = height;
+
+    if (isOffscreen()) {
+        delete_framebuffer(m_targetFramebuffer, m_targetTexture);
+        if (create_framebuffer((GLsizei) width, (GLsizei) height, m_targetFramebuffer, m_targetTexture)) {
+            // Unbound so that no pass samples the target it draws to.
+            glBindTexture(GL_TEXTURE_2D, 0);
+        } else {
+            LOGE("Could not create offscreen target.");
+        }
+
+        // Offscreen frames are batch work, each one shows the selected filter, so programs are built
+        // synchronously.
+        return;
+    }
+
+    // Called on the render thread with its context current, without a worker programs are built
+    // synchronously.
+    m_compiler.start();
+
+    // The display transform depends on the surface size.
+    isParametersChanged = true;
 }
 
 void GLVideoRendererYUV420::render() {
+    TRACE_SCOPE("render");
+    StatsScope scope(m_stats, RenderStats::sRender);
+
+    // Switching precision needs a new program, useProgram() creates it.
+    if (acquireParameters() && m_params.highPrecision != m_programHighPrecision) {
+        delete_program(m_program);
+    }
+
+    beginGpuTiming();
+    drawFrame();
+    endGpuTiming();
+
+    updateGpuStats();
+
+    readTarget();
+}
+
+void GLVideoRendererYUV420::drawFrame() {
+    TRACE_SCOPE("draw frame");
+
+    updateTextureRegion();
+
+    // Ahead of binding, offscreen the program builds here and its precision check rebinds
+    // the framebuffer and texture units.
+    GLuint program = useProgram();
+
+    bindTarget();
     glViewport(0, 0, m_surfaceWidth, m_surfaceHeight);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-    if (!updateTextures() || !useProgram()) return;
+    if (!program || !updateTextures()) return;
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void GLVideoRendererYUV420::updateFrame(const video_frame &frame) {
-    m_sizeY = frame.width * frame.height;
-    m_sizeU = frame.width * frame.height / 4;
-    m_sizeV = frame.width * frame.height / 4;
+void GLVideoRendererYUV420::beginGpuTiming() {
+    if (m_stats.isEnabled()) m_gpuTimer.begin();
+}
 
-    if (m_pDataY == nullptr || m_frameWidth != frame.width || m_frameHeight != frame.height) {
-        m_pDataY = std::make_unique<uint8_t[]>(m_sizeY + m_sizeU + m_sizeV);
-        m_pDataU = m_pDataY.get() + m_sizeY;
-        m_pDataV = m_pDataU + m_sizeU;
-        isProgramChanged = true;
+void GLVideoRendererYUV420::endGpuTiming() {
+    int64_t elapsed;
+    if (m_gpuTimer.end(elapsed)) m_stats.record(RenderStats::sGpu, elapsed);
+}
+
+void GLVideoRendererYUV420::updateGpuStats() {
+    // The stats passes leave the program, target and attributes of the frame as they found them.
+    if (!m_params.gpuStats || !m_textureWidth) {
+        m_frameStats.reset();
+        return;
     }
 
-    m_frameWidth = frame.width;
-    m_frameHeight = frame.height;
+    gpu_luma_stats stats;
+    if (m_frameStats.update(m_textureIdY, stats)) publishGpuStats(stats);
+}
 
-    if (m_frameWidth == frame.stride_y) {
-        memcpy(m_pDataY.get(), frame.y, m_sizeY);
-    } else {
-        uint8_t *pSrcY = frame.y;
-        uint8_t *pDstY = m_pDataY.get();
+void GLVideoRendererYUV420::bindTarget() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_targetFramebuffer);
+}
 
-        for (int h = 0; h < m_frameHeight; h++) {
-            memcpy(pDstY, pSrcY, m_frameWidth);
+void GLVideoRendererYUV420::readTarget() {
+    if (!m_targetFramebuffer || !m_frameCallback) return;
 
-            pSrcY += frame.stride_y;
-            pDstY += m_frameWidth;
-        }
-    }
+    TRACE_SCOPE("read target");
 
-    if (m_frameWidth / 2 == frame.stride_uv) {
-        memcpy(m_pDataU, frame.u, m_sizeU);
-        memcpy(m_pDataV, frame.v, m_sizeV);
-    } else {
-        uint8_t *pSrcU = frame.u;
-        uint8_t *pSrcV = frame.v;
-        uint8_t *pDstU = m_pDataU;
-        uint8_t *pDstV = m_pDataV;
+    auto width = (GLsizei) m_surfaceWidth;
+    auto height = (GLsizei) m_surfaceHeight;
+    size_t rowSize = m_surfaceWidth * 4;
+    m_targetPixels.resize(rowSize * m_surfaceHeight);
 
-        for (int h = 0; h < m_frameHeight / 2; h++) {
-            memcpy(pDstU, pSrcU, m_frameWidth / 2);
-            memcpy(pDstV, pSrcV, m_frameWidth / 2);
+    // Waits for the GPU. GL rows start at the bottom, the callback gets them top first.
+    glBindFramebuffer(GL_FRAMEBUFFER, m_targetFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_targetPixels.data());
 
-            pDstU += m_frameWidth / 2;
-            pDstV += m_frameWidth / 2;
+    for (size_t top = 0, bottom = m_surfaceHeight - 1; top < bottom; top++, bottom--) {
+        std::swap_ranges(&m_targetPixels[top * rowSize], &m_targetPixels[(top + 1) * rowSize],
+                         &m_targetPixels[bottom * rowSize]);
+    }
 
-            pSrcU += frame.stride_uv;
-            pSrcV += frame.stride_uv;
-        }
+    m_frameCallback(m_targetPixels.data(), m_surfaceWidth, m_surfaceHeight);
+}
+
+void GLVideoRendererYUV420::updateFrame(FrameRef frame) {
+    if (!m_frame || m_frameWidth != frame.width() || m_frameHeight != frame.height()) {
+        isProgramChanged = true;
     }
 
+    m_frameWidth = frame.width();
+    m_frameHeight = frame.height();
+
+    // Held until the next frame replaces it, a zoom or pan re-uploads from it.
+    m_frame = std::move(frame);
     isDirty = true;
 }
 
-void GLVideoRendererYUV420::draw(uint8_t *buffer, size_t length, size_t width, size_t height,
-                                 float rotation, bool mirror) {
-    m_rotation = rotation;
-    m_mirror = mirror;
+void GLVideoRendererYUV420::packRegion() {
+    const video_frame &planes = m_frame.planes();
+    const frame_region &region = m_region;
 
-    video_frame frame;
-    frame.width = width;
-    frame.height = height;
-    frame.stride_y = width;
-    frame.stride_uv = width / 2;
-    frame.y = buffer;
-    frame.u = buffer + width * height;
-    frame.v = buffer + width * height * 5 / 4;
+    if (m_frame.isPacked() && region.width == m_frameWidth && region.height == m_frameHeight) {
+        // Uploaded straight from the frame.
+        m_pDataY = planes.y;
+        m_pDataU = planes.u;
+        m_pDataV = planes.v;
+        return;
+    }
+
+    TRACE_SCOPE("copy planes");
+    StatsScope scope(m_stats, RenderStats::sCopy);
+
+    size_t widthUV = region.width / 2;
+    size_t heightUV = region.height / 2;
+    size_t sizeY = region.width * region.height;
+    size_t sizeUV = widthUV * heightUV;
+
+    m_packedFrame.resize(sizeY + 2 * sizeUV);
+    uint8_t *pY = m_packedFrame.data();
+    uint8_t *pU = pY + sizeY;
+    uint8_t *pV = pU + sizeUV;
+    m_pDataY = pY;
+    m_pDataU = pU;
+    m_pDataV = pV;
+
+    size_t offsetY = region.y * planes.stride_y + region.x;
+    size_t offsetUV = region.y / 2 * planes.stride_uv + region.x / 2 * planes.pixel_stride_uv;
+
+    copy_plane(pY, region.width, planes.y + offsetY, planes.stride_y, region.width, region.height);
+    if (planes.pixel_stride_uv == 2) {
+        // NV21 interleaves v first.
+        bool vFirst = planes.v < planes.u;
+        split_uv_plane(vFirst ? pV : pU, vFirst ? pU : pV, widthUV, (vFirst ? planes.v : planes.u) + offsetUV,
+                       planes.stride_uv, widthUV, heightUV);
+    } else {
+        copy_plane(pU, widthUV, planes.u + offsetUV, planes.stride_uv, widthUV, heightUV);
+        copy_plane(pV, widthUV, planes.v + offsetUV, planes.stride_uv, widthUV, heightUV);
+    }
+}
+
+void GLVideoRendererYUV420::draw(FrameRef frame, float rotation, bool mirror) {
+    setTransform(rotation, mirror);
 
-    updateFrame(frame);
+    updateFrame(std::move(frame));
 }
 
-void GLVideoRendererYUV420::setParameters(uint32_t params) {
-    m_params = params;
+void GLVideoRendererYUV420::updateTextureRegion() {
+    if (!updateRegion(regionApron())) return;
+
+    // texSize follows the region, and a frame still held is uploaded again for it.
+    isProgramChanged = true;
+    if (m_frame) isDirty = true;
 }
 
-uint32_t GLVideoRendererYUV420::getParameters() {
-    return m_params;
+size_t GLVideoRendererYUV420::regionApron() const {
+    return kRegionApron;
 }
 
 bool GLVideoRendererYUV420::createTextures() {
-    auto widthY = (GLsizei) m_frameWidth;
-    auto heightY = (GLsizei) m_frameHeight;
+    auto widthY = (GLsizei) m_region.width;
+    auto heightY = (GLsizei) m_region.height;
 
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &m_textureIdY);
@@ -149,8 +258,8 @@ bool GLVideoRendererYUV420::createTextures() {
         return false;
     }
 
-    GLsizei widthU = (GLsizei) m_frameWidth / 2;
-    GLsizei heightU = (GLsizei) m_frameHeight / 2;
+    GLsizei widthU = widthY / 2;
+    GLsizei heightU = heightY / 2;
 
     glActiveTexture(GL_TEXTURE1);
     glGenTextures(1, &m_textureIdU);
@@ -167,8 +276,8 @@ bool GLVideoRendererYUV420::createTextures() {
         return false;
     }
 
-    GLsizei widthV = (GLsizei) m_frameWidth / 2;
-    GLsizei heightV = (GLsizei) m_frameHeight / 2;
+    GLsizei widthV = widthY / 2;
+    GLsizei heightV = heightY / 2;
 
     glActiveTexture(GL_TEXTURE2);
     glGenTextures(1, &m_textureIdV);
@@ -191,27 +300,43 @@ bool GLVideoRendererYUV420::createTextures() {
 bool GLVideoRendererYUV420::updateTextures() {
     if (!m_textureIdY && !m_textureIdU && !m_textureIdV && !createTextures()) return false;
 
-    if (isDirty) {
+    if (isDirty && m_frame) {
+        if (m_params.tileUpdates && uploadChangedTiles()) {
+            isDirty = false;
+            return true;
+        }
+
+        if (!m_params.tileUpdates) m_tiles.reset();
+
+        packRegion();
+
+        TRACE_SCOPE("upload textures");
+        StatsScope scope(m_stats, RenderStats::sUpload);
+
+        auto widthY = (GLsizei) m_region.width;
+        auto heightY = (GLsizei) m_region.height;
+
+        // Region rows are packed without padding, whatever their width.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, m_textureIdY);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, (GLsizei) m_frameWidth,
-                     (GLsizei) m_frameHeight, 0,
-                     GL_LUMINANCE, GL_UNSIGNED_BYTE, m_pDataY.get());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, widthY, heightY, 0,
+                     GL_LUMINANCE, GL_UNSIGNED_BYTE, m_pDataY);
 
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, m_textureIdU);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, (GLsizei) m_frameWidth / 2,
-                     (GLsizei) m_frameHeight / 2,
-                     0,
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, widthY / 2, heightY / 2, 0,
                      GL_LUMINANCE, GL_UNSIGNED_BYTE, m_pDataU);
 
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, m_textureIdV);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, (GLsizei) m_frameWidth / 2,
-                     (GLsizei) m_frameHeight / 2,
-                     0,
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, widthY / 2, heightY / 2, 0,
                      GL_LUMINANCE, GL_UNSIGNED_BYTE, m_pDataV);
 
+        m_textureWidth = m_region.width;
+        m_textureHeight = m_region.height;
+
         isDirty = false;
 
         return true;
@@ -220,6 +345,92 @@ bool GLVideoRendererYUV420::updateTextures() {
     return false;
 }
 
+bool GLVideoRendererYUV420::uploadChangedTiles() {
+    TRACE_SCOPE("upload tiles");
+    int64_t start = m_stats.isEnabled() ? RenderStats::now() : 0;
+
+    size_t dirtyTiles = m_tiles.update(m_frame.planes(), m_region, m_params.tileThreshold);
+    if (!m_tiles.count()) return false;
+
+    m_stats.recordRatio(RenderStats::rDirtyTiles, (float) dirtyTiles / (float) m_tiles.count());
+
+    // Textures of another size, or a frame where every tile changed, take the whole region.
+    if (m_textureWidth != m_region.width || m_textureHeight != m_region.height || dirtyTiles == m_tiles.count()) {
+        return false;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (size_t row = 0; row < m_tiles.rows(); row++) {
+        size_t column = 0;
+
+        while (column < m_tiles.columns()) {
+            if (!m_tiles.isDirty(column, row)) {
+                column++;
+                continue;
+            }
+
+            size_t first = column;
+            while (column < m_tiles.columns() && m_tiles.isDirty(column, row)) column++;
+
+            size_t x, y, width, height, lastX, lastY, lastWidth, lastHeight;
+            m_tiles.tileRect(first, row, x, y, width, height);
+            m_tiles.tileRect(column - 1, row, lastX, lastY, lastWidth, lastHeight);
+
+            uploadTileRun(x, y, lastX + lastWidth - x, height);
+        }
+    }
+
+    // Compare and upload together, the whole upload when no tile changed.
+    if (start) m_stats.record(RenderStats::sUpload, RenderStats::now() - start);
+
+    return true;
+}
+
+void GLVideoRendererYUV420::uploadTileRun(size_t x, size_t y, size_t width, size_t height) {
+    const video_frame &planes = m_frame.planes();
+    const frame_region &region = m_region;
+
+    size_t chromaX = x / 2;
+    size_t chromaY = y / 2;
+    size_t chromaWidth = (x + width) / 2 - chromaX;
+    size_t chromaHeight = (y + height) / 2 - chromaY;
+
+    m_tilePixels.resize(width * height + 2 * chromaWidth * chromaHeight);
+    uint8_t *pY = m_tilePixels.data();
+    uint8_t *pU = pY + width * height;
+    uint8_t *pV = pU + chromaWidth * chromaHeight;
+
+    size_t offsetY = (region.y + y) * planes.stride_y + region.x + x;
+    size_t offsetUV = (region.y / 2 + chromaY) * planes.stride_uv +
+                      (region.x / 2 + chromaX) * planes.pixel_stride_uv;
+
+    copy_plane(pY, width, planes.y + offsetY, planes.stride_y, width, height);
+    if (planes.pixel_stride_uv == 2) {
+        bool vFirst = planes.v < planes.u;
+        split_uv_plane(vFirst ? pV : pU, vFirst ? pU : pV, chromaWidth, (vFirst ? planes.v : planes.u) + offsetUV,
+                       planes.stride_uv, chromaWidth, chromaHeight);
+    } else {
+        copy_plane(pU, chromaWidth, planes.u + offsetUV, planes.stride_uv, chromaWidth, chromaHeight);
+        copy_plane(pV, chromaWidth, planes.v + offsetUV, planes.stride_uv, chromaWidth, chromaHeight);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdY);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint) x, (GLint) y, (GLsizei) width, (GLsizei) height, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, pY);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdU);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint) chromaX, (GLint) chromaY, (GLsizei) chromaWidth,
+                    (GLsizei) chromaHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, pU);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdV);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint) chromaX, (GLint) chromaY, (GLsizei) chromaWidth,
+                    (GLsizei) chromaHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, pV);
+}
+
 void GLVideoRendererYUV420::deleteTextures() {
     if (m_textureIdY) {
         glActiveTexture(GL_TEXTURE0);
@@ -244,17 +455,32 @@ void GLVideoRendererYUV420::deleteTextures() {
 
         m_textureIdV = 0;
     }
+
+    m_textureWidth = 0;
+    m_textureHeight = 0;
 }
 
 int GLVideoRendererYUV420::createProgram(const char *pVertexSource, const char *pFragmentSource) {
-    m_program = create_program(pVertexSource, pFragmentSource, m_vertexShader, m_pixelShader);
+    // Only ever the plain conversion, filters go through requestProgram().
+    GLuint program = buildProgram(pVertexSource, pFragmentSource, m_params.highPrecision, 0);
 
-    if (!m_program) {
+    if (!program) {
         check_gl_error("Create program");
         LOGE("Could not create program.");
         return 0;
     }
 
+    installProgram(program, 0, m_params.highPrecision);
+
+    return m_program;
+}
+
+void GLVideoRendererYUV420::installProgram(GLuint program, size_t filter, bool highPrecision) {
+    if (program != m_program) {
+        delete_program(m_program);
+    }
+    m_program = program;
+
     m_vertexPos = glGetAttribLocation(m_program, "position");
     m_rotationLoc = glGetUniformLocation(m_program, "rotation");
     m_scaleLoc = glGetUniformLocation(m_program, "scale");
@@ -263,8 +489,282 @@ int GLVideoRendererYUV420::createProgram(const char *pVertexSource, const char *
     m_textureVLoc = glGetUniformLocation(m_program, "s_textureV");
     m_textureSize = glGetUniformLocation(m_program, "texSize");
     m_textureLoc = glGetAttribLocation(m_program, "texcoord");
+    m_programHighPrecision = highPrecision;
+    m_programFilter = filter;
 
-    return m_program;
+    // A new program never has its uniforms set.
+    isProgramChanged = true;
+}
+
+GLuint GLVideoRendererYUV420::buildProgram(const char *pVertexSource, const char *pFragmentSource,
+                                           bool highPrecision, size_t filter) {
+    GLShaderCompiler::Result result = GLShaderCompiler::build(
+            programRequest(pVertexSource, pFragmentSource, highPrecision, filter));
+    rememberPrecision(pFragmentSource, result);
+
+    // The precision check draws with its own textures, the tables of the program drawn are bound
+    // again by useProgram().
+    if (result.checked) {
+        bindFrameTextures();
+        isProgramChanged = true;
+    }
+
+    return result.program;
+}
+
+void GLVideoRendererYUV420::requestProgram(uint32_t key, const char *pVertexSource,
+                                           const char *pFragmentSource, bool highPrecision, size_t filter) {
+    if (!m_compiler.isRunning()) {
+        GLuint program = buildProgram(pVertexSource, pFragmentSource, highPrecision, filter);
+
+        auto it = m_builtPrograms.find(key);
+        if (it != m_builtPrograms.end()) {
+            delete_program(it->second);
+        }
+        m_builtPrograms[key] = program;
+        return;
+    }
+
+    m_requestedSources[key] = pFragmentSource;
+    m_compiler.submit(key, programRequest(pVertexSource, pFragmentSource, highPrecision, filter));
+}
+
+bool GLVideoRendererYUV420::takeProgram(uint32_t key, GLuint &program) {
+    auto built = m_builtPrograms.find(key);
+    if (built != m_builtPrograms.end()) {
+        program = built->second;
+        m_builtPrograms.erase(built);
+        return true;
+    }
+
+    GLShaderCompiler::Result result{};
+    if (!m_compiler.take(key, result)) return false;
+
+    auto source = m_requestedSources.find(key);
+    if (source != m_requestedSources.end()) {
+        rememberPrecision(source->second, result);
+        m_requestedSources.erase(source);
+    }
+
+    program = result.program;
+    return true;
+}
+
+void GLVideoRendererYUV420::cancelProgram(uint32_t key) {
+    auto built = m_builtPrograms.find(key);
+    if (built != m_builtPrograms.end()) {
+        delete_program(built->second);
+        m_builtPrograms.erase(built);
+    }
+
+    m_requestedSources.erase(key);
+    m_compiler.cancel(key);
+}
+
+GLShaderCompiler::Request GLVideoRendererYUV420::programRequest(const char *pVertexSource,
+                                                                const char *pFragmentSource,
+                                                                bool highPrecision, size_t filter) {
+    GLShaderCompiler::Request request;
+    request.vertex = pVertexSource;
+    request.fragment = pFragmentSource;
+
+    if (highPrecision || fragment_precision() != pMediump) return request;
+
+    auto it = m_mediumpSources.find(pFragmentSource);
+    if (it != m_mediumpSources.end()) {
+        if (it->second) {
+            request.fragment = shader_with_precision(pFragmentSource, pMediump);
+        }
+        return request;
+    }
+
+    // Checked with the parameters of the moment, the snapshot is copied for the worker.
+    render_parameters params = m_params;
+    request.variant = shader_with_precision(pFragmentSource, pMediump);
+    request.check = [this, params, filter](GLuint reference, GLuint variant) {
+        std::vector<uint8_t> referenceRGBA;
+        std::vector<uint8_t> variantRGBA;
+
+        return renderPrecisionCheck(reference, variant, params, filter, referenceRGBA, variantRGBA) &&
+               comparePrecision(referenceRGBA, variantRGBA);
+    };
+
+    return request;
+}
+
+void GLVideoRendererYUV420::rememberPrecision(const char *pFragmentSource,
+                                              const GLShaderCompiler::Result &result) {
+    if (result.checked) {
+        m_mediumpSources[pFragmentSource] = result.passed;
+    }
+}
+
+bool GLVideoRendererYUV420::renderPrecisionCheck(GLuint reference, GLuint variant, const render_parameters &params,
+                                                 size_t filter, std::vector<uint8_t> &referenceRGBA,
+                                                 std::vector<uint8_t> &variantRGBA) const {
+    TRACE_SCOPE("precision check");
+
+    const GLsizei size = kPrecisionCheckSize;
+    const GLsizei sizeUV = size / 2;
+
+    // Ramps over the full range with some noise so that flat areas and edges are both covered.
+    std::vector<uint8_t> planes((size_t) (size * size + 2 * sizeUV * sizeUV));
+    uint8_t *pY = planes.data();
+    uint8_t *pU = pY + size * size;
+    uint8_t *pV = pU + sizeUV * sizeUV;
+    uint32_t seed = 1;
+
+    for (GLsizei y = 0; y < size; y++) {
+        for (GLsizei x = 0; x < size; x++) {
+            seed = seed * 1103515245u + 12345u;
+            int value = x * 255 / (size - 1) + (int) ((seed >> 16) & 0x1F) - 16;
+            pY[y * size + x] = (uint8_t) std::min(std::max(value, 0), 255);
+        }
+    }
+
+    for (GLsizei y = 0; y < sizeUV; y++) {
+        for (GLsizei x = 0; x < sizeUV; x++) {
+            pU[y * sizeUV + x] = (uint8_t) (y * 255 / (sizeUV - 1));
+            pV[y * sizeUV + x] = (uint8_t) (255 - (x + y) * 255 / (2 * sizeUV - 2));
+        }
+    }
+
+    GLuint textures[3];
+    glGenTextures(3, textures);
+
+    for (int i = 0; i < 3; i++) {
+        GLsizei width = i ? sizeUV : size;
+        const uint8_t *pData = i == 0 ? pY : (i == 1 ? pU : pV);
+
+        glActiveTexture((GLenum) (GL_TEXTURE0 + i));
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, width, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, pData);
+    }
+
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    GLuint table = 0;
+
+    glActiveTexture(GL_TEXTURE3);
+    bool rendered = create_framebuffer(size, size, framebuffer, texture);
+    if (rendered) {
+        // Unbound so that no pass samples its own render target.
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, size, size);
+
+        drawPrecisionCheck(reference, params, filter, table, referenceRGBA);
+        drawPrecisionCheck(variant, params, filter, table, variantRGBA);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        delete_framebuffer(framebuffer, texture);
+    }
+
+    glDeleteTextures(3, textures);
+    if (table) {
+        glDeleteTextures(1, &table);
+    }
+
+    check_gl_error("Check precision");
+
+    return rendered;
+}
+
+bool GLVideoRendererYUV420::comparePrecision(const std::vector<uint8_t> &referenceRGBA,
+                                             const std::vector<uint8_t> &variantRGBA) {
+    size_t histogram[256] = {0};
+    size_t total = 0;
+    size_t samples = 0;
+
+    for (size_t i = 0; i < referenceRGBA.size() && i < variantRGBA.size(); i++) {
+        if ((i & 3) == 3) continue;
+
+        int error = std::abs((int) referenceRGBA[i] - (int) variantRGBA[i]);
+        histogram[error]++;
+        total += (size_t) error;
+        samples++;
+    }
+
+    if (!samples) return false;
+
+    int p99 = 0;
+    size_t count = histogram[0];
+    while (p99 < 255 && count < samples * 99 / 100) {
+        count += histogram[++p99];
+    }
+    float mean = (float) total / (float) samples;
+
+    bool passed = mean <= kMaxMeanPrecisionError && p99 <= kMaxP99PrecisionError;
+    LOGI("mediump fragment shader error mean %.3f p99 %d, using %s.", mean, p99,
+         passed ? "mediump" : "highp");
+
+    return passed;
+}
+
+void GLVideoRendererYUV420::drawPrecisionCheck(GLuint program, const render_parameters &params, size_t filter,
+                                               GLuint &table, std::vector<uint8_t> &rgba) const {
+    glUseProgram(program);
+    setVertexAttributes((GLuint) glGetAttribLocation(program, "position"),
+                        (GLuint) glGetAttribLocation(program, "texcoord"));
+
+    float identity[16];
+    load_identity(identity);
+    glUniformMatrix4fv(glGetUniformLocation(program, "rotation"), 1, GL_FALSE, identity);
+    glUniformMatrix4fv(glGetUniformLocation(program, "scale"), 1, GL_FALSE, identity);
+    glUniform1i(glGetUniformLocation(program, "s_textureY"), 0);
+    glUniform1i(glGetUniformLocation(program, "s_textureU"), 1);
+    glUniform1i(glGetUniformLocation(program, "s_textureV"), 2);
+    glUniform2f(glGetUniformLocation(program, "texSize"), (float) kPrecisionCheckSize,
+                (float) kPrecisionCheckSize);
+
+    // Blur passes run as a single tap.
+    glUniform2f(glGetUniformLocation(program, "texelStep"), 1.0f / (float) kPrecisionCheckSize, 0.0f);
+    glUniform1f(glGetUniformLocation(program, "weights"), 1.0f);
+    glUniform1i(glGetUniformLocation(program, "tapCount"), 1);
+    uploadParameters(program, params, filter);
+    bindCheckTable(program, filter, params, table);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    rgba.resize((size_t) (kPrecisionCheckSize * kPrecisionCheckSize * 4));
+    glReadPixels(0, 0, kPrecisionCheckSize, kPrecisionCheckSize, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+    // Unused so that the program can be replaced on the render thread.
+    glUseProgram(0);
+}
+
+void GLVideoRendererYUV420::bindFrameTextures() {
+    // The next draw only uploads when the frame is dirty.
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdY);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdU);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_textureIdV);
+}
+
+void GLVideoRendererYUV420::setVertexAttributes(GLuint vertexPos, GLuint texcoord) {
+    glVertexAttribPointer(vertexPos, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
+    glEnableVertexAttribArray(vertexPos);
+
+    glVertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, 0, kTextureCoords);
+    glEnableVertexAttribArray(texcoord);
+}
+
+void GLVideoRendererYUV420::uploadParameters(GLuint program, const render_parameters &params, size_t) const {
+    GLint colorMatrixLoc = glGetUniformLocation(program, "colorMatrix");
+    if (colorMatrixLoc >= 0) {
+        // Row-major on the CPU, so column i in GLSL holds the coefficients of channel i.
+        glUniformMatrix4fv(colorMatrixLoc, 1, GL_FALSE, params.colorMatrix);
+    }
+}
+
+void GLVideoRendererYUV420::bindCheckTable(GLuint, size_t, const render_parameters &, GLuint &) const {
+    // The conversion samples the frame alone.
 }
 
 GLuint GLVideoRendererYUV420::useProgram() {
@@ -278,32 +778,34 @@ GLuint GLVideoRendererYUV420::useProgram() {
 
         check_gl_error("Use program.");
 
-        glVertexAttribPointer(m_vertexPos, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
-        glEnableVertexAttribArray(m_vertexPos);
+        setVertexAttributes(m_vertexPos, m_textureLoc);
 
         glUniform1i(m_textureYLoc, 0);
         glUniform1i(m_textureULoc, 1);
         glUniform1i(m_textureVLoc, 2);
-        glVertexAttribPointer(m_textureLoc, 2, GL_FLOAT, GL_FALSE, 0, kTextureCoords);
-        glEnableVertexAttribArray(m_textureLoc);
-
-        float rotation[16];
-        mat4f_load_rotate_mat(rotation, m_rotation);
-        glUniformMatrix4fv(m_rotationLoc, 1, GL_FALSE, rotation);
-
-        float scale[16];
-        mat4f_load_scale_mat(scale, m_rotation, m_surfaceWidth, m_surfaceHeight, m_frameWidth, m_frameHeight,
-                             m_mirror, true);
-        glUniformMatrix4fv(m_scaleLoc, 1, GL_FALSE, scale);
 
         if (m_textureSize >= 0) {
             GLfloat size[2];
-            size[0] = m_frameWidth;
-            size[1] = m_frameHeight;
+            size[0] = m_region.width;
+            size[1] = m_region.height;
             glUniform2fv(m_textureSize, 1, &size[0]);
         }
 
         isProgramChanged = false;
+        isParametersChanged = true;
+    }
+
+    // Only re-derived when a new parameter version arrived or the program is new.
+    if (isParametersChanged) {
+        float rotation[16];
+        float scale[16];
+        loadTransform(rotation, scale, true);
+        glUniformMatrix4fv(m_rotationLoc, 1, GL_FALSE, rotation);
+        glUniformMatrix4fv(m_scaleLoc, 1, GL_FALSE, scale);
+
+        uploadParameters(m_program, m_params, m_programFilter);
+
+        isParametersChanged = false;
     }
 
     return m_program;
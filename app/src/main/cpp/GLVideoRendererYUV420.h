@@ -2,7 +2,15 @@
 #define _GL_VIDEO_RENDERER_YUV_H_
 
 #include "VideoRenderer.h"
+#include "DirtyTiles.h"
 #include "GLUtils.h"
+#include "GLShaderCompiler.h"
+#include "GLGpuTimer.h"
+#include "GLFrameStats.h"
+
+#include <map>
+#include <string>
+#include <vector>
 
 class GLVideoRendererYUV420 : public VideoRenderer {
 public:
@@ -15,37 +23,146 @@ public:
 
     void render() override;
 
-    void draw(uint8_t *buffer, size_t length, size_t width, size_t height, float rotation, bool mirror) override;
-
-    void setParameters(uint32_t params) override;
-
-    uint32_t getParameters() override;
+    void draw(FrameRef frame, float rotation, bool mirror) override;
 
     int createProgram(const char *pVertexSource, const char *pFragmentSource) override;
 
 protected:
+    // Width and height of the synthetic frame precision checks render.
+    static const GLsizei kPrecisionCheckSize = 128;
+
+    // Draws the current frame with the current program, render() after taking the parameters.
+    void drawFrame();
+
+    // Bracket the GL commands of a render() call, timed on the GPU while stats are enabled.
+    void beginGpuTiming();
+
+    void endGpuTiming();
+
+    // Queues the GPU statistics of the Y texture while they are enabled and publishes results read
+    // back from earlier frames, render() after drawing.
+    void updateGpuStats();
+
+    // Binds the offscreen framebuffer, or the window's when there is none.
+    void bindTarget() const;
+
+    // Reads the offscreen framebuffer back and hands it to the frame callback, render() at the end.
+    void readTarget();
+
     virtual GLuint useProgram();
 
+    // Sets the runtime parameter uniforms of program, built for filter and in use, from params.
+    // Only reads its arguments, the compile worker calls it for precision checks.
+    virtual void uploadParameters(GLuint program, const render_parameters &params, size_t filter) const;
+
+    // Binds the lookup table program samples besides the frame for a precision check, creating it
+    // into table when 0. Tables are made for the check, the live ones may be replaced meanwhile.
+    virtual void bindCheckTable(GLuint program, size_t filter, const render_parameters &params,
+                                GLuint &table) const;
+
+    // Renders a program for filter and its variant over a synthetic frame, with params and the
+    // tables of bindCheckTable(). Returns false when they could not be rendered.
+    bool renderPrecisionCheck(GLuint reference, GLuint variant, const render_parameters &params, size_t filter,
+                              std::vector<uint8_t> &referenceRGBA, std::vector<uint8_t> &variantRGBA) const;
+
+    // Bounds the color error of the variant rendering against the reference one.
+    static bool comparePrecision(const std::vector<uint8_t> &referenceRGBA,
+                                 const std::vector<uint8_t> &variantRGBA);
+
+    // Builds a program for filter on the compile worker, or right away when it isn't running.
+    // Collect it with takeProgram() under the same key.
+    void requestProgram(uint32_t key, const char *pVertexSource, const char *pFragmentSource,
+                        bool highPrecision, size_t filter);
+
+    // Returns true once the program requested under key is ready, program is 0 if it failed.
+    bool takeProgram(uint32_t key, GLuint &program);
+
+    void cancelProgram(uint32_t key);
+
+    // Builds a program for filter on the calling thread.
+    GLuint buildProgram(const char *pVertexSource, const char *pFragmentSource, bool highPrecision,
+                        size_t filter);
+
+    // Replaces m_program, which draws filter from now on.
+    void installProgram(GLuint program, size_t filter, bool highPrecision);
+
+    // Takes the frame region in view, see VideoRenderer::updateRegion(), ahead of useProgram().
+    void updateTextureRegion();
+
+    // Pixels around the view the textures hold as well, for filter taps and bilinear fetches.
+    virtual size_t regionApron() const;
+
+    bool updateTextures();
+
+    static void setVertexAttributes(GLuint vertexPos, GLuint texcoord);
+
+    GLShaderCompiler m_compiler;
+
     GLuint m_program;
-    GLuint m_vertexShader;
-    GLuint m_pixelShader;
+
+    // Whether m_program was built with render_parameters::highPrecision set, and for which filter.
+    bool m_programHighPrecision;
+    size_t m_programFilter;
 private:
     bool createTextures();
 
-    bool updateTextures();
-
     void deleteTextures();
 
-    void updateFrame(const video_frame &frame);
+    // Keeps the frame until the next one, its region in view is uploaded by updateTextures().
+    void updateFrame(FrameRef frame);
+
+    // Points m_pDataY/U/V at the region in view, straight into packed I420 frames holding nothing
+    // else and into the region copied to m_packedFrame otherwise.
+    void packRegion();
+
+    // Compares the region with the last one uploaded and uploads the tiles that changed, neighbours
+    // in a row of tiles together. Returns false when the whole region needs uploading instead.
+    bool uploadChangedTiles();
+
+    // Gathers the pixels of the region at (x, y) from m_frame and updates that part of the textures.
+    void uploadTileRun(size_t x, size_t y, size_t width, size_t height);
+
+    // Request for the mediump variant of a fragment shader where the device benefits from it, with
+    // renderPrecisionCheck() deciding unless an earlier result is known, and the highp reference otherwise.
+    GLShaderCompiler::Request programRequest(const char *pVertexSource, const char *pFragmentSource,
+                                             bool highPrecision, size_t filter);
+
+    void rememberPrecision(const char *pFragmentSource, const GLShaderCompiler::Result &result);
+
+    void drawPrecisionCheck(GLuint program, const render_parameters &params, size_t filter, GLuint &table,
+                            std::vector<uint8_t> &rgba) const;
+
+    void bindFrameTextures();
+
+    GLGpuTimer m_gpuTimer;
+    GLFrameStats m_frameStats;
+
+    // Offscreen render target and the pixels read back from it.
+    GLuint m_targetFramebuffer;
+    GLuint m_targetTexture;
+    std::vector<uint8_t> m_targetPixels;
+
+    // Check results by fragment source, shaders are static strings.
+    std::map<const char *, bool> m_mediumpSources;
+
+    // Fragment sources of requests in flight, and results built without the worker.
+    std::map<uint32_t, const char *> m_requestedSources;
+    std::map<uint32_t, GLuint> m_builtPrograms;
 
-    std::unique_ptr<uint8_t[]> m_pDataY;
+    // Current frame and the planes of its region in view, in m_frame or m_packedFrame.
+    FrameRef m_frame;
+    std::vector<uint8_t> m_packedFrame;
 
-    uint8_t *m_pDataU;
-    uint8_t *m_pDataV;
+    const uint8_t *m_pDataY;
+    const uint8_t *m_pDataU;
+    const uint8_t *m_pDataV;
 
-    size_t m_sizeY;
-    size_t m_sizeU;
-    size_t m_sizeV;
+    // Tiles changed since the last upload, the size the textures were last specified at, and the
+    // pixels of a tile run on their way up.
+    DirtyTiles m_tiles;
+    size_t m_textureWidth;
+    size_t m_textureHeight;
+    std::vector<uint8_t> m_tilePixels;
 
     GLuint m_textureIdY;
     GLuint m_textureIdU;
@@ -1,12 +1,22 @@
 #include "GLVideoRendererYUV420Filter.h"
 #include "GLShaders.h"
+#include "CommonUtils.h"
+#include "FilterTables.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <EGL/egl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
 
 GLVideoRendererYUV420Filter::GLVideoRendererYUV420Filter() {
     m_fragmentShader.push_back(kFragmentShader);
     m_fragmentShader.push_back(kFragmentShader1);
-    m_fragmentShader.push_back(kFragmentShader2);
-    m_fragmentShader.push_back(kFragmentShader3);
-    m_fragmentShader.push_back(kFragmentShader4);
+    m_fragmentShader.push_back(kFragmentShaderWarp);
+    m_fragmentShader.push_back(kFragmentShaderWarp);
+    m_fragmentShader.push_back(kFragmentShaderWarp);
     m_fragmentShader.push_back(kFragmentShader5);
     m_fragmentShader.push_back(kFragmentShader6);
     m_fragmentShader.push_back(kFragmentShader7);
@@ -17,29 +27,596 @@ GLVideoRendererYUV420Filter::GLVideoRendererYUV420Filter() {
     m_fragmentShader.push_back(kFragmentShader12);
 }
 
-GLVideoRendererYUV420Filter::~GLVideoRendererYUV420Filter() = default;
+GLVideoRendererYUV420Filter::~GLVideoRendererYUV420Filter() {
+    // Stopped before this class goes, the worker may be calling uploadParameters().
+    m_compiler.stop();
+
+    cancelFilter();
+    deleteBlur();
+    deleteLuts();
+
+    glDeleteTextures(2, m_warpTextures);
+
+    if (m_paletteTexture) {
+        glDeleteTextures(1, &m_paletteTexture);
+    }
+
+    if (m_quantizationTexture) {
+        glDeleteTextures(1, &m_quantizationTexture);
+    }
+}
+
+void GLVideoRendererYUV420Filter::init(ANativeWindow *window, AAssetManager *assetManager,
+                                       size_t width, size_t height) {
+    GLVideoRendererYUV420::init(window, assetManager, width, height);
+
+    // GLES2 has no 3D textures, the LUTs are tiled into 2D ones there. Decided by the version the
+    // context was created for, drivers may run GLES2 contexts at a later version.
+    EGLint version = 2;
+    eglQueryContext(eglGetCurrentDisplay(), eglGetCurrentContext(), EGL_CONTEXT_CLIENT_VERSION, &version);
+    if (m_luts.empty() && version >= 3) {
+        m_texImage3D = (TexImage3DProc) eglGetProcAddress("glTexImage3D");
+    }
 
-void GLVideoRendererYUV420Filter::setParameters(uint32_t params) {
-    GLVideoRendererYUV420::setParameters(params);
-    m_filter = params & 0x0000000F;
+    if (assetManager && m_luts.empty()) {
+        loadLuts(assetManager);
+    }
 }
 
 uint32_t GLVideoRendererYUV420Filter::getParameters() {
-    m_params |= (m_fragmentShader.size() << 4) & 0x000000F0;
+    uint32_t params = GLVideoRendererYUV420::getParameters();
+
+    // Bits 4-7 report the filter count, bits 20-23 the LUT count.
+    params |= (m_fragmentShader.size() << 4) & 0x000000F0;
+    params |= (m_lutCount.load() << 20) & 0x00F00000;
 
-    return m_params;
+    return params;
 }
 
 void GLVideoRendererYUV420Filter::render() {
-    if (m_filter != m_prevFilter) {
-        m_prevFilter = m_filter;
+    TRACE_SCOPE("render");
+    StatsScope scope(m_stats, RenderStats::sRender);
+
+    acquireParameters();
+
+    // Out of range filters show the plain conversion.
+    size_t filter = m_params.filter < m_fragmentShader.size() ? m_params.filter : 0;
+    size_t lut = m_params.lut <= m_luts.size() ? m_params.lut : 0;
+    bool highPrecision = m_params.highPrecision;
+
+    if (filter != m_requestedFilter || lut != m_requestedLut || highPrecision != m_requestedHighPrecision) {
+        m_requestedFilter = filter;
+        m_requestedLut = lut;
+        m_requestedHighPrecision = highPrecision;
+
+        requestFilter();
+    }
+
+    // The previous filter keeps drawing until the new one is built.
+    if (m_filterPending) {
+        takeFilter();
+    }
+
+    beginGpuTiming();
+
+    if (m_prevFilter == kBlurFilter) {
+        renderBlur();
+    } else {
+        updateWarpMap();
+
+        drawFrame();
+    }
+
+    endGpuTiming();
+
+    updateGpuStats();
+
+    readTarget();
+}
+
+uint32_t GLVideoRendererYUV420Filter::programKey(size_t filter, size_t lut, bool highPrecision) {
+    return (uint32_t) filter | (uint32_t) lut << 8 | (highPrecision ? 1u << 16 : 0u);
+}
+
+void GLVideoRendererYUV420Filter::requestFilter() {
+    // Only the newest selection is worth finishing.
+    cancelFilter();
+
+    if (m_requestedFilter == m_prevFilter && m_requestedLut == m_prevLut &&
+        m_requestedHighPrecision == m_prevHighPrecision) {
+        return;
+    }
+
+    bool highPrecision = m_requestedHighPrecision;
+
+    if (m_requestedFilter == kBlurFilter) {
+        // Blur runs its own two programs, see renderBlur().
+        if (m_blurH.program && m_blurHighPrecision == highPrecision) {
+            showFilter();
+            return;
+        }
+
+        m_pendingKey = programKey(kBlurFilter, 0, highPrecision);
+        requestProgram(m_pendingKey | kBlurHorizontalKey, kVertexShader, kFragmentShader1, highPrecision,
+                       kBlurFilter);
+        requestProgram(m_pendingKey | kBlurVerticalKey, kVertexShader, kFragmentShaderBlurVertical,
+                       highPrecision, kBlurFilter);
+    } else {
+        // Grading is fused into the plain conversion shader.
+        bool grade = m_requestedFilter == 0 && m_requestedLut;
+        const char *pVertexSource = grade && m_texImage3D ? kVertexShader3 : kVertexShader;
+        const char *pFragmentSource = !grade ? m_fragmentShader.at(m_requestedFilter)
+                                             : m_texImage3D ? kFragmentShaderLut3D : kFragmentShaderLut;
+
+        m_pendingKey = programKey(m_requestedFilter, m_requestedLut, highPrecision);
+        requestProgram(m_pendingKey, pVertexSource, pFragmentSource, highPrecision, m_requestedFilter);
+    }
+
+    m_filterPending = true;
+}
+
+void GLVideoRendererYUV420Filter::takeFilter() {
+    if (m_requestedFilter == kBlurFilter) {
+        const uint32_t keys[2] = {m_pendingKey | kBlurHorizontalKey, m_pendingKey | kBlurVerticalKey};
+
+        for (int i = 0; i < 2; i++) {
+            if (!m_pendingBlurTaken[i]) {
+                m_pendingBlurTaken[i] = takeProgram(keys[i], m_pendingBlur[i]);
+            }
+        }
+
+        if (!m_pendingBlurTaken[0] || !m_pendingBlurTaken[1]) return;
+
+        m_filterPending = false;
+        m_pendingBlurTaken[0] = false;
+        m_pendingBlurTaken[1] = false;
+
+        if (!m_pendingBlur[0] || !m_pendingBlur[1]) {
+            LOGE("Could not create blur program.");
+            delete_program(m_pendingBlur[0]);
+            delete_program(m_pendingBlur[1]);
+            return;
+        }
+
+        deleteBlur();
+        setupBlurPass(m_blurH, m_pendingBlur[0]);
+        setupBlurPass(m_blurV, m_pendingBlur[1]);
+        m_blurHighPrecision = m_requestedHighPrecision;
+        m_pendingBlur[0] = 0;
+        m_pendingBlur[1] = 0;
+    } else {
+        GLuint program = 0;
+        if (!takeProgram(m_pendingKey, program)) return;
+
+        m_filterPending = false;
+
+        if (!program) {
+            check_gl_error("Create program");
+            LOGE("Could not create program for filter %zu.", m_requestedFilter);
+            return;
+        }
+
+        installProgram(program, m_requestedFilter, m_requestedHighPrecision);
+    }
+
+    showFilter();
+}
+
+void GLVideoRendererYUV420Filter::cancelFilter() {
+    if (!m_filterPending) return;
+
+    cancelProgram(m_pendingKey);
+    cancelProgram(m_pendingKey | kBlurHorizontalKey);
+    cancelProgram(m_pendingKey | kBlurVerticalKey);
+
+    delete_program(m_pendingBlur[0]);
+    delete_program(m_pendingBlur[1]);
+    m_pendingBlurTaken[0] = false;
+    m_pendingBlurTaken[1] = false;
+
+    m_filterPending = false;
+}
+
+void GLVideoRendererYUV420Filter::showFilter() {
+    m_prevFilter = m_requestedFilter;
+    m_prevLut = m_requestedLut;
+    m_prevHighPrecision = m_requestedHighPrecision;
+
+    // Uniforms of the programs now drawn may predate the current parameters.
+    isParametersChanged = true;
+}
+
+void GLVideoRendererYUV420Filter::uploadParameters(GLuint program, const render_parameters &params,
+                                                   size_t filter) const {
+    GLVideoRendererYUV420::uploadParameters(program, params, filter);
+
+    size_t count;
+    const filter_parameter *parameters = filter_parameters(filter, count);
+
+    for (size_t i = 0; i < count && filter < kMaxFilters; i++) {
+        GLint location = glGetUniformLocation(program, parameters[i].name);
+        if (location >= 0) {
+            glUniform1f(location, params.filterValues[filter][i]);
+        }
+    }
+}
+
+size_t GLVideoRendererYUV420Filter::regionApron() const {
+    size_t apron = GLVideoRendererYUV420::regionApron();
+
+    // Blur taps reach radius pixels out, the other filters stay within a few.
+    if (m_prevFilter == kBlurFilter) {
+        apron += (size_t) std::ceil(m_params.filterValues[kBlurFilter][0]);
+    }
+
+    return apron;
+}
+
+GLuint GLVideoRendererYUV420Filter::useProgram() {
+    bool programChanged = isProgramChanged;
+    GLuint program = GLVideoRendererYUV420::useProgram();
+
+    if (program && (programChanged || m_warpSwapped) && warpType(m_prevFilter) != WarpMap::tNone) {
+        bindWarpMap(program);
+    }
+
+    if (program && programChanged && m_prevFilter == 0 && m_prevLut) {
+        const LutTexture &lut = m_luts.at(m_prevLut - 1);
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(m_texImage3D ? GL_TEXTURE_3D : GL_TEXTURE_2D, lut.texture);
+        glUniform1i(glGetUniformLocation(program, "s_lut"), 4);
+        glUniform1f(glGetUniformLocation(program, "lutSize"), (float) lut.size);
+    }
+
+    if (program && programChanged) {
+        bindFilterTable(program);
+    }
+
+    return program;
+}
+
+WarpMap::Type GLVideoRendererYUV420Filter::warpType(size_t filter) {
+    switch (filter) {
+        case 2:
+            return WarpMap::tSwirl;
+        case 3:
+            return WarpMap::tMagnifier;
+        case 4:
+            return WarpMap::tFishEye;
+        default:
+            return WarpMap::tNone;
+    }
+}
+
+void GLVideoRendererYUV420Filter::updateWarpMap() {
+    WarpMap::Type type = warpType(m_prevFilter);
+    if (type == WarpMap::tNone || !m_frameWidth || !m_frameHeight) return;
+
+    // Regenerated on the JobSystem when the distortion, its parameters or the frame size change,
+    // the last map is drawn until then. Only the very first one is waited for.
+    const float *params = m_params.filterValues[m_prevFilter];
+    if (!m_warpMap.update(type, m_frameWidth, m_frameHeight, params)) {
+        if (m_warpTextures[m_warpFront]) return;
+
+        m_warpMap.wait();
+        if (!m_warpMap.update(type, m_frameWidth, m_frameHeight, params)) return;
+    }
+
+    TRACE_SCOPE("upload warp map");
+    size_t back = m_warpTextures[m_warpFront] ? 1 - m_warpFront : m_warpFront;
+
+    glActiveTexture(GL_TEXTURE5);
+    if (!m_warpTextures[back]) {
+        glGenTextures(1, &m_warpTextures[back]);
+        glBindTexture(GL_TEXTURE_2D, m_warpTextures[back]);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // Packed coordinates can't be filtered, the shader interpolates them.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, m_warpTextures[back]);
+    }
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei) m_warpMap.width(), (GLsizei) m_warpMap.height(),
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, m_warpMap.data());
+    check_gl_error("Update warp map");
+
+    m_warpFront = back;
+    m_warpSwapped = true;
+}
+
+void GLVideoRendererYUV420Filter::bindWarpMap(GLuint program) {
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, m_warpTextures[m_warpFront]);
+    glUniform1i(glGetUniformLocation(program, "s_warp"), 5);
+    glUniform2f(glGetUniformLocation(program, "warpSize"), (float) m_warpMap.width(), (float) m_warpMap.height());
+
+    m_warpSwapped = false;
+}
+
+void GLVideoRendererYUV420Filter::bindFilterTable(GLuint program) {
+    // Tables are generated the first time their filter is selected and kept afterwards.
+    if (m_prevFilter == kThermalFilter) {
+        if (!m_paletteTexture) {
+            m_paletteTexture = createPaletteTexture();
+        }
+
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, m_paletteTexture);
+        glUniform1i(glGetUniformLocation(program, "s_palette"), 6);
+        glUniform1f(glGetUniformLocation(program, "paletteSize"), (float) kPaletteSize);
+    } else if (m_prevFilter == kToonFilter) {
+        if (!m_quantizationTexture) {
+            m_quantizationTexture = createQuantizationTexture();
+        }
+
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, m_quantizationTexture);
+        glUniform1i(glGetUniformLocation(program, "s_quantization"), 6);
+        glUniform1f(glGetUniformLocation(program, "quantizationSize"), (float) kQuantizationSize);
+    }
+}
 
-        if (m_filter >= 0 && m_filter < m_fragmentShader.size()) {
-            isProgramChanged = true;
-            delete_program(m_program);
-            createProgram(kVertexShader, m_fragmentShader.at(m_filter));
+GLuint GLVideoRendererYUV420Filter::createTableTexture(GLsizei width, GLsizei height, GLint filter,
+                                                       const uint8_t *rgba) {
+    GLuint texture = 0;
+
+    glActiveTexture(GL_TEXTURE6);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    check_gl_error("Create table texture");
+
+    return texture;
+}
+
+GLuint GLVideoRendererYUV420Filter::createPaletteTexture() {
+    std::vector<uint8_t> rgba(kPaletteSize * 4);
+    thermal_palette(rgba.data(), kPaletteSize);
+
+    return createTableTexture((GLsizei) kPaletteSize, 1, GL_LINEAR, rgba.data());
+}
+
+GLuint GLVideoRendererYUV420Filter::createQuantizationTexture() {
+    CubeLut lut;
+    toon_quantization_lut(lut, kQuantizationSize);
+
+    std::vector<uint8_t> rgba;
+    lut.toTiledRGBA(rgba);
+    // Quantization is a step function, interpolating between cells would blur the bands.
+    return createTableTexture((GLsizei) (kQuantizationSize * kQuantizationSize), (GLsizei) kQuantizationSize,
+                              GL_NEAREST, rgba.data());
+}
+
+void GLVideoRendererYUV420Filter::bindCheckTable(GLuint program, size_t filter, const render_parameters &params,
+                                                 GLuint &table) const {
+    // Made like the live tables, for the first of the two programs checked. The frame is a fraction
+    // of the one drawn, the warp map of its size is generated on the calling thread.
+    if (glGetUniformLocation(program, "s_lut") >= 0) {
+        if (!table) {
+            // Far from linear within a cell, so that the interpolation weights count.
+            CubeLut lut;
+            lut.generate(kCheckLutSize, [](const float in[3], float out[3]) {
+                out[0] = std::sqrt(in[0] * in[1]);
+                out[1] = in[1] * in[1] * in[2];
+                out[2] = 0.5f + 0.5f * std::sin(6.0f * in[2] + 3.0f * in[0]);
+            });
+            table = createLutTexture(lut).texture;
+        }
+
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(m_texImage3D ? GL_TEXTURE_3D : GL_TEXTURE_2D, table);
+        glUniform1i(glGetUniformLocation(program, "s_lut"), 4);
+        glUniform1f(glGetUniformLocation(program, "lutSize"), (float) kCheckLutSize);
+    } else if (glGetUniformLocation(program, "s_warp") >= 0) {
+        auto size = (size_t) kPrecisionCheckSize;
+        auto latticeSize = (GLsizei) WarpMap::latticeSize(size);
+
+        if (!table) {
+            WarpMap map;
+            map.generate(warpType(filter), size, size, params.filterValues[filter]);
+            table = createTableTexture(latticeSize, latticeSize, GL_NEAREST, map.data());
+        }
+
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, table);
+        glUniform1i(glGetUniformLocation(program, "s_warp"), 5);
+        glUniform2f(glGetUniformLocation(program, "warpSize"), (float) latticeSize, (float) latticeSize);
+    } else if (glGetUniformLocation(program, "s_palette") >= 0) {
+        if (!table) {
+            table = createPaletteTexture();
+        }
+
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, table);
+        glUniform1i(glGetUniformLocation(program, "s_palette"), 6);
+        glUniform1f(glGetUniformLocation(program, "paletteSize"), (float) kPaletteSize);
+    } else if (glGetUniformLocation(program, "s_quantization") >= 0) {
+        if (!table) {
+            table = createQuantizationTexture();
         }
+
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, table);
+        glUniform1i(glGetUniformLocation(program, "s_quantization"), 6);
+        glUniform1f(glGetUniformLocation(program, "quantizationSize"), (float) kQuantizationSize);
+    }
+}
+
+void GLVideoRendererYUV420Filter::loadLuts(AAssetManager *assetManager) {
+    for (const auto &lut: loadCubeLuts(assetManager)) {
+        LutTexture texture = createLutTexture(lut);
+        if (!texture.texture) continue;
+
+        m_luts.push_back(texture);
+        m_lutCount = m_luts.size();
     }
+}
+
+GLVideoRendererYUV420Filter::LutTexture GLVideoRendererYUV420Filter::createLutTexture(const CubeLut &lut) const {
+    LutTexture texture{0, lut.size()};
+    std::vector<uint8_t> rgba;
+    auto size = (GLsizei) lut.size();
+
+    // The shaders fetch the corners of the lattice cell at texel centers and interpolate themselves.
+    glActiveTexture(GL_TEXTURE4);
+    glGenTextures(1, &texture.texture);
+
+    if (m_texImage3D) {
+        lut.toRGBA(rgba);
+
+        glBindTexture(GL_TEXTURE_3D, texture.texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        m_texImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, size, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    } else {
+        lut.toTiledRGBA(rgba);
+
+        glBindTexture(GL_TEXTURE_2D, texture.texture);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size * size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        LOGE("Could not create LUT texture (0x%x).", error);
+        glDeleteTextures(1, &texture.texture);
+        texture.texture = 0;
+    }
+
+    return texture;
+}
+
+void GLVideoRendererYUV420Filter::deleteLuts() {
+    for (auto &lut: m_luts) {
+        glDeleteTextures(1, &lut.texture);
+    }
+    m_luts.clear();
+    m_lutCount = 0;
+}
+
+void GLVideoRendererYUV420Filter::setupBlurPass(BlurPass &pass, GLuint program) {
+    pass.program = program;
+    pass.vertexPos = glGetAttribLocation(pass.program, "position");
+    pass.texcoord = glGetAttribLocation(pass.program, "texcoord");
+    pass.rotationLoc = glGetUniformLocation(pass.program, "rotation");
+    pass.scaleLoc = glGetUniformLocation(pass.program, "scale");
+    pass.texelStepLoc = glGetUniformLocation(pass.program, "texelStep");
+    pass.offsetsLoc = glGetUniformLocation(pass.program, "offsets");
+    pass.weightsLoc = glGetUniformLocation(pass.program, "weights");
+    pass.tapCountLoc = glGetUniformLocation(pass.program, "tapCount");
+
+    glUseProgram(pass.program);
+    glUniform1i(glGetUniformLocation(pass.program, "s_textureY"), 0);
+    glUniform1i(glGetUniformLocation(pass.program, "s_textureU"), 1);
+    glUniform1i(glGetUniformLocation(pass.program, "s_textureV"), 2);
+    glUniform1i(glGetUniformLocation(pass.program, "s_texture"), 3);
+}
+
+void GLVideoRendererYUV420Filter::renderBlur() {
+    TRACE_SCOPE("render blur");
+
+    updateTextureRegion();
+
+    bindTarget();
+    glViewport(0, 0, m_surfaceWidth, m_surfaceHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    if (!m_blurH.program || !updateTextures()) return;
+
+    bool changed = isParametersChanged || isProgramChanged;
+
+    auto width = (GLsizei) m_region.width;
+    auto height = (GLsizei) m_region.height;
+
+    glActiveTexture(GL_TEXTURE3);
+    if (m_blurWidth != m_region.width || m_blurHeight != m_region.height) {
+        delete_framebuffer(m_blurFramebuffer, m_blurTexture);
+        if (!create_framebuffer(width, height, m_blurFramebuffer, m_blurTexture)) return;
+
+        m_blurWidth = m_region.width;
+        m_blurHeight = m_region.height;
+        changed = true;
+    }
+
+    if (changed) {
+        setBlurUniforms();
+
+        isParametersChanged = false;
+        isProgramChanged = false;
+    }
+
+    // Horizontal pass in the space of the region in view: YUV planes to the RGB intermediate texture.
+    glBindFramebuffer(GL_FRAMEBUFFER, m_blurFramebuffer);
+    glViewport(0, 0, width, height);
+
+    glUseProgram(m_blurH.program);
+    setVertexAttributes(m_blurH.vertexPos, m_blurH.texcoord);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Vertical pass to the screen, applying the display transform.
+    bindTarget();
+    glViewport(0, 0, m_surfaceWidth, m_surfaceHeight);
+    glBindTexture(GL_TEXTURE_2D, m_blurTexture);
+
+    glUseProgram(m_blurV.program);
+    setVertexAttributes(m_blurV.vertexPos, m_blurV.texcoord);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    check_gl_error("Render blur");
+}
+
+void GLVideoRendererYUV420Filter::setBlurUniforms() {
+    float offsets[kMaxBlurTaps];
+    float weights[kMaxBlurTaps];
+    float radius = m_params.filterValues[kBlurFilter][0];
+    size_t maxTaps = std::max(std::min(m_params.maxBlurTaps, kMaxBlurTaps), (size_t) 1);
+    auto taps = (GLint) gaussian_linear_kernel(radius, offsets, weights, maxTaps);
+
+    float identity[16];
+    load_identity(identity);
+
+    glUseProgram(m_blurH.program);
+    glUniformMatrix4fv(m_blurH.rotationLoc, 1, GL_FALSE, identity);
+    glUniformMatrix4fv(m_blurH.scaleLoc, 1, GL_FALSE, identity);
+    glUniform2f(m_blurH.texelStepLoc, 1.0f / (float) m_region.width, 0.0f);
+    glUniform1fv(m_blurH.offsetsLoc, taps, offsets);
+    glUniform1fv(m_blurH.weightsLoc, taps, weights);
+    glUniform1i(m_blurH.tapCountLoc, taps);
+    GLVideoRendererYUV420::uploadParameters(m_blurH.program, m_params, kBlurFilter);
+
+    glUseProgram(m_blurV.program);
+
+    float rotation[16];
+    float scale[16];
+    loadTransform(rotation, scale, true);
+    glUniformMatrix4fv(m_blurV.rotationLoc, 1, GL_FALSE, rotation);
+    glUniformMatrix4fv(m_blurV.scaleLoc, 1, GL_FALSE, scale);
+
+    glUniform2f(m_blurV.texelStepLoc, 0.0f, 1.0f / (float) m_region.height);
+    glUniform1fv(m_blurV.offsetsLoc, taps, offsets);
+    glUniform1fv(m_blurV.weightsLoc, taps, weights);
+    glUniform1i(m_blurV.tapCountLoc, taps);
+}
+
+void GLVideoRendererYUV420Filter::deleteBlur() {
+    delete_program(m_blurH.program);
+    delete_program(m_blurV.program);
+    delete_framebuffer(m_blurFramebuffer, m_blurTexture);
 
-    GLVideoRendererYUV420::render();
+    m_blurWidth = 0;
+    m_blurHeight = 0;
 }
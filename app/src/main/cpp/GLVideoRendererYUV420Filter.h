@@ -2,6 +2,10 @@
 #define _GL_VIDEO_RENDERER_YUV_FILTER_H_
 
 #include "GLVideoRendererYUV420.h"
+#include "CubeLut.h"
+#include "FilterParameters.h"
+#include "WarpMap.h"
+#include <atomic>
 #include <vector>
 
 class GLVideoRendererYUV420Filter : public GLVideoRendererYUV420 {
@@ -11,15 +15,134 @@ public:
 
     ~GLVideoRendererYUV420Filter() override;
 
-    void render() override;
+    void
+    init(ANativeWindow *window, AAssetManager *assetManager, size_t width, size_t height) override;
 
-    void setParameters(uint32_t params) override;
+    void render() override;
 
     uint32_t getParameters() override;
 
+protected:
+    GLuint useProgram() override;
+
+    size_t regionApron() const override;
+
+    void uploadParameters(GLuint program, const render_parameters &params, size_t filter) const override;
+
+    void bindCheckTable(GLuint program, size_t filter, const render_parameters &params,
+                        GLuint &table) const override;
+
 private:
-    size_t m_filter = 0;
+    static const size_t kBlurFilter = 1;
+    static const size_t kToonFilter = 9;
+    static const size_t kThermalFilter = 10;
+    static const size_t kPaletteSize = 256;
+    static const size_t kQuantizationSize = 32;
+    // LUT of the precision check, see bindCheckTable().
+    static const size_t kCheckLutSize = 17;
+    static const size_t kMaxBlurTaps = 16;
+    // Key bits of the two blur pass programs, see programKey().
+    static const uint32_t kBlurHorizontalKey = 1u << 24;
+    static const uint32_t kBlurVerticalKey = 2u << 24;
+
+    struct BlurPass {
+        GLuint program;
+        GLuint vertexPos;
+        GLuint texcoord;
+        GLint rotationLoc;
+        GLint scaleLoc;
+        GLint texelStepLoc;
+        GLint offsetsLoc;
+        GLint weightsLoc;
+        GLint tapCountLoc;
+    };
+
+    typedef void (GL_APIENTRYP TexImage3DProc)(GLenum target, GLint level, GLint internalformat, GLsizei width,
+                                               GLsizei height, GLsizei depth, GLint border, GLenum format,
+                                               GLenum type, const void *pixels);
+
+    struct LutTexture {
+        GLuint texture;
+        size_t size;
+    };
+
+    static uint32_t programKey(size_t filter, size_t lut, bool highPrecision);
+
+    // Requests the programs of the selected filter, shown by takeFilter() once they are built.
+    void requestFilter();
+
+    void takeFilter();
+
+    void cancelFilter();
+
+    // Makes the selected filter the one drawn, its programs are in place.
+    void showFilter();
+
+    static WarpMap::Type warpType(size_t filter);
+
+    void updateWarpMap();
+
+    void bindWarpMap(GLuint program);
+
+    void bindFilterTable(GLuint program);
+
+    static GLuint createTableTexture(GLsizei width, GLsizei height, GLint filter, const uint8_t *rgba);
+
+    static GLuint createPaletteTexture();
+
+    static GLuint createQuantizationTexture();
+
+    void loadLuts(AAssetManager *assetManager);
+
+    LutTexture createLutTexture(const CubeLut &lut) const;
+
+    void deleteLuts();
+
+    void setupBlurPass(BlurPass &pass, GLuint program);
+
+    void renderBlur();
+
+    void setBlurUniforms();
+
+    void deleteBlur();
+
+    // Selection the render thread last saw, and the one drawn until the programs for it are ready.
+    size_t m_requestedFilter = 0;
+    size_t m_requestedLut = 0;
+    bool m_requestedHighPrecision = false;
     size_t m_prevFilter = 0;
+    size_t m_prevLut = 0;
+    bool m_prevHighPrecision = false;
+
+    bool m_filterPending = false;
+    uint32_t m_pendingKey = 0;
+    // Blur pass programs taken so far, horizontal and vertical.
+    GLuint m_pendingBlur[2] = {0, 0};
+    bool m_pendingBlurTaken[2] = {false, false};
+
+    std::vector<LutTexture> m_luts;
+    // Set on GLES3 contexts, which keep the LUTs in 3D textures, see kFragmentShaderLut3D.
+    TexImage3DProc m_texImage3D = nullptr;
+    // Read from the UI thread by getParameters().
+    std::atomic<size_t> m_lutCount{0};
+
+    // The map is generated off the render thread and uploaded to the texture not drawn with, which
+    // then becomes m_warpTextures[m_warpFront]. Set when the front texture changed since bound.
+    WarpMap m_warpMap;
+    GLuint m_warpTextures[2] = {0, 0};
+    size_t m_warpFront = 0;
+    bool m_warpSwapped = false;
+
+    GLuint m_paletteTexture = 0;
+    GLuint m_quantizationTexture = 0;
+
+    BlurPass m_blurH{};
+    BlurPass m_blurV{};
+    bool m_blurHighPrecision = false;
+    GLuint m_blurFramebuffer = 0;
+    GLuint m_blurTexture = 0;
+    size_t m_blurWidth = 0;
+    size_t m_blurHeight = 0;
 
     std::vector<const char *> m_fragmentShader;
 };
@@ -0,0 +1,114 @@
+#include "JobSystem.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+JobSystem::JobSystem(size_t threadCount) : m_stop(false) {
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+
+    for (auto &worker: m_workers) {
+        worker.join();
+    }
+}
+
+JobSystem &JobSystem::instance() {
+    // The calling thread takes part in parallelFor(), leave it a core.
+    static JobSystem jobSystem(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+    return jobSystem;
+}
+
+void JobSystem::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_condition.notify_one();
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t, size_t)> &job) {
+    if (!count) return;
+
+    // Chunks are claimed in order by the calling thread and by helper jobs on the workers. The
+    // calling thread only ever runs chunks of this call, so a long job queued by someone else
+    // never delays it, and nested calls still finish since the caller can run every chunk itself.
+    struct state {
+        const std::function<void(size_t, size_t)> *job;
+        size_t count;
+        size_t chunkSize;
+        size_t chunks;
+        std::atomic<size_t> next;
+        size_t finished;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        // Runs chunks until none is left to claim.
+        void run() {
+            for (size_t chunk = next++; chunk < chunks; chunk = next++) {
+                size_t begin = chunk * chunkSize;
+                (*job)(begin, std::min(begin + chunkSize, count));
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++finished == chunks) done.notify_all();
+            }
+        }
+    };
+
+    // Helpers may start after the call returned, they find nothing to claim then.
+    auto shared = std::make_shared<state>();
+    shared->job = &job;
+    shared->count = count;
+    shared->chunks = std::min(count, m_workers.size() + 1);
+    shared->chunkSize = (count + shared->chunks - 1) / shared->chunks;
+    shared->chunks = (count + shared->chunkSize - 1) / shared->chunkSize;
+    shared->next = 0;
+    shared->finished = 0;
+
+    // Queued ahead of whole-frame jobs, which are in no hurry.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 1; i < shared->chunks; i++) {
+            m_jobs.push_front([shared]() { shared->run(); });
+        }
+    }
+    m_condition.notify_all();
+
+    shared->run();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->done.wait(lock, [&shared]() { return shared->finished == shared->chunks; });
+}
+
+size_t JobSystem::threadCount() const {
+    return m_workers.size();
+}
+
+void JobSystem::workerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+
+            if (m_stop && m_jobs.empty()) return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        TRACE_SCOPE("job");
+        job();
+    }
+}
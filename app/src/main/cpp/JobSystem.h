@@ -0,0 +1,41 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads shared by the CPU side processing stages.
+class JobSystem {
+public:
+    explicit JobSystem(size_t threadCount);
+
+    ~JobSystem();
+
+    static JobSystem &instance();
+
+    // Queues a job and returns immediately.
+    void submit(std::function<void()> job);
+
+    // Splits [0, count) into contiguous ranges and runs them on the workers and the calling
+    // thread. Returns when every range is done. The calling thread runs no other queued job, so
+    // whole-frame jobs from submit() never hold up a render thread calling this.
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &job);
+
+    size_t threadCount() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop;
+};
+
+#endif //_JOB_SYSTEM_H_
@@ -0,0 +1,279 @@
+#include "LumaStats.h"
+#include "JobSystem.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Per band sums, merged into luma_stats once every band is done.
+struct luma_band {
+    uint32_t histogram[256];
+    uint64_t zoneSums[luma_stats::kZoneColumns * luma_stats::kZoneRows];
+    uint64_t zoneSamples[luma_stats::kZoneColumns * luma_stats::kZoneRows];
+    int64_t laplacianSum;
+    uint64_t laplacianSquares;
+    uint64_t laplacianSamples;
+};
+
+static uint64_t row_sum(const uint8_t *row, size_t width) {
+    uint64_t sum = 0;
+    size_t x = 0;
+
+#if defined(__ARM_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; x + 16 <= width; x += 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(row + x)));
+    }
+
+    uint64x2_t pairs = vpaddlq_u32(acc);
+    sum = vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1);
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; x + 16 <= width; x += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (row + x)), zero));
+    }
+
+    sum = (uint64_t) _mm_cvtsi128_si32(acc) + (uint64_t) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+    for (; x < width; x++) sum += row[x];
+
+    return sum;
+}
+
+// Four tables, so that runs of equal samples don't wait on the same counter.
+static void histogram_row(const uint8_t *row, size_t width, uint32_t (*histograms)[256]) {
+    size_t x = 0;
+
+    for (; x + 4 <= width; x += 4) {
+        histograms[0][row[x]]++;
+        histograms[1][row[x + 1]]++;
+        histograms[2][row[x + 2]]++;
+        histograms[3][row[x + 3]]++;
+    }
+
+    for (; x < width; x++) histograms[0][row[x]]++;
+}
+
+// Sums 4 * center - left - right - up - down and its square over the inner samples of a row.
+static void laplacian_row(const uint8_t *up, const uint8_t *row, const uint8_t *down, size_t width,
+                          int64_t &sum, uint64_t &squares) {
+    size_t x = 1;
+
+#if defined(__ARM_NEON)
+    int32x4_t accSum = vdupq_n_s32(0);
+    uint64x2_t accSquares = vdupq_n_u64(0);
+    for (; x + 8 + 1 <= width; x += 8) {
+        int16x8_t center = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row + x)));
+        int16x8_t neighbours = vreinterpretq_s16_u16(vaddq_u16(
+                vaddl_u8(vld1_u8(row + x - 1), vld1_u8(row + x + 1)),
+                vaddl_u8(vld1_u8(up + x), vld1_u8(down + x))));
+        int16x8_t laplacian = vsubq_s16(vshlq_n_s16(center, 2), neighbours);
+
+        accSum = vpadalq_s16(accSum, laplacian);
+        int32x4_t low = vmull_s16(vget_low_s16(laplacian), vget_low_s16(laplacian));
+        int32x4_t high = vmull_s16(vget_high_s16(laplacian), vget_high_s16(laplacian));
+        accSquares = vpadalq_u32(accSquares, vreinterpretq_u32_s32(vaddq_s32(low, high)));
+    }
+
+    int64x2_t sums = vpaddlq_s32(accSum);
+    sum += vgetq_lane_s64(sums, 0) + vgetq_lane_s64(sums, 1);
+    squares += vgetq_lane_u64(accSquares, 0) + vgetq_lane_u64(accSquares, 1);
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i ones = _mm_set1_epi16(1);
+    __m128i accSum = zero;
+    __m128i accSquares = zero;
+    for (; x + 8 + 1 <= width; x += 8) {
+        __m128i center = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (row + x)), zero);
+        __m128i left = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (row + x - 1)), zero);
+        __m128i right = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (row + x + 1)), zero);
+        __m128i above = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (up + x)), zero);
+        __m128i below = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (down + x)), zero);
+        __m128i neighbours = _mm_add_epi16(_mm_add_epi16(left, right), _mm_add_epi16(above, below));
+        __m128i laplacian = _mm_sub_epi16(_mm_slli_epi16(center, 2), neighbours);
+
+        accSum = _mm_add_epi32(accSum, _mm_madd_epi16(laplacian, ones));
+        __m128i square = _mm_madd_epi16(laplacian, laplacian);
+        accSquares = _mm_add_epi64(accSquares, _mm_unpacklo_epi32(square, zero));
+        accSquares = _mm_add_epi64(accSquares, _mm_unpackhi_epi32(square, zero));
+    }
+
+    int32_t sumLanes[4];
+    uint64_t squareLanes[2];
+    _mm_storeu_si128((__m128i *) sumLanes, accSum);
+    _mm_storeu_si128((__m128i *) squareLanes, accSquares);
+    sum += (int64_t) sumLanes[0] + sumLanes[1] + sumLanes[2] + sumLanes[3];
+    squares += squareLanes[0] + squareLanes[1];
+#endif
+
+    for (; x + 1 < width; x++) {
+        int laplacian = 4 * row[x] - row[x - 1] - row[x + 1] - up[x] - down[x];
+        sum += laplacian;
+        squares += (uint64_t) (laplacian * laplacian);
+    }
+}
+
+LumaStats::LumaStats() : m_enabled(false), m_step(1), m_busy(false), m_valid(false), m_stats() {
+
+}
+
+LumaStats::~LumaStats() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return !m_busy; });
+}
+
+void LumaStats::setEnabled(bool enabled, size_t step) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_enabled = enabled;
+    m_step = std::max(step, (size_t) 1);
+    if (!enabled) m_valid = false;
+}
+
+void LumaStats::analyze(const FrameRef &frame) {
+    size_t step;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_enabled || m_busy || !frame) return;
+
+        m_busy = true;
+        step = m_step;
+    }
+
+    // std::function needs a copyable callable, FrameRef only moves.
+    auto held = std::make_shared<FrameRef>(frame.share());
+    JobSystem::instance().submit([this, held, step]() {
+        TRACE_SCOPE("luma stats");
+
+        luma_stats stats;
+        compute(held->planes(), step, stats);
+        stats.timestamp = held->timestamp();
+        held->reset();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats = stats;
+        m_valid = m_enabled;
+        m_busy = false;
+        m_idle.notify_all();
+    });
+}
+
+bool LumaStats::snapshot(luma_stats &stats) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_valid) return false;
+
+    stats = m_stats;
+    return true;
+}
+
+bool LumaStats::snapshot(float *values) const {
+    luma_stats stats;
+    if (!snapshot(stats)) return false;
+
+    *values++ = (float) stats.samples;
+    *values++ = stats.mean;
+    *values++ = (float) stats.shadows;
+    *values++ = (float) stats.highlights;
+    *values++ = stats.sharpness;
+    for (float zoneMean: stats.zoneMeans) *values++ = zoneMean;
+    for (uint32_t bin: stats.histogram) *values++ = (float) bin;
+
+    return true;
+}
+
+void LumaStats::compute(const video_frame &planes, size_t step, luma_stats &stats) const {
+    const size_t zoneColumns = luma_stats::kZoneColumns;
+    const size_t zoneRows = luma_stats::kZoneRows;
+    size_t width = planes.width / step;
+    size_t height = planes.height / step;
+
+    luma_band total = {};
+    std::mutex totalMutex;
+
+    JobSystem::instance().parallelFor(height, [&](size_t begin, size_t end) {
+        luma_band band = {};
+        uint32_t histograms[4][256] = {};
+
+        // Subsampled rows are gathered into a ring of three, so the kernels always see contiguous rows.
+        std::vector<uint8_t> gathered(step > 1 ? 3 * width : 0);
+        auto sampledRow = [&](size_t row) -> const uint8_t * {
+            const uint8_t *src = planes.y + row * step * planes.stride_y;
+            if (step == 1) return src;
+
+            uint8_t *dst = gathered.data() + row % 3 * width;
+            for (size_t x = 0; x < width; x++) dst[x] = src[x * step];
+            return dst;
+        };
+
+        const uint8_t *up = begin > 0 ? sampledRow(begin - 1) : nullptr;
+        const uint8_t *row = sampledRow(begin);
+        for (size_t y = begin; y < end; y++) {
+            const uint8_t *down = y + 1 < height ? sampledRow(y + 1) : nullptr;
+
+            histogram_row(row, width, histograms);
+
+            size_t zoneRow = y * zoneRows / height;
+            for (size_t zoneColumn = 0; zoneColumn < zoneColumns; zoneColumn++) {
+                size_t x0 = zoneColumn * width / zoneColumns;
+                size_t x1 = (zoneColumn + 1) * width / zoneColumns;
+                band.zoneSums[zoneRow * zoneColumns + zoneColumn] += row_sum(row + x0, x1 - x0);
+                band.zoneSamples[zoneRow * zoneColumns + zoneColumn] += x1 - x0;
+            }
+
+            if (up && down && width > 2) {
+                laplacian_row(up, row, down, width, band.laplacianSum, band.laplacianSquares);
+                band.laplacianSamples += width - 2;
+            }
+
+            up = row;
+            row = down;
+        }
+
+        std::lock_guard<std::mutex> lock(totalMutex);
+        for (size_t i = 0; i < 256; i++) {
+            total.histogram[i] += histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+        }
+        for (size_t i = 0; i < zoneColumns * zoneRows; i++) {
+            total.zoneSums[i] += band.zoneSums[i];
+            total.zoneSamples[i] += band.zoneSamples[i];
+        }
+        total.laplacianSum += band.laplacianSum;
+        total.laplacianSquares += band.laplacianSquares;
+        total.laplacianSamples += band.laplacianSamples;
+    });
+
+    memcpy(stats.histogram, total.histogram, sizeof(stats.histogram));
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < zoneColumns * zoneRows; i++) {
+        sum += total.zoneSums[i];
+        stats.zoneMeans[i] = total.zoneSamples[i] ? (float) total.zoneSums[i] / (float) total.zoneSamples[i] : 0.0f;
+    }
+
+    stats.samples = (uint32_t) (width * height);
+    stats.mean = stats.samples ? (float) sum / (float) stats.samples : 0.0f;
+
+    stats.shadows = 0;
+    stats.highlights = 0;
+    for (int i = 0; i <= luma_stats::kClipMargin; i++) {
+        stats.shadows += stats.histogram[i];
+        stats.highlights += stats.histogram[255 - i];
+    }
+
+    stats.sharpness = 0.0f;
+    if (total.laplacianSamples) {
+        double mean = (double) total.laplacianSum / (double) total.laplacianSamples;
+        double meanSquare = (double) total.laplacianSquares / (double) total.laplacianSamples;
+        stats.sharpness = (float) (meanSquare - mean * mean);
+    }
+}
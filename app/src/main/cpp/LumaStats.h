@@ -0,0 +1,68 @@
+#ifndef _LUMA_STATS_H_
+#define _LUMA_STATS_H_
+
+#include "FrameRef.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Exposure and focus statistics of the luma plane of a frame, or of every step-th sample of every
+// step-th row of it.
+struct luma_stats {
+    static const size_t kZoneColumns = 4;
+    static const size_t kZoneRows = 4;
+    // Samples within this many code values of black or white count as clipped.
+    static const int kClipMargin = 4;
+
+    uint32_t histogram[256];
+    // Mean luma per zone of a kZoneColumns x kZoneRows grid, row by row from the top left.
+    float zoneMeans[kZoneColumns * kZoneRows];
+    float mean;
+    uint32_t samples;
+    uint32_t shadows;
+    uint32_t highlights;
+    // Variance of the 4-neighbour Laplacian over the sampled grid, higher when in focus.
+    float sharpness;
+    int64_t timestamp;
+};
+
+// Computes luma_stats of ingested frames on the JobSystem, off the caller's thread. A frame that
+// arrives while the previous one is still being analyzed is skipped.
+class LumaStats {
+public:
+    // Values in snapshot(float *): sample count, mean, shadow and highlight sample counts, sharpness,
+    // the zone means, then the 256 histogram bins.
+    static const size_t kValueCount = 5 + luma_stats::kZoneColumns * luma_stats::kZoneRows + 256;
+
+    LumaStats();
+
+    // Waits for the analysis in flight.
+    ~LumaStats();
+
+    // Off by default. step 1 reads every sample, larger steps subsample both ways.
+    void setEnabled(bool enabled, size_t step);
+
+    // Holds another reference to frame until its analysis is done.
+    void analyze(const FrameRef &frame);
+
+    // The statistics of the last analyzed frame, false when there are none.
+    bool snapshot(luma_stats &stats) const;
+
+    // Fills kValueCount values as above.
+    bool snapshot(float *values) const;
+
+private:
+    void compute(const video_frame &planes, size_t step, luma_stats &stats) const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    bool m_enabled;
+    size_t m_step;
+    bool m_busy;
+    bool m_valid;
+    luma_stats m_stats;
+};
+
+#endif //_LUMA_STATS_H_
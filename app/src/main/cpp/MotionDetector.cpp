@@ -0,0 +1,388 @@
+#include "MotionDetector.h"
+#include "JobSystem.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The background moves 1/16 of the way to each analyzed frame, absorbing lighting changes within a
+// second or so at camera rates.
+static const int kAdaptShift = 4;
+
+// A block moved when more than 1/8 of its pixels did.
+static const uint32_t kBlockShare = 8;
+
+// Analyzed frames below the trigger before motion counts as stopped.
+static const size_t kReleaseFrames = 15;
+
+// Sums scale rows of src into sums, width samples each.
+static void sum_rows(const uint8_t *src, size_t stride, size_t scale, size_t width, uint16_t *sums) {
+    for (size_t x = 0; x < width; x++) sums[x] = src[x];
+
+    for (size_t row = 1; row < scale; row++) {
+        const uint8_t *line = src + row * stride;
+        size_t x = 0;
+
+#if defined(__ARM_NEON)
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t pixels = vld1q_u8(line + x);
+            vst1q_u16(sums + x, vaddw_u8(vld1q_u16(sums + x), vget_low_u8(pixels)));
+            vst1q_u16(sums + x + 8, vaddw_u8(vld1q_u16(sums + x + 8), vget_high_u8(pixels)));
+        }
+#elif defined(__SSE2__)
+        __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= width; x += 16) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) (line + x));
+            __m128i low = _mm_loadu_si128((const __m128i *) (sums + x));
+            __m128i high = _mm_loadu_si128((const __m128i *) (sums + x + 8));
+            _mm_storeu_si128((__m128i *) (sums + x), _mm_add_epi16(low, _mm_unpacklo_epi8(pixels, zero)));
+            _mm_storeu_si128((__m128i *) (sums + x + 8), _mm_add_epi16(high, _mm_unpackhi_epi8(pixels, zero)));
+        }
+#endif
+
+        for (; x < width; x++) sums[x] += line[x];
+    }
+}
+
+// Adds neighbouring pairs of the count sums, count / 2 sums are left at the start. Sums stay below 65536.
+static void sum_pairs(uint16_t *sums, size_t count) {
+    size_t x = 0;
+
+#if defined(__ARM_NEON)
+    for (; x + 16 <= count; x += 16) {
+        uint16x8x2_t pairs = vuzpq_u16(vld1q_u16(sums + x), vld1q_u16(sums + x + 8));
+        vst1q_u16(sums + x / 2, vaddq_u16(pairs.val[0], pairs.val[1]));
+    }
+#elif defined(__SSE2__)
+    // Pairs add up in 32-bit lanes, biased so that the signed pack keeps them.
+    __m128i low = _mm_set1_epi32(0xffff);
+    __m128i bias32 = _mm_set1_epi32(0x8000);
+    __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (sums + x));
+        __m128i b = _mm_loadu_si128((const __m128i *) (sums + x + 8));
+        a = _mm_sub_epi32(_mm_add_epi32(_mm_and_si128(a, low), _mm_srli_epi32(a, 16)), bias32);
+        b = _mm_sub_epi32(_mm_add_epi32(_mm_and_si128(b, low), _mm_srli_epi32(b, 16)), bias32);
+        _mm_storeu_si128((__m128i *) (sums + x / 2), _mm_add_epi16(_mm_packs_epi32(a, b), bias16));
+    }
+#endif
+
+    for (; x + 2 <= count; x += 2) sums[x / 2] = (uint16_t) (sums[x] + sums[x + 1]);
+}
+
+// Box filters row y of the downscaled plane out of the luma plane.
+static void downscale_row(const video_frame &planes, size_t y, size_t scale, size_t width, uint16_t *sums,
+                          uint8_t *dst) {
+    const uint8_t *src = planes.y + y * scale * planes.stride_y;
+    if (scale == 1) {
+        memcpy(dst, src, width);
+        return;
+    }
+
+    sum_rows(src, planes.stride_y, scale, width * scale, sums);
+
+    // Power of two boxes halve the sums pairwise and divide with a shift.
+    if (!(scale & (scale - 1))) {
+        size_t shift = 0;
+        for (size_t count = width * scale; count > width; count /= 2, shift++) sum_pairs(sums, count);
+
+        for (size_t x = 0; x < width; x++) {
+            dst[x] = (uint8_t) ((sums[x] + (1u << (2 * shift) >> 1)) >> (2 * shift));
+        }
+        return;
+    }
+
+    // Fixed point division by the box area, rounded.
+    uint32_t area = (uint32_t) (scale * scale);
+    uint32_t reciprocal = ((1u << 16) + area / 2) / area;
+    for (size_t x = 0; x < width; x++) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < scale; i++) sum += sums[x * scale + i];
+        dst[x] = (uint8_t) std::min((sum * reciprocal + (1u << 15)) >> 16, 255u);
+    }
+}
+
+// Marks the samples of row more than threshold off the background with 0xff, then moves the background
+// towards row.
+static void diff_row(const uint8_t *row, uint8_t *background, size_t width, uint8_t threshold, uint8_t *moved) {
+    size_t x = 0;
+
+#if defined(__ARM_NEON)
+    uint8x16_t limit = vdupq_n_u8(threshold);
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t current = vld1q_u8(row + x);
+        uint8x16_t model = vld1q_u8(background + x);
+        vst1q_u8(moved + x, vcgtq_u8(vabdq_u8(current, model), limit));
+
+        int16x8_t low = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(current), vget_low_u8(model)));
+        int16x8_t high = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(current), vget_high_u8(model)));
+        low = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(model))), vrshrq_n_s16(low, kAdaptShift));
+        high = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(model))), vrshrq_n_s16(high, kAdaptShift));
+        vst1q_u8(background + x, vcombine_u8(vqmovun_s16(low), vqmovun_s16(high)));
+    }
+#elif defined(__SSE2__)
+    // Unsigned compares through the sign bit.
+    __m128i zero = _mm_setzero_si128();
+    __m128i sign = _mm_set1_epi8((char) 0x80);
+    __m128i limit = _mm_set1_epi8((char) (threshold ^ 0x80));
+    __m128i rounding = _mm_set1_epi16(1 << (kAdaptShift - 1));
+    for (; x + 16 <= width; x += 16) {
+        __m128i current = _mm_loadu_si128((const __m128i *) (row + x));
+        __m128i model = _mm_loadu_si128((const __m128i *) (background + x));
+        __m128i difference = _mm_or_si128(_mm_subs_epu8(current, model), _mm_subs_epu8(model, current));
+        _mm_storeu_si128((__m128i *) (moved + x), _mm_cmpgt_epi8(_mm_xor_si128(difference, sign), limit));
+
+        __m128i modelLow = _mm_unpacklo_epi8(model, zero);
+        __m128i modelHigh = _mm_unpackhi_epi8(model, zero);
+        __m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(current, zero), modelLow);
+        __m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(current, zero), modelHigh);
+        low = _mm_add_epi16(modelLow, _mm_srai_epi16(_mm_add_epi16(low, rounding), kAdaptShift));
+        high = _mm_add_epi16(modelHigh, _mm_srai_epi16(_mm_add_epi16(high, rounding), kAdaptShift));
+        _mm_storeu_si128((__m128i *) (background + x), _mm_packus_epi16(low, high));
+    }
+#endif
+
+    for (; x < width; x++) {
+        int difference = row[x] - background[x];
+        moved[x] = std::abs(difference) > threshold ? 0xff : 0;
+        background[x] = (uint8_t) (background[x] + ((difference + (1 << (kAdaptShift - 1))) >> kAdaptShift));
+    }
+}
+
+MotionDetector::MotionDetector()
+        : m_enabled(false), m_threshold(0), m_trigger(0.0f), m_busy(false), m_mapColumns(0), m_width(0),
+          m_height(0), m_columns(0), m_rows(0), m_reset(true), m_active(false), m_quietFrames(0) {
+
+}
+
+MotionDetector::~MotionDetector() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return !m_busy; });
+}
+
+void MotionDetector::setEnabled(bool enabled, int threshold, float trigger, const motion_callback &callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_enabled = enabled;
+    m_threshold = std::min(std::max(threshold, 0), 254);
+    m_trigger = std::min(std::max(trigger, 0.0f), 1.0f);
+    m_callback = enabled ? callback : nullptr;
+
+    // The background is stale by the time detection is turned on again.
+    if (!enabled) {
+        m_reset = true;
+        m_map.clear();
+    }
+}
+
+void MotionDetector::analyze(const FrameRef &frame) {
+    int threshold;
+    float trigger;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_enabled || m_busy || !frame) return;
+
+        m_busy = true;
+        threshold = m_threshold;
+        trigger = m_trigger;
+    }
+
+    // std::function needs a copyable callable, FrameRef only moves.
+    auto held = std::make_shared<FrameRef>(frame.share());
+    JobSystem::instance().submit([this, held, threshold, trigger]() {
+        motion_event event;
+        bool changed = update(held->planes(), threshold, trigger, event);
+        event.timestamp = held->timestamp();
+        held->reset();
+
+        motion_callback callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (changed && m_enabled) callback = m_callback;
+        }
+
+        // Called before the detector counts as idle, so no callback outlives it.
+        if (callback) callback(event);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy = false;
+        m_idle.notify_all();
+    });
+}
+
+bool MotionDetector::update(const video_frame &planes, int threshold, float trigger, motion_event &event) {
+    TRACE_SCOPE("motion");
+
+    size_t scale = std::max((planes.width + kMaxWidth - 1) / kMaxWidth, (size_t) 1);
+    size_t width = planes.width / scale;
+    size_t height = planes.height / scale;
+    if (!width || !height) return false;
+
+    bool reset;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        reset = m_reset || width != m_width || height != m_height;
+        m_reset = false;
+    }
+
+    if (reset) {
+        m_width = width;
+        m_height = height;
+        m_columns = (width + kBlockSize - 1) / kBlockSize;
+        m_rows = (height + kBlockSize - 1) / kBlockSize;
+        m_background.resize(width * height);
+        m_counts.assign(m_columns * m_rows, 0);
+        m_active = false;
+        m_quietFrames = 0;
+    }
+
+    // Bands of block rows, so every band owns the counts it writes.
+    auto limit = (uint8_t) std::min(std::max(threshold, 0), 254);
+    JobSystem::instance().parallelFor(m_rows, [&](size_t begin, size_t end) {
+        std::unique_ptr<uint16_t[]> sums(new uint16_t[width * scale]);
+        std::unique_ptr<uint8_t[]> row(new uint8_t[width]);
+        // Padded to whole blocks, the padding never moves.
+        std::unique_ptr<uint8_t[]> moved(new uint8_t[m_columns * kBlockSize]());
+
+        for (size_t blockRow = begin; blockRow < end; blockRow++) {
+            uint32_t *counts = &m_counts[blockRow * m_columns];
+            std::fill(counts, counts + m_columns, 0);
+
+            size_t y1 = std::min((blockRow + 1) * kBlockSize, height);
+            for (size_t y = blockRow * kBlockSize; y < y1; y++) {
+                uint8_t *background = &m_background[y * width];
+                downscale_row(planes, y, scale, width, sums.get(), row.get());
+
+                if (reset) {
+                    memcpy(background, row.get(), width);
+                    continue;
+                }
+
+                diff_row(row.get(), background, width, limit, moved.get());
+                for (size_t column = 0; column < m_columns; column++) {
+                    uint64_t bits;
+                    memcpy(&bits, moved.get() + column * kBlockSize, sizeof(bits));
+                    counts[column] += (uint32_t) __builtin_popcountll(bits) / 8;
+                }
+            }
+        }
+    });
+
+    if (reset) return false;
+
+    findBoxes(planes.width, planes.height, scale, event);
+
+    // Hysteresis, so that a pause in the motion doesn't end it.
+    if (!m_active && event.level > 0.0f && event.level >= trigger) {
+        m_active = true;
+        m_quietFrames = 0;
+    } else if (m_active && (event.level == 0.0f || event.level < trigger)) {
+        if (++m_quietFrames < kReleaseFrames) return false;
+        m_active = false;
+    } else {
+        m_quietFrames = 0;
+        return false;
+    }
+
+    event.active = m_active;
+    return true;
+}
+
+void MotionDetector::findBoxes(size_t frameWidth, size_t frameHeight, size_t scale, motion_event &event) {
+    size_t blockCount = m_columns * m_rows;
+    std::vector<uint8_t> map(blockCount);
+    size_t moving = 0;
+
+    for (size_t blockRow = 0; blockRow < m_rows; blockRow++) {
+        size_t blockHeight = std::min(kBlockSize, m_height - blockRow * kBlockSize);
+        for (size_t column = 0; column < m_columns; column++) {
+            size_t blockWidth = std::min(kBlockSize, m_width - column * kBlockSize);
+            size_t i = blockRow * m_columns + column;
+            map[i] = m_counts[i] * kBlockShare > blockWidth * blockHeight;
+            moving += map[i];
+        }
+    }
+
+    event.level = (float) moving / (float) blockCount;
+    event.boxCount = 0;
+
+    // 4-connected groups of moving blocks, flood filled on the small map.
+    struct group {
+        size_t x0, y0, x1, y1;
+        size_t blocks;
+    };
+    std::vector<group> groups;
+    std::vector<uint8_t> visited(blockCount);
+    std::vector<size_t> stack;
+
+    for (size_t start = 0; start < blockCount && moving; start++) {
+        if (!map[start] || visited[start]) continue;
+
+        group found{m_columns, m_rows, 0, 0, 0};
+        visited[start] = 1;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+
+            size_t x = i % m_columns;
+            size_t y = i / m_columns;
+            found.x0 = std::min(found.x0, x);
+            found.y0 = std::min(found.y0, y);
+            found.x1 = std::max(found.x1, x + 1);
+            found.y1 = std::max(found.y1, y + 1);
+            found.blocks++;
+
+            const size_t neighbours[4] = {
+                    x > 0 ? i - 1 : blockCount,
+                    x + 1 < m_columns ? i + 1 : blockCount,
+                    y > 0 ? i - m_columns : blockCount,
+                    y + 1 < m_rows ? i + m_columns : blockCount,
+            };
+            for (size_t neighbour: neighbours) {
+                if (neighbour < blockCount && map[neighbour] && !visited[neighbour]) {
+                    visited[neighbour] = 1;
+                    stack.push_back(neighbour);
+                }
+            }
+        }
+
+        groups.push_back(found);
+    }
+
+    std::sort(groups.begin(), groups.end(), [](const group &a, const group &b) { return a.blocks > b.blocks; });
+
+    // Blocks back to frame pixels, the last ones cover what the downscale left out.
+    size_t blockPixels = kBlockSize * scale;
+    for (const group &found: groups) {
+        if (event.boxCount == motion_event::kMaxBoxes) break;
+
+        size_t x1 = found.x1 == m_columns ? frameWidth : std::min(found.x1 * blockPixels, frameWidth);
+        size_t y1 = found.y1 == m_rows ? frameHeight : std::min(found.y1 * blockPixels, frameHeight);
+        motion_box &box = event.boxes[event.boxCount++];
+        box.x = (uint32_t) (found.x0 * blockPixels);
+        box.y = (uint32_t) (found.y0 * blockPixels);
+        box.width = (uint32_t) (x1 - box.x);
+        box.height = (uint32_t) (y1 - box.y);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_map.swap(map);
+    m_mapColumns = m_columns;
+}
+
+size_t MotionDetector::snapshot(std::vector<uint8_t> &map) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_map.empty()) return 0;
+
+    map = m_map;
+    return m_mapColumns;
+}
@@ -0,0 +1,91 @@
+#ifndef _MOTION_DETECTOR_H_
+#define _MOTION_DETECTOR_H_
+
+#include "FrameRef.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// A region that moved, in luma pixels of the ingested frame before any rotation.
+struct motion_box {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct motion_event {
+    static const size_t kMaxBoxes = 8;
+
+    // True when motion started, false when it stopped.
+    bool active;
+    // Share of the motion map blocks that moved.
+    float level;
+    // Regions of connected moving blocks, largest first.
+    motion_box boxes[kMaxBoxes];
+    size_t boxCount;
+    int64_t timestamp;
+};
+
+typedef std::function<void(const motion_event &event)> motion_callback;
+
+// Finds motion in ingested frames against a background that follows slow changes, on a downscaled
+// copy of the luma plane at most kMaxWidth wide. Moving pixels are counted in blocks of kBlockSize
+// downscaled pixels, the motion map. Frames that arrive while one is analyzed are skipped.
+class MotionDetector {
+public:
+    static const size_t kMaxWidth = 480;
+    static const size_t kBlockSize = 8;
+
+    MotionDetector();
+
+    // Waits for the analysis in flight.
+    ~MotionDetector();
+
+    // Off by default. Pixels more than threshold code values off the background move, and motion
+    // starts once a share of trigger of the blocks moved. callback runs on a JobSystem thread when
+    // motion starts and once it stopped for a while, with the boxes of the frame that tripped it.
+    void setEnabled(bool enabled, int threshold, float trigger, const motion_callback &callback);
+
+    // Holds another reference to frame until its analysis is done.
+    void analyze(const FrameRef &frame);
+
+    // Analyzes planes on the caller's thread, spreading rows over the JobSystem. Returns true with
+    // event filled when motion started or stopped. The first frame of a size only sets the background.
+    bool update(const video_frame &planes, int threshold, float trigger, motion_event &event);
+
+    // The motion map of the last analyzed frame, 1 for each block that moved row by row from the top
+    // left. Returns the number of columns, 0 when there is no map.
+    size_t snapshot(std::vector<uint8_t> &map) const;
+
+private:
+    // Turns the block counts into the motion map and the boxes of its connected blocks.
+    void findBoxes(size_t frameWidth, size_t frameHeight, size_t scale, motion_event &event);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    bool m_enabled;
+    int m_threshold;
+    float m_trigger;
+    motion_callback m_callback;
+    bool m_busy;
+
+    // Touched only by update(), except m_map and m_mapColumns which are guarded by m_mutex.
+    std::vector<uint8_t> m_background;
+    std::vector<uint32_t> m_counts;
+    std::vector<uint8_t> m_map;
+    size_t m_mapColumns;
+    size_t m_width;
+    size_t m_height;
+    size_t m_columns;
+    size_t m_rows;
+    bool m_reset;
+    bool m_active;
+    size_t m_quietFrames;
+};
+
+#endif //_MOTION_DETECTOR_H_
@@ -0,0 +1,470 @@
+#include "PixelFormat.h"
+#include "CommonUtils.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "PixelKernels.h"
+#include "Trace.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+// getauxval(AT_HWCAP) bits, spelled out as not every NDK's headers have them.
+#if defined(__aarch64__)
+static const unsigned long kHwcapAsimdDotProd = 1ul << 20;
+#elif defined(__arm__)
+static const unsigned long kHwcapNeon = 1ul << 12;
+#endif
+
+size_t pixel_kernels_supported(const pixel_kernels **sets, size_t maxCount) {
+#if defined(__aarch64__) || defined(__arm__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+#endif
+    const pixel_kernels *candidates[] = {
+            pixel_kernels_scalar(),
+#if defined(__aarch64__)
+            pixel_kernels_neon(),
+            hwcap & kHwcapAsimdDotProd ? pixel_kernels_neon_dotprod() : nullptr,
+#elif defined(__arm__)
+            hwcap & kHwcapNeon ? pixel_kernels_neon() : nullptr,
+#elif defined(__i386__) || defined(__x86_64__)
+            __builtin_cpu_supports("sse4.1") ? pixel_kernels_sse41() : nullptr,
+            __builtin_cpu_supports("avx2") ? pixel_kernels_avx2() : nullptr,
+#endif
+    };
+
+    size_t count = 0;
+    for (const pixel_kernels *kernels : candidates) {
+        if (kernels != nullptr && count < maxCount) sets[count++] = kernels;
+    }
+    return count;
+}
+
+const pixel_kernels &pixel_kernels_best() {
+    static const pixel_kernels *best = []() {
+        const pixel_kernels *sets[4];
+        const pixel_kernels *kernels = sets[pixel_kernels_supported(sets, 4) - 1];
+        LOGI("Pixel format conversion with %s kernels", kernels->name);
+        return kernels;
+    }();
+
+    return *best;
+}
+
+static bool is_yuv(PixelFormat format) {
+    return format == pxI420 || format == pxNV12 || format == pxNV21 || format == pxYUYV;
+}
+
+static size_t plane_count(PixelFormat format) {
+    switch (format) {
+        case pxI420:
+            return 3;
+        case pxNV12:
+        case pxNV21:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Image rows per row of the plane, 2 for 4:2:0 chroma as only those formats have more planes.
+static size_t plane_subsampling(size_t plane) {
+    return plane > 0 ? 2 : 1;
+}
+
+static size_t plane_row_bytes(PixelFormat format, size_t plane, size_t width) {
+    switch (format) {
+        case pxI420:
+            return plane > 0 ? width / 2 : width;
+        case pxYUYV:
+        case pxRGB565:
+            return width * 2;
+        case pxRGBA:
+            return width * 4;
+        default:
+            return width;
+    }
+}
+
+size_t pixel_image_size(PixelFormat format, size_t width, size_t height) {
+    size_t size = 0;
+    for (size_t plane = 0; plane < plane_count(format); plane++) {
+        size += plane_row_bytes(format, plane, width) * (height / plane_subsampling(plane));
+    }
+    return size;
+}
+
+pixel_image pixel_image_packed(PixelFormat format, size_t width, size_t height, uint8_t *data) {
+    pixel_image image = {format, width, height, {nullptr, nullptr, nullptr}, {0, 0, 0}};
+    for (size_t plane = 0; plane < plane_count(format); plane++) {
+        image.planes[plane] = data;
+        image.strides[plane] = plane_row_bytes(format, plane, width);
+        data += image.strides[plane] * (height / plane_subsampling(plane));
+    }
+    return image;
+}
+
+bool pixel_image_from_frame(const video_frame &frame, pixel_image &image) {
+    image = {pxI420, frame.width, frame.height, {frame.y, frame.u, frame.v},
+             {frame.stride_y, frame.stride_uv, frame.stride_uv}};
+
+    if (frame.pixel_stride_uv == 1) return true;
+    if (frame.pixel_stride_uv != 2) return false;
+
+    image.format = frame.v == frame.u + 1 ? pxNV12 : pxNV21;
+    if (image.format == pxNV21 && frame.u != frame.v + 1) return false;
+
+    image.planes[1] = image.format == pxNV12 ? frame.u : frame.v;
+    image.planes[2] = nullptr;
+    image.strides[2] = 0;
+    return true;
+}
+
+// Bytes per element of a plane, the unit rotations move around. YUYV has none as its pixels share chroma.
+static size_t plane_element_size(PixelFormat format, size_t plane) {
+    switch (format) {
+        case pxNV12:
+        case pxNV21:
+            return plane > 0 ? 2 : 1;
+        case pxRGB565:
+            return 2;
+        case pxRGBA:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+static uint8_t *image_row(const pixel_image &image, size_t plane, size_t row) {
+    return image.planes[plane] + row / plane_subsampling(plane) * image.strides[plane];
+}
+
+// The count rows of image from row on, as an image of its own.
+static pixel_image image_band(const pixel_image &image, size_t row, size_t count) {
+    pixel_image band = image;
+    band.height = count;
+    for (size_t plane = 0; plane < plane_count(image.format); plane++) {
+        band.planes[plane] = image_row(image, plane, row);
+    }
+    return band;
+}
+
+// Rows of a pair on their way between formats, luma and one chroma sample per two pixels per row.
+// Both rows point at the same chroma when it is 4:2:0.
+struct yuv_rows {
+    const uint8_t *y[2];
+    const uint8_t *u[2];
+    const uint8_t *v[2];
+};
+
+// Per band row buffers, for two rows each.
+struct conversion_scratch {
+    explicit conversion_scratch(size_t width) : y(width * 2), u(width), v(width), rgba(width * 8) {}
+
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> u;
+    std::vector<uint8_t> v;
+    std::vector<uint8_t> rgba;
+};
+
+// Points rgba at the pair of rows from row on of an RGBA or RGB565 image.
+static void read_rgba_rows(const pixel_kernels &kernels, const pixel_image &src, size_t row,
+                           conversion_scratch &scratch, const uint8_t **rgba) {
+    for (size_t i = 0; i < 2; i++) {
+        if (src.format == pxRGBA) {
+            rgba[i] = image_row(src, 0, row + i);
+        } else {
+            uint8_t *converted = scratch.rgba.data() + i * src.width * 4;
+            kernels.rgb565_to_rgba(image_row(src, 0, row + i), converted, src.width);
+            rgba[i] = converted;
+        }
+    }
+}
+
+// The pair of rows from row on as YUV. With subsample, the chroma of both rows is merged as 4:2:0 needs.
+static void read_yuv_rows(const pixel_kernels &kernels, const pixel_image &src, size_t row, bool subsample,
+                          conversion_scratch &scratch, yuv_rows &rows) {
+    size_t width = src.width;
+    size_t chroma = width / 2;
+    uint8_t *y = scratch.y.data();
+    uint8_t *u = scratch.u.data();
+    uint8_t *v = scratch.v.data();
+
+    switch (src.format) {
+        case pxI420:
+            for (size_t i = 0; i < 2; i++) {
+                rows.y[i] = image_row(src, 0, row + i);
+                rows.u[i] = image_row(src, 1, row);
+                rows.v[i] = image_row(src, 2, row);
+            }
+            return;
+        case pxNV12:
+        case pxNV21:
+            kernels.split_uv(image_row(src, 1, row), src.format == pxNV12 ? u : v, src.format == pxNV12 ? v : u,
+                             chroma);
+            for (size_t i = 0; i < 2; i++) {
+                rows.y[i] = image_row(src, 0, row + i);
+                rows.u[i] = u;
+                rows.v[i] = v;
+            }
+            return;
+        case pxYUYV: {
+            const uint8_t *yuyv[2] = {image_row(src, 0, row), image_row(src, 0, row + 1)};
+            for (size_t i = 0; i < 2; i++) {
+                kernels.yuyv_to_y(yuyv[i], y + i * width, width);
+                rows.y[i] = y + i * width;
+
+                size_t offset = subsample ? 0 : i * chroma;
+                if (i == 0 || !subsample) {
+                    kernels.yuyv_to_uv(yuyv[i], yuyv[subsample ? 1 : i], u + offset, v + offset, width);
+                }
+                rows.u[i] = u + offset;
+                rows.v[i] = v + offset;
+            }
+            return;
+        }
+        default: {
+            const uint8_t *rgba[2];
+            read_rgba_rows(kernels, src, row, scratch, rgba);
+            for (size_t i = 0; i < 2; i++) {
+                kernels.rgba_to_y(rgba[i], y + i * width, width);
+                rows.y[i] = y + i * width;
+
+                size_t offset = subsample ? 0 : i * chroma;
+                if (i == 0 || !subsample) {
+                    kernels.rgba_to_uv(rgba[i], rgba[subsample ? 1 : i], u + offset, v + offset, width);
+                }
+                rows.u[i] = u + offset;
+                rows.v[i] = v + offset;
+            }
+            return;
+        }
+    }
+}
+
+static void write_yuv_rows(const pixel_kernels &kernels, const yuv_rows &rows, const pixel_image &dst, size_t row,
+                           conversion_scratch &scratch) {
+    size_t width = dst.width;
+
+    switch (dst.format) {
+        case pxI420:
+            for (size_t i = 0; i < 2; i++) memcpy(image_row(dst, 0, row + i), rows.y[i], width);
+            memcpy(image_row(dst, 1, row), rows.u[0], width / 2);
+            memcpy(image_row(dst, 2, row), rows.v[0], width / 2);
+            return;
+        case pxNV12:
+        case pxNV21:
+            for (size_t i = 0; i < 2; i++) memcpy(image_row(dst, 0, row + i), rows.y[i], width);
+            kernels.merge_uv(dst.format == pxNV12 ? rows.u[0] : rows.v[0],
+                             dst.format == pxNV12 ? rows.v[0] : rows.u[0], image_row(dst, 1, row), width / 2);
+            return;
+        case pxYUYV:
+            for (size_t i = 0; i < 2; i++) {
+                kernels.yuv_to_yuyv(rows.y[i], rows.u[i], rows.v[i], image_row(dst, 0, row + i), width);
+            }
+            return;
+        case pxRGBA:
+            for (size_t i = 0; i < 2; i++) {
+                kernels.yuv_to_rgba(rows.y[i], rows.u[i], rows.v[i], image_row(dst, 0, row + i), width);
+            }
+            return;
+        case pxRGB565:
+            for (size_t i = 0; i < 2; i++) {
+                kernels.yuv_to_rgba(rows.y[i], rows.u[i], rows.v[i], scratch.rgba.data(), width);
+                kernels.rgba_to_rgb565(scratch.rgba.data(), image_row(dst, 0, row + i), width);
+            }
+            return;
+    }
+}
+
+static bool check_rows(const pixel_image &src, const pixel_image &dst, size_t row, size_t count) {
+    if (src.width != dst.width || src.height != dst.height || (src.width | src.height | row | count) & 1 ||
+        row + count > src.height) {
+        LOGE("Can't convert rows %zu to %zu of a %zux%zu image to %zux%zu", row, row + count, src.width,
+             src.height, dst.width, dst.height);
+        return false;
+    }
+    return true;
+}
+
+bool convert_pixel_rows(const pixel_kernels &kernels, const pixel_image &src, const pixel_image &dst, size_t row,
+                        size_t count) {
+    if (!check_rows(src, dst, row, count)) return false;
+    if (!count) return true;
+
+    if (src.format == dst.format) {
+        for (size_t plane = 0; plane < plane_count(src.format); plane++) {
+            size_t subsampling = plane_subsampling(plane);
+            copy_plane(image_row(dst, plane, row), dst.strides[plane], image_row(src, plane, row),
+                       src.strides[plane], plane_row_bytes(src.format, plane, src.width), count / subsampling);
+        }
+        return true;
+    }
+
+    conversion_scratch scratch(src.width);
+    bool subsample = dst.format != pxYUYV;
+
+    for (size_t pair = row; pair < row + count; pair += 2) {
+        if (is_yuv(src.format) || is_yuv(dst.format)) {
+            yuv_rows rows;
+            read_yuv_rows(kernels, src, pair, subsample && is_yuv(dst.format), scratch, rows);
+            write_yuv_rows(kernels, rows, dst, pair, scratch);
+            continue;
+        }
+
+        // RGBA and RGB565 convert directly.
+        for (size_t i = 0; i < 2; i++) {
+            if (src.format == pxRGBA) {
+                kernels.rgba_to_rgb565(image_row(src, 0, pair + i), image_row(dst, 0, pair + i), src.width);
+            } else {
+                kernels.rgb565_to_rgba(image_row(src, 0, pair + i), image_row(dst, 0, pair + i), src.width);
+            }
+        }
+    }
+    return true;
+}
+
+bool convert_pixel_rows(const pixel_image &src, const pixel_image &dst, size_t row, size_t count) {
+    return convert_pixel_rows(pixel_kernels_best(), src, dst, row, count);
+}
+
+bool convert_pixel_image(const pixel_image &src, const pixel_image &dst) {
+    TRACE_SCOPE("convert pixels");
+
+    if (!check_rows(src, dst, 0, src.height)) return false;
+
+    const pixel_kernels &kernels = pixel_kernels_best();
+    JobSystem::instance().parallelFor(src.height / 2, [&](size_t begin, size_t end) {
+        convert_pixel_rows(kernels, src, dst, begin * 2, (end - begin) * 2);
+    });
+    return true;
+}
+
+// Rows of a rotated image run down or up the columns of the source for 90 and 270, which is a
+// transpose with either side flipped by a negative stride. Bands of this many rows read runs of a few
+// cache lines from each source row, and keep the rows being written, or the band converted after
+// rotating, in L2.
+static const size_t kRotateBand = 256;
+
+static bool check_rotation(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror, size_t row,
+                           size_t count) {
+    if (rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270) {
+        LOGE("Can't rotate by %d degrees", rotation);
+        return false;
+    }
+    if (src.format == pxYUYV && (rotation || mirror)) {
+        LOGE("Can't rotate YUYV images");
+        return false;
+    }
+
+    bool swap = rotation == 90 || rotation == 270;
+    if ((swap ? src.height : src.width) != dst.width || (swap ? src.width : src.height) != dst.height ||
+        (src.width | src.height | row | count) & 1 || row + count > dst.height) {
+        LOGE("Can't rotate rows %zu to %zu of a %zux%zu image by %d to %zux%zu", row, row + count, src.width,
+             src.height, rotation, dst.width, dst.height);
+        return false;
+    }
+    return true;
+}
+
+// Writes count rows of a plane from row on to dst, which points at the first of them. width and
+// height are those of the source plane in elements of size bytes.
+static void rotate_plane(const pixel_kernels &kernels, const uint8_t *src, size_t srcStride, size_t width,
+                         size_t height, size_t size, uint8_t *dst, size_t dstStride, int rotation, bool mirror,
+                         size_t row, size_t count) {
+    auto transpose = size == 1 ? kernels.transpose_8 : size == 2 ? kernels.transpose_16 : kernels.transpose_32;
+    auto reverse = size == 1 ? kernels.reverse_8 : size == 2 ? kernels.reverse_16 : kernels.reverse_32;
+    ptrdiff_t down = (ptrdiff_t) srcStride;
+    const uint8_t *last = src + (height - 1) * srcStride;
+
+    switch (rotation) {
+        case 90:
+            // Row r is column r, bottom up, or top down when mirrored.
+            transpose(mirror ? src + row * size : last + row * size, mirror ? down : -down, dst,
+                      (ptrdiff_t) dstStride, count, height);
+            return;
+        case 270: {
+            // Row r is column width - 1 - r, top down, or bottom up when mirrored. The block's first
+            // column is the band's last row.
+            size_t column = width - row - count;
+            transpose(mirror ? last + column * size : src + column * size, mirror ? -down : down,
+                      dst + (count - 1) * dstStride, -(ptrdiff_t) dstStride, count, height);
+            return;
+        }
+        default: {
+            bool flip = rotation == 180;
+            for (size_t r = row; r < row + count; r++) {
+                const uint8_t *line = src + (flip ? height - 1 - r : r) * srcStride;
+                uint8_t *out = dst + (r - row) * dstStride;
+                if (flip != mirror) {
+                    reverse(line, out, width);
+                } else {
+                    memcpy(out, line, width * size);
+                }
+            }
+            return;
+        }
+    }
+}
+
+// Rotates into band, which holds rows row to row + band.height of the rotated image in src's format.
+static void rotate_planes(const pixel_kernels &kernels, const pixel_image &src, const pixel_image &band,
+                          int rotation, bool mirror, size_t row) {
+    for (size_t plane = 0; plane < plane_count(src.format); plane++) {
+        size_t subsampling = plane_subsampling(plane);
+        rotate_plane(kernels, src.planes[plane], src.strides[plane], src.width / subsampling,
+                     src.height / subsampling, plane_element_size(src.format, plane), band.planes[plane],
+                     band.strides[plane], rotation, mirror, row / subsampling, band.height / subsampling);
+    }
+}
+
+bool rotate_pixel_rows(const pixel_kernels &kernels, const pixel_image &src, const pixel_image &dst, int rotation,
+                       bool mirror, size_t row, size_t count) {
+    if (!check_rotation(src, dst, rotation, mirror, row, count)) return false;
+    if (!count) return true;
+    if (!rotation && !mirror) return convert_pixel_rows(kernels, src, dst, row, count);
+
+    // Converting formats rotates each band in src's format first and converts it while in cache.
+    std::vector<uint8_t> data;
+    pixel_image rotated{};
+    if (src.format != dst.format) {
+        data.resize(pixel_image_size(src.format, dst.width, kRotateBand));
+        rotated = pixel_image_packed(src.format, dst.width, kRotateBand, data.data());
+    }
+
+    for (size_t band = row; band < row + count; band += kRotateBand) {
+        size_t rows = row + count - band < kRotateBand ? row + count - band : kRotateBand;
+        if (src.format == dst.format) {
+            rotate_planes(kernels, src, image_band(dst, band, rows), rotation, mirror, band);
+        } else {
+            rotated.height = rows;
+            rotate_planes(kernels, src, rotated, rotation, mirror, band);
+            convert_pixel_rows(kernels, rotated, image_band(dst, band, rows), 0, rows);
+        }
+    }
+    return true;
+}
+
+bool rotate_pixel_rows(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror, size_t row,
+                       size_t count) {
+    return rotate_pixel_rows(pixel_kernels_best(), src, dst, rotation, mirror, row, count);
+}
+
+bool rotate_pixel_image(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror) {
+    TRACE_SCOPE("rotate pixels");
+
+    if (!check_rotation(src, dst, rotation, mirror, 0, dst.height)) return false;
+    if (!rotation && !mirror) return convert_pixel_image(src, dst);
+
+    const pixel_kernels &kernels = pixel_kernels_best();
+    size_t bands = (dst.height + kRotateBand - 1) / kRotateBand;
+    JobSystem::instance().parallelFor(bands, [&](size_t begin, size_t end) {
+        size_t row = begin * kRotateBand;
+        size_t last = end * kRotateBand < dst.height ? end * kRotateBand : dst.height;
+        rotate_pixel_rows(kernels, src, dst, rotation, mirror, row, last - row);
+    });
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef _PIXEL_FORMAT_H_
+#define _PIXEL_FORMAT_H_
+
+#include "FrameRef.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Layouts convert_pixel_image() converts between. YUV is BT.601 full range like the camera frames,
+// RGB565 is little-endian.
+enum PixelFormat {
+    pxI420, pxNV12, pxNV21, pxYUYV, pxRGBA, pxRGB565
+};
+
+// Planes of an image: Y, U and V for I420, Y and interleaved chroma for NV12 and NV21, a single
+// plane for the packed formats. Unused planes are nullptr.
+struct pixel_image {
+    PixelFormat format;
+    size_t width;
+    size_t height;
+    uint8_t *planes[3];
+    size_t strides[3];
+};
+
+// Bytes of an image of the format without row padding.
+size_t pixel_image_size(PixelFormat format, size_t width, size_t height);
+
+// An image without row padding with its planes one after the other in data.
+pixel_image pixel_image_packed(PixelFormat format, size_t width, size_t height, uint8_t *data);
+
+// The planes of a frame, false for a pixel stride that fits none of the formats.
+bool pixel_image_from_frame(const video_frame &frame, pixel_image &image);
+
+// Converts count rows from row on, on the calling thread, so that callers can run bands of a frame
+// wherever suits them. Both images must have the same even size, and row and count must be even.
+bool convert_pixel_rows(const pixel_image &src, const pixel_image &dst, size_t row, size_t count);
+
+// Converts the whole image in bands spread over the JobSystem.
+bool convert_pixel_image(const pixel_image &src, const pixel_image &dst);
+
+// Rotates src clockwise by rotation degrees, 0, 90, 180 or 270, then mirrors it left to right if
+// asked, into count rows of dst from row on, converting to the format of dst on the way. dst is
+// src's size with width and height swapped for 90 and 270. YUYV sources only convert.
+bool rotate_pixel_rows(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror, size_t row,
+                       size_t count);
+
+// Rotates the whole image in bands spread over the JobSystem.
+bool rotate_pixel_image(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror);
+
+#endif //_PIXEL_FORMAT_H_
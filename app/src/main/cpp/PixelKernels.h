@@ -0,0 +1,191 @@
+#ifndef _PIXEL_KERNELS_H_
+#define _PIXEL_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Kernels behind convert_pixel_rows() and rotate_pixel_rows(). Chroma is always planar in the
+// conversions, the converter splits and merges interleaved chroma around them. Widths are in pixels
+// and even.
+struct pixel_kernels {
+    const char *name;
+
+    // u[i] = uv[2 * i], v[i] = uv[2 * i + 1], for count chroma pairs, and back.
+    void (*split_uv)(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count);
+    void (*merge_uv)(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count);
+
+    // A row of YUV with one chroma sample per two pixels to RGBA.
+    void (*yuv_to_rgba)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgba, size_t width);
+
+    void (*rgba_to_y)(const uint8_t *rgba, uint8_t *y, size_t width);
+
+    // Chroma of the 2x2 blocks of two RGBA rows, pass the same row twice for 2x1 blocks.
+    void (*rgba_to_uv)(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *u, uint8_t *v, size_t width);
+
+    void (*rgba_to_rgb565)(const uint8_t *rgba, uint8_t *rgb565, size_t width);
+
+    void (*rgb565_to_rgba)(const uint8_t *rgb565, uint8_t *rgba, size_t width);
+
+    void (*yuv_to_yuyv)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *yuyv, size_t width);
+
+    void (*yuyv_to_y)(const uint8_t *yuyv, uint8_t *y, size_t width);
+
+    // Chroma of two YUYV rows averaged, pass the same row twice for its own chroma.
+    void (*yuyv_to_uv)(const uint8_t *yuyv0, const uint8_t *yuyv1, uint8_t *u, uint8_t *v, size_t width);
+
+    // Row x of dst gets column x of a width x height block of src, for elements of 1, 2 and 4 bytes.
+    // Strides may be negative to flip either side. SIMD sets transpose in register tiles.
+    void (*transpose_8)(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride, size_t width,
+                        size_t height);
+    void (*transpose_16)(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride, size_t width,
+                         size_t height);
+    void (*transpose_32)(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride, size_t width,
+                         size_t height);
+
+    // dst gets the count elements of src in reverse order.
+    void (*reverse_8)(const uint8_t *src, uint8_t *dst, size_t count);
+    void (*reverse_16)(const uint8_t *src, uint8_t *dst, size_t count);
+    void (*reverse_32)(const uint8_t *src, uint8_t *dst, size_t count);
+};
+
+// Kernel sets compiled into this binary, nullptr for those that aren't. The SIMD ones start from the
+// scalar set, or the set below them, and replace the kernels where they pay off.
+const pixel_kernels *pixel_kernels_scalar();
+
+const pixel_kernels *pixel_kernels_neon();
+
+const pixel_kernels *pixel_kernels_neon_dotprod();
+
+const pixel_kernels *pixel_kernels_sse41();
+
+const pixel_kernels *pixel_kernels_avx2();
+
+// The best set this CPU runs, picked once on first use.
+const pixel_kernels &pixel_kernels_best();
+
+// Fills sets with up to maxCount sets this CPU runs, scalar first. Returns how many.
+size_t pixel_kernels_supported(const pixel_kernels **sets, size_t maxCount);
+
+struct pixel_image;
+
+// convert_pixel_rows() and rotate_pixel_rows() with the given set, to compare them.
+bool convert_pixel_rows(const pixel_kernels &kernels, const pixel_image &src, const pixel_image &dst, size_t row,
+                        size_t count);
+
+bool rotate_pixel_rows(const pixel_kernels &kernels, const pixel_image &src, const pixel_image &dst, int rotation,
+                       bool mirror, size_t row, size_t count);
+
+// The fixed point math every set computes exactly, BT.601 full range as in the shaders. YUV to RGB is
+// in Q6 so that SIMD kernels stay in 16 bits: r = y + 1.403 v', g = y - 0.344 u' - 0.714 v',
+// b = y + 1.770 u' with u' = u - 128 and v' = v - 128, rounded down after adding half.
+static const int kPixelYuvShift = 6;
+static const int kPixelVToR = 90;
+static const int kPixelUToG = 22;
+static const int kPixelVToG = 46;
+static const int kPixelUToB = 113;
+
+// RGB to YUV in Q8, chroma from the rounded mean of each block.
+static const int kPixelRgbShift = 8;
+static const int kPixelRToY = 77;
+static const int kPixelGToY = 150;
+static const int kPixelBToY = 29;
+static const int kPixelRToU = -43;
+static const int kPixelGToU = -85;
+static const int kPixelBToU = 128;
+static const int kPixelRToV = 128;
+static const int kPixelGToV = -107;
+static const int kPixelBToV = -21;
+
+// Per pixel versions for the tails of SIMD kernels. Static, so that every kernel file keeps copies
+// built with its own instruction set.
+static inline uint8_t pixel_clamp(int value) {
+    return (uint8_t) (value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static inline void pixel_yuv_to_rgba(int y, int u, int v, uint8_t *rgba) {
+    int luma = (y << kPixelYuvShift) + (1 << (kPixelYuvShift - 1));
+    u -= 128;
+    v -= 128;
+
+    rgba[0] = pixel_clamp((luma + kPixelVToR * v) >> kPixelYuvShift);
+    rgba[1] = pixel_clamp((luma - kPixelUToG * u - kPixelVToG * v) >> kPixelYuvShift);
+    rgba[2] = pixel_clamp((luma + kPixelUToB * u) >> kPixelYuvShift);
+    rgba[3] = 255;
+}
+
+static inline uint8_t pixel_rgb_to_y(int r, int g, int b) {
+    return (uint8_t) ((kPixelRToY * r + kPixelGToY * g + kPixelBToY * b + (1 << (kPixelRgbShift - 1)))
+            >> kPixelRgbShift);
+}
+
+static inline uint8_t pixel_rgb_to_u(int r, int g, int b) {
+    return pixel_clamp(((kPixelRToU * r + kPixelGToU * g + kPixelBToU * b + (1 << (kPixelRgbShift - 1)))
+            >> kPixelRgbShift) + 128);
+}
+
+static inline uint8_t pixel_rgb_to_v(int r, int g, int b) {
+    return pixel_clamp(((kPixelRToV * r + kPixelGToV * g + kPixelBToV * b + (1 << (kPixelRgbShift - 1)))
+            >> kPixelRgbShift) + 128);
+}
+
+// Means of the 2x2 block of two RGBA rows at pixel x, rounded.
+static inline void pixel_block_mean(const uint8_t *rgba0, const uint8_t *rgba1, size_t x, int *mean) {
+    for (int c = 0; c < 3; c++) {
+        mean[c] = (rgba0[x * 4 + c] + rgba0[x * 4 + 4 + c] + rgba1[x * 4 + c] + rgba1[x * 4 + 4 + c] + 2) >> 2;
+    }
+}
+
+static inline uint16_t pixel_rgb_to_rgb565(const uint8_t *rgba) {
+    return (uint16_t) ((rgba[0] >> 3) << 11 | (rgba[1] >> 2) << 5 | rgba[2] >> 3);
+}
+
+// Widens by replicating the top bits, so that 0 and full scale map to 0 and 255.
+static inline void pixel_rgb565_to_rgba(uint16_t pixel, uint8_t *rgba) {
+    int r = pixel >> 11;
+    int g = (pixel >> 5) & 0x3f;
+    int b = pixel & 0x1f;
+
+    rgba[0] = (uint8_t) (r << 3 | r >> 2);
+    rgba[1] = (uint8_t) (g << 2 | g >> 4);
+    rgba[2] = (uint8_t) (b << 3 | b >> 2);
+    rgba[3] = 255;
+}
+
+// Element by element versions of the transposes and reversals, for the edges of SIMD tiles.
+static inline void pixel_transpose(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                                   size_t width, size_t height, size_t size) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t *row = src + (ptrdiff_t) y * srcStride;
+        for (size_t x = 0; x < width; x++) {
+            memcpy(dst + (ptrdiff_t) x * dstStride + y * size, row + x * size, size);
+        }
+    }
+}
+
+// A transpose over whole tiles of kTile x kTile elements of kSize bytes by transposeTile, and over the
+// edges element by element.
+template<size_t kSize, size_t kTile, void (*transposeTile)(const uint8_t *, ptrdiff_t, uint8_t *, ptrdiff_t)>
+static void pixel_transpose_tiles(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                                  size_t width, size_t height) {
+    size_t y = 0;
+    for (; y + kTile <= height; y += kTile) {
+        const uint8_t *rows = src + (ptrdiff_t) y * srcStride;
+        size_t x = 0;
+        for (; x + kTile <= width; x += kTile) {
+            transposeTile(rows + x * kSize, srcStride, dst + (ptrdiff_t) x * dstStride + y * kSize, dstStride);
+        }
+        pixel_transpose(rows + x * kSize, srcStride, dst + (ptrdiff_t) x * dstStride + y * kSize, dstStride,
+                        width - x, kTile, kSize);
+    }
+    pixel_transpose(src + (ptrdiff_t) y * srcStride, srcStride, dst + y * kSize, dstStride, width, height - y,
+                    kSize);
+}
+
+static inline void pixel_reverse(const uint8_t *src, uint8_t *dst, size_t count, size_t size) {
+    for (size_t i = 0; i < count; i++) {
+        memcpy(dst + i * size, src + (count - 1 - i) * size, size);
+    }
+}
+
+#endif //_PIXEL_KERNELS_H_
@@ -0,0 +1,132 @@
+#include "PixelKernels.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+static void split_uv_avx2(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count) {
+    const __m256i low = _mm256_set1_epi16(0xff);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (uv + i * 2));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (uv + i * 2 + 32));
+        // Packing works within 128 bit lanes, the permute puts the quarters back in order.
+        __m256i cu = _mm256_packus_epi16(_mm256_and_si256(a, low), _mm256_and_si256(b, low));
+        __m256i cv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *) (u + i), _mm256_permute4x64_epi64(cu, 0xd8));
+        _mm256_storeu_si256((__m256i *) (v + i), _mm256_permute4x64_epi64(cv, 0xd8));
+    }
+    for (; i < count; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+static void merge_uv_avx2(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (u + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (v + i));
+        __m256i low = _mm256_unpacklo_epi8(a, b);
+        __m256i high = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i *) (uv + i * 2), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256((__m256i *) (uv + i * 2 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    for (; i < count; i++) {
+        uv[i * 2] = u[i];
+        uv[i * 2 + 1] = v[i];
+    }
+}
+
+// Narrows 16 values in 16 bit lanes to bytes in order, saturating.
+static inline __m128i pack_bytes(__m256i values) {
+    return _mm_packus_epi16(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+}
+
+static void yuv_to_rgba_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgba,
+                             size_t width) {
+    const __m128i center = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    const __m256i half = _mm256_set1_epi16(1 << (kPixelYuvShift - 1));
+    const __m256i vToR = _mm256_set1_epi16(kPixelVToR);
+    const __m256i uToG = _mm256_set1_epi16(kPixelUToG);
+    const __m256i vToG = _mm256_set1_epi16(kPixelVToG);
+    const __m256i uToB = _mm256_set1_epi16(kPixelUToB);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i luma = _mm256_add_epi16(_mm256_slli_epi16(
+                _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (y + x))), kPixelYuvShift), half);
+        __m128i cu = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (u + x / 2))), center);
+        __m128i cv = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (v + x / 2))), center);
+        __m256i pu = _mm256_set_m128i(_mm_unpackhi_epi16(cu, cu), _mm_unpacklo_epi16(cu, cu));
+        __m256i pv = _mm256_set_m128i(_mm_unpackhi_epi16(cv, cv), _mm_unpacklo_epi16(cv, cv));
+
+        __m128i r = pack_bytes(_mm256_srai_epi16(_mm256_add_epi16(luma, _mm256_mullo_epi16(pv, vToR)),
+                                                 kPixelYuvShift));
+        __m128i g = pack_bytes(_mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(
+                luma, _mm256_mullo_epi16(pu, uToG)), _mm256_mullo_epi16(pv, vToG)), kPixelYuvShift));
+        __m128i b = pack_bytes(_mm256_srai_epi16(_mm256_add_epi16(luma, _mm256_mullo_epi16(pu, uToB)),
+                                                 kPixelYuvShift));
+
+        __m256i rg = _mm256_set_m128i(_mm_unpackhi_epi8(r, g), _mm_unpacklo_epi8(r, g));
+        __m256i ba = _mm256_set_m128i(_mm_unpackhi_epi8(b, alpha), _mm_unpacklo_epi8(b, alpha));
+        // Lane-wise interleave leaves pixels 0-3 and 8-11 in the first result.
+        __m256i first = _mm256_unpacklo_epi16(rg, ba);
+        __m256i second = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256((__m256i *) (rgba + x * 4), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *) (rgba + x * 4 + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    for (; x < width; x++) {
+        pixel_yuv_to_rgba(y[x], u[x / 2], v[x / 2], rgba + x * 4);
+    }
+}
+
+static void rgba_to_y_avx2(const uint8_t *rgba, uint8_t *y, size_t width) {
+    const __m256i weights = _mm256_setr_epi16(kPixelRToY, kPixelGToY, kPixelBToY, 0,
+                                              kPixelRToY, kPixelGToY, kPixelBToY, 0,
+                                              kPixelRToY, kPixelGToY, kPixelBToY, 0,
+                                              kPixelRToY, kPixelGToY, kPixelBToY, 0);
+    const __m256i half = _mm256_set1_epi32(1 << (kPixelRgbShift - 1));
+    // Undoes the lane-wise horizontal adds and packs, see below.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i weighed[4];
+        for (int i = 0; i < 4; i++) {
+            __m256i pixels = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (rgba + (x + i * 4) * 4)));
+            weighed[i] = _mm256_madd_epi16(pixels, weights);
+        }
+        // Lanes hold pixels {0 1 4 5 | 2 3 6 7} and {8 9 12 13 | 10 11 14 15}.
+        __m256i low = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(weighed[0], weighed[1]), half),
+                                        kPixelRgbShift);
+        __m256i high = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(weighed[2], weighed[3]), half),
+                                         kPixelRgbShift);
+        __m256i luma = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(low, high), order);
+        _mm_storeu_si128((__m128i *) (y + x), pack_bytes(luma));
+    }
+    for (; x < width; x++) {
+        y[x] = pixel_rgb_to_y(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+}
+
+const pixel_kernels *pixel_kernels_avx2() {
+    static const pixel_kernels kernels = [] {
+        const pixel_kernels *base = pixel_kernels_sse41();
+        pixel_kernels result = base != nullptr ? *base : *pixel_kernels_scalar();
+        result.name = "avx2";
+        result.split_uv = split_uv_avx2;
+        result.merge_uv = merge_uv_avx2;
+        result.yuv_to_rgba = yuv_to_rgba_avx2;
+        result.rgba_to_y = rgba_to_y_avx2;
+        return result;
+    }();
+    return &kernels;
+}
+
+#else
+
+const pixel_kernels *pixel_kernels_avx2() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include "PixelKernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+static void split_uv_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs = vld2q_u8(uv + i * 2);
+        vst1q_u8(u + i, pairs.val[0]);
+        vst1q_u8(v + i, pairs.val[1]);
+    }
+    for (; i < count; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+static void merge_uv_neon(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs;
+        pairs.val[0] = vld1q_u8(u + i);
+        pairs.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + i * 2, pairs);
+    }
+    for (; i < count; i++) {
+        uv[i * 2] = u[i];
+        uv[i * 2 + 1] = v[i];
+    }
+}
+
+static void yuv_to_rgba_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgba,
+                             size_t width) {
+    const uint8x8_t center = vdup_n_u8(128);
+    const int16x8_t half = vdupq_n_s16(1 << (kPixelYuvShift - 1));
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t luma = vld1q_u8(y + x);
+        // Wraps to the signed difference from the center, then doubles each sample for its two pixels.
+        int16x8_t du = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + x / 2), center));
+        int16x8_t dv = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + x / 2), center));
+        int16x8x2_t cu = vzipq_s16(du, du);
+        int16x8x2_t cv = vzipq_s16(dv, dv);
+
+        uint8x8_t channels[3][2];
+        for (int h = 0; h < 2; h++) {
+            int16x8_t l = vaddq_s16(vreinterpretq_s16_u16(
+                    vshll_n_u8(h == 0 ? vget_low_u8(luma) : vget_high_u8(luma), kPixelYuvShift)), half);
+            channels[0][h] = vqshrun_n_s16(vmlaq_n_s16(l, cv.val[h], kPixelVToR), kPixelYuvShift);
+            channels[1][h] = vqshrun_n_s16(vmlsq_n_s16(vmlsq_n_s16(l, cu.val[h], kPixelUToG),
+                                                       cv.val[h], kPixelVToG), kPixelYuvShift);
+            channels[2][h] = vqshrun_n_s16(vmlaq_n_s16(l, cu.val[h], kPixelUToB), kPixelYuvShift);
+        }
+
+        uint8x16x4_t pixels;
+        pixels.val[0] = vcombine_u8(channels[0][0], channels[0][1]);
+        pixels.val[1] = vcombine_u8(channels[1][0], channels[1][1]);
+        pixels.val[2] = vcombine_u8(channels[2][0], channels[2][1]);
+        pixels.val[3] = vdupq_n_u8(255);
+        vst4q_u8(rgba + x * 4, pixels);
+    }
+    for (; x < width; x++) {
+        pixel_yuv_to_rgba(y[x], u[x / 2], v[x / 2], rgba + x * 4);
+    }
+}
+
+static void rgba_to_y_neon(const uint8_t *rgba, uint8_t *y, size_t width) {
+    const uint8x8_t rToY = vdup_n_u8(kPixelRToY);
+    const uint8x8_t gToY = vdup_n_u8(kPixelGToY);
+    const uint8x8_t bToY = vdup_n_u8(kPixelBToY);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(rgba + x * 4);
+        uint16x8_t low = vmull_u8(vget_low_u8(pixels.val[0]), rToY);
+        low = vmlal_u8(low, vget_low_u8(pixels.val[1]), gToY);
+        low = vmlal_u8(low, vget_low_u8(pixels.val[2]), bToY);
+        uint16x8_t high = vmull_u8(vget_high_u8(pixels.val[0]), rToY);
+        high = vmlal_u8(high, vget_high_u8(pixels.val[1]), gToY);
+        high = vmlal_u8(high, vget_high_u8(pixels.val[2]), bToY);
+        vst1q_u8(y + x, vcombine_u8(vrshrn_n_u16(low, kPixelRgbShift), vrshrn_n_u16(high, kPixelRgbShift)));
+    }
+    for (; x < width; x++) {
+        y[x] = pixel_rgb_to_y(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+}
+
+// One chroma component of 8 blocks from their channel means.
+static inline uint8x8_t weigh_blocks(int16x8_t r, int16x8_t g, int16x8_t b, int16_t rWeight, int16_t gWeight,
+                                     int16_t bWeight) {
+    int16x8_t sum = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(r, rWeight), g, gWeight), b, bWeight);
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, kPixelRgbShift), vdupq_n_s16(128)));
+}
+
+static void rgba_to_uv_neon(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *u, uint8_t *v,
+                            size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t top = vld4q_u8(rgba0 + x * 4);
+        uint8x16x4_t bottom = vld4q_u8(rgba1 + x * 4);
+        int16x8_t means[3];
+        for (int c = 0; c < 3; c++) {
+            means[c] = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(top.val[c]), bottom.val[c]), 2));
+        }
+        vst1_u8(u + x / 2, weigh_blocks(means[0], means[1], means[2], kPixelRToU, kPixelGToU, kPixelBToU));
+        vst1_u8(v + x / 2, weigh_blocks(means[0], means[1], means[2], kPixelRToV, kPixelGToV, kPixelBToV));
+    }
+    for (; x < width; x += 2) {
+        int mean[3];
+        pixel_block_mean(rgba0, rgba1, x, mean);
+        u[x / 2] = pixel_rgb_to_u(mean[0], mean[1], mean[2]);
+        v[x / 2] = pixel_rgb_to_v(mean[0], mean[1], mean[2]);
+    }
+}
+
+static void rgba_to_rgb565_neon(const uint8_t *rgba, uint8_t *rgb565, size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t pixels = vld4q_u8(rgba + x * 4);
+        uint8x16x2_t packed;
+        // Low byte: the bottom 3 bits of green and 5 of blue, high byte: 5 of red and the top 3 of green.
+        packed.val[0] = vsriq_n_u8(vshlq_n_u8(pixels.val[1], 3), pixels.val[2], 3);
+        packed.val[1] = vsriq_n_u8(pixels.val[0], pixels.val[1], 5);
+        vst2q_u8(rgb565 + x * 2, packed);
+    }
+    for (; x < width; x++) {
+        uint16_t pixel = pixel_rgb_to_rgb565(rgba + x * 4);
+        rgb565[x * 2] = (uint8_t) pixel;
+        rgb565[x * 2 + 1] = (uint8_t) (pixel >> 8);
+    }
+}
+
+static void rgb565_to_rgba_neon(const uint8_t *rgb565, uint8_t *rgba, size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t packed = vld2q_u8(rgb565 + x * 2);
+        uint8x16_t green = vsriq_n_u8(vshlq_n_u8(packed.val[1], 5), packed.val[0], 3);
+        uint8x16_t blue = vshlq_n_u8(packed.val[0], 3);
+        uint8x16x4_t pixels;
+        // Inserting a channel's own top bits below it widens it.
+        pixels.val[0] = vsriq_n_u8(packed.val[1], packed.val[1], 5);
+        pixels.val[1] = vsriq_n_u8(green, green, 6);
+        pixels.val[2] = vsriq_n_u8(blue, blue, 5);
+        pixels.val[3] = vdupq_n_u8(255);
+        vst4q_u8(rgba + x * 4, pixels);
+    }
+    for (; x < width; x++) {
+        pixel_rgb565_to_rgba((uint16_t) (rgb565[x * 2] | rgb565[x * 2 + 1] << 8), rgba + x * 4);
+    }
+}
+
+static void yuv_to_yuyv_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *yuyv,
+                             size_t width) {
+    size_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        uint8x16x2_t luma = vld2q_u8(y + x);
+        uint8x16x4_t pixels;
+        pixels.val[0] = luma.val[0];
+        pixels.val[1] = vld1q_u8(u + x / 2);
+        pixels.val[2] = luma.val[1];
+        pixels.val[3] = vld1q_u8(v + x / 2);
+        vst4q_u8(yuyv + x * 2, pixels);
+    }
+    for (; x < width; x += 2) {
+        yuyv[x * 2] = y[x];
+        yuyv[x * 2 + 1] = u[x / 2];
+        yuyv[x * 2 + 2] = y[x + 1];
+        yuyv[x * 2 + 3] = v[x / 2];
+    }
+}
+
+static void yuyv_to_y_neon(const uint8_t *yuyv, uint8_t *y, size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        vst1q_u8(y + x, vld2q_u8(yuyv + x * 2).val[0]);
+    }
+    for (; x < width; x++) {
+        y[x] = yuyv[x * 2];
+    }
+}
+
+static void yuyv_to_uv_neon(const uint8_t *yuyv0, const uint8_t *yuyv1, uint8_t *u, uint8_t *v,
+                            size_t width) {
+    size_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        uint8x16x4_t top = vld4q_u8(yuyv0 + x * 2);
+        uint8x16x4_t bottom = vld4q_u8(yuyv1 + x * 2);
+        vst1q_u8(u + x / 2, vrhaddq_u8(top.val[1], bottom.val[1]));
+        vst1q_u8(v + x / 2, vrhaddq_u8(top.val[3], bottom.val[3]));
+    }
+    for (; x < width; x += 2) {
+        u[x / 2] = (uint8_t) ((yuyv0[x * 2 + 1] + yuyv1[x * 2 + 1] + 1) >> 1);
+        v[x / 2] = (uint8_t) ((yuyv0[x * 2 + 3] + yuyv1[x * 2 + 3] + 1) >> 1);
+    }
+}
+
+// Zipping the first half of the rows with the second half log2(tile) times transposes them, as in
+// PixelKernelsSse41.cpp: 4 rounds for 16 x 16 bytes, 3 for 8 x 8 of 2 bytes, 2 for 4 x 4 of 4 bytes.
+template<size_t kTile, uint8x16x2_t (*zip)(uint8x16_t, uint8x16_t)>
+static inline void transpose_tile(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    uint8x16_t rows[kTile];
+    for (size_t i = 0; i < kTile; i++) {
+        rows[i] = vld1q_u8(src + (ptrdiff_t) i * srcStride);
+    }
+
+    for (size_t round = 1; round < kTile; round *= 2) {
+        uint8x16_t zipped[kTile];
+        for (size_t i = 0; i < kTile / 2; i++) {
+            uint8x16x2_t pair = zip(rows[i], rows[i + kTile / 2]);
+            zipped[i * 2] = pair.val[0];
+            zipped[i * 2 + 1] = pair.val[1];
+        }
+        for (size_t i = 0; i < kTile; i++) rows[i] = zipped[i];
+    }
+
+    for (size_t i = 0; i < kTile; i++) {
+        vst1q_u8(dst + (ptrdiff_t) i * dstStride, rows[i]);
+    }
+}
+
+static inline uint8x16x2_t zip_8(uint8x16_t a, uint8x16_t b) {
+    return vzipq_u8(a, b);
+}
+
+static inline uint8x16x2_t zip_16(uint8x16_t a, uint8x16_t b) {
+    uint16x8x2_t pair = vzipq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b));
+    uint8x16x2_t result = {{vreinterpretq_u8_u16(pair.val[0]), vreinterpretq_u8_u16(pair.val[1])}};
+    return result;
+}
+
+static inline uint8x16x2_t zip_32(uint8x16_t a, uint8x16_t b) {
+    uint32x4x2_t pair = vzipq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b));
+    uint8x16x2_t result = {{vreinterpretq_u8_u32(pair.val[0]), vreinterpretq_u8_u32(pair.val[1])}};
+    return result;
+}
+
+static void transpose_tile_8(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<16, zip_8>(src, srcStride, dst, dstStride);
+}
+
+static void transpose_tile_16(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<8, zip_16>(src, srcStride, dst, dstStride);
+}
+
+static void transpose_tile_32(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<4, zip_32>(src, srcStride, dst, dstStride);
+}
+
+// Reverses within 64 bit halves, then swaps the halves.
+static inline uint8x16_t reverse_register_8(uint8x16_t block) {
+    block = vrev64q_u8(block);
+    return vcombine_u8(vget_high_u8(block), vget_low_u8(block));
+}
+
+static inline uint8x16_t reverse_register_16(uint8x16_t block) {
+    block = vreinterpretq_u8_u16(vrev64q_u16(vreinterpretq_u16_u8(block)));
+    return vcombine_u8(vget_high_u8(block), vget_low_u8(block));
+}
+
+static inline uint8x16_t reverse_register_32(uint8x16_t block) {
+    block = vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(block)));
+    return vcombine_u8(vget_high_u8(block), vget_low_u8(block));
+}
+
+template<size_t kSize, uint8x16_t (*reverseRegister)(uint8x16_t)>
+static void reverse_elements(const uint8_t *src, uint8_t *dst, size_t count) {
+    const size_t elements = 16 / kSize;
+    size_t i = 0;
+    for (; i + elements <= count; i += elements) {
+        vst1q_u8(dst + i * kSize, reverseRegister(vld1q_u8(src + (count - i - elements) * kSize)));
+    }
+    pixel_reverse(src, dst + i * kSize, count - i, kSize);
+}
+
+const pixel_kernels *pixel_kernels_neon() {
+    static const pixel_kernels kernels = {
+            "neon",
+            split_uv_neon,
+            merge_uv_neon,
+            yuv_to_rgba_neon,
+            rgba_to_y_neon,
+            rgba_to_uv_neon,
+            rgba_to_rgb565_neon,
+            rgb565_to_rgba_neon,
+            yuv_to_yuyv_neon,
+            yuyv_to_y_neon,
+            yuyv_to_uv_neon,
+            pixel_transpose_tiles<1, 16, transpose_tile_8>,
+            pixel_transpose_tiles<2, 8, transpose_tile_16>,
+            pixel_transpose_tiles<4, 4, transpose_tile_32>,
+            reverse_elements<1, reverse_register_8>,
+            reverse_elements<2, reverse_register_16>,
+            reverse_elements<4, reverse_register_32>,
+    };
+    return &kernels;
+}
+
+#else
+
+const pixel_kernels *pixel_kernels_neon() {
+    return nullptr;
+}
+
+#endif
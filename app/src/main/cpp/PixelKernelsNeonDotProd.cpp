@@ -0,0 +1,46 @@
+#include "PixelKernels.h"
+
+#if defined(__ARM_FEATURE_DOTPROD)
+
+#include <arm_neon.h>
+
+// Weighs each RGBA pixel with one dot product instead of deinterleaving its channels first.
+static void rgba_to_y_neon_dotprod(const uint8_t *rgba, uint8_t *y, size_t width) {
+    const uint8_t weightBytes[16] = {
+            kPixelRToY, kPixelGToY, kPixelBToY, 0, kPixelRToY, kPixelGToY, kPixelBToY, 0,
+            kPixelRToY, kPixelGToY, kPixelBToY, 0, kPixelRToY, kPixelGToY, kPixelBToY, 0,
+    };
+    const uint8x16_t weights = vld1q_u8(weightBytes);
+    const uint32x4_t zero = vdupq_n_u32(0);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint16x4_t luma[4];
+        for (int i = 0; i < 4; i++) {
+            luma[i] = vmovn_u32(vdotq_u32(zero, vld1q_u8(rgba + (x + i * 4) * 4), weights));
+        }
+        vst1q_u8(y + x, vcombine_u8(vrshrn_n_u16(vcombine_u16(luma[0], luma[1]), kPixelRgbShift),
+                                    vrshrn_n_u16(vcombine_u16(luma[2], luma[3]), kPixelRgbShift)));
+    }
+    for (; x < width; x++) {
+        y[x] = pixel_rgb_to_y(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+}
+
+const pixel_kernels *pixel_kernels_neon_dotprod() {
+    static const pixel_kernels kernels = [] {
+        const pixel_kernels *base = pixel_kernels_neon();
+        pixel_kernels result = base != nullptr ? *base : *pixel_kernels_scalar();
+        result.name = "neon-dotprod";
+        result.rgba_to_y = rgba_to_y_neon_dotprod;
+        return result;
+    }();
+    return &kernels;
+}
+
+#else
+
+const pixel_kernels *pixel_kernels_neon_dotprod() {
+    return nullptr;
+}
+
+#endif
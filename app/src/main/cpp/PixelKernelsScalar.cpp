@@ -0,0 +1,126 @@
+#include "PixelKernels.h"
+
+static void split_uv_scalar(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+static void merge_uv_scalar(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uv[i * 2] = u[i];
+        uv[i * 2 + 1] = v[i];
+    }
+}
+
+static void yuv_to_rgba_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgba,
+                               size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        pixel_yuv_to_rgba(y[x], u[x / 2], v[x / 2], rgba + x * 4);
+    }
+}
+
+static void rgba_to_y_scalar(const uint8_t *rgba, uint8_t *y, size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        y[x] = pixel_rgb_to_y(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+}
+
+static void rgba_to_uv_scalar(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *u, uint8_t *v,
+                              size_t width) {
+    for (size_t x = 0; x < width; x += 2) {
+        int mean[3];
+        pixel_block_mean(rgba0, rgba1, x, mean);
+        u[x / 2] = pixel_rgb_to_u(mean[0], mean[1], mean[2]);
+        v[x / 2] = pixel_rgb_to_v(mean[0], mean[1], mean[2]);
+    }
+}
+
+static void rgba_to_rgb565_scalar(const uint8_t *rgba, uint8_t *rgb565, size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        uint16_t pixel = pixel_rgb_to_rgb565(rgba + x * 4);
+        rgb565[x * 2] = (uint8_t) pixel;
+        rgb565[x * 2 + 1] = (uint8_t) (pixel >> 8);
+    }
+}
+
+static void rgb565_to_rgba_scalar(const uint8_t *rgb565, uint8_t *rgba, size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        pixel_rgb565_to_rgba((uint16_t) (rgb565[x * 2] | rgb565[x * 2 + 1] << 8), rgba + x * 4);
+    }
+}
+
+static void yuv_to_yuyv_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *yuyv,
+                               size_t width) {
+    for (size_t x = 0; x < width; x += 2) {
+        yuyv[x * 2] = y[x];
+        yuyv[x * 2 + 1] = u[x / 2];
+        yuyv[x * 2 + 2] = y[x + 1];
+        yuyv[x * 2 + 3] = v[x / 2];
+    }
+}
+
+static void yuyv_to_y_scalar(const uint8_t *yuyv, uint8_t *y, size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        y[x] = yuyv[x * 2];
+    }
+}
+
+static void yuyv_to_uv_scalar(const uint8_t *yuyv0, const uint8_t *yuyv1, uint8_t *u, uint8_t *v,
+                              size_t width) {
+    for (size_t x = 0; x < width; x += 2) {
+        u[x / 2] = (uint8_t) ((yuyv0[x * 2 + 1] + yuyv1[x * 2 + 1] + 1) >> 1);
+        v[x / 2] = (uint8_t) ((yuyv0[x * 2 + 3] + yuyv1[x * 2 + 3] + 1) >> 1);
+    }
+}
+
+static void transpose_8_scalar(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                               size_t width, size_t height) {
+    pixel_transpose(src, srcStride, dst, dstStride, width, height, 1);
+}
+
+static void transpose_16_scalar(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                                size_t width, size_t height) {
+    pixel_transpose(src, srcStride, dst, dstStride, width, height, 2);
+}
+
+static void transpose_32_scalar(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                                size_t width, size_t height) {
+    pixel_transpose(src, srcStride, dst, dstStride, width, height, 4);
+}
+
+static void reverse_8_scalar(const uint8_t *src, uint8_t *dst, size_t count) {
+    pixel_reverse(src, dst, count, 1);
+}
+
+static void reverse_16_scalar(const uint8_t *src, uint8_t *dst, size_t count) {
+    pixel_reverse(src, dst, count, 2);
+}
+
+static void reverse_32_scalar(const uint8_t *src, uint8_t *dst, size_t count) {
+    pixel_reverse(src, dst, count, 4);
+}
+
+const pixel_kernels *pixel_kernels_scalar() {
+    static const pixel_kernels kernels = {
+            "scalar",
+            split_uv_scalar,
+            merge_uv_scalar,
+            yuv_to_rgba_scalar,
+            rgba_to_y_scalar,
+            rgba_to_uv_scalar,
+            rgba_to_rgb565_scalar,
+            rgb565_to_rgba_scalar,
+            yuv_to_yuyv_scalar,
+            yuyv_to_y_scalar,
+            yuyv_to_uv_scalar,
+            transpose_8_scalar,
+            transpose_16_scalar,
+            transpose_32_scalar,
+            reverse_8_scalar,
+            reverse_16_scalar,
+            reverse_32_scalar,
+    };
+    return &kernels;
+}
@@ -0,0 +1,353 @@
+#include "PixelKernels.h"
+
+#if defined(__SSE4_1__)
+
+#include <smmintrin.h>
+
+static void split_uv_sse41(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count) {
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (uv + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (uv + i * 2 + 16));
+        _mm_storeu_si128((__m128i *) (u + i), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+        _mm_storeu_si128((__m128i *) (v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    for (; i < count; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+static void merge_uv_sse41(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (u + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (v + i));
+        _mm_storeu_si128((__m128i *) (uv + i * 2), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *) (uv + i * 2 + 16), _mm_unpackhi_epi8(a, b));
+    }
+    for (; i < count; i++) {
+        uv[i * 2] = u[i];
+        uv[i * 2 + 1] = v[i];
+    }
+}
+
+// Stores 16 pixels of 8 bit channels as RGBA.
+static inline void store_rgba(__m128i r, __m128i g, __m128i b, uint8_t *rgba) {
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    __m128i rg = _mm_unpacklo_epi8(r, g);
+    __m128i ba = _mm_unpacklo_epi8(b, alpha);
+    _mm_storeu_si128((__m128i *) rgba, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *) (rgba + 16), _mm_unpackhi_epi16(rg, ba));
+    rg = _mm_unpackhi_epi8(r, g);
+    ba = _mm_unpackhi_epi8(b, alpha);
+    _mm_storeu_si128((__m128i *) (rgba + 32), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *) (rgba + 48), _mm_unpackhi_epi16(rg, ba));
+}
+
+static void yuv_to_rgba_sse41(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgba,
+                              size_t width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i center = _mm_set1_epi16(128);
+    const __m128i half = _mm_set1_epi16(1 << (kPixelYuvShift - 1));
+    const __m128i vToR = _mm_set1_epi16(kPixelVToR);
+    const __m128i uToG = _mm_set1_epi16(kPixelUToG);
+    const __m128i vToG = _mm_set1_epi16(kPixelVToG);
+    const __m128i uToB = _mm_set1_epi16(kPixelUToB);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i cu = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (u + x / 2))), center);
+        __m128i cv = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (v + x / 2))), center);
+
+        __m128i channels[3][2];
+        for (int h = 0; h < 2; h++) {
+            __m128i l = _mm_add_epi16(_mm_slli_epi16(h == 0 ? _mm_unpacklo_epi8(luma, zero)
+                                                            : _mm_unpackhi_epi8(luma, zero), kPixelYuvShift), half);
+            __m128i pu = h == 0 ? _mm_unpacklo_epi16(cu, cu) : _mm_unpackhi_epi16(cu, cu);
+            __m128i pv = h == 0 ? _mm_unpacklo_epi16(cv, cv) : _mm_unpackhi_epi16(cv, cv);
+
+            channels[0][h] = _mm_srai_epi16(_mm_add_epi16(l, _mm_mullo_epi16(pv, vToR)), kPixelYuvShift);
+            channels[1][h] = _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(l, _mm_mullo_epi16(pu, uToG)),
+                                                          _mm_mullo_epi16(pv, vToG)), kPixelYuvShift);
+            channels[2][h] = _mm_srai_epi16(_mm_add_epi16(l, _mm_mullo_epi16(pu, uToB)), kPixelYuvShift);
+        }
+        store_rgba(_mm_packus_epi16(channels[0][0], channels[0][1]),
+                   _mm_packus_epi16(channels[1][0], channels[1][1]),
+                   _mm_packus_epi16(channels[2][0], channels[2][1]), rgba + x * 4);
+    }
+    for (; x < width; x++) {
+        pixel_yuv_to_rgba(y[x], u[x / 2], v[x / 2], rgba + x * 4);
+    }
+}
+
+// Luma of 4 RGBA pixels in 32 bit lanes, before rounding.
+static inline __m128i weigh_rgba(const uint8_t *rgba, __m128i weights) {
+    __m128i pixels = _mm_loadu_si128((const __m128i *) rgba);
+    __m128i low = _mm_madd_epi16(_mm_cvtepu8_epi16(pixels), weights);
+    __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, _mm_setzero_si128()), weights);
+    return _mm_hadd_epi32(low, high);
+}
+
+static void rgba_to_y_sse41(const uint8_t *rgba, uint8_t *y, size_t width) {
+    const __m128i weights = _mm_setr_epi16(kPixelRToY, kPixelGToY, kPixelBToY, 0,
+                                           kPixelRToY, kPixelGToY, kPixelBToY, 0);
+    const __m128i half = _mm_set1_epi32(1 << (kPixelRgbShift - 1));
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma[4];
+        for (int i = 0; i < 4; i++) {
+            luma[i] = _mm_srli_epi32(_mm_add_epi32(weigh_rgba(rgba + (x + i * 4) * 4, weights), half),
+                                     kPixelRgbShift);
+        }
+        _mm_storeu_si128((__m128i *) (y + x), _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]),
+                                                               _mm_packs_epi32(luma[2], luma[3])));
+    }
+    for (; x < width; x++) {
+        y[x] = pixel_rgb_to_y(rgba[x * 4], rgba[x * 4 + 1], rgba[x * 4 + 2]);
+    }
+}
+
+// Rounded means of the two 2x2 blocks of 4 pixels of two RGBA rows, as RGBA in 16 bit lanes.
+static inline __m128i block_means(const uint8_t *rgba0, const uint8_t *rgba1) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *) rgba0);
+    __m128i b = _mm_loadu_si128((const __m128i *) rgba1);
+    __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// Chroma of 4 blocks in 32 bit lanes, from their means and the weights of one component.
+static inline __m128i weigh_blocks(__m128i means0, __m128i means1, __m128i weights) {
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(means0, weights), _mm_madd_epi16(means1, weights));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (kPixelRgbShift - 1))), kPixelRgbShift);
+    return _mm_add_epi32(sum, _mm_set1_epi32(128));
+}
+
+static void rgba_to_uv_sse41(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *u, uint8_t *v,
+                             size_t width) {
+    const __m128i uWeights = _mm_setr_epi16(kPixelRToU, kPixelGToU, kPixelBToU, 0,
+                                            kPixelRToU, kPixelGToU, kPixelBToU, 0);
+    const __m128i vWeights = _mm_setr_epi16(kPixelRToV, kPixelGToV, kPixelBToV, 0,
+                                            kPixelRToV, kPixelGToV, kPixelBToV, 0);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i means[4];
+        for (int i = 0; i < 4; i++) {
+            means[i] = block_means(rgba0 + (x + i * 4) * 4, rgba1 + (x + i * 4) * 4);
+        }
+        __m128i cu = _mm_packs_epi32(weigh_blocks(means[0], means[1], uWeights),
+                                     weigh_blocks(means[2], means[3], uWeights));
+        __m128i cv = _mm_packs_epi32(weigh_blocks(means[0], means[1], vWeights),
+                                     weigh_blocks(means[2], means[3], vWeights));
+        _mm_storel_epi64((__m128i *) (u + x / 2), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64((__m128i *) (v + x / 2), _mm_packus_epi16(cv, cv));
+    }
+    for (; x < width; x += 2) {
+        int mean[3];
+        pixel_block_mean(rgba0, rgba1, x, mean);
+        u[x / 2] = pixel_rgb_to_u(mean[0], mean[1], mean[2]);
+        v[x / 2] = pixel_rgb_to_v(mean[0], mean[1], mean[2]);
+    }
+}
+
+// RGB565 of 4 RGBA pixels in 32 bit lanes.
+static inline __m128i pack_rgb565(const uint8_t *rgba) {
+    __m128i pixels = _mm_loadu_si128((const __m128i *) rgba);
+    __m128i r = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xf8)), 8);
+    __m128i g = _mm_srli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xfc00)), 5);
+    __m128i b = _mm_srli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xf80000)), 19);
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static void rgba_to_rgb565_sse41(const uint8_t *rgba, uint8_t *rgb565, size_t width) {
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        _mm_storeu_si128((__m128i *) (rgb565 + x * 2), _mm_packus_epi32(pack_rgb565(rgba + x * 4),
+                                                                        pack_rgb565(rgba + x * 4 + 16)));
+    }
+    for (; x < width; x++) {
+        uint16_t pixel = pixel_rgb_to_rgb565(rgba + x * 4);
+        rgb565[x * 2] = (uint8_t) pixel;
+        rgb565[x * 2 + 1] = (uint8_t) (pixel >> 8);
+    }
+}
+
+static void rgb565_to_rgba_sse41(const uint8_t *rgb565, uint8_t *rgba, size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i channels[3][2];
+        for (int h = 0; h < 2; h++) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) (rgb565 + (x + h * 8) * 2));
+            __m128i r = _mm_srli_epi16(pixels, 11);
+            __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), _mm_set1_epi16(0x3f));
+            __m128i b = _mm_and_si128(pixels, _mm_set1_epi16(0x1f));
+            channels[0][h] = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+            channels[1][h] = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+            channels[2][h] = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        }
+        store_rgba(_mm_packus_epi16(channels[0][0], channels[0][1]),
+                   _mm_packus_epi16(channels[1][0], channels[1][1]),
+                   _mm_packus_epi16(channels[2][0], channels[2][1]), rgba + x * 4);
+    }
+    for (; x < width; x++) {
+        pixel_rgb565_to_rgba((uint16_t) (rgb565[x * 2] | rgb565[x * 2 + 1] << 8), rgba + x * 4);
+    }
+}
+
+static void yuv_to_yuyv_sse41(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *yuyv,
+                              size_t width) {
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (u + x / 2)),
+                                       _mm_loadl_epi64((const __m128i *) (v + x / 2)));
+        _mm_storeu_si128((__m128i *) (yuyv + x * 2), _mm_unpacklo_epi8(luma, uv));
+        _mm_storeu_si128((__m128i *) (yuyv + x * 2 + 16), _mm_unpackhi_epi8(luma, uv));
+    }
+    for (; x < width; x += 2) {
+        yuyv[x * 2] = y[x];
+        yuyv[x * 2 + 1] = u[x / 2];
+        yuyv[x * 2 + 2] = y[x + 1];
+        yuyv[x * 2 + 3] = v[x / 2];
+    }
+}
+
+static void yuyv_to_y_sse41(const uint8_t *yuyv, uint8_t *y, size_t width) {
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (yuyv + x * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (yuyv + x * 2 + 16));
+        _mm_storeu_si128((__m128i *) (y + x), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+    }
+    for (; x < width; x++) {
+        y[x] = yuyv[x * 2];
+    }
+}
+
+static void yuyv_to_uv_sse41(const uint8_t *yuyv0, const uint8_t *yuyv1, uint8_t *u, uint8_t *v,
+                             size_t width) {
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i uv0 = _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i *) (yuyv0 + x * 2)), 8),
+                                       _mm_srli_epi16(_mm_loadu_si128((const __m128i *) (yuyv0 + x * 2 + 16)), 8));
+        __m128i uv1 = _mm_packus_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i *) (yuyv1 + x * 2)), 8),
+                                       _mm_srli_epi16(_mm_loadu_si128((const __m128i *) (yuyv1 + x * 2 + 16)), 8));
+        __m128i uv = _mm_avg_epu8(uv0, uv1);
+        __m128i cu = _mm_and_si128(uv, low);
+        __m128i cv = _mm_srli_epi16(uv, 8);
+        _mm_storel_epi64((__m128i *) (u + x / 2), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64((__m128i *) (v + x / 2), _mm_packus_epi16(cv, cv));
+    }
+    for (; x < width; x += 2) {
+        u[x / 2] = (uint8_t) ((yuyv0[x * 2 + 1] + yuyv1[x * 2 + 1] + 1) >> 1);
+        v[x / 2] = (uint8_t) ((yuyv0[x * 2 + 3] + yuyv1[x * 2 + 3] + 1) >> 1);
+    }
+}
+
+// Interleaving the first half of the rows with the second half moves the element at row r, column c
+// to row (r * 2 + c / (tile / 2)) % tile, column (c * 2 + r / (tile / 2)) % tile. Done log2(tile) times
+// that is the transpose: 4 rounds for 16 x 16 bytes, 3 for 8 x 8 of 2 bytes, 2 for 4 x 4 of 4 bytes.
+template<size_t kTile, __m128i (*interleaveLow)(__m128i, __m128i), __m128i (*interleaveHigh)(__m128i, __m128i)>
+static inline void transpose_tile(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    __m128i rows[kTile];
+    for (size_t i = 0; i < kTile; i++) {
+        rows[i] = _mm_loadu_si128((const __m128i *) (src + (ptrdiff_t) i * srcStride));
+    }
+
+    for (size_t round = 1; round < kTile; round *= 2) {
+        __m128i interleaved[kTile];
+        for (size_t i = 0; i < kTile / 2; i++) {
+            interleaved[i * 2] = interleaveLow(rows[i], rows[i + kTile / 2]);
+            interleaved[i * 2 + 1] = interleaveHigh(rows[i], rows[i + kTile / 2]);
+        }
+        for (size_t i = 0; i < kTile; i++) rows[i] = interleaved[i];
+    }
+
+    for (size_t i = 0; i < kTile; i++) {
+        _mm_storeu_si128((__m128i *) (dst + (ptrdiff_t) i * dstStride), rows[i]);
+    }
+}
+
+static inline __m128i unpacklo_8(__m128i a, __m128i b) { return _mm_unpacklo_epi8(a, b); }
+
+static inline __m128i unpackhi_8(__m128i a, __m128i b) { return _mm_unpackhi_epi8(a, b); }
+
+static inline __m128i unpacklo_16(__m128i a, __m128i b) { return _mm_unpacklo_epi16(a, b); }
+
+static inline __m128i unpackhi_16(__m128i a, __m128i b) { return _mm_unpackhi_epi16(a, b); }
+
+static inline __m128i unpacklo_32(__m128i a, __m128i b) { return _mm_unpacklo_epi32(a, b); }
+
+static inline __m128i unpackhi_32(__m128i a, __m128i b) { return _mm_unpackhi_epi32(a, b); }
+
+static void transpose_tile_8(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<16, unpacklo_8, unpackhi_8>(src, srcStride, dst, dstStride);
+}
+
+static void transpose_tile_16(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<8, unpacklo_16, unpackhi_16>(src, srcStride, dst, dstStride);
+}
+
+static void transpose_tile_32(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride) {
+    transpose_tile<4, unpacklo_32, unpackhi_32>(src, srcStride, dst, dstStride);
+}
+
+// Reverses 16 bytes at a time with order, a byte shuffle that reverses the elements of one register.
+static inline void reverse_elements(const uint8_t *src, uint8_t *dst, size_t count, size_t size, __m128i order) {
+    size_t elements = 16 / size;
+    size_t i = 0;
+    for (; i + elements <= count; i += elements) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (src + (count - i - elements) * size));
+        _mm_storeu_si128((__m128i *) (dst + i * size), _mm_shuffle_epi8(block, order));
+    }
+    pixel_reverse(src, dst + i * size, count - i, size);
+}
+
+static void reverse_8_sse41(const uint8_t *src, uint8_t *dst, size_t count) {
+    reverse_elements(src, dst, count, 1, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+static void reverse_16_sse41(const uint8_t *src, uint8_t *dst, size_t count) {
+    reverse_elements(src, dst, count, 2, _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+}
+
+static void reverse_32_sse41(const uint8_t *src, uint8_t *dst, size_t count) {
+    reverse_elements(src, dst, count, 4, _mm_setr_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+}
+
+const pixel_kernels *pixel_kernels_sse41() {
+    static const pixel_kernels kernels = {
+            "sse4.1",
+            split_uv_sse41,
+            merge_uv_sse41,
+            yuv_to_rgba_sse41,
+            rgba_to_y_sse41,
+            rgba_to_uv_sse41,
+            rgba_to_rgb565_sse41,
+            rgb565_to_rgba_sse41,
+            yuv_to_yuyv_sse41,
+            yuyv_to_y_sse41,
+            yuyv_to_uv_sse41,
+            pixel_transpose_tiles<1, 16, transpose_tile_8>,
+            pixel_transpose_tiles<2, 8, transpose_tile_16>,
+            pixel_transpose_tiles<4, 4, transpose_tile_32>,
+            reverse_8_sse41,
+            reverse_16_sse41,
+            reverse_32_sse41,
+    };
+    return &kernels;
+}
+
+#else
+
+const pixel_kernels *pixel_kernels_sse41() {
+    return nullptr;
+}
+
+#endif
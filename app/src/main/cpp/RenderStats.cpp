@@ -0,0 +1,76 @@
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <ctime>
+
+RenderStats::RenderStats() : m_enabled(false), m_windows() {
+
+}
+
+void RenderStats::setEnabled(bool enabled) {
+    if (enabled && !isEnabled()) {
+        // Samples from an earlier session would skew the new one.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &window: m_windows) {
+            window.next = 0;
+            window.count = 0;
+        }
+    }
+
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void RenderStats::record(Stage stage, int64_t nanoseconds) {
+    if (!isEnabled() || stage >= kStageCount) return;
+
+    recordSample(stage, nanoseconds);
+}
+
+void RenderStats::recordRatio(Ratio ratio, float value) {
+    if (!isEnabled() || ratio >= kRatioCount) return;
+
+    recordSample(kStageCount + ratio, (int64_t) (value * 1000000.0f + 0.5f));
+}
+
+void RenderStats::recordSample(size_t index, int64_t sample) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Window &window = m_windows[index];
+
+    window.samples[window.next] = sample;
+    window.next = (window.next + 1) % kWindowSize;
+    window.count = std::min(window.count + 1, kWindowSize);
+}
+
+void RenderStats::snapshot(float *values) const {
+    int64_t samples[kWindowSize];
+
+    for (size_t stage = 0; stage < kStageCount + kRatioCount; stage++) {
+        // Nanoseconds to microseconds, parts per million to percent.
+        float scale = stage < kStageCount ? 1000.0f : 10000.0f;
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            count = m_windows[stage].count;
+            std::copy(m_windows[stage].samples, m_windows[stage].samples + count, samples);
+        }
+
+        float *stageValues = values + stage * kValuesPerStage;
+        std::fill(stageValues, stageValues + kValuesPerStage, 0.0f);
+        if (!count) continue;
+
+        // Sorted outside the lock, recording never waits for a reader.
+        std::sort(samples, samples + count);
+
+        stageValues[0] = (float) count;
+        stageValues[1] = (float) samples[(count - 1) * 50 / 100] / scale;
+        stageValues[2] = (float) samples[(count - 1) * 95 / 100] / scale;
+        stageValues[3] = (float) samples[(count - 1) * 99 / 100] / scale;
+    }
+}
+
+int64_t RenderStats::now() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,87 @@
+#ifndef _RENDER_STATS_H_
+#define _RENDER_STATS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Rolling latency percentiles per pipeline stage, and percentiles of per frame ratios, over the last
+// kWindowSize samples of each. Recording is a single relaxed load while disabled.
+class RenderStats {
+public:
+    enum Stage {
+        // draw() on the ingest thread, queued frame to render thread, plane copy into the
+        // renderer, texture upload, CPU side of rendering, GPU execution, swap or present, and
+        // draw() to presented.
+        sIngest, sQueue, sCopy, sUpload, sRender, sGpu, sPresent, sLatency, kStageCount
+    };
+
+    enum Ratio {
+        // Share of the frame tiles uploaded, with tile updates on.
+        rDirtyTiles, kRatioCount
+    };
+
+    // Values per stage in snapshot(): sample count, p50, p95 and p99 in microseconds. Ratios follow
+    // the stages with as many values, percentiles in percent.
+    static const size_t kValuesPerStage = 4;
+    static const size_t kValueCount = (kStageCount + kRatioCount) * kValuesPerStage;
+    static const size_t kWindowSize = 256;
+
+    RenderStats();
+
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void record(Stage stage, int64_t nanoseconds);
+
+    // value in [0, 1].
+    void recordRatio(Ratio ratio, float value);
+
+    // Fills kValueCount values, zeros for stages and ratios without samples.
+    void snapshot(float *values) const;
+
+    // CLOCK_MONOTONIC in nanoseconds.
+    static int64_t now();
+
+private:
+    struct Window {
+        int64_t samples[kWindowSize];
+        size_t next;
+        size_t count;
+    };
+
+    void recordSample(size_t window, int64_t sample);
+
+    std::atomic<bool> m_enabled;
+    mutable std::mutex m_mutex;
+    // Stages, then ratios in parts per million.
+    Window m_windows[kStageCount + kRatioCount];
+};
+
+// Records the time from construction to destruction, if stats were enabled at construction.
+class StatsScope {
+public:
+    StatsScope(RenderStats &stats, RenderStats::Stage stage)
+            : m_stats(stats), m_stage(stage), m_start(stats.isEnabled() ? RenderStats::now() : 0) {
+
+    }
+
+    ~StatsScope() {
+        if (m_start) m_stats.record(m_stage, RenderStats::now() - m_start);
+    }
+
+    StatsScope(const StatsScope &) = delete;
+
+    StatsScope &operator=(const StatsScope &) = delete;
+
+private:
+    RenderStats &m_stats;
+    RenderStats::Stage m_stage;
+    int64_t m_start;
+};
+
+#endif //_RENDER_STATS_H_
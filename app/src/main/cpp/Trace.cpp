@@ -0,0 +1,176 @@
+#include "Trace.h"
+
+#if MEDIA_TRACE
+
+#include "Log.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Events kept per thread, the oldest are overwritten when nobody drains them in time.
+static const size_t kEventsPerThread = 8192;
+
+enum trace_event_type : uint8_t {
+    eBegin, eEnd, eCounter, eFrame
+};
+
+struct trace_event {
+    const char *name;
+    int64_t timestamp;
+    int64_t value;
+    trace_event_type type;
+};
+
+// Written only by its own thread. Trace::write() reads the events before the published count and
+// drops the ones the thread may have overwritten meanwhile.
+struct thread_buffer {
+    trace_event events[kEventsPerThread];
+    std::atomic<uint64_t> written;
+    uint64_t drained;
+    pid_t tid;
+    char name[16];
+};
+
+std::atomic<bool> Trace::s_enabled(false);
+
+// Buffers outlive their threads, so write() never reads freed memory.
+static std::mutex s_buffersMutex;
+static std::vector<std::unique_ptr<thread_buffer>> s_buffers;
+static thread_local thread_buffer *t_buffer = nullptr;
+
+static int64_t trace_time() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static thread_buffer *thread_trace_buffer() {
+    if (t_buffer) return t_buffer;
+
+    // Once per thread, every later event is recorded without locking.
+    std::unique_ptr<thread_buffer> buffer(new thread_buffer());
+    buffer->tid = (pid_t) syscall(SYS_gettid);
+    prctl(PR_GET_NAME, buffer->name);
+
+    for (char &c: buffer->name) {
+        if (c == '"' || c == '\\') c = '_';
+    }
+
+    std::lock_guard<std::mutex> lock(s_buffersMutex);
+    t_buffer = buffer.get();
+    s_buffers.push_back(std::move(buffer));
+
+    return t_buffer;
+}
+
+static void record(trace_event_type type, const char *name, int64_t value) {
+    thread_buffer *buffer = thread_trace_buffer();
+    uint64_t index = buffer->written.load(std::memory_order_relaxed);
+
+    trace_event &event = buffer->events[index % kEventsPerThread];
+    event.name = name;
+    event.timestamp = trace_time();
+    event.value = value;
+    event.type = type;
+
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+void Trace::setEnabled(bool enabled) {
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Trace::begin(const char *name) {
+    record(eBegin, name, 0);
+}
+
+void Trace::end() {
+    record(eEnd, nullptr, 0);
+}
+
+void Trace::counter(const char *name, int64_t value) {
+    record(eCounter, name, value);
+}
+
+void Trace::frame(uint64_t id) {
+    record(eFrame, "frame", (int64_t) id);
+}
+
+bool Trace::write(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        LOGE("Could not open trace file %s.", path);
+        return false;
+    }
+
+    auto pid = (int) getpid();
+    std::vector<trace_event> events;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"media-lib\"}}", pid);
+
+    std::lock_guard<std::mutex> lock(s_buffersMutex);
+
+    for (auto &buffer: s_buffers) {
+        auto tid = (int) buffer->tid;
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t first = std::max(buffer->drained, written > kEventsPerThread ? written - kEventsPerThread : 0);
+
+        events.clear();
+        for (uint64_t i = first; i < written; i++) {
+            events.push_back(buffer->events[i % kEventsPerThread]);
+        }
+
+        // The thread may be writing over the slot after the last one it published.
+        uint64_t published = buffer->written.load(std::memory_order_acquire);
+        uint64_t valid = published + 1 > kEventsPerThread ? published + 1 - kEventsPerThread : 0;
+        buffer->drained = written;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                pid, tid, buffer->name);
+
+        for (uint64_t i = std::max(first, valid); i < written; i++) {
+            const trace_event &event = events[i - first];
+            double ts = (double) event.timestamp / 1000.0;
+
+            switch (event.type) {
+                case eBegin:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                            event.name, ts, pid, tid);
+                    break;
+                case eEnd:
+                    fprintf(file, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}", ts, pid, tid);
+                    break;
+                case eCounter:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                                  "\"args\":{\"value\":%" PRId64 "}}", event.name, ts, pid, tid, event.value);
+                    break;
+                case eFrame:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                                  "\"args\":{\"id\":%" PRId64 "}}", event.name, ts, pid, tid, event.value);
+                    break;
+            }
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool written = !ferror(file);
+    if (fclose(file) || !written) {
+        LOGE("Could not write trace file %s.", path);
+        return false;
+    }
+
+    return true;
+}
+
+#endif
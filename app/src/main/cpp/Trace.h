@@ -0,0 +1,72 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+// Trace points compile to nothing unless MEDIA_TRACE is set, which debug builds do. Even then
+// nothing is recorded until Trace::setEnabled(true). Names must be string literals.
+#if MEDIA_TRACE
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class Trace {
+public:
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void begin(const char *name);
+
+    static void end();
+
+    static void counter(const char *name, int64_t value);
+
+    // Marks the frame the calling thread works on from here.
+    static void frame(uint64_t id);
+
+    // Drains every thread's events recorded since the last call to a Chrome trace event JSON
+    // file, which chrome://tracing and the Perfetto UI open. Returns false if it can't be written.
+    static bool write(const char *path);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : m_active(Trace::isEnabled()) {
+        if (m_active) Trace::begin(name);
+    }
+
+    ~TraceScope() {
+        if (m_active) Trace::end();
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    bool m_active;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) \
+    do { if (Trace::isEnabled()) Trace::counter(name, (int64_t) (value)); } while (0)
+#define TRACE_FRAME(id) \
+    do { if (Trace::isEnabled()) Trace::frame((uint64_t) (id)); } while (0)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#define TRACE_FRAME(id) do {} while (0)
+
+#endif
+
+#endif //_TRACE_H_
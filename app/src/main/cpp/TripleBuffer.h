@@ -0,0 +1,50 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer value exchange where neither side ever waits. The writer
+// fills back() and publishes it, the reader swaps in the latest published value with update()
+// and reads it from front() until its next update(). Writers on several threads must serialize.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_buffers(), m_back(0), m_front(1), m_middle(2) {
+
+    }
+
+    T &back() {
+        return m_buffers[m_back];
+    }
+
+    void publish() {
+        uint8_t previous = m_middle.exchange((uint8_t) (m_back | kFresh), std::memory_order_acq_rel);
+        m_back = (uint8_t) (previous & kIndexMask);
+    }
+
+    // Returns true when a value was published since the last call.
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & kFresh)) return false;
+
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = (uint8_t) (previous & kIndexMask);
+
+        return true;
+    }
+
+    const T &front() const {
+        return m_buffers[m_front];
+    }
+
+private:
+    static const uint8_t kIndexMask = 0x03;
+    static const uint8_t kFresh = 0x04;
+
+    T m_buffers[3];
+    uint8_t m_back;
+    uint8_t m_front;
+    std::atomic<uint8_t> m_middle;
+};
+
+#endif //_TRIPLE_BUFFER_H_
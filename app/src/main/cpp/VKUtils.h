@@ -1,7 +1,7 @@
 #ifndef _VK_UTILS_H_
 #define _VK_UTILS_H_
 
-#include <android/asset_manager_jni.h>
+#include <android/asset_manager.h>
 #include <vulkan/vulkan.h>
 
 bool createShaderModuleFromAsset(VkDevice device, const char *shaderFilePath,
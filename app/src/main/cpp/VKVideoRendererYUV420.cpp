@@ -2,30 +2,63 @@
 #include "VKUtils.h"
 #include "CommonUtils.h"
 #include "Log.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
 #include <cstring>
 #include <vulkan/vulkan.h>
+
+#ifdef __ANDROID__
 #include <vulkan/vulkan_android.h>
+#endif
+
+// Luma pixels kept around the view, textures are sampled with the nearest texel.
+static const size_t kRegionApron = 2;
+
+// Values per stats slot, 48 of them used, and the most samples the stats pass reads along each side.
+static const uint32_t kStatsSlotValues = 64;
+static const size_t kStatsGridSize = 512;
+
+// Push constants of video_stats.comp.
+struct stats_params {
+    int32_t grid[2];
+    int32_t step;
+    uint32_t base;
+};
 
 VKVideoRendererYUV420::VKVideoRendererYUV420()
         : texType{tTexY, tTexU, tTexV},
-          m_pBuffer(nullptr),
+          m_lutIndex(0),
           m_indexCount(0) {
     m_deviceInfo.initialized = false;
+    m_deviceInfo.surface = VK_NULL_HANDLE;
+    m_render.queryPool = VK_NULL_HANDLE;
+    m_statsPass.readIndex = UINT32_MAX;
 }
 
 VKVideoRendererYUV420::~VKVideoRendererYUV420() {
+    // The last frame may still be on the GPU, nothing waits for it after submission.
+    if (isInitialized()) {
+        vkDeviceWaitIdle(m_deviceInfo.device);
+    }
+
     deleteCommandPool();
+    deleteStatsPass();
     deleteGraphicsPipeline();
     deleteTextures();
+    deleteLutTexture();
     deleteUniformBuffers();
     deleteBuffers();
     deleteRenderPass();
     deleteSwapChain();
+    deleteOffscreenTarget();
 
     vkDestroyDevice(m_deviceInfo.device, nullptr);
+    if (m_deviceInfo.surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(m_deviceInfo.instance, m_deviceInfo.surface, nullptr);
+    }
     vkDestroyInstance(m_deviceInfo.instance, nullptr);
 
     m_deviceInfo.initialized = false;
@@ -36,6 +69,7 @@ void VKVideoRendererYUV420::createRenderPipeline() {
     createFrameBuffers(); // Create 2 frame buffers.
     createVertexBuffer();
     createIndexBuffer();
+    createLutTexture();
     createUniformBuffers();
     createTextures();
     createProgram(nullptr, nullptr); // Create graphics pipeline
@@ -52,6 +86,11 @@ void VKVideoRendererYUV420::init(ANativeWindow *window, AAssetManager *assetMana
 
     m_assetManager = assetManager;
 
+    if (assetManager && m_luts.empty()) {
+        m_luts = loadCubeLuts(assetManager);
+        m_lutCount = m_luts.size();
+    }
+
     VkApplicationInfo appInfo = {
             .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
             .pNext = nullptr,
@@ -63,55 +102,148 @@ void VKVideoRendererYUV420::init(ANativeWindow *window, AAssetManager *assetMana
     };
 
     createDevice(window, &appInfo);
-    createSwapChain();
+
+    if (isOffscreen()) {
+        createOffscreenTarget();
+    } else {
+        createSwapChain();
+    }
 }
 
 void VKVideoRendererYUV420::render() {
-    uint32_t nextIndex;
-    // Get the framebuffer index we should draw in
-    CALL_VK(vkAcquireNextImageKHR(m_deviceInfo.device, m_swapchainInfo.swapchain, UINT64_MAX,
-                                  m_render.semaphore, VK_NULL_HANDLE, &nextIndex))
-    CALL_VK(vkResetFences(m_deviceInfo.device, 1, &m_render.fence))
+    if (isOffscreen()) {
+        TRACE_SCOPE("submit");
+        StatsScope scope(m_stats, RenderStats::sRender);
 
-    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo submitInfo{
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .pNext = nullptr,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &m_render.semaphore,
-            .pWaitDstStageMask = &waitStageMask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &m_render.cmdBuffer[nextIndex],
-            .signalSemaphoreCount = 0,
-            .pSignalSemaphores = nullptr
-    };
-    CALL_VK(vkQueueSubmit(m_deviceInfo.queue, 1, &submitInfo, m_render.fence))
-    CALL_VK(vkWaitForFences(m_deviceInfo.device, 1, &m_render.fence, VK_TRUE, 100000000))
+        CALL_VK(vkResetFences(m_deviceInfo.device, 1, &m_render.fence))
+
+        VkSubmitInfo submitInfo{
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = nullptr,
+                .waitSemaphoreCount = 0,
+                .pWaitSemaphores = nullptr,
+                .pWaitDstStageMask = nullptr,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &m_render.cmdBuffer[0],
+                .signalSemaphoreCount = 0,
+                .pSignalSemaphores = nullptr
+        };
+        CALL_VK(vkQueueSubmit(m_deviceInfo.queue, 1, &submitInfo, m_render.fence))
+        m_render.timedIndex = 0;
+        m_statsPass.readIndex = m_statsPass.recorded ? 0 : UINT32_MAX;
+
+        readTarget();
+        return;
+    }
 
+    uint32_t nextIndex;
+    {
+        TRACE_SCOPE("submit");
+        StatsScope scope(m_stats, RenderStats::sRender);
+
+        // Get the framebuffer index we should draw in
+        CALL_VK(vkAcquireNextImageKHR(m_deviceInfo.device, m_swapchainInfo.swapchain, UINT64_MAX,
+                                      m_render.semaphore, VK_NULL_HANDLE, &nextIndex))
+        CALL_VK(vkResetFences(m_deviceInfo.device, 1, &m_render.fence))
+
+        VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        VkSubmitInfo submitInfo{
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = nullptr,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &m_render.semaphore,
+                .pWaitDstStageMask = &waitStageMask,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &m_render.cmdBuffer[nextIndex],
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &m_render.renderSemaphores[nextIndex]
+        };
+        CALL_VK(vkQueueSubmit(m_deviceInfo.queue, 1, &submitInfo, m_render.fence))
+        m_render.timedIndex = nextIndex;
+        m_statsPass.readIndex = m_statsPass.recorded ? nextIndex : UINT32_MAX;
+    }
+
+    // Presentation waits on the GPU, not on the CPU, the fence is only waited on by the next draw().
     VkResult result;
     VkPresentInfoKHR presentInfo{
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .pNext = nullptr,
-            .waitSemaphoreCount = 0,
-            .pWaitSemaphores = nullptr,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &m_render.renderSemaphores[nextIndex],
             .swapchainCount = 1,
             .pSwapchains = &m_swapchainInfo.swapchain,
             .pImageIndices = &nextIndex,
             .pResults = &result,
     };
+    TRACE_SCOPE("present");
+    StatsScope scope(m_stats, RenderStats::sPresent);
     vkQueuePresentKHR(m_deviceInfo.queue, &presentInfo);
 }
 
-void VKVideoRendererYUV420::draw(uint8_t *buffer, size_t length, size_t width, size_t height,
-                                 float rotation, bool mirror) {
-    m_pBuffer = buffer;
-    m_rotation = rotation;
-    m_mirror = mirror;
+void VKVideoRendererYUV420::readTarget() {
+    TRACE_SCOPE("read target");
+
+    // The command buffer ends with the copy to the readback buffer, made visible to the host.
+    CALL_VK(vkWaitForFences(m_deviceInfo.device, 1, &m_render.fence, VK_TRUE, UINT64_MAX))
+    readTimestamps();
+    readGpuStats();
+
+    m_frameCallback((const uint8_t *) m_offscreen.mapped, m_swapchainInfo.displaySize.width,
+                    m_swapchainInfo.displaySize.height);
+}
+
+void VKVideoRendererYUV420::readTimestamps() {
+    if (!m_stats.isEnabled() || m_render.queryPool == VK_NULL_HANDLE ||
+        m_render.timedIndex == UINT32_MAX) {
+        return;
+    }
+
+    // The fence passed, so the results are in unless the wait for it timed out.
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(m_deviceInfo.device, m_render.queryPool, m_render.timedIndex * 2, 2,
+                              sizeof(timestamps), timestamps, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & m_deviceInfo.timestampMask;
+        m_stats.record(RenderStats::sGpu, (int64_t) ((double) ticks * m_deviceInfo.timestampPeriod));
+    }
+
+    m_render.timedIndex = UINT32_MAX;
+}
+
+void VKVideoRendererYUV420::draw(FrameRef frame, float rotation, bool mirror) {
+    TRACE_SCOPE("draw");
+
+    size_t width = frame.width();
+    size_t height = frame.height();
+
+    // Drawing happens on the calling thread, so the snapshot is taken right away.
+    setTransform(rotation, mirror);
+    bool parametersChanged = acquireParameters();
+
+    // The previous frame must be done with the textures before they are rewritten or recreated.
+    if (isInitialized()) {
+        TRACE_SCOPE("fence wait");
+        CALL_VK(vkWaitForFences(m_deviceInfo.device, 1, &m_render.fence, VK_TRUE, 100000000))
+        readTimestamps();
+        readGpuStats();
+    }
+
+    m_frame = std::move(frame);
+    m_frameWidth = width;
+    m_frameHeight = height;
 
-    if (isInitialized() && (m_frameWidth != width || m_frameHeight != height)) {
-        m_frameWidth = width;
-        m_frameHeight = height;
+    // Another LUT is uploaded before the uniforms, descriptors and command buffers are updated for it.
+    bool lutChanged = isInitialized() && selectedLut() != m_lutIndex;
+    if (lutChanged) {
+        deleteLutTexture();
+        createLutTexture();
+    }
+
+    // Textures only hold the region in view, a zoom that changes its size recreates them.
+    bool regionChanged = updateRegion(kRegionApron);
+    bool resized = textures[tTexY].width != m_region.width || textures[tTexY].height != m_region.height;
 
+    if (isInitialized() && resized) {
         deleteUniformBuffers();
         deleteTextures();
         deleteCommandPool();
@@ -120,33 +252,42 @@ void VKVideoRendererYUV420::draw(uint8_t *buffer, size_t length, size_t width, s
         createTextures();
         updateDescriptorSet();
         createCommandPool();
-    } else {
-        m_frameWidth = width;
-        m_frameHeight = height;
+    } else if (isInitialized() && (regionChanged || parametersChanged)) {
+        updateUniformBuffers();
+        writeUniformBuffers();
+    }
+
+    // The stats pass is part of the prerecorded command buffers, turning it on or off records them again.
+    bool statsToggled = m_params.gpuStats != m_statsPass.recorded && !m_statsPass.unsupported;
+    if (isInitialized() && !resized && (statsToggled || lutChanged)) {
+        if (lutChanged) {
+            writeUniformBuffers();
+            updateDescriptorSet();
+        }
+
+        deleteCommandPool();
+        createCommandPool();
     }
 
     if (!isInitialized()) {
         createRenderPipeline();
     } else {
+        TRACE_SCOPE("upload textures");
+        StatsScope scope(m_stats, RenderStats::sUpload);
         updateTextures();
     }
 
+    // The planes are in the textures now, the frame can go back to its owner.
+    m_frame.reset();
+
     if (isInitialized()) {
         render();
     }
 }
 
-void VKVideoRendererYUV420::setParameters(uint32_t params) {
-    m_params = params;
-}
-
-uint32_t VKVideoRendererYUV420::getParameters() {
-    return m_params;
-}
-
 bool VKVideoRendererYUV420::createTextures() {
     for (int i = 0; i < kTextureCount; i++) {
-        loadTexture(m_pBuffer, texType[i], m_frameWidth, m_frameHeight, &textures[i],
+        loadTexture(texType[i], m_region.width, m_region.height, &textures[i],
                     VK_IMAGE_USAGE_SAMPLED_BIT,
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
@@ -189,13 +330,48 @@ bool VKVideoRendererYUV420::createTextures() {
 }
 
 bool VKVideoRendererYUV420::updateTextures() {
+    // The mapped textures keep their texels between frames, so only changed tiles need rewriting.
+    if (m_params.tileUpdates) {
+        size_t dirtyTiles = m_tiles.update(m_frame.planes(), m_region, m_params.tileThreshold);
+        if (m_tiles.count()) {
+            m_stats.recordRatio(RenderStats::rDirtyTiles, (float) dirtyTiles / (float) m_tiles.count());
+        }
+
+        if (dirtyTiles < m_tiles.count()) {
+            copyChangedTiles();
+            return true;
+        }
+    } else {
+        m_tiles.reset();
+    }
+
     for (int i = 0; i < kTextureCount; i++) {
-        size_t offset = getBufferOffset(&textures[i], texType[i], m_frameWidth, m_frameHeight);
-        copyTextureData(&textures[i], m_pBuffer + offset);
+        setTextureSize(&textures[i], texType[i], m_region.width, m_region.height);
+        copyTextureData(&textures[i], texType[i]);
     }
     return true;
 }
 
+void VKVideoRendererYUV420::copyChangedTiles() {
+    for (size_t row = 0; row < m_tiles.rows(); row++) {
+        for (size_t column = 0; column < m_tiles.columns(); column++) {
+            if (!m_tiles.isDirty(column, row)) continue;
+
+            size_t x, y, width, height;
+            m_tiles.tileRect(column, row, x, y, width, height);
+
+            copyTextureRect(&textures[tTexY], tTexY, x, y, width, height);
+
+            size_t chromaX = x / 2;
+            size_t chromaY = y / 2;
+            size_t chromaWidth = (x + width) / 2 - chromaX;
+            size_t chromaHeight = (y + height) / 2 - chromaY;
+            copyTextureRect(&textures[tTexU], tTexU, chromaX, chromaY, chromaWidth, chromaHeight);
+            copyTextureRect(&textures[tTexV], tTexV, chromaX, chromaY, chromaWidth, chromaHeight);
+        }
+    }
+}
+
 void VKVideoRendererYUV420::deleteTextures() const {
     for (auto &texture: textures) {
         vkDestroyImageView(m_deviceInfo.device, texture.view, nullptr);
@@ -206,6 +382,145 @@ void VKVideoRendererYUV420::deleteTextures() const {
     }
 }
 
+uint32_t VKVideoRendererYUV420::getParameters() {
+    return VideoRenderer::getParameters() | ((m_lutCount.load() << 20) & 0x00F00000);
+}
+
+size_t VKVideoRendererYUV420::selectedLut() const {
+    return m_params.lut <= m_luts.size() ? m_params.lut : 0;
+}
+
+void VKVideoRendererYUV420::createLutTexture() {
+    m_lutIndex = selectedLut();
+
+    CubeLut identity;
+    if (!m_lutIndex) {
+        identity.generate(2, [](const float in[3], float out[3]) {
+            std::copy_n(in, 3, out);
+        });
+    }
+
+    const CubeLut &lut = m_lutIndex ? m_luts[m_lutIndex - 1] : identity;
+    auto size = (uint32_t) lut.size();
+    m_ubo.lutSize = m_lutIndex ? (float) size : 0.0f;
+
+    std::vector<uint8_t> rgba;
+    lut.toRGBA(rgba);
+
+    // Linear tiling is only guaranteed for 2D images, the LUT goes through a staging buffer.
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(rgba.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingBufferMemory);
+
+    void *data = nullptr;
+    CALL_VK(vkMapMemory(m_deviceInfo.device, stagingBufferMemory, 0, rgba.size(), 0, &data))
+    memcpy(data, rgba.data(), rgba.size());
+    vkUnmapMemory(m_deviceInfo.device, stagingBufferMemory);
+
+    const VkImageCreateInfo imageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_3D,
+            .format = kLutFormat,
+            .extent = {size, size, size},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &m_deviceInfo.queueFamilyIndex,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    CALL_VK(vkCreateImage(m_deviceInfo.device, &imageCreateInfo, nullptr, &m_lutTexture.image))
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(m_deviceInfo.device, m_lutTexture.image, &memReqs);
+    VkMemoryAllocateInfo memAlloc{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .allocationSize = memReqs.size,
+            .memoryTypeIndex = 0,
+    };
+    mapMemoryTypeToIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
+    CALL_VK(vkAllocateMemory(m_deviceInfo.device, &memAlloc, nullptr, &m_lutTexture.mem))
+    CALL_VK(vkBindImageMemory(m_deviceInfo.device, m_lutTexture.image, m_lutTexture.mem, 0))
+
+    VkCommandPool cmdPool;
+    VkCommandBuffer cmdBuffer = beginOneTimeCommands(cmdPool);
+
+    setImageLayout(cmdBuffer, m_lutTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    VkBufferImageCopy copyRegion{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {size, size, size},
+    };
+    vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer, m_lutTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copyRegion);
+
+    setImageLayout(cmdBuffer, m_lutTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    endOneTimeCommands(cmdPool, cmdBuffer);
+
+    vkDestroyBuffer(m_deviceInfo.device, stagingBuffer, nullptr);
+    vkFreeMemory(m_deviceInfo.device, stagingBufferMemory, nullptr);
+
+    // The shader fetches the corners of the lattice cell with texelFetch and interpolates itself.
+    const VkSamplerCreateInfo sampler{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .pNext = nullptr,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0.0f,
+            .maxAnisotropy = 1,
+            .compareOp = VK_COMPARE_OP_NEVER,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+            .unnormalizedCoordinates = VK_FALSE,
+    };
+    const VkImageViewCreateInfo view{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .image = m_lutTexture.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_3D,
+            .format = kLutFormat,
+            .components = {
+                    VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+                    VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A},
+            .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+    };
+
+    CALL_VK(vkCreateSampler(m_deviceInfo.device, &sampler, nullptr, &m_lutTexture.sampler))
+    CALL_VK(vkCreateImageView(m_deviceInfo.device, &view, nullptr, &m_lutTexture.view))
+
+    m_lutTexture.width = size;
+    m_lutTexture.height = size;
+}
+
+void VKVideoRendererYUV420::deleteLutTexture() const {
+    vkDestroyImageView(m_deviceInfo.device, m_lutTexture.view, nullptr);
+    vkDestroyImage(m_deviceInfo.device, m_lutTexture.image, nullptr);
+    vkDestroySampler(m_deviceInfo.device, m_lutTexture.sampler, nullptr);
+    vkFreeMemory(m_deviceInfo.device, m_lutTexture.mem, nullptr);
+}
+
 void VKVideoRendererYUV420::deleteRenderPass() const {
     vkDestroyRenderPass(m_deviceInfo.device, m_render.renderPass, nullptr);
 }
@@ -219,10 +534,17 @@ VKVideoRendererYUV420::createDevice(ANativeWindow *platformWindow, VkApplication
     std::vector<const char *> instance_extensions;
     std::vector<const char *> device_extensions;
 
-    instance_extensions.push_back("VK_KHR_surface");
-    instance_extensions.push_back("VK_KHR_android_surface");
+    // Offscreen rendering needs neither a surface nor a swapchain.
+    if (!isOffscreen()) {
+        instance_extensions.push_back("VK_KHR_surface");
+#ifdef __ANDROID__
+        instance_extensions.push_back("VK_KHR_android_surface");
+#else
+        instance_extensions.push_back("VK_EXT_headless_surface");
+#endif
 
-    device_extensions.push_back("VK_KHR_swapchain");
+        device_extensions.push_back("VK_KHR_swapchain");
+    }
 
     // Create the Vulkan instance
     VkInstanceCreateInfo instanceCreateInfo{
@@ -235,15 +557,34 @@ VKVideoRendererYUV420::createDevice(ANativeWindow *platformWindow, VkApplication
             .ppEnabledExtensionNames = instance_extensions.data(),
     };
     CALL_VK(vkCreateInstance(&instanceCreateInfo, nullptr, &m_deviceInfo.instance))
-    VkAndroidSurfaceCreateInfoKHR createInfo{
-            .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
-            .pNext = nullptr,
-            .flags = 0,
-            .window = platformWindow
-    };
 
-    CALL_VK(vkCreateAndroidSurfaceKHR(m_deviceInfo.instance, &createInfo, nullptr,
-                                      &m_deviceInfo.surface))
+#ifdef __ANDROID__
+    if (!isOffscreen()) {
+        VkAndroidSurfaceCreateInfoKHR createInfo{
+                .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
+                .pNext = nullptr,
+                .flags = 0,
+                .window = platformWindow
+        };
+
+        CALL_VK(vkCreateAndroidSurfaceKHR(m_deviceInfo.instance, &createInfo, nullptr,
+                                          &m_deviceInfo.surface))
+    }
+#else
+    // Host tools have no window, they present to a headless surface where they don't render offscreen.
+    if (!isOffscreen()) {
+        VkHeadlessSurfaceCreateInfoEXT createInfo{
+                .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+                .pNext = nullptr,
+                .flags = 0
+        };
+
+        auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(
+                m_deviceInfo.instance, "vkCreateHeadlessSurfaceEXT");
+        assert(createHeadlessSurface);
+        CALL_VK(createHeadlessSurface(m_deviceInfo.instance, &createInfo, nullptr, &m_deviceInfo.surface))
+    }
+#endif
     // Find one GPU to use:
     // On Android, every GPU device is equal -- supporting
     // graphics/compute/present
@@ -276,6 +617,15 @@ VKVideoRendererYUV420::createDevice(ANativeWindow *platformWindow, VkApplication
     }
     assert(queueFamilyIndex < queueFamilyCount);
     m_deviceInfo.queueFamilyIndex = queueFamilyIndex;
+
+    // GPU timing for the stats, where the graphics queue writes timestamps.
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_deviceInfo.physicalDevice, &deviceProperties);
+    uint32_t timestampBits = queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+    m_deviceInfo.compute = (queueFamilyProperties[queueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    m_deviceInfo.timestampPeriod = deviceProperties.limits.timestampPeriod;
+    m_deviceInfo.timestampMask = timestampBits >= 64 ? UINT64_MAX
+                                                     : timestampBits ? (1ull << timestampBits) - 1 : 0;
     // Create a logical device (vulkan device)
     float priorities[] = {
             1.0f,
@@ -331,6 +681,11 @@ void VKVideoRendererYUV420::createSwapChain() {
     }
     assert(chosenFormat < formatCount);
 
+    // Surfaces without a size of their own, such as headless ones, take the one the renderer was given.
+    if (surfaceCapabilities.currentExtent.width == UINT32_MAX) {
+        surfaceCapabilities.currentExtent = {static_cast<uint32_t>(m_surfaceWidth),
+                                             static_cast<uint32_t>(m_surfaceHeight)};
+    }
     m_swapchainInfo.displaySize = surfaceCapabilities.currentExtent;
     m_swapchainInfo.displayFormat = formats[chosenFormat].format;
 
@@ -361,13 +716,72 @@ void VKVideoRendererYUV420::createSwapChain() {
                                     &m_swapchainInfo.swapchainLength, nullptr))
 }
 
+void VKVideoRendererYUV420::createOffscreenTarget() {
+    m_swapchainInfo.swapchain = VK_NULL_HANDLE;
+    m_swapchainInfo.swapchainLength = 1;
+    m_swapchainInfo.displaySize = {static_cast<uint32_t>(m_surfaceWidth), static_cast<uint32_t>(m_surfaceHeight)};
+    m_swapchainInfo.displayFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    m_swapchainInfo.displayImages = std::make_unique<VkImage[]>(1);
+
+    VkImageCreateInfo imageCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = m_swapchainInfo.displayFormat,
+            .extent = {m_swapchainInfo.displaySize.width, m_swapchainInfo.displaySize.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &m_deviceInfo.queueFamilyIndex,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    CALL_VK(vkCreateImage(m_deviceInfo.device, &imageCreateInfo, nullptr, &m_swapchainInfo.displayImages[0]))
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(m_deviceInfo.device, m_swapchainInfo.displayImages[0], &memReqs);
+    VkMemoryAllocateInfo memAlloc = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .allocationSize = memReqs.size,
+            .memoryTypeIndex = 0,
+    };
+    VK_CHECK(allocateMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                              &memAlloc.memoryTypeIndex))
+    CALL_VK(vkAllocateMemory(m_deviceInfo.device, &memAlloc, nullptr, &m_offscreen.imageMemory))
+    CALL_VK(vkBindImageMemory(m_deviceInfo.device, m_swapchainInfo.displayImages[0], m_offscreen.imageMemory, 0))
+
+    // Coherent, so the mapped pixels are current once the fence passed.
+    VkDeviceSize size = (VkDeviceSize) m_surfaceWidth * m_surfaceHeight * 4;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 m_offscreen.buffer, m_offscreen.bufferMemory);
+    CALL_VK(vkMapMemory(m_deviceInfo.device, m_offscreen.bufferMemory, 0, size, 0, &m_offscreen.mapped))
+}
+
+void VKVideoRendererYUV420::deleteOffscreenTarget() const {
+    if (m_offscreen.buffer == VK_NULL_HANDLE) return;
+
+    vkUnmapMemory(m_deviceInfo.device, m_offscreen.bufferMemory);
+    vkDestroyBuffer(m_deviceInfo.device, m_offscreen.buffer, nullptr);
+    vkFreeMemory(m_deviceInfo.device, m_offscreen.bufferMemory, nullptr);
+    vkDestroyImage(m_deviceInfo.device, m_swapchainInfo.displayImages[0], nullptr);
+    vkFreeMemory(m_deviceInfo.device, m_offscreen.imageMemory, nullptr);
+}
+
 void VKVideoRendererYUV420::deleteSwapChain() const {
     for (int i = 0; i < m_swapchainInfo.swapchainLength; i++) {
         vkDestroyFramebuffer(m_deviceInfo.device, m_swapchainInfo.framebuffers[i], nullptr);
         vkDestroyImageView(m_deviceInfo.device, m_swapchainInfo.displayViews[i], nullptr);
     }
 
-    vkDestroySwapchainKHR(m_deviceInfo.device, m_swapchainInfo.swapchain, nullptr);
+    if (m_swapchainInfo.swapchain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(m_deviceInfo.device, m_swapchainInfo.swapchain, nullptr);
+    }
 }
 
 void VKVideoRendererYUV420::deleteCommandPool() const {
@@ -376,6 +790,12 @@ void VKVideoRendererYUV420::deleteCommandPool() const {
     vkDestroyCommandPool(m_deviceInfo.device, m_render.cmdPool, nullptr);
     vkDestroyFence(m_deviceInfo.device, m_render.fence, nullptr);
     vkDestroySemaphore(m_deviceInfo.device, m_render.semaphore, nullptr);
+    for (uint32_t i = 0; i < m_render.cmdBufferLen; i++) {
+        vkDestroySemaphore(m_deviceInfo.device, m_render.renderSemaphores[i], nullptr);
+    }
+    if (m_render.queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_deviceInfo.device, m_render.queryPool, nullptr);
+    }
 }
 
 void VKVideoRendererYUV420::deleteGraphicsPipeline() {
@@ -388,14 +808,16 @@ void VKVideoRendererYUV420::deleteGraphicsPipeline() {
 }
 
 void VKVideoRendererYUV420::createFrameBuffers(VkImageView depthView) {
-    // query display attachment to swapchain
-    uint32_t swapchainImagesCount = 0;
-    CALL_VK(vkGetSwapchainImagesKHR(m_deviceInfo.device, m_swapchainInfo.swapchain,
-                                    &swapchainImagesCount, nullptr))
-    m_swapchainInfo.displayImages = std::make_unique<VkImage[]>(swapchainImagesCount);
-    CALL_VK(vkGetSwapchainImagesKHR(m_deviceInfo.device, m_swapchainInfo.swapchain,
-                                    &swapchainImagesCount,
-                                    m_swapchainInfo.displayImages.get()))
+    // query display attachment to swapchain, the offscreen target has its one image already
+    uint32_t swapchainImagesCount = m_swapchainInfo.swapchainLength;
+    if (!isOffscreen()) {
+        CALL_VK(vkGetSwapchainImagesKHR(m_deviceInfo.device, m_swapchainInfo.swapchain,
+                                        &swapchainImagesCount, nullptr))
+        m_swapchainInfo.displayImages = std::make_unique<VkImage[]>(swapchainImagesCount);
+        CALL_VK(vkGetSwapchainImagesKHR(m_deviceInfo.device, m_swapchainInfo.swapchain,
+                                        &swapchainImagesCount,
+                                        m_swapchainInfo.displayImages.get()))
+    }
 
     // create image view for each swapchain image
     m_swapchainInfo.displayViews = std::make_unique<VkImageView[]>(swapchainImagesCount);
@@ -526,12 +948,12 @@ void VKVideoRendererYUV420::setImageLayout(VkCommandBuffer cmdBuffer, VkImage im
 VkResult VKVideoRendererYUV420::createGraphicsPipeline() {
     memset(&m_gfxPipeline, 0, sizeof(m_gfxPipeline));
 
-    const VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[2]{
+    const VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[3]{
             {
                     .binding = 0,
                     .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
                     .descriptorCount = 1,
-                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
                     .pImmutableSamplers = nullptr
             },
             {
@@ -540,11 +962,18 @@ VkResult VKVideoRendererYUV420::createGraphicsPipeline() {
                     .descriptorCount = kTextureCount,
                     .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
                     .pImmutableSamplers = nullptr
+            },
+            {
+                    .binding = 2,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                    .pImmutableSamplers = nullptr
             }};
     const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
             .pNext = nullptr,
-            .bindingCount = 2,
+            .bindingCount = 3,
             .pBindings = descriptorSetLayoutBinding,
     };
     CALL_VK(vkCreateDescriptorSetLayout(m_deviceInfo.device,
@@ -757,10 +1186,16 @@ void VKVideoRendererYUV420::updateDescriptorSet() {
     for (int32_t idx = 0; idx < kTextureCount; idx++) {
         texDsts[idx].sampler = textures[idx].sampler;
         texDsts[idx].imageView = textures[idx].view;
-        texDsts[idx].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        texDsts[idx].imageLayout = textures[idx].imageLayout;
     }
 
-    VkWriteDescriptorSet writeDst[2]{
+    VkDescriptorImageInfo lutDst{
+            .sampler = m_lutTexture.sampler,
+            .imageView = m_lutTexture.view,
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+
+    VkWriteDescriptorSet writeDst[3]{
             {
                     .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                     .pNext = nullptr,
@@ -784,9 +1219,25 @@ void VKVideoRendererYUV420::updateDescriptorSet() {
                     .pImageInfo = texDsts,
                     .pBufferInfo = nullptr,
                     .pTexelBufferView = nullptr
+            },
+            {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .pNext = nullptr,
+                    .dstSet = m_gfxPipeline.descSet,
+                    .dstBinding = 2,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .pImageInfo = &lutDst,
+                    .pBufferInfo = nullptr,
+                    .pTexelBufferView = nullptr
             }
     };
-    vkUpdateDescriptorSets(m_deviceInfo.device, 2, writeDst, 0, nullptr);
+    vkUpdateDescriptorSets(m_deviceInfo.device, 3, writeDst, 0, nullptr);
+
+    if (m_statsPass.mapped) {
+        updateStatsDescriptorSet();
+    }
 }
 
 // initialize descriptor set
@@ -798,7 +1249,7 @@ void VKVideoRendererYUV420::createDescriptorSet() {
             },
             {
                     .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    .descriptorCount = kTextureCount
+                    .descriptorCount = kTextureCount + 1
             }
     };
     const VkDescriptorPoolCreateInfo descriptor_pool = {
@@ -849,6 +1300,25 @@ void VKVideoRendererYUV420::createCommandPool() {
     CALL_VK(vkAllocateCommandBuffers(m_deviceInfo.device, &cmdBufferCreateInfo,
                                      m_render.cmdBuffer.get()))
 
+    // Two timestamps per command buffer, written on every frame and read only with stats enabled.
+    m_render.queryPool = VK_NULL_HANDLE;
+    m_render.timedIndex = UINT32_MAX;
+    if (m_deviceInfo.timestampMask) {
+        VkQueryPoolCreateInfo queryPoolCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = m_render.cmdBufferLen * 2,
+                .pipelineStatistics = 0,
+        };
+        CALL_VK(vkCreateQueryPool(m_deviceInfo.device, &queryPoolCreateInfo, nullptr,
+                                  &m_render.queryPool))
+    }
+
+    m_statsPass.recorded = m_params.gpuStats && createStatsPass();
+    m_statsPass.readIndex = UINT32_MAX;
+
     for (int bufferIndex = 0; bufferIndex < m_swapchainInfo.swapchainLength; bufferIndex++) {
         // We start by creating and declare the "beginning" our command buffer
         VkCommandBufferBeginInfo cmdBufferBeginInfo{
@@ -859,13 +1329,25 @@ void VKVideoRendererYUV420::createCommandPool() {
         };
         CALL_VK(vkBeginCommandBuffer(m_render.cmdBuffer[bufferIndex], &cmdBufferBeginInfo))
 
-        // transition the buffer into color attachment
-        setImageLayout(m_render.cmdBuffer[bufferIndex],
-                       m_swapchainInfo.displayImages[bufferIndex],
-                       VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                       VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        if (m_render.queryPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(m_render.cmdBuffer[bufferIndex], m_render.queryPool, bufferIndex * 2, 2);
+            vkCmdWriteTimestamp(m_render.cmdBuffer[bufferIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                m_render.queryPool, bufferIndex * 2);
+        }
+
+        if (m_statsPass.recorded) {
+            recordStatsPass(m_render.cmdBuffer[bufferIndex], bufferIndex);
+        }
+
+        // transition the buffer into color attachment, the offscreen render pass starts undefined
+        if (!isOffscreen()) {
+            setImageLayout(m_render.cmdBuffer[bufferIndex],
+                           m_swapchainInfo.displayImages[bufferIndex],
+                           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        }
 
         // Now we start a render pass. Any draw command has to be recorded in a render pass
         VkClearValue clearValues;
@@ -899,21 +1381,31 @@ void VKVideoRendererYUV420::createCommandPool() {
         vkCmdDrawIndexed(m_render.cmdBuffer[bufferIndex], m_indexCount, 1, 0, 0, 0);
 
         vkCmdEndRenderPass(m_render.cmdBuffer[bufferIndex]);
-        setImageLayout(m_render.cmdBuffer[bufferIndex],
-                       m_swapchainInfo.displayImages[bufferIndex],
-                       VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                       VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        if (isOffscreen()) {
+            recordReadback(m_render.cmdBuffer[bufferIndex]);
+        } else {
+            setImageLayout(m_render.cmdBuffer[bufferIndex],
+                           m_swapchainInfo.displayImages[bufferIndex],
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        }
+
+        if (m_render.queryPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(m_render.cmdBuffer[bufferIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                m_render.queryPool, bufferIndex * 2 + 1);
+        }
         CALL_VK(vkEndCommandBuffer(m_render.cmdBuffer[bufferIndex]))
     }
 
     // We need to create a fence to be able, in the main loop, to wait for our
-    // draw command(s) to finish before swapping the framebuffers
+    // draw command(s) to finish before touching the textures again. Signalled so that the
+    // first frame doesn't wait.
     VkFenceCreateInfo fenceCreateInfo{
             .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
             .pNext = nullptr,
-            .flags = 0,
+            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
     };
     CALL_VK(vkCreateFence(m_deviceInfo.device, &fenceCreateInfo, nullptr, &m_render.fence))
 
@@ -926,6 +1418,299 @@ void VKVideoRendererYUV420::createCommandPool() {
     };
     CALL_VK(vkCreateSemaphore(m_deviceInfo.device, &semaphoreCreateInfo, nullptr,
                               &m_render.semaphore))
+    m_render.renderSemaphores = std::make_unique<VkSemaphore[]>(m_render.cmdBufferLen);
+    for (uint32_t i = 0; i < m_render.cmdBufferLen; i++) {
+        CALL_VK(vkCreateSemaphore(m_deviceInfo.device, &semaphoreCreateInfo, nullptr,
+                                  &m_render.renderSemaphores[i]))
+    }
+}
+
+void VKVideoRendererYUV420::recordReadback(VkCommandBuffer cmdBuffer) const {
+    setImageLayout(cmdBuffer, m_swapchainInfo.displayImages[0],
+                   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    // Tightly packed rows, top first like the image.
+    VkBufferImageCopy region{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {m_swapchainInfo.displaySize.width, m_swapchainInfo.displaySize.height, 1},
+    };
+    vkCmdCopyImageToBuffer(cmdBuffer, m_swapchainInfo.displayImages[0], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           m_offscreen.buffer, 1, &region);
+
+    VkBufferMemoryBarrier bufferBarrier{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = m_offscreen.buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+    };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr,
+                         1, &bufferBarrier, 0, nullptr);
+}
+
+bool VKVideoRendererYUV420::createStatsPass() {
+    if (m_statsPass.unsupported) return false;
+    if (m_statsPass.mapped) return true;
+
+    // Compute work has to go to the graphics queue, to stay ordered with the uploads and the draw.
+    m_statsPass.unsupported = true;
+    if (!m_deviceInfo.compute) {
+        LOGE("GPU stats need a queue that runs compute work.");
+        return false;
+    }
+
+    const VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[2]{
+            {
+                    .binding = 0,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .pImmutableSamplers = nullptr
+            },
+            {
+                    .binding = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .pImmutableSamplers = nullptr
+            }};
+    const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = nullptr,
+            .bindingCount = 2,
+            .pBindings = descriptorSetLayoutBinding,
+    };
+    CALL_VK_RET(vkCreateDescriptorSetLayout(m_deviceInfo.device, &descriptorSetLayoutCreateInfo, nullptr,
+                                            &m_statsPass.descLayout))
+
+    const VkDescriptorPoolSize poolSizes[2]{
+            {
+                    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .descriptorCount = 1
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .descriptorCount = 1
+            }
+    };
+    const VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .maxSets = 1,
+            .poolSizeCount = 2,
+            .pPoolSizes = poolSizes,
+    };
+    CALL_VK_RET(vkCreateDescriptorPool(m_deviceInfo.device, &descriptorPoolCreateInfo, nullptr,
+                                       &m_statsPass.descPool))
+
+    VkDescriptorSetAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .descriptorPool = m_statsPass.descPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &m_statsPass.descLayout};
+    CALL_VK_RET(vkAllocateDescriptorSets(m_deviceInfo.device, &allocInfo, &m_statsPass.descSet))
+
+    VkPushConstantRange pushConstantRange{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(stats_params),
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .pNext = nullptr,
+            .setLayoutCount = 1,
+            .pSetLayouts = &m_statsPass.descLayout,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange,
+    };
+    CALL_VK_RET(vkCreatePipelineLayout(m_deviceInfo.device, &pipelineLayoutCreateInfo, nullptr,
+                                       &m_statsPass.layout))
+
+    VkShaderModule computeShader;
+    if (!createShaderModuleFromAsset(m_deviceInfo.device, "shaders/video_stats.comp.spv", m_assetManager,
+                                     &computeShader)) {
+        LOGE("Could not load the GPU stats shader.");
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .stage = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = computeShader,
+                    .pName = "main",
+                    .pSpecializationInfo = nullptr,
+            },
+            .layout = m_statsPass.layout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = 0,
+    };
+    VkResult pipelineResult = vkCreateComputePipelines(m_deviceInfo.device, VK_NULL_HANDLE, 1,
+                                                       &pipelineCreateInfo, nullptr, &m_statsPass.pipeline);
+    vkDestroyShaderModule(m_deviceInfo.device, computeShader, nullptr);
+    CALL_VK_RET(pipelineResult)
+
+    // Coherent, so the results are visible to the host once the fence passed.
+    createBuffer(m_render.cmdBufferLen * kStatsSlotValues * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 m_statsPass.buffer, m_statsPass.bufferMemory);
+    void *mapped;
+    CALL_VK_RET(vkMapMemory(m_deviceInfo.device, m_statsPass.bufferMemory, 0, VK_WHOLE_SIZE, 0, &mapped))
+    m_statsPass.mapped = (const uint32_t *) mapped;
+
+    updateStatsDescriptorSet();
+
+    m_statsPass.unsupported = false;
+    return true;
+}
+
+void VKVideoRendererYUV420::updateStatsDescriptorSet() {
+    VkDescriptorImageInfo imageInfo{
+            .sampler = textures[tTexY].sampler,
+            .imageView = textures[tTexY].view,
+            .imageLayout = textures[tTexY].imageLayout,
+    };
+    VkDescriptorBufferInfo bufferInfo{
+            .buffer = m_statsPass.buffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet writeDst[2]{
+            {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .pNext = nullptr,
+                    .dstSet = m_statsPass.descSet,
+                    .dstBinding = 0,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .pImageInfo = &imageInfo,
+                    .pBufferInfo = nullptr,
+                    .pTexelBufferView = nullptr
+            },
+            {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .pNext = nullptr,
+                    .dstSet = m_statsPass.descSet,
+                    .dstBinding = 1,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .pImageInfo = nullptr,
+                    .pBufferInfo = &bufferInfo,
+                    .pTexelBufferView = nullptr
+            }
+    };
+    vkUpdateDescriptorSets(m_deviceInfo.device, 2, writeDst, 0, nullptr);
+}
+
+void VKVideoRendererYUV420::recordStatsPass(VkCommandBuffer cmdBuffer, uint32_t bufferIndex) const {
+    VkDeviceSize slotSize = kStatsSlotValues * sizeof(uint32_t);
+    vkCmdFillBuffer(cmdBuffer, m_statsPass.buffer, bufferIndex * slotSize, slotSize, 0);
+
+    VkBufferMemoryBarrier clearBarrier{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = m_statsPass.buffer,
+            .offset = bufferIndex * slotSize,
+            .size = slotSize,
+    };
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+    // Large textures are subsampled, so the pass costs about the same at any resolution.
+    size_t width = textures[tTexY].width;
+    size_t height = textures[tTexY].height;
+    size_t step = std::max((std::max(width, height) + kStatsGridSize - 1) / kStatsGridSize, (size_t) 1);
+    stats_params params{
+            .grid = {(int32_t) (width / step), (int32_t) (height / step)},
+            .step = (int32_t) step,
+            .base = bufferIndex * kStatsSlotValues,
+    };
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_statsPass.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_statsPass.layout, 0, 1,
+                            &m_statsPass.descSet, 0, nullptr);
+    vkCmdPushConstants(cmdBuffer, m_statsPass.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(cmdBuffer, (uint32_t) (params.grid[0] + 15) / 16, (uint32_t) (params.grid[1] + 15) / 16, 1);
+
+    VkBufferMemoryBarrier readBarrier = clearBarrier;
+    readBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, nullptr, 1, &readBarrier, 0, nullptr);
+}
+
+void VKVideoRendererYUV420::readGpuStats() {
+    uint32_t index = m_statsPass.readIndex;
+    m_statsPass.readIndex = UINT32_MAX;
+
+    // The wait in draw() gives up after a while, the slot is only complete once the fence passed.
+    if (index == UINT32_MAX || vkGetFenceStatus(m_deviceInfo.device, m_render.fence) != VK_SUCCESS) {
+        return;
+    }
+
+    const uint32_t *zoneSums = m_statsPass.mapped + index * kStatsSlotValues;
+    const uint32_t *zoneSamples = zoneSums + gpu_luma_stats::kZoneCount;
+    const uint32_t *bins = zoneSamples + gpu_luma_stats::kZoneCount;
+
+    gpu_luma_stats stats;
+    uint64_t sum = 0;
+    uint64_t samples = 0;
+    for (size_t i = 0; i < gpu_luma_stats::kZoneCount; i++) {
+        stats.zoneMeans[i] = zoneSamples[i] ? (float) zoneSums[i] / (float) zoneSamples[i] : 0.0f;
+        sum += zoneSums[i];
+        samples += zoneSamples[i];
+    }
+    if (!samples) return;
+
+    stats.mean = (float) sum / (float) samples;
+    for (size_t i = 0; i < gpu_luma_stats::kBinCount; i++) {
+        stats.histogram[i] = (float) bins[i] / (float) samples;
+    }
+
+    publishGpuStats(stats);
+}
+
+void VKVideoRendererYUV420::deleteStatsPass() const {
+    if (m_statsPass.buffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(m_deviceInfo.device, m_statsPass.bufferMemory);
+        vkDestroyBuffer(m_deviceInfo.device, m_statsPass.buffer, nullptr);
+        vkFreeMemory(m_deviceInfo.device, m_statsPass.bufferMemory, nullptr);
+    }
+
+    vkDestroyPipeline(m_deviceInfo.device, m_statsPass.pipeline, nullptr);
+    vkDestroyPipelineLayout(m_deviceInfo.device, m_statsPass.layout, nullptr);
+    vkDestroyDescriptorPool(m_deviceInfo.device, m_statsPass.descPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_deviceInfo.device, m_statsPass.descLayout, nullptr);
 }
 
 // A helper function
@@ -949,13 +1734,24 @@ bool VKVideoRendererYUV420::mapMemoryTypeToIndex(uint32_t typeBits, VkFlags requ
 }
 
 void VKVideoRendererYUV420::updateUniformBuffers() {
-    mat4f_load_rotate_mat(m_ubo.rotation, m_rotation);
-
-    mat4f_load_scale_mat(m_ubo.scale, m_rotation, m_surfaceWidth, m_surfaceHeight,
-                         m_frameWidth, m_frameHeight, m_mirror, false);
+    loadTransform(m_ubo.rotation, m_ubo.scale, false);
 }
 
 void VKVideoRendererYUV420::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    VkCommandPool cmdPool;
+    VkCommandBuffer cmdBuffer = beginOneTimeCommands(cmdPool);
+
+    VkBufferCopy copyRegion = {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = size
+    };
+    vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    endOneTimeCommands(cmdPool, cmdBuffer);
+}
+
+VkCommandBuffer VKVideoRendererYUV420::beginOneTimeCommands(VkCommandPool &cmdPool) {
     VkCommandPoolCreateInfo cmdPoolCreateInfo{
             .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
             .pNext = nullptr,
@@ -963,7 +1759,6 @@ void VKVideoRendererYUV420::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, V
             .queueFamilyIndex = m_deviceInfo.queueFamilyIndex,
     };
 
-    VkCommandPool cmdPool;
     CALL_VK(vkCreateCommandPool(m_deviceInfo.device, &cmdPoolCreateInfo, nullptr, &cmdPool))
 
     VkCommandBuffer cmdBuffer;
@@ -983,13 +1778,10 @@ void VKVideoRendererYUV420::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, V
             .pInheritanceInfo = nullptr};
     CALL_VK(vkBeginCommandBuffer(cmdBuffer, &cmdBufferInfo))
 
-    VkBufferCopy copyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = size
-    };
-    vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    return cmdBuffer;
+}
 
+void VKVideoRendererYUV420::endOneTimeCommands(VkCommandPool cmdPool, VkCommandBuffer cmdBuffer) {
     CALL_VK(vkEndCommandBuffer(cmdBuffer))
     VkFenceCreateInfo fenceInfo = {
             .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
@@ -1056,12 +1848,19 @@ void VKVideoRendererYUV420::createBuffer(VkDeviceSize size, VkBufferUsageFlags u
 void VKVideoRendererYUV420::createUniformBuffers() {
     updateUniformBuffers();
 
+    createBuffer(sizeof(m_ubo), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 m_buffers.uboBuffer, m_buffers.uboBufferMemory);
+
+    writeUniformBuffers();
+}
+
+void VKVideoRendererYUV420::writeUniformBuffers() {
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
 
     VkDeviceSize bufferSize = sizeof(m_ubo);
 
-    // Create Vertex shader uniform buffer
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                  stagingBuffer, stagingBufferMemory);
@@ -1071,10 +1870,6 @@ void VKVideoRendererYUV420::createUniformBuffers() {
     memcpy(data, &m_ubo, bufferSize);
     vkUnmapMemory(m_deviceInfo.device, stagingBufferMemory);
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                 m_buffers.uboBuffer, m_buffers.uboBufferMemory);
-
     copyBuffer(stagingBuffer, m_buffers.uboBuffer, bufferSize);
 
     vkDestroyBuffer(m_deviceInfo.device, stagingBuffer, nullptr);
@@ -1184,36 +1979,52 @@ VkResult VKVideoRendererYUV420::allocateMemoryTypeFromProperties(uint32_t typeBi
     return VK_ERROR_MEMORY_MAP_FAILED;
 }
 
-size_t VKVideoRendererYUV420::getBufferOffset(VulkanTexture *texture, TextureType type,
-                                              size_t width, size_t height) {
-    size_t offset = 0;
+void VKVideoRendererYUV420::setTextureSize(VulkanTexture *texture, TextureType type, size_t width,
+                                           size_t height) {
     if (type == tTexY) {
         texture->width = width;
         texture->height = height;
-    } else if (type == tTexU) {
-        texture->width = width / 2;
-        texture->height = height / 2;
-        offset = width * height;
-    } else if (type == tTexV) {
+    } else {
         texture->width = width / 2;
         texture->height = height / 2;
-        offset = width * height * 5 / 4;
     }
+}
 
-    return offset;
+void VKVideoRendererYUV420::copyTextureData(VulkanTexture *texture, TextureType type) const {
+    copyTextureRect(texture, type, 0, 0, texture->width, texture->height);
 }
 
-void VKVideoRendererYUV420::copyTextureData(VulkanTexture *texture, uint8_t *data) {
-    auto *mappedData = (uint8_t *) texture->mapped;
-    for (int i = 0; i < texture->height; ++i) {
-        memcpy(mappedData, data, texture->width);
-        mappedData += texture->layout.rowPitch;
-        data += texture->width;
+void VKVideoRendererYUV420::copyTextureRect(VulkanTexture *texture, TextureType type, size_t x, size_t y,
+                                            size_t width, size_t height) const {
+    const video_frame &planes = m_frame.planes();
+    size_t rowPitch = texture->layout.rowPitch;
+    auto *dst = (uint8_t *) texture->mapped + y * rowPitch + x;
+
+    if (type == tTexY) {
+        const uint8_t *src = planes.y + (m_region.y + y) * planes.stride_y + m_region.x + x;
+        copy_plane(dst, rowPitch, src, planes.stride_y, width, height);
+        return;
+    }
+
+    const uint8_t *src = (type == tTexU ? planes.u : planes.v) + (m_region.y / 2 + y) * planes.stride_uv +
+                         (m_region.x / 2 + x) * planes.pixel_stride_uv;
+    if (planes.pixel_stride_uv == 1) {
+        copy_plane(dst, rowPitch, src, planes.stride_uv, width, height);
+        return;
+    }
+
+    for (size_t row = 0; row < height; row++) {
+        const uint8_t *srcRow = src + row * planes.stride_uv;
+        uint8_t *dstRow = dst + row * rowPitch;
+
+        for (size_t column = 0; column < width; column++) {
+            dstRow[column] = srcRow[column * planes.pixel_stride_uv];
+        }
     }
 }
 
 VkResult
-VKVideoRendererYUV420::loadTexture(uint8_t *buffer, TextureType type, size_t width, size_t height,
+VKVideoRendererYUV420::loadTexture(TextureType type, size_t width, size_t height,
                                    VulkanTexture *texture, VkImageUsageFlags usage,
                                    VkFlags required_props) {
     if (!(usage | required_props)) {
@@ -1233,7 +2044,7 @@ VKVideoRendererYUV420::loadTexture(uint8_t *buffer, TextureType type, size_t wid
         needBlit = false;
     }
 
-    size_t offset = getBufferOffset(texture, type, width, height);
+    setTextureSize(texture, type, width, height);
 
     // Allocate the linear texture so texture could be copied over
     VkImageCreateInfo imageCreateInfo = {
@@ -1280,7 +2091,7 @@ VKVideoRendererYUV420::loadTexture(uint8_t *buffer, TextureType type, size_t wid
         CALL_VK(vkMapMemory(m_deviceInfo.device, texture->mem, 0, memAlloc.allocationSize, 0,
                             &texture->mapped))
 
-        copyTextureData(texture, buffer + offset);
+        copyTextureData(texture, type);
     }
 
     texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -1423,7 +2234,8 @@ void VKVideoRendererYUV420::createRenderPass() {
             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .finalLayout = isOffscreen() ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                         : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
     };
 
     VkAttachmentReference colourReference{
@@ -1,9 +1,11 @@
-#include <__bit_reference>
-
 #ifndef _VK_VIDEO_RENDERER_YUV_H_
 #define _VK_VIDEO_RENDERER_YUV_H_
 
 #include "VideoRenderer.h"
+#include "DirtyTiles.h"
+
+#include <atomic>
+#include <vector>
 #include <vulkan/vulkan.h>
 
 class VKVideoRendererYUV420 : public VideoRenderer {
@@ -17,10 +19,9 @@ public:
 
     void render() override;
 
-    void draw(uint8_t *buffer, size_t length, size_t width, size_t height, float rotation, bool mirror) override;
-
-    void setParameters(uint32_t params) override;
+    void draw(FrameRef frame, float rotation, bool mirror) override;
 
+    // Adds the LUT count in bits 20-23.
     uint32_t getParameters() override;
 
     int createProgram(const char *pVertexSource, const char *pFragmentSource) override;
@@ -35,9 +36,13 @@ private:
         float uv[2];
     };
 
+    // std140 layout of video_frame.vert and video_frame.frag.
     struct UniformBufferObject {
         float rotation[16];
         float scale[16];
+        // Lattice points along each side of the grading LUT, 0 for none.
+        float lutSize;
+        float padding[3];
     };
 
     UniformBufferObject m_ubo{};
@@ -45,7 +50,7 @@ private:
     struct VulkanTexture {
         VkSampler sampler;
         VkImage image;
-        __unused VkImageLayout imageLayout;
+        VkImageLayout imageLayout;
         VkSubresourceLayout layout;
         VkDeviceMemory mem;
         VkImageView view;
@@ -64,6 +69,13 @@ private:
         VkSurfaceKHR surface;
         VkQueue queue;
 
+        // Nanoseconds per timestamp tick and the bits the queue writes, 0 without timestamps.
+        float timestampPeriod;
+        uint64_t timestampMask;
+
+        // Whether the queue family runs compute work too, which the GPU stats need.
+        bool compute;
+
         bool initialized;
     };
     VulkanDeviceInfo m_deviceInfo{};
@@ -82,13 +94,30 @@ private:
     };
     VulkanSwapchainInfo m_swapchainInfo;
 
+    // Offscreen mode renders to the single image of m_swapchainInfo, copied to a host visible buffer
+    // at the end of each command buffer.
+    struct VulkanOffscreenInfo {
+        VkDeviceMemory imageMemory;
+        VkBuffer buffer;
+        VkDeviceMemory bufferMemory;
+        void *mapped;
+    };
+    VulkanOffscreenInfo m_offscreen{};
+
     struct VulkanRenderInfo {
         VkRenderPass renderPass;
         VkCommandPool cmdPool;
         std::unique_ptr<VkCommandBuffer[]> cmdBuffer;
         uint32_t cmdBufferLen;
+        // Signalled when the acquired image is ready, and when rendering to it is done. Presentation
+        // may still wait on the latter when the next frame is submitted, so there is one per swapchain
+        // image, reused only once that image was acquired again.
         VkSemaphore semaphore;
+        std::unique_ptr<VkSemaphore[]> renderSemaphores;
         VkFence fence;
+        // Start and end timestamps of each command buffer, and the one submitted last.
+        VkQueryPool queryPool;
+        uint32_t timedIndex;
     };
     VulkanRenderInfo m_render;
 
@@ -102,6 +131,25 @@ private:
     };
     VulkanGfxPipelineInfo m_gfxPipeline{};
 
+    // Compute pass reducing gpu_luma_stats of the Y texture at the start of the command buffers, each of
+    // them into its own slot of a host visible buffer. Created the first time the stats are turned on.
+    struct VulkanStatsInfo {
+        VkDescriptorSetLayout descLayout;
+        VkDescriptorPool descPool;
+        VkDescriptorSet descSet;
+        VkPipelineLayout layout;
+        VkPipeline pipeline;
+        VkBuffer buffer;
+        VkDeviceMemory bufferMemory;
+        const uint32_t *mapped;
+        // Set when the pass can't be created, so it isn't tried again.
+        bool unsupported;
+        // Whether the command buffers record the pass, and the slot of the one submitted last.
+        bool recorded;
+        uint32_t readIndex;
+    };
+    VulkanStatsInfo m_statsPass{};
+
     struct VulkanBufferInfo {
         VkBuffer vertexBuffer;
         VkDeviceMemory vertexBufferMemory;
@@ -118,7 +166,18 @@ private:
     const TextureType texType[kTextureCount];
     struct VulkanTexture textures[kTextureCount]{};
 
-    uint8_t *m_pBuffer;
+    // Grading LUTs loaded at init(), and the one in the 3D texture at binding 2, 0 for none. Without
+    // one the texture holds a 2x2x2 identity the shader skips.
+    static const VkFormat kLutFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    std::vector<CubeLut> m_luts;
+    std::atomic<size_t> m_lutCount{0};
+    size_t m_lutIndex;
+    struct VulkanTexture m_lutTexture{};
+
+    // Frame the textures are filled from, held while draw() uploads it.
+    FrameRef m_frame;
+    // Tiles of the region changed since the last upload, with tile updates on.
+    DirtyTiles m_tiles;
     uint32_t m_indexCount;
 
     AAssetManager *m_assetManager;
@@ -140,6 +199,11 @@ private:
 
     void createSwapChain();
 
+    void createOffscreenTarget();
+
+    // Waits for the submitted frame and hands the readback buffer to the frame callback.
+    void readTarget();
+
     void createUniformBuffers();
 
     void createVertexBuffer();
@@ -148,23 +212,69 @@ private:
 
     void createCommandPool();
 
+    // Copies the offscreen image to the readback buffer at the end of cmdBuffer.
+    void recordReadback(VkCommandBuffer cmdBuffer) const;
+
+    // Creates the stats pass for m_render.cmdBufferLen slots, false when the device can't run it.
+    bool createStatsPass();
+
+    // Clears the bufferIndex slot and dispatches the stats pass into it.
+    void recordStatsPass(VkCommandBuffer cmdBuffer, uint32_t bufferIndex) const;
+
+    // Publishes the stats of the last submitted frame, after its fence was waited on.
+    void readGpuStats();
+
+    void updateStatsDescriptorSet();
+
+    void deleteStatsPass() const;
+
     bool createTextures();
 
+    // LUT index of m_params, 0 when it is out of range.
+    size_t selectedLut() const;
+
+    // Uploads the selected LUT into a device local 3D texture and sets lutSize for it.
+    void createLutTexture();
+
+    void deleteLutTexture() const;
+
+    // A command buffer of a pool of its own, submitted and waited for by endOneTimeCommands().
+    VkCommandBuffer beginOneTimeCommands(VkCommandPool &cmdPool);
+
+    void endOneTimeCommands(VkCommandPool cmdPool, VkCommandBuffer cmdBuffer);
+
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-    static void copyTextureData(VulkanTexture *texture, uint8_t *data);
+    // Copies the region in view of the m_frame plane for type into the mapped texture, gathering
+    // semi-planar chroma.
+    void copyTextureData(VulkanTexture *texture, TextureType type) const;
+
+    // Copies width x height texels at (x, y) of the texture, the same way.
+    void copyTextureRect(VulkanTexture *texture, TextureType type, size_t x, size_t y, size_t width,
+                         size_t height) const;
+
+    // Copies the tiles m_tiles found changed.
+    void copyChangedTiles();
 
     void updateDescriptorSet();
 
     void updateUniformBuffers();
 
+    // Stages m_ubo into the uniform buffer, once the GPU is done with the last frame.
+    void writeUniformBuffers();
+
     bool updateTextures();
 
+    // Records the GPU time of the last submitted frame, after its fence was waited on.
+    void readTimestamps();
+
     bool
     mapMemoryTypeToIndex(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex) const;
 
     void deleteSwapChain() const;
 
+    void deleteOffscreenTarget() const;
+
     void deleteCommandPool() const;
 
     void deleteRenderPass() const;
@@ -182,8 +292,7 @@ private:
     VkResult allocateMemoryTypeFromProperties(uint32_t typeBits, VkFlags requirements_mask,
                                               uint32_t *typeIndex);
 
-    static size_t
-    getBufferOffset(VulkanTexture *texture, TextureType type, size_t width, size_t height);
+    static void setTextureSize(VulkanTexture *texture, TextureType type, size_t width, size_t height);
 
     static void setImageLayout(VkCommandBuffer cmdBuffer,
                                VkImage image,
@@ -192,7 +301,7 @@ private:
                                VkPipelineStageFlags srcStages,
                                VkPipelineStageFlags destStages);
 
-    VkResult loadTexture(uint8_t *buffer, TextureType type, size_t width, size_t height,
+    VkResult loadTexture(TextureType type, size_t width, size_t height,
                          VulkanTexture *texture, VkImageUsageFlags usage, VkFlags required_props);
 };
 
@@ -1,29 +1,275 @@
 #include "VideoRenderer.h"
 #include "GLVideoRendererYUV420.h"
-#include "VKVideoRendererYUV420.h"
 #include "GLVideoRendererYUV420Filter.h"
+#include "CommonUtils.h"
+#include "Log.h"
+
+// Host tools build without the Vulkan SDK by setting MEDIA_VULKAN=0, the Vulkan type then gets GL.
+#ifndef MEDIA_VULKAN
+#define MEDIA_VULKAN 1
+#endif
+
+#if MEDIA_VULKAN
+#include "VKVideoRendererYUV420.h"
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// Region edges are kept on multiples of this, even for the chroma planes and so that small pans
+// mostly keep the texture size.
+static const size_t kRegionAlignment = 16;
+
+static const char kLutAssetDir[] = "luts";
 
 VideoRenderer::VideoRenderer()
         : m_frameWidth(0),
           m_frameHeight(0),
           m_surfaceWidth(0),
           m_surfaceHeight(0),
-          m_params(0),
-          m_rotation(0),
-          m_mirror(true),
+          m_region(),
+          m_viewCenterX(0.5f),
+          m_viewCenterY(0.5f),
+          m_params(),
           isDirty(false),
-          isProgramChanged(false) {
+          isProgramChanged(false),
+          isParametersChanged(true),
+          m_pendingParams(),
+          m_gpuStatsValid(false) {
+    for (size_t filter = 0; filter < kMaxFilters; filter++) {
+        size_t count;
+        const filter_parameter *parameters = filter_parameters(filter, count);
+
+        for (size_t i = 0; i < count; i++) {
+            m_pendingParams.filterValues[filter][i] = parameters[i].value;
+        }
+    }
+
+    m_pendingParams.mirror = true;
+    m_pendingParams.zoom = 1.0f;
+    m_pendingParams.centerX = 0.5f;
+    m_pendingParams.centerY = 0.5f;
+    mat4f_load_yuv_to_rgb_mat(m_pendingParams.colorMatrix);
+    m_pendingParams.maxBlurTaps = SIZE_MAX;
 
+    m_params = m_pendingParams;
 }
 
 VideoRenderer::~VideoRenderer() = default;
 
+void VideoRenderer::setParameters(uint32_t params) {
+    updateParameters([params](render_parameters &parameters) {
+        parameters.filter = params & 0x0000000F;
+        parameters.lut = (params & 0x000F0000) >> 16;
+    });
+}
+
+uint32_t VideoRenderer::getParameters() {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+    return (uint32_t) (m_pendingParams.filter | (m_pendingParams.lut << 16));
+}
+
+void VideoRenderer::setFilterParameters(size_t filter, const float *values, size_t count) {
+    if (filter >= kMaxFilters) return;
+
+    size_t parameterCount;
+    const filter_parameter *parameters = filter_parameters(filter, parameterCount);
+
+    updateParameters([&](render_parameters &params) {
+        for (size_t i = 0; i < count && i < parameterCount; i++) {
+            params.filterValues[filter][i] = std::min(std::max(values[i], parameters[i].min), parameters[i].max);
+        }
+    });
+}
+
+void VideoRenderer::setColorMatrix(const float *matrix) {
+    updateParameters([matrix](render_parameters &params) {
+        std::copy(matrix, matrix + 16, params.colorMatrix);
+    });
+}
+
+void VideoRenderer::setQuality(bool highPrecision, size_t maxBlurTaps) {
+    updateParameters([highPrecision, maxBlurTaps](render_parameters &params) {
+        params.highPrecision = highPrecision;
+        params.maxBlurTaps = maxBlurTaps;
+    });
+}
+
+void VideoRenderer::setZoom(float zoom, float centerX, float centerY) {
+    updateParameters([zoom, centerX, centerY](render_parameters &params) {
+        params.zoom = std::max(zoom, 1.0f);
+        params.centerX = std::min(std::max(centerX, 0.0f), 1.0f);
+        params.centerY = std::min(std::max(centerY, 0.0f), 1.0f);
+    });
+}
+
+void VideoRenderer::setTileUpdates(bool enabled, int threshold) {
+    updateParameters([enabled, threshold](render_parameters &params) {
+        params.tileUpdates = enabled;
+        params.tileThreshold = std::min(std::max(threshold, 0), 255);
+    });
+}
+
+void VideoRenderer::setGpuStats(bool enabled) {
+    updateParameters([enabled](render_parameters &params) {
+        params.gpuStats = enabled;
+    });
+}
+
+bool VideoRenderer::getGpuStats(float *values) {
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        if (!m_pendingParams.gpuStats) return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_gpuStatsMutex);
+    if (m_gpuStats.update()) m_gpuStatsValid = true;
+    if (!m_gpuStatsValid) return false;
+
+    const gpu_luma_stats &stats = m_gpuStats.front();
+    *values++ = stats.mean;
+    for (float zoneMean: stats.zoneMeans) *values++ = zoneMean;
+    for (float bin: stats.histogram) *values++ = bin;
+
+    return true;
+}
+
+void VideoRenderer::publishGpuStats(const gpu_luma_stats &stats) {
+    m_gpuStats.back() = stats;
+    m_gpuStats.publish();
+}
+
+void VideoRenderer::setOffscreen(const frame_callback &callback) {
+    m_frameCallback = callback;
+}
+
+bool VideoRenderer::isOffscreen() const {
+    return (bool) m_frameCallback;
+}
+
+RenderStats &VideoRenderer::getStats() {
+    return m_stats;
+}
+
+bool VideoRenderer::updateRegion(size_t apron) {
+    frame_region region{0, 0, m_frameWidth, m_frameHeight};
+    m_viewCenterX = 0.5f;
+    m_viewCenterY = 0.5f;
+
+    if (m_frameWidth && m_frameHeight && m_surfaceWidth && m_surfaceHeight) {
+        float rotation[16];
+        float scale[16];
+        mat4f_load_rotate_mat(rotation, m_params.rotation);
+        mat4f_load_scale_mat(scale, (int) m_params.rotation, m_surfaceWidth, m_surfaceHeight, m_frameWidth,
+                             m_frameHeight, m_params.mirror, true);
+
+        m_viewCenterX = m_params.centerX;
+        m_viewCenterY = m_params.centerY;
+        region = visible_frame_region(rotation, scale, m_params.zoom, &m_viewCenterX, &m_viewCenterY,
+                                      m_frameWidth, m_frameHeight, apron, kRegionAlignment);
+    }
+
+    bool changed = region.x != m_region.x || region.y != m_region.y || region.width != m_region.width ||
+                   region.height != m_region.height;
+    m_region = region;
+
+    return changed;
+}
+
+void VideoRenderer::loadTransform(float *rotation, float *scale, bool mirrorY) const {
+    float rotate[16];
+    float crop[16];
+    mat4f_load_rotate_mat(rotate, m_params.rotation);
+    mat4f_load_crop_mat(crop, m_params.zoom, m_viewCenterX, m_viewCenterY, m_frameWidth, m_frameHeight, m_region);
+    mat4f_multiply(rotation, crop, rotate);
+
+    mat4f_load_scale_mat(scale, (int) m_params.rotation, m_surfaceWidth, m_surfaceHeight, m_frameWidth,
+                         m_frameHeight, m_params.mirror, mirrorY);
+}
+
+void VideoRenderer::updateParameters(const std::function<void(render_parameters &)> &update) {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+    update(m_pendingParams);
+    publishPending();
+}
+
+void VideoRenderer::setTransform(float rotation, bool mirror) {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+    // Called for every frame, only a change is worth a new version.
+    if (m_pendingParams.rotation == rotation && m_pendingParams.mirror == mirror) return;
+
+    m_pendingParams.rotation = rotation;
+    m_pendingParams.mirror = mirror;
+    publishPending();
+}
+
+void VideoRenderer::publishPending() {
+    m_pendingParams.version++;
+
+    m_publishedParams.back() = m_pendingParams;
+    m_publishedParams.publish();
+}
+
+bool VideoRenderer::acquireParameters() {
+    if (!m_publishedParams.update() || m_publishedParams.front().version == m_params.version) return false;
+
+    m_params = m_publishedParams.front();
+    isParametersChanged = true;
+
+    return true;
+}
+
+std::vector<CubeLut> VideoRenderer::loadCubeLuts(AAssetManager *assetManager) {
+    std::vector<CubeLut> luts;
+    AAssetDir *dir = AAssetManager_openDir(assetManager, kLutAssetDir);
+    if (!dir) return luts;
+
+    std::vector<std::string> names;
+    const char *fileName;
+    while ((fileName = AAssetDir_getNextFileName(dir)) != nullptr) {
+        std::string name(fileName);
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".cube") == 0) {
+            names.push_back(name);
+        }
+    }
+    AAssetDir_close(dir);
+    std::sort(names.begin(), names.end());
+
+    for (const auto &name: names) {
+        if (luts.size() == kMaxLuts) break;
+
+        std::string path = std::string(kLutAssetDir) + "/" + name;
+        AAsset *asset = AAssetManager_open(assetManager, path.c_str(), AASSET_MODE_BUFFER);
+        if (!asset) continue;
+
+        CubeLut lut;
+        bool loaded = lut.load((const char *) AAsset_getBuffer(asset), (size_t) AAsset_getLength(asset));
+        AAsset_close(asset);
+
+        if (!loaded) {
+            LOGE("Could not load LUT %s.", path.c_str());
+            continue;
+        }
+
+        LOGI("Loaded LUT %s, size %zu.", path.c_str(), lut.size());
+        luts.push_back(std::move(lut));
+    }
+
+    return luts;
+}
+
 std::unique_ptr<VideoRenderer> VideoRenderer::create(int type) {
     switch (type) {
         case tYUV420_FILTER:
             return {std::make_unique<GLVideoRendererYUV420Filter>()};
+#if MEDIA_VULKAN
         case tVK_YUV420:
             return {std::make_unique<VKVideoRendererYUV420>()};
+#endif
         case tYUV420:
         default:
             return {std::make_unique<GLVideoRendererYUV420>()};
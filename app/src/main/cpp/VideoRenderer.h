@@ -1,7 +1,17 @@
 #ifndef _H_VIDEO_RENDERER_
 #define _H_VIDEO_RENDERER_
 
+#include "CommonUtils.h"
+#include "CubeLut.h"
+#include "FilterParameters.h"
+#include "FrameRef.h"
+#include "RenderStats.h"
+#include "TripleBuffer.h"
+
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <android/native_window.h>
 #include <android/asset_manager.h>
 
@@ -9,16 +19,58 @@ enum {
     tYUV420, tVK_YUV420, tYUV420_FILTER
 };
 
-struct video_frame {
-    size_t width;
-    size_t height;
-    size_t stride_y;
-    size_t stride_uv;
-    uint8_t *y;
-    uint8_t *u;
-    uint8_t *v;
+// Everything the UI and capture threads control, published to the render thread as one
+// versioned snapshot so that a frame never mixes old and new settings.
+struct render_parameters {
+    uint64_t version;
+
+    // Filter index and grading LUT, 0 for none.
+    size_t filter;
+    size_t lut;
+    float filterValues[kMaxFilters][kMaxFilterParameters];
+
+    // Display transform.
+    float rotation;
+    bool mirror;
+
+    // Digital zoom, 1 or more times around a point of the frame in normalized coordinates.
+    float zoom;
+    float centerX;
+    float centerY;
+
+    // Row-major YUV to RGB conversion, see mat4f_load_yuv_to_rgb_mat().
+    float colorMatrix[16];
+
+    // Quality settings: keep every shader at highp, upper bound on blur taps.
+    bool highPrecision;
+    size_t maxBlurTaps;
+
+    // Upload only the tiles that changed by more than tileThreshold code values in some sample.
+    bool tileUpdates;
+    int tileThreshold;
+
+    // Reduce luma statistics on the GPU, see gpu_luma_stats.
+    bool gpuStats;
 };
 
+// Luma statistics of the region a renderer uploaded, reduced on the GPU and read back a frame or two
+// after the frame they describe. Code values for means, zones in a 4x4 grid from the top left.
+struct gpu_luma_stats {
+    static const size_t kZoneCount = 16;
+    static const size_t kBinCount = 16;
+    // Values in VideoRenderer::getGpuStats(): mean, zone means, then histogram.
+    static const size_t kValueCount = 1 + kZoneCount + kBinCount;
+
+    float mean;
+    float zoneMeans[kZoneCount];
+    // Share of the samples in each run of 16 code values.
+    float histogram[kBinCount];
+};
+
+// Receives each frame rendered offscreen, RGBA rows top to bottom and width * 4 bytes apart. The
+// pixels are only valid during the call.
+typedef std::function<void(const uint8_t *rgba, size_t width, size_t height)> frame_callback;
+
 class VideoRenderer {
 public:
     VideoRenderer();
@@ -29,28 +81,110 @@ public:
 
     virtual void init(ANativeWindow *window, AAssetManager *assetManager, size_t width, size_t height) = 0;
 
+    // Before init(), which then renders to a width x height target of its own instead of a window
+    // and hands every frame to callback once the GPU finished it.
+    void setOffscreen(const frame_callback &callback);
+
     virtual void render() = 0;
 
-    virtual void
-    draw(uint8_t *buffer, size_t length, size_t width, size_t height, float rotation, bool mirror) = 0;
+    // Takes the next frame to show. Renderers keep the reference for as long as they read its planes,
+    // which is what lets the caller hand over frames without copying them.
+    virtual void draw(FrameRef frame, float rotation, bool mirror) = 0;
+
+    // Packed filter index (bits 0-3) and LUT index (bits 16-19).
+    virtual void setParameters(uint32_t params);
+
+    virtual uint32_t getParameters();
+
+    // Runtime parameters of a filter, see filter_parameters(). Renderers without filters ignore them.
+    void setFilterParameters(size_t filter, const float *values, size_t count);
+
+    void setColorMatrix(const float *matrix);
+
+    void setQuality(bool highPrecision, size_t maxBlurTaps);
+
+    // Magnifies the view zoom times around (centerX, centerY), normalized frame coordinates with rows
+    // from the top, panning no further than the frame edges. Only the region in view is uploaded.
+    void setZoom(float zoom, float centerX, float centerY);
 
-    virtual void setParameters(uint32_t params) = 0;
+    // For mostly static scenes, frames are compared tile by tile with the last one uploaded and only
+    // tiles where a sample moved by more than threshold are uploaded. Off by default.
+    void setTileUpdates(bool enabled, int threshold);
 
-    virtual uint32_t getParameters() = 0;
+    // For when the CPU is the bottleneck, an alternative to the LumaStats of the frames. Off by default.
+    void setGpuStats(bool enabled);
+
+    // Fills gpu_luma_stats::kValueCount values from the newest results, false while there are none.
+    // Callable from any thread, readers take turns but the render thread never waits for them.
+    bool getGpuStats(float *values);
 
     virtual int createProgram(const char *pVertexSource, const char *pFragmentSource) = 0;
 
+    // Stage latencies, recorded by the renderer and whoever drives it.
+    RenderStats &getStats();
+
 protected:
+    // Grading LUTs the LUT index bits can select.
+    static const size_t kMaxLuts = 15;
+
+    // Parses the .cube files of the luts asset directory in name order, so that LUT indices are
+    // stable between runs, up to kMaxLuts of them. Files that don't parse are skipped.
+    static std::vector<CubeLut> loadCubeLuts(AAssetManager *assetManager);
+
+    // Edits the parameters and publishes them to the render thread, callable from any thread.
+    void updateParameters(const std::function<void(render_parameters &)> &update);
+
+    void setTransform(float rotation, bool mirror);
+
+    // Render thread, takes the latest published snapshot into m_params without blocking.
+    // Sets isParametersChanged and returns true when its version differs from the last one.
+    bool acquireParameters();
+
+    bool isOffscreen() const;
+
+    // Takes the frame region in view for the current parameters, with apron pixels around it for
+    // filter taps. Returns true when it moved or changed size.
+    bool updateRegion(size_t apron);
+
+    // Vertex shader matrices for the current parameters, the zoom into m_region folded into the
+    // rotation. mirrorY flips the frame vertically, as GL textures need.
+    void loadTransform(float *rotation, float *scale, bool mirrorY) const;
+
+    // Render thread, hands statistics read back from the GPU to getGpuStats().
+    void publishGpuStats(const gpu_luma_stats &stats);
+
     size_t m_frameWidth;
     size_t m_frameHeight;
     size_t m_surfaceWidth;
     size_t m_surfaceHeight;
-    uint32_t m_params;
-    float m_rotation;
-    bool m_mirror;
+
+    // Part of the frame the textures hold, and the zoom centre clamped to the frame.
+    frame_region m_region;
+    float m_viewCenterX;
+    float m_viewCenterY;
+
+    // Render thread snapshot.
+    render_parameters m_params;
 
     bool isDirty;
     bool isProgramChanged;
+    bool isParametersChanged;
+
+    RenderStats m_stats;
+
+    frame_callback m_frameCallback;
+
+private:
+    // Called with m_pendingMutex held.
+    void publishPending();
+
+    std::mutex m_pendingMutex;
+    render_parameters m_pendingParams;
+    TripleBuffer<render_parameters> m_publishedParams;
+
+    std::mutex m_gpuStatsMutex;
+    TripleBuffer<gpu_luma_stats> m_gpuStats;
+    bool m_gpuStatsValid;
 };
 
 #endif // _H_VIDEO_RENDERER_
@@ -1,25 +1,347 @@
 #include "VideoRendererContext.h"
 #include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/resource.h>
 
 VideoRendererContext::jni_fields_t VideoRendererContext::jni_fields = {nullptr};
 
-VideoRendererContext::VideoRendererContext(int type) {
+// Frames waiting for the render thread, the oldest is dropped so that latency stays bounded.
+static const size_t kMaxQueuedFrames = 2;
+
+// Android's urgent display priority, the one the system uses for its own composition threads.
+static const int kRenderThreadPriority = -8;
+
+VideoRendererContext::VideoRendererContext(int type)
+        : m_type(type), m_frameCount(0), m_rendering(false), m_stopRendering(false), m_frameInFlight(false),
+          m_offscreen(false), m_releaseRenderer(false), m_window(nullptr),
+          m_assetManager(nullptr), m_width(0), m_height(0), m_display(EGL_NO_DISPLAY),
+          m_config(nullptr), m_context(EGL_NO_CONTEXT), m_surface(EGL_NO_SURFACE),
+          m_presentationTime(nullptr), m_swapInterval(1), m_presentationDelay(0) {
     m_pVideoRenderer = VideoRenderer::create(type);
 }
 
-VideoRendererContext::~VideoRendererContext() = default;
+VideoRendererContext::~VideoRendererContext() {
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_releaseRenderer = true;
+    }
+    stop();
+
+    if (m_context == EGL_NO_CONTEXT) return;
+
+    // GL objects go with the context anyway, but the renderer's compile worker must stop first. Without a
+    // render thread to release it, e.g. after stop(), a 1x1 pbuffer makes the context current, no
+    // EGL_KHR_surfaceless_context is assumed.
+    if (m_pVideoRenderer) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        EGLSurface surface = eglCreatePbufferSurface(m_display, m_config, pbufferAttribs);
+        if (surface == EGL_NO_SURFACE || !eglMakeCurrent(m_display, surface, surface, m_context)) {
+            LOGE("Could not make EGL context current to release the renderer (0x%x).", eglGetError());
+        }
+
+        m_pVideoRenderer.reset();
+
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE) {
+            eglDestroySurface(m_display, surface);
+        }
+    }
+
+    eglDestroyContext(m_display, m_context);
+    eglReleaseThread();
+}
 
 void VideoRendererContext::init(ANativeWindow *window, AAssetManager *assetManager, size_t width, size_t height) {
-    m_pVideoRenderer->init(window, assetManager, width, height);
+    if (!window) {
+        m_pVideoRenderer->init(window, assetManager, width, height);
+        return;
+    }
+
+    // A new size comes with the same window, the surface is simply recreated.
+    stop();
+
+    m_window = window;
+    m_assetManager = assetManager;
+    m_width = width;
+    m_height = height;
+    m_offscreen = false;
+    m_pVideoRenderer->setOffscreen(nullptr);
+
+    startRendering();
+}
+
+void VideoRendererContext::initOffscreen(AAssetManager *assetManager, size_t width, size_t height,
+                                         const frame_callback &callback) {
+    stop();
+
+    m_assetManager = assetManager;
+    m_width = width;
+    m_height = height;
+    m_offscreen = true;
+    m_pVideoRenderer->setOffscreen(callback);
+
+    startRendering();
+}
+
+void VideoRendererContext::startRendering() {
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_rendering = true;
+        m_stopRendering = false;
+    }
+
+    m_renderThread = std::thread(&VideoRendererContext::renderLoop, this);
+}
+
+void VideoRendererContext::flush() {
+    std::unique_lock<std::mutex> lock(m_frameMutex);
+    m_doneCondition.wait(lock, [this]() {
+        return !m_rendering || m_stopRendering || (m_frames.empty() && !m_frameInFlight);
+    });
+}
+
+void VideoRendererContext::stop() {
+    if (m_renderThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_frameMutex);
+            m_stopRendering = true;
+        }
+        m_frameCondition.notify_all();
+        m_doneCondition.notify_all();
+
+        m_renderThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        m_rendering = false;
+        m_frames.clear();
+    }
+
+    if (m_window) {
+        ANativeWindow_release(m_window);
+        m_window = nullptr;
+    }
 }
 
 void VideoRendererContext::render() {
+    if (isRendering()) return;
+
     m_pVideoRenderer->render();
 }
 
-void VideoRendererContext::draw(uint8_t *buffer, size_t length, size_t width, size_t height,
-                                float rotation, bool mirror) {
-    m_pVideoRenderer->draw(buffer, length, width, height, rotation, mirror);
+FrameRef VideoRendererContext::acquireFrame(size_t width, size_t height, int64_t timestamp) {
+    return m_framePool.acquire(width, height, timestamp);
+}
+
+void VideoRendererContext::draw(FrameRef frame, float rotation, bool mirror) {
+    TRACE_SCOPE("ingest");
+    StatsScope scope(m_pVideoRenderer->getStats(), RenderStats::sIngest);
+
+    uint64_t id = ++m_frameCount;
+    TRACE_FRAME(id);
+
+    m_lumaStats.analyze(frame);
+    m_motionDetector.analyze(frame);
+
+    if (!isRendering()) {
+        m_pVideoRenderer->draw(std::move(frame), rotation, mirror);
+        return;
+    }
+
+    queued_frame queued{std::move(frame), rotation, mirror, RenderStats::now(), id};
+    {
+        std::unique_lock<std::mutex> lock(m_frameMutex);
+        if (m_offscreen) {
+            // Offscreen output must have every frame, so the producer waits instead.
+            m_doneCondition.wait(lock, [this]() {
+                return m_stopRendering || m_frames.size() < kMaxQueuedFrames;
+            });
+        }
+
+        // A dropped frame goes back to its pool with the last reference.
+        if (m_frames.size() == kMaxQueuedFrames) {
+            m_frames.pop_front();
+        }
+        m_frames.push_back(std::move(queued));
+        TRACE_COUNTER("queued frames", m_frames.size());
+    }
+    m_frameCondition.notify_one();
+}
+
+bool VideoRendererContext::isRendering() {
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+
+    return m_rendering;
+}
+
+bool VideoRendererContext::createSurface() {
+    if (m_display == EGL_NO_DISPLAY) {
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, nullptr, nullptr)) {
+            LOGE("Could not initialize EGL display (0x%x).", eglGetError());
+            m_display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        const char *extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_ANDROID_presentation_time")) {
+            m_presentationTime = (PFNEGLPRESENTATIONTIMEANDROIDPROC) eglGetProcAddress(
+                    "eglPresentationTimeANDROID");
+        }
+    }
+
+    if (m_context == EGL_NO_CONTEXT) {
+        // Pbuffer capable where possible, the shader compile worker may need one. Offscreen rendering
+        // draws to a framebuffer object, the pbuffer only makes the context current.
+        const EGLint surfaceTypes[] = {EGL_WINDOW_BIT | EGL_PBUFFER_BIT, m_window ? EGL_WINDOW_BIT : EGL_PBUFFER_BIT};
+        EGLint count = 0;
+
+        for (EGLint surfaceType: surfaceTypes) {
+            const EGLint configAttribs[] = {
+                    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                    EGL_SURFACE_TYPE, surfaceType,
+                    EGL_RED_SIZE, 8,
+                    EGL_GREEN_SIZE, 8,
+                    EGL_BLUE_SIZE, 8,
+                    EGL_ALPHA_SIZE, 8,
+                    EGL_NONE
+            };
+
+            if (eglChooseConfig(m_display, configAttribs, &m_config, 1, &count) && count) break;
+        }
+
+        if (!count) {
+            LOGE("Could not find EGL config (0x%x).", eglGetError());
+            return false;
+        }
+
+        // GLES3 where the config allows it, for the 3D LUT textures. The renderers need only GLES2.
+        for (EGLint version = 3; version >= 2 && m_context == EGL_NO_CONTEXT; version--) {
+            const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE};
+            m_context = eglCreateContext(m_display, m_config, EGL_NO_CONTEXT, contextAttribs);
+        }
+        if (m_context == EGL_NO_CONTEXT) {
+            LOGE("Could not create EGL context (0x%x).", eglGetError());
+            return false;
+        }
+    }
+
+    if (m_window) {
+        EGLint format = 0;
+        eglGetConfigAttrib(m_display, m_config, EGL_NATIVE_VISUAL_ID, &format);
+        ANativeWindow_setBuffersGeometry(m_window, 0, 0, format);
+
+        m_surface = eglCreateWindowSurface(m_display, m_config, m_window, nullptr);
+    } else {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        m_surface = eglCreatePbufferSurface(m_display, m_config, pbufferAttribs);
+    }
+
+    if (m_surface == EGL_NO_SURFACE) {
+        LOGE("Could not create window surface (0x%x).", eglGetError());
+        return false;
+    }
+
+    if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+        LOGE("Could not make EGL context current (0x%x).", eglGetError());
+        destroySurface();
+        return false;
+    }
+
+    return true;
+}
+
+void VideoRendererContext::destroySurface() {
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (m_surface != EGL_NO_SURFACE) {
+        eglDestroySurface(m_display, m_surface);
+        m_surface = EGL_NO_SURFACE;
+    }
+}
+
+void VideoRendererContext::renderLoop() {
+    if (setpriority(PRIO_PROCESS, 0, kRenderThreadPriority)) {
+        LOGI("Could not raise render thread priority.");
+    }
+
+    // Vulkan sets up its swapchain in init(), GL needs a context and surface first. Without them
+    // frames are still consumed, so that the queue never backs up.
+    bool gl = m_type != tVK_YUV420;
+    bool ready = !gl || createSurface();
+    if (ready) {
+        m_pVideoRenderer->init(m_window, m_assetManager, m_width, m_height);
+    }
+
+    int swapInterval = -1;
+
+    for (;;) {
+        queued_frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_frameMutex);
+            m_frameCondition.wait(lock, [this]() { return m_stopRendering || !m_frames.empty(); });
+
+            if (m_stopRendering) break;
+
+            frame = std::move(m_frames.front());
+            m_frames.pop_front();
+            m_frameInFlight = true;
+        }
+        m_doneCondition.notify_all();
+
+        TRACE_FRAME(frame.id);
+        RenderStats &stats = m_pVideoRenderer->getStats();
+        stats.record(RenderStats::sQueue, RenderStats::now() - frame.timestamp);
+
+        if (ready && (!gl || m_offscreen)) {
+            // Vulkan uploads, submits and presents, only waiting for the GPU before reusing its
+            // textures. Offscreen renderers read the target back instead of presenting it.
+            m_pVideoRenderer->draw(std::move(frame.frame), frame.rotation, frame.mirror);
+            if (gl) m_pVideoRenderer->render();
+            stats.record(RenderStats::sLatency, RenderStats::now() - frame.timestamp);
+        } else if (ready) {
+            if (swapInterval != m_swapInterval) {
+                swapInterval = m_swapInterval;
+                eglSwapInterval(m_display, swapInterval);
+            }
+
+            m_pVideoRenderer->draw(std::move(frame.frame), frame.rotation, frame.mirror);
+            m_pVideoRenderer->render();
+
+            if (m_presentationTime) {
+                m_presentationTime(m_display, m_surface, frame.timestamp + m_presentationDelay);
+            }
+
+            {
+                TRACE_SCOPE("swap");
+                StatsScope scope(stats, RenderStats::sPresent);
+                if (!eglSwapBuffers(m_display, m_surface)) {
+                    LOGE("Could not swap buffers (0x%x).", eglGetError());
+                }
+            }
+            stats.record(RenderStats::sLatency, RenderStats::now() - frame.timestamp);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_frameMutex);
+            m_frameInFlight = false;
+        }
+        m_doneCondition.notify_all();
+    }
+
+    if (gl) {
+        // The renderer goes with the context, released while the surface still makes it current.
+        if (ready && m_releaseRenderer) {
+            m_pVideoRenderer.reset();
+        }
+
+        destroySurface();
+        eglReleaseThread();
+    }
 }
 
 void VideoRendererContext::setParameters(uint32_t params) {
@@ -30,6 +352,64 @@ uint32_t VideoRendererContext::getParameters() {
     return m_pVideoRenderer->getParameters();
 }
 
+void VideoRendererContext::setFilterParameters(size_t filter, const float *values, size_t count) {
+    m_pVideoRenderer->setFilterParameters(filter, values, count);
+}
+
+void VideoRendererContext::setColorMatrix(const float *matrix) {
+    m_pVideoRenderer->setColorMatrix(matrix);
+}
+
+void VideoRendererContext::setQuality(bool highPrecision, size_t maxBlurTaps) {
+    m_pVideoRenderer->setQuality(highPrecision, maxBlurTaps);
+}
+
+void VideoRendererContext::setZoom(float zoom, float centerX, float centerY) {
+    m_pVideoRenderer->setZoom(zoom, centerX, centerY);
+}
+
+void VideoRendererContext::setTileUpdates(bool enabled, int threshold) {
+    m_pVideoRenderer->setTileUpdates(enabled, threshold);
+}
+
+void VideoRendererContext::setPresentation(int swapInterval, int64_t presentationDelay) {
+    m_swapInterval = std::max(swapInterval, 0);
+    m_presentationDelay = std::max(presentationDelay, (int64_t) 0);
+}
+
+void VideoRendererContext::setStatsEnabled(bool enabled) {
+    m_pVideoRenderer->getStats().setEnabled(enabled);
+}
+
+void VideoRendererContext::getStats(float *values) {
+    m_pVideoRenderer->getStats().snapshot(values);
+}
+
+void VideoRendererContext::setLumaStatsEnabled(bool enabled, size_t step) {
+    m_lumaStats.setEnabled(enabled, step);
+}
+
+bool VideoRendererContext::getLumaStats(float *values) {
+    return m_lumaStats.snapshot(values);
+}
+
+void VideoRendererContext::setGpuStatsEnabled(bool enabled) {
+    m_pVideoRenderer->setGpuStats(enabled);
+}
+
+bool VideoRendererContext::getGpuStats(float *values) {
+    return m_pVideoRenderer->getGpuStats(values);
+}
+
+void VideoRendererContext::setMotionDetection(bool enabled, int threshold, float trigger,
+                                              const motion_callback &callback) {
+    m_motionDetector.setEnabled(enabled, threshold, trigger, callback);
+}
+
+size_t VideoRendererContext::getMotionMap(std::vector<uint8_t> &map) {
+    return m_motionDetector.snapshot(map);
+}
+
 void VideoRendererContext::createContext(JNIEnv *env, jobject obj, jint type) {
     auto *context = new VideoRendererContext(type);
 
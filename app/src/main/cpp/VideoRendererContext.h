@@ -2,8 +2,19 @@
 #define _H_VIDEO_RENDERER_CONTEXT_
 
 #include "VideoRenderer.h"
+#include "LumaStats.h"
+#include "MotionDetector.h"
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <jni.h>
 #include <android/asset_manager.h>
 
@@ -17,16 +28,68 @@ public:
 
     ~VideoRendererContext();
 
+    // Renderers given a window draw on a render thread of their own, GL ones with an EGL context
+    // created here. Frames passed to draw() are queued for it and render() does nothing.
     void init(ANativeWindow *window, AAssetManager *assetManager, size_t width, size_t height);
 
+    // Renders on the render thread as init() does, but into a width x height offscreen target handed to
+    // callback frame by frame. No frame is dropped, draw() waits while the queue is full.
+    void initOffscreen(AAssetManager *assetManager, size_t width, size_t height, const frame_callback &callback);
+
+    // Waits until every frame queued so far went through the render thread.
+    void flush();
+
+    // Stops the render thread and releases its window, the EGL context is kept for the next one.
+    void stop();
+
     void render();
 
-    void draw(uint8_t *buffer, size_t length, size_t width, size_t height, float rotation, bool mirror);
+    // A packed I420 frame from the pool for the caller to fill and pass to draw().
+    FrameRef acquireFrame(size_t width, size_t height, int64_t timestamp);
+
+    void draw(FrameRef frame, float rotation, bool mirror);
 
     void setParameters(uint32_t params);
 
     uint32_t getParameters();
 
+    void setFilterParameters(size_t filter, const float *values, size_t count);
+
+    void setColorMatrix(const float *matrix);
+
+    void setQuality(bool highPrecision, size_t maxBlurTaps);
+
+    void setZoom(float zoom, float centerX, float centerY);
+
+    void setTileUpdates(bool enabled, int threshold);
+
+    // Frames are presented presentationDelay nanoseconds after they were queued, 0 for as soon as
+    // possible.
+    void setPresentation(int swapInterval, int64_t presentationDelay);
+
+    // Stage latency recording, off by default. getStats() fills RenderStats::kValueCount values, see
+    // RenderStats::snapshot().
+    void setStatsEnabled(bool enabled);
+
+    void getStats(float *values);
+
+    // Luma statistics of ingested frames, every step-th sample both ways, off by default.
+    // getLumaStats() fills LumaStats::kValueCount values, see LumaStats::snapshot().
+    void setLumaStatsEnabled(bool enabled, size_t step);
+
+    bool getLumaStats(float *values);
+
+    // Luma statistics reduced on the GPU by the renderer, see VideoRenderer::getGpuStats().
+    void setGpuStatsEnabled(bool enabled);
+
+    bool getGpuStats(float *values);
+
+    // Motion detection on ingested frames, off by default, see MotionDetector::setEnabled().
+    void setMotionDetection(bool enabled, int threshold, float trigger, const motion_callback &callback);
+
+    // The motion map of the last analyzed frame, see MotionDetector::snapshot().
+    size_t getMotionMap(std::vector<uint8_t> &map);
+
     static void createContext(JNIEnv *env, jobject obj, jint type);
 
     static void storeContext(JNIEnv *env, jobject obj, VideoRendererContext *context);
@@ -36,7 +99,59 @@ public:
     static VideoRendererContext *getContext(JNIEnv *env, jobject obj);
 
 private:
+    struct queued_frame {
+        FrameRef frame;
+        float rotation;
+        bool mirror;
+        // CLOCK_MONOTONIC nanoseconds, when draw() queued the frame.
+        int64_t timestamp;
+        uint64_t id;
+    };
+
+    bool isRendering();
+
+    void startRendering();
+
+    bool createSurface();
+
+    void destroySurface();
+
+    void renderLoop();
+
+    int m_type;
     std::unique_ptr<VideoRenderer> m_pVideoRenderer;
+    // Frames passed to draw(), which numbers them for traces.
+    uint64_t m_frameCount;
+
+    std::thread m_renderThread;
+    std::deque<queued_frame> m_frames;
+    FramePool m_framePool;
+    LumaStats m_lumaStats;
+    MotionDetector m_motionDetector;
+    std::mutex m_frameMutex;
+    std::condition_variable m_frameCondition;
+    // Signalled whenever the render thread takes or finishes a frame.
+    std::condition_variable m_doneCondition;
+    bool m_rendering;
+    bool m_stopRendering;
+    bool m_frameInFlight;
+    bool m_offscreen;
+    // Set by the destructor, the render thread then releases the renderer while its surface is current.
+    bool m_releaseRenderer;
+
+    ANativeWindow *m_window;
+    AAssetManager *m_assetManager;
+    size_t m_width;
+    size_t m_height;
+
+    EGLDisplay m_display;
+    EGLConfig m_config;
+    EGLContext m_context;
+    EGLSurface m_surface;
+    PFNEGLPRESENTATIONTIMEANDROIDPROC m_presentationTime;
+
+    std::atomic<int> m_swapInterval;
+    std::atomic<int64_t> m_presentationDelay;
 
     static jni_fields_t jni_fields;
 };
@@ -1,9 +1,136 @@
 #include "VideoRendererJNI.h"
 #include "VideoRendererContext.h"
+#include "PixelFormat.h"
+#include "Trace.h"
 
 #include <android/native_window_jni.h>
 #include <android/asset_manager_jni.h>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// The JNIEnv of the calling thread, attached to the VM for the scope when it isn't yet.
+struct scoped_env {
+    explicit scoped_env(JavaVM *javaVm) : vm(javaVm), env(nullptr), attached(false) {
+        if (vm->GetEnv((void **) &env, JNI_VERSION_1_6) == JNI_EDETACHED) {
+            attached = vm->AttachCurrentThread(&env, nullptr) == JNI_OK;
+            if (!attached) env = nullptr;
+        }
+    }
+
+    ~scoped_env() {
+        if (attached) vm->DetachCurrentThread();
+    }
+
+    JavaVM *vm;
+    JNIEnv *env;
+    bool attached;
+};
+
+// A VideoRenderer.MotionListener held past the JNI call, called and released on JobSystem threads.
+class motion_listener {
+public:
+    motion_listener(JNIEnv *env, jobject listener) : m_vm(nullptr), m_listener(nullptr), m_onMotion(nullptr) {
+        env->GetJavaVM(&m_vm);
+        m_listener = env->NewGlobalRef(listener);
+        m_onMotion = env->GetMethodID(env->GetObjectClass(listener), "onMotion", "(ZFJ[I)V");
+    }
+
+    ~motion_listener() {
+        scoped_env scope(m_vm);
+        if (scope.env) scope.env->DeleteGlobalRef(m_listener);
+    }
+
+    void onMotion(const motion_event &event) const {
+        scoped_env scope(m_vm);
+        JNIEnv *env = scope.env;
+        if (!env || !m_onMotion) return;
+
+        // Boxes flattened to x, y, width and height each.
+        jint values[motion_event::kMaxBoxes * 4];
+        for (size_t i = 0; i < event.boxCount; i++) {
+            values[i * 4] = (jint) event.boxes[i].x;
+            values[i * 4 + 1] = (jint) event.boxes[i].y;
+            values[i * 4 + 2] = (jint) event.boxes[i].width;
+            values[i * 4 + 3] = (jint) event.boxes[i].height;
+        }
+
+        jintArray boxes = env->NewIntArray((jsize) (event.boxCount * 4));
+        if (!boxes) return;
+        env->SetIntArrayRegion(boxes, 0, (jsize) (event.boxCount * 4), values);
+
+        env->CallVoidMethod(m_listener, m_onMotion, (jboolean) event.active, (jfloat) event.level,
+                            (jlong) event.timestamp, boxes);
+        if (env->ExceptionCheck()) env->ExceptionClear();
+        env->DeleteLocalRef(boxes);
+    }
+
+private:
+    JavaVM *m_vm;
+    jobject m_listener;
+    jmethodID m_onMotion;
+};
+
+// A java.lang.AutoCloseable that owns the planes of a frame, closed when the last reference to the
+// frame goes, on whichever thread drops it.
+class frame_owner {
+public:
+    frame_owner(JNIEnv *env, jobject owner) : m_vm(nullptr), m_owner(nullptr), m_close(nullptr) {
+        env->GetJavaVM(&m_vm);
+        m_owner = env->NewGlobalRef(owner);
+        m_close = env->GetMethodID(env->GetObjectClass(owner), "close", "()V");
+    }
+
+    ~frame_owner() {
+        scoped_env scope(m_vm);
+        if (scope.env) scope.env->DeleteGlobalRef(m_owner);
+    }
+
+    void close() const {
+        scoped_env scope(m_vm);
+        JNIEnv *env = scope.env;
+        if (!env || !m_close) return;
+
+        env->CallVoidMethod(m_owner, m_close);
+        if (env->ExceptionCheck()) env->ExceptionClear();
+    }
+
+private:
+    JavaVM *m_vm;
+    jobject m_owner;
+    jmethodID m_close;
+};
+
+// Whether a direct buffer holds rows of columns samples pixelStride bytes apart, rows stride bytes apart.
+static bool holds_plane(JNIEnv *env, jobject buffer, size_t rows, size_t stride, size_t columns,
+                        size_t pixelStride) {
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+
+    return capacity > 0 && (size_t) capacity >= (rows - 1) * stride + (columns - 1) * pixelStride + 1;
+}
+
+// Whether direct buffers hold the planes of a width x height YUV_420_888 image. The last row of an
+// Image plane may stop at its last sample, so only that much is required.
+static bool valid_planes(JNIEnv *env, jobject y, jobject u, jobject v, jint strideY, jint strideUV,
+                         jint pixelStrideUV, jint width, jint height) {
+    if (width <= 0 || height <= 0 || (width | height) & 1 || strideY < width || pixelStrideUV < 1 ||
+        strideUV < width / 2 * pixelStrideUV) {
+        return false;
+    }
+
+    return holds_plane(env, y, height, strideY, width, 1) &&
+           holds_plane(env, u, height / 2, strideUV, width / 2, pixelStrideUV) &&
+           holds_plane(env, v, height / 2, strideUV, width / 2, pixelStrideUV);
+}
+
+static video_frame frame_planes(JNIEnv *env, jobject y, jobject u, jobject v, jint strideY, jint strideUV,
+                                jint pixelStrideUV, jint width, jint height) {
+    return {(size_t) width, (size_t) height, (size_t) strideY, (size_t) strideUV, (size_t) pixelStrideUV,
+            (uint8_t *) env->GetDirectBufferAddress(y), (uint8_t *) env->GetDirectBufferAddress(u),
+            (uint8_t *) env->GetDirectBufferAddress(v)};
+}
+
 JCMCPRV(void, create)(JNIEnv *env, jobject obj, jint type) {
     VideoRendererContext::createContext(env, obj, type);
 }
@@ -22,6 +149,12 @@ JCMCPRV(void, init)(JNIEnv *env, jobject obj, jobject surface, jobject assetMana
     if (context) context->init(window, aAssetManager, (size_t) width, (size_t) height);
 }
 
+JCMCPRV(void, stop)(JNIEnv *env, jobject obj) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->stop();
+}
+
 JCMCPRV(void, render)(JNIEnv *env, jobject obj) {
     VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
 
@@ -29,16 +162,44 @@ JCMCPRV(void, render)(JNIEnv *env, jobject obj) {
 }
 
 JCMCPRV(void, draw)(JNIEnv *env, jobject obj, jbyteArray data, jint width, jint height,
-                    jint rotation, jboolean mirror) {
-    jbyte *bufferPtr = env->GetByteArrayElements(data, nullptr);
+                    jint rotation, jboolean mirror, jlong timestamp) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
 
-    jsize arrayLength = env->GetArrayLength(data);
+    if (!context) return;
+
+    // Copied once, from the Java array straight into a pooled frame the renderer keeps.
+    FrameRef frame = context->acquireFrame((size_t) width, (size_t) height, (int64_t) timestamp);
+    const video_frame &planes = frame.planes();
+    auto size = (jsize) (planes.width * planes.height + 2 * planes.stride_uv * (planes.height / 2));
+
+    if (env->GetArrayLength(data) < size) return;
+    env->GetByteArrayRegion(data, 0, size, (jbyte *) planes.y);
+
+    context->draw(std::move(frame), rotation, mirror);
+}
 
+JCMCPRV(jboolean, drawImage)(JNIEnv *env, jobject obj, jobject owner, jobject y, jobject u, jobject v, jint strideY,
+                             jint strideUV, jint pixelStrideUV, jint width, jint height, jint rotation,
+                             jboolean mirror, jlong timestamp) {
     VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
 
-    if (context) context->draw((uint8_t *) bufferPtr, (size_t) arrayLength, (size_t) width, (size_t) height, rotation, mirror);
+    if (!context || !owner || !valid_planes(env, y, u, v, strideY, strideUV, pixelStrideUV, width, height)) {
+        return JNI_FALSE;
+    }
 
-    env->ReleaseByteArrayElements(data, bufferPtr, 0);
+    const video_frame planes = frame_planes(env, y, u, v, strideY, strideUV, pixelStrideUV, width, height);
+
+    // Only layouts the renderers and conversions know are taken, the caller copies the others.
+    pixel_image image;
+    if (!planes.y || !planes.u || !planes.v || !pixel_image_from_frame(planes, image)) return JNI_FALSE;
+
+    // No copy, the renderer reads the image planes until the frame is released and owner closed.
+    auto held = std::make_shared<frame_owner>(env, owner);
+    FrameRef frame = FrameRef::wrap(planes, (int64_t) timestamp, [held]() { held->close(); });
+
+    context->draw(std::move(frame), rotation, mirror);
+
+    return JNI_TRUE;
 }
 
 JCMCPRV(void, setParameters)(JNIEnv *env, jobject obj, jint params) {
@@ -54,3 +215,211 @@ JCMCPRV(jint, getParameters)(JNIEnv *env, jobject obj) {
 
     return 0;
 }
+
+JCMCPRV(void, setFilterParameters)(JNIEnv *env, jobject obj, jint filter, jfloatArray values) {
+    jfloat *valuesPtr = env->GetFloatArrayElements(values, nullptr);
+
+    jsize count = env->GetArrayLength(values);
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setFilterParameters((size_t) filter, valuesPtr, (size_t) count);
+
+    env->ReleaseFloatArrayElements(values, valuesPtr, JNI_ABORT);
+}
+
+JCMCPRV(void, setColorMatrix)(JNIEnv *env, jobject obj, jfloatArray matrix) {
+    if (env->GetArrayLength(matrix) < 16) return;
+
+    jfloat *matrixPtr = env->GetFloatArrayElements(matrix, nullptr);
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setColorMatrix(matrixPtr);
+
+    env->ReleaseFloatArrayElements(matrix, matrixPtr, JNI_ABORT);
+}
+
+JCMCPRV(void, setQuality)(JNIEnv *env, jobject obj, jboolean highPrecision, jint maxBlurTaps) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setQuality(highPrecision, (size_t) std::max(maxBlurTaps, 1));
+}
+
+JCMCPRV(void, setZoom)(JNIEnv *env, jobject obj, jfloat zoom, jfloat centerX, jfloat centerY) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setZoom(zoom, centerX, centerY);
+}
+
+JCMCPRV(void, setTileUpdates)(JNIEnv *env, jobject obj, jboolean enabled, jint threshold) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setTileUpdates(enabled, threshold);
+}
+
+JCMCPRV(void, setPresentation)(JNIEnv *env, jobject obj, jint swapInterval, jlong presentationDelay) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setPresentation(swapInterval, presentationDelay);
+}
+
+JCMCPRV(void, setStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setStatsEnabled(enabled);
+}
+
+JCMCPRV(jfloatArray, getStats)(JNIEnv *env, jobject obj) {
+    const size_t count = RenderStats::kValueCount;
+    jfloat values[count] = {};
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->getStats(values);
+
+    jfloatArray stats = env->NewFloatArray((jsize) count);
+    if (stats) env->SetFloatArrayRegion(stats, 0, (jsize) count, values);
+
+    return stats;
+}
+
+JCMCPRV(void, setLumaStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled, jint step) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setLumaStatsEnabled(enabled, (size_t) std::max(step, 1));
+}
+
+JCMCPRV(jboolean, getLumaStats)(JNIEnv *env, jobject obj, jfloatArray values) {
+    const size_t count = LumaStats::kValueCount;
+    if (!values || env->GetArrayLength(values) < (jsize) count) return JNI_FALSE;
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    // Written straight into the caller's array, no frame data crosses JNI.
+    jfloat stats[count];
+    if (!context || !context->getLumaStats(stats)) return JNI_FALSE;
+
+    env->SetFloatArrayRegion(values, 0, (jsize) count, stats);
+
+    return JNI_TRUE;
+}
+
+JCMCPRV(void, setGpuStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    if (context) context->setGpuStatsEnabled(enabled);
+}
+
+JCMCPRV(jboolean, getGpuStats)(JNIEnv *env, jobject obj, jfloatArray values) {
+    const size_t count = gpu_luma_stats::kValueCount;
+    if (!values || env->GetArrayLength(values) < (jsize) count) return JNI_FALSE;
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    jfloat stats[count];
+    if (!context || !context->getGpuStats(stats)) return JNI_FALSE;
+
+    env->SetFloatArrayRegion(values, 0, (jsize) count, stats);
+
+    return JNI_TRUE;
+}
+
+JCMCPRV(void, setMotionDetection)(JNIEnv *env, jobject obj, jboolean enabled, jint threshold, jfloat trigger,
+                                  jobject listener) {
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+    if (!context) return;
+
+    motion_callback callback;
+    if (enabled && listener) {
+        auto held = std::make_shared<motion_listener>(env, listener);
+        callback = [held](const motion_event &event) { held->onMotion(event); };
+    }
+
+    context->setMotionDetection(enabled, threshold, trigger, callback);
+}
+
+JCMCPRV(jbyteArray, getMotionMap)(JNIEnv *env, jobject obj, jintArray size) {
+    if (!size || env->GetArrayLength(size) < 2) return nullptr;
+
+    VideoRendererContext *context = VideoRendererContext::getContext(env, obj);
+
+    std::vector<uint8_t> map;
+    size_t columns = context ? context->getMotionMap(map) : 0;
+    if (!columns) return nullptr;
+
+    const jint dimensions[2] = {(jint) columns, (jint) (map.size() / columns)};
+    env->SetIntArrayRegion(size, 0, 2, dimensions);
+
+    jbyteArray blocks = env->NewByteArray((jsize) map.size());
+    if (blocks) env->SetByteArrayRegion(blocks, 0, (jsize) map.size(), (const jbyte *) map.data());
+
+    return blocks;
+}
+
+JCMCPRV(void, setTraceEnabled)(JNIEnv *env, jclass cls, jboolean enabled) {
+#if MEDIA_TRACE
+    Trace::setEnabled(enabled);
+#endif
+}
+
+JCMCPRV(jboolean, writeTrace)(JNIEnv *env, jclass cls, jstring path) {
+#if MEDIA_TRACE
+    const char *pathPtr = env->GetStringUTFChars(path, nullptr);
+    if (!pathPtr) return JNI_FALSE;
+
+    bool written = Trace::write(pathPtr);
+
+    env->ReleaseStringUTFChars(path, pathPtr);
+
+    return (jboolean) written;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+JCMCPRV(jboolean, convertPixels)(JNIEnv *env, jclass cls, jbyteArray src, jint srcFormat, jbyteArray dst,
+                                 jint dstFormat, jint width, jint height, jint rotation, jboolean mirror) {
+    if (srcFormat < pxI420 || srcFormat > pxRGB565 || dstFormat < pxI420 || dstFormat > pxRGB565 || width <= 0 ||
+        height <= 0 || (width | height) & 1) {
+        return JNI_FALSE;
+    }
+
+    if ((size_t) env->GetArrayLength(src) < pixel_image_size((PixelFormat) srcFormat, width, height) ||
+        (size_t) env->GetArrayLength(dst) < pixel_image_size((PixelFormat) dstFormat, width, height)) {
+        return JNI_FALSE;
+    }
+
+    bool swap = rotation == 90 || rotation == 270;
+    jbyte *srcData = env->GetByteArrayElements(src, nullptr);
+    jbyte *dstData = srcData ? env->GetByteArrayElements(dst, nullptr) : nullptr;
+    bool converted = dstData && rotate_pixel_image(
+            pixel_image_packed((PixelFormat) srcFormat, width, height, (uint8_t *) srcData),
+            pixel_image_packed((PixelFormat) dstFormat, swap ? height : width, swap ? width : height,
+                               (uint8_t *) dstData), rotation, mirror);
+
+    if (dstData) env->ReleaseByteArrayElements(dst, dstData, 0);
+    if (srcData) env->ReleaseByteArrayElements(src, srcData, JNI_ABORT);
+
+    return (jboolean) converted;
+}
+
+JCMCPRV(jboolean, packPlanes)(JNIEnv *env, jclass cls, jobject y, jobject u, jobject v, jint strideY, jint strideUV,
+                              jint pixelStrideUV, jint width, jint height, jbyteArray dst) {
+    if (!valid_planes(env, y, u, v, strideY, strideUV, pixelStrideUV, width, height) ||
+        (size_t) env->GetArrayLength(dst) < pixel_image_size(pxI420, width, height)) {
+        return JNI_FALSE;
+    }
+
+    const video_frame planes = frame_planes(env, y, u, v, strideY, strideUV, pixelStrideUV, width, height);
+    pixel_image src;
+    if (!planes.y || !planes.u || !planes.v || !pixel_image_from_frame(planes, src)) return JNI_FALSE;
+
+    jbyte *dstData = env->GetByteArrayElements(dst, nullptr);
+    if (!dstData) return JNI_FALSE;
+
+    bool converted = convert_pixel_image(src, pixel_image_packed(pxI420, width, height, (uint8_t *) dstData));
+    env->ReleaseByteArrayElements(dst, dstData, 0);
+
+    return (jboolean) converted;
+}
@@ -13,10 +13,36 @@ extern "C" {
 JCMCPRV(void, create)(JNIEnv *env, jobject obj, jint type);
 JCMCPRV(void, destroy)(JNIEnv *env, jobject obj);
 JCMCPRV(void, init)(JNIEnv *env, jobject obj, jobject surface, jobject assetManager, jint width, jint height);
+JCMCPRV(void, stop)(JNIEnv *env, jobject obj);
 JCMCPRV(void, render)(JNIEnv *env, jobject obj);
-JCMCPRV(void, draw)(JNIEnv *env, jobject obj, jbyteArray data, jint width, jint height, jint rotation, jboolean mirror);
+JCMCPRV(void, draw)(JNIEnv *env, jobject obj, jbyteArray data, jint width, jint height, jint rotation, jboolean mirror,
+                    jlong timestamp);
+JCMCPRV(jboolean, drawImage)(JNIEnv *env, jobject obj, jobject owner, jobject y, jobject u, jobject v, jint strideY,
+                             jint strideUV, jint pixelStrideUV, jint width, jint height, jint rotation,
+                             jboolean mirror, jlong timestamp);
 JCMCPRV(void, setParameters)(JNIEnv *env, jobject obj, jint params);
 JCMCPRV(jint, getParameters)(JNIEnv *env, jobject obj);
+JCMCPRV(void, setFilterParameters)(JNIEnv *env, jobject obj, jint filter, jfloatArray values);
+JCMCPRV(void, setColorMatrix)(JNIEnv *env, jobject obj, jfloatArray matrix);
+JCMCPRV(void, setQuality)(JNIEnv *env, jobject obj, jboolean highPrecision, jint maxBlurTaps);
+JCMCPRV(void, setZoom)(JNIEnv *env, jobject obj, jfloat zoom, jfloat centerX, jfloat centerY);
+JCMCPRV(void, setTileUpdates)(JNIEnv *env, jobject obj, jboolean enabled, jint threshold);
+JCMCPRV(void, setPresentation)(JNIEnv *env, jobject obj, jint swapInterval, jlong presentationDelay);
+JCMCPRV(void, setStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled);
+JCMCPRV(jfloatArray, getStats)(JNIEnv *env, jobject obj);
+JCMCPRV(void, setLumaStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled, jint step);
+JCMCPRV(jboolean, getLumaStats)(JNIEnv *env, jobject obj, jfloatArray values);
+JCMCPRV(void, setGpuStatsEnabled)(JNIEnv *env, jobject obj, jboolean enabled);
+JCMCPRV(jboolean, getGpuStats)(JNIEnv *env, jobject obj, jfloatArray values);
+JCMCPRV(void, setMotionDetection)(JNIEnv *env, jobject obj, jboolean enabled, jint threshold, jfloat trigger,
+                                  jobject listener);
+JCMCPRV(jbyteArray, getMotionMap)(JNIEnv *env, jobject obj, jintArray size);
+JCMCPRV(void, setTraceEnabled)(JNIEnv *env, jclass cls, jboolean enabled);
+JCMCPRV(jboolean, writeTrace)(JNIEnv *env, jclass cls, jstring path);
+JCMCPRV(jboolean, convertPixels)(JNIEnv *env, jclass cls, jbyteArray src, jint srcFormat, jbyteArray dst,
+                                 jint dstFormat, jint width, jint height, jint rotation, jboolean mirror);
+JCMCPRV(jboolean, packPlanes)(JNIEnv *env, jclass cls, jobject y, jobject u, jobject v, jint strideY, jint strideUV,
+                              jint pixelStrideUV, jint width, jint height, jbyteArray dst);
 
 #ifdef __cplusplus
 }
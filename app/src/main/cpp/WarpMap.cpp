@@ -0,0 +1,193 @@
+#include "WarpMap.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float kCoordMin = -0.5f;
+static const float kCoordRange = 2.0f;
+
+static inline void encode(float coord, uint8_t *texel) {
+    float normalized = std::min(std::max((coord - kCoordMin) / kCoordRange, 0.0f), 1.0f);
+    auto value = (uint16_t) (normalized * 65535.0f + 0.5f);
+
+    texel[0] = (uint8_t) (value >> 8);
+    texel[1] = (uint8_t) (value & 0xFF);
+}
+
+WarpMap::WarpMap() : m_front(), m_building(), m_busy(false), m_backReady(false) {
+
+}
+
+WarpMap::~WarpMap() {
+    wait();
+}
+
+bool WarpMap::Request::operator==(const Request &other) const {
+    return type == other.type && width == other.width && height == other.height &&
+           memcmp(params, other.params, sizeof(params)) == 0;
+}
+
+bool WarpMap::update(Type type, size_t width, size_t height, const float *params) {
+    Request request{type, width, height, {}};
+    memcpy(request.params, params, sizeof(request.params));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A finished map is shown even if newer parameters came in since, it is closer than the last.
+    bool ready = m_backReady;
+    if (ready) {
+        std::swap(m_data, m_back);
+        m_front = m_building;
+        m_backReady = false;
+    }
+
+    // One map at a time, parameters that change while it runs are picked up by a later call.
+    if (!m_busy && !(request == m_front)) {
+        m_building = request;
+        m_busy = true;
+
+        JobSystem::instance().submit([this]() {
+            generate(m_building, m_back);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+            m_backReady = true;
+            m_done.notify_all();
+        });
+    }
+
+    return ready;
+}
+
+void WarpMap::generate(Type type, size_t width, size_t height, const float *params) {
+    wait();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_front = Request{type, width, height, {}};
+    memcpy(m_front.params, params, sizeof(m_front.params));
+    m_backReady = false;
+
+    generate(m_front, m_data);
+}
+
+void WarpMap::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return !m_busy; });
+}
+
+void WarpMap::generate(const Request &request, std::unique_ptr<uint8_t[]> &data) {
+    size_t width = latticeSize(request.width);
+    size_t height = latticeSize(request.height);
+
+    data = std::make_unique<uint8_t[]>(width * height * 4);
+
+    uint8_t *rows = data.get();
+    JobSystem::instance().parallelFor(height, [&request, rows](size_t begin, size_t end) {
+        generateRows(request, rows, begin, end);
+    });
+}
+
+void WarpMap::generateRows(const Request &request, uint8_t *data, size_t begin, size_t end) {
+    size_t width = latticeSize(request.width);
+    size_t height = latticeSize(request.height);
+
+    for (size_t y = begin; y < end; ++y) {
+        uint8_t *texel = data + y * width * 4;
+        float v = (float) y / (float) (height - 1);
+
+        for (size_t x = 0; x < width; ++x, texel += 4) {
+            float u = (float) x / (float) (width - 1);
+            float su, sv;
+            sourceCoord(request.type, request.width, request.height, request.params, u, v, &su, &sv);
+
+            encode(su, texel);
+            encode(sv, texel + 2);
+        }
+    }
+}
+
+size_t WarpMap::latticeSize(size_t size) {
+    return (size + kStep - 1) / kStep + 1;
+}
+
+void WarpMap::sourceCoord(Type type, size_t width, size_t height, const float *params, float u, float v,
+                          float *su, float *sv) {
+    *su = u;
+    *sv = v;
+
+    auto texWidth = (float) width;
+    auto texHeight = (float) height;
+
+    switch (type) {
+        case tSwirl: {
+            float swirlRadius = params[0];
+            float swirlAngle = params[1];
+            float x = u * texWidth - texWidth / 2.0f;
+            float y = v * texHeight - texHeight / 2.0f;
+            float dist = sqrtf(x * x + y * y);
+
+            if (dist < swirlRadius) {
+                float percent = (swirlRadius - dist) / swirlRadius;
+                float theta = percent * percent * swirlAngle * 8.0f;
+                float s = sinf(theta);
+                float c = cosf(theta);
+
+                *su = (x * c - y * s + texWidth / 2.0f) / texWidth;
+                *sv = (x * s + y * c + texHeight / 2.0f) / texHeight;
+            }
+            break;
+        }
+        case tMagnifier: {
+            float magnifierRadius = params[0];
+            float minZoom = params[1];
+            float maxZoom = params[2];
+            float aspect = texWidth / texHeight;
+            float relX = u * aspect - 0.5f * aspect;
+            float relY = v - 0.5f;
+            float dist = sqrtf(relX * relX + relY * relY);
+
+            if (dist <= magnifierRadius) {
+                float angle = atan2f(relY, relX);
+                float radius = dist * ((maxZoom * dist / magnifierRadius) + minZoom);
+
+                *su = (0.5f * aspect + cosf(angle) * radius) / aspect;
+                *sv = 0.5f + sinf(angle) * radius;
+            }
+            break;
+        }
+        case tFishEye: {
+            float aperture = params[0];
+            float maxFactor = sinf(0.5f * aperture * (float) M_PI / 180.0f);
+            float x = 2.0f * u - 1.0f;
+            float y = 2.0f * v - 1.0f;
+
+            if (sqrtf(x * x + y * y) < 2.0f - maxFactor) {
+                float d = sqrtf(x * x + y * y) * maxFactor;
+                float z = sqrtf(std::max(1.0f - d * d, 0.0f));
+                float r = atan2f(d, z) / (float) M_PI;
+                float phi = atan2f(y, x);
+
+                *su = r * cosf(phi) + 0.5f;
+                *sv = r * sinf(phi) + 0.5f;
+            }
+            break;
+        }
+        case tNone:
+        default:
+            break;
+    }
+}
+
+const uint8_t *WarpMap::data() const {
+    return m_data.get();
+}
+
+size_t WarpMap::width() const {
+    return m_data ? latticeSize(m_front.width) : 0;
+}
+
+size_t WarpMap::height() const {
+    return m_data ? latticeSize(m_front.height) : 0;
+}
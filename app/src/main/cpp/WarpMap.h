@@ -0,0 +1,81 @@
+#ifndef _WARP_MAP_H_
+#define _WARP_MAP_H_
+
+#include "FilterParameters.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Source coordinates for the distortion filters on a lattice every kStep frame pixels, computed on
+// the CPU whenever the distortion or the frame size changes. The shader interpolates between the
+// four lattice points around each pixel, so the map stays small and the output smooth. Coordinates
+// are stored as 16-bit fixed point over [-0.5, 1.5], u in RG and v in BA.
+class WarpMap {
+public:
+    enum Type {
+        tNone, tSwirl, tMagnifier, tFishEye
+    };
+
+    // Frame pixels between lattice points.
+    static const size_t kStep = 4;
+
+    WarpMap();
+
+    // Waits for the map being generated.
+    ~WarpMap();
+
+    // Starts generating the map for the arguments on the JobSystem unless it is current or being
+    // generated. Returns true when a map finished since the last call, data() holds it from then on.
+    // params holds kMaxFilterParameters values laid out as in filter_parameters().
+    bool update(Type type, size_t width, size_t height, const float *params);
+
+    // Generates the map on the calling thread, for callers that need it right away.
+    void generate(Type type, size_t width, size_t height, const float *params);
+
+    // Blocks until the map being generated is done, update() then takes it.
+    void wait();
+
+    // Source texture coordinate for the destination coordinate (u, v).
+    static void sourceCoord(Type type, size_t width, size_t height, const float *params, float u, float v,
+                            float *su, float *sv);
+
+    // Lattice points along a frame side of size pixels, the first and last on the frame edges.
+    static size_t latticeSize(size_t size);
+
+    const uint8_t *data() const;
+
+    // Size of the lattice, not of the frame.
+    size_t width() const;
+
+    size_t height() const;
+
+private:
+    struct Request {
+        Type type;
+        size_t width;
+        size_t height;
+        float params[kMaxFilterParameters];
+
+        bool operator==(const Request &other) const;
+    };
+
+    static void generateRows(const Request &request, uint8_t *data, size_t begin, size_t end);
+
+    static void generate(const Request &request, std::unique_ptr<uint8_t[]> &data);
+
+    // Map in data(), and the one being generated into m_back.
+    Request m_front;
+    Request m_building;
+    std::unique_ptr<uint8_t[]> m_data;
+    std::unique_ptr<uint8_t[]> m_back;
+
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    bool m_busy;
+    bool m_backReady;
+};
+
+#endif //_WARP_MAP_H_
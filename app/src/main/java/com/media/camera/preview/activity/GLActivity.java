@@ -6,11 +6,11 @@ import android.app.AlertDialog;
 import android.app.Dialog;
 import android.content.Intent;
 import android.content.pm.PackageManager;
-import android.opengl.GLSurfaceView;
 import android.os.Bundle;
 import android.support.annotation.NonNull;
 import android.support.v4.app.ActivityCompat;
 import android.support.v4.app.DialogFragment;
+import android.view.SurfaceView;
 
 import com.media.camera.preview.R;
 import com.media.camera.preview.controller.CameraController;
@@ -28,19 +28,20 @@ public class GLActivity extends BaseActivity implements ActivityCompat.OnRequest
     private GLVideoRenderer mVideoRenderer;
     private ErrorDialog mErrorDialog;
     private int mFilter = 0;
+    private int mLut = 0;
 
     @Override
     public void onCreate(Bundle savedInstanceState) {
         super.onCreate(savedInstanceState);
         setContentView(R.layout.activity_gl);
 
-        GLSurfaceView glSurfaceView = findViewById(R.id.preview);
-        mVideoRenderer = new GLVideoRenderer();
-        mVideoRenderer.init(glSurfaceView);
+        SurfaceView surfaceView = findViewById(R.id.preview);
+        mVideoRenderer = new GLVideoRenderer(getApplicationContext());
+        mVideoRenderer.init(surfaceView);
 
         mCameraController = new CameraController(this, mVideoRenderer);
 
-        setup(glSurfaceView);
+        setup(surfaceView);
     }
 
     @Override
@@ -136,6 +137,15 @@ public class GLActivity extends BaseActivity implements ActivityCompat.OnRequest
                     mVideoRenderer.setVideoParameters(mParams);
                 }
                 break;
+            case SWIPE_DOWN:
+                mParams = mVideoRenderer.getVideoParameters();
+                int lutCount = (mParams & 0x00F00000) >>> 20;
+                if (lutCount > 0) {
+                    mLut = (mLut + 1) % (lutCount + 1);
+                    mParams = (mParams & 0xFFF0FFFF) | (mLut << 16);
+                    mVideoRenderer.setVideoParameters(mParams);
+                }
+                break;
             default:
                 break;
         }
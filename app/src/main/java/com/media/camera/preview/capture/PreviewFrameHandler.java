@@ -1,9 +1,17 @@
 package com.media.camera.preview.capture;
 
+import android.media.Image;
+
 /**
  * Created by oleg on 11/2/17.
  */
 
 public interface PreviewFrameHandler {
-    void onPreviewFrame(byte[] data, int width, int height);
+    void onPreviewFrame(byte[] data, int width, int height, long timestamp);
+
+    /**
+     * Takes the image without a copy, closing owner once done with it. Returns false to get the
+     * image through {@link #onPreviewFrame} instead.
+     */
+    boolean onPreviewImage(Image image, AutoCloseable owner);
 }
@@ -4,7 +4,13 @@ import android.graphics.ImageFormat;
 import android.media.Image;
 import android.media.ImageReader;
 
+import com.media.camera.preview.render.VideoRenderer;
+
 import java.nio.ByteBuffer;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.Map;
+import java.util.Set;
 
 /**
  * Created by oleg on 11/2/17.
@@ -14,29 +20,109 @@ public class VideoCapture implements ImageReader.OnImageAvailableListener {
 
     private final PreviewFrameHandler mPreviewFrameHandler;
 
+    // Images handed on by reader, and readers to close once none of theirs is held any more.
+    private final Map<ImageReader, Integer> mHeldImages = new HashMap<>();
+    private final Set<ImageReader> mClosingReaders = new HashSet<>();
+
     public VideoCapture(PreviewFrameHandler frameHandler) {
         mPreviewFrameHandler = frameHandler;
     }
 
+    /**
+     * Closes the reader now or, while images of it are still held, once the last one is closed.
+     * Closing a reader frees the buffers of its images.
+     */
+    public void closeReader(ImageReader imageReader) {
+        imageReader.setOnImageAvailableListener(null, null);
+
+        synchronized (mHeldImages) {
+            if (mHeldImages.containsKey(imageReader)) {
+                mClosingReaders.add(imageReader);
+                return;
+            }
+        }
+
+        imageReader.close();
+    }
+
     @Override
     public void onImageAvailable(ImageReader imageReader) {
+        Image image;
+        try {
+            image = imageReader.acquireLatestImage();
+        } catch (IllegalStateException e) {
+            // Every image is held, this frame is dropped and the next comes once one is back.
+            return;
+        }
 
-        Image image = imageReader.acquireLatestImage();
         if (image != null) {
             if (mPreviewFrameHandler != null) {
-                mPreviewFrameHandler.onPreviewFrame(YUV_420_888_data(image), image.getWidth(), image.getHeight());
+                HeldImage held = new HeldImage(imageReader, image);
+                if (mPreviewFrameHandler.onPreviewImage(image, held)) return;
+
+                held.release();
+                mPreviewFrameHandler.onPreviewFrame(YUV_420_888_data(image), image.getWidth(), image.getHeight(),
+                        image.getTimestamp());
             }
 
             image.close();
         }
     }
 
+    /**
+     * An image handed on, counted against its reader until it is closed.
+     */
+    private final class HeldImage implements AutoCloseable {
+        private final ImageReader mImageReader;
+        private final Image mImage;
+
+        HeldImage(ImageReader imageReader, Image image) {
+            mImageReader = imageReader;
+            mImage = image;
+
+            synchronized (mHeldImages) {
+                Integer count = mHeldImages.get(imageReader);
+                mHeldImages.put(imageReader, count == null ? 1 : count + 1);
+            }
+        }
+
+        @Override
+        public void close() {
+            mImage.close();
+            release();
+        }
+
+        // Stops counting the image, closing its reader if that was waiting for it.
+        void release() {
+            synchronized (mHeldImages) {
+                int count = mHeldImages.get(mImageReader) - 1;
+                if (count > 0) {
+                    mHeldImages.put(mImageReader, count);
+                    return;
+                }
+
+                mHeldImages.remove(mImageReader);
+                if (!mClosingReaders.remove(mImageReader)) return;
+            }
+
+            mImageReader.close();
+        }
+    }
+
     private static byte[] YUV_420_888_data(Image image) {
         final int imageWidth = image.getWidth();
         final int imageHeight = image.getHeight();
         final Image.Plane[] planes = image.getPlanes();
         byte[] data = new byte[imageWidth * imageHeight *
                 ImageFormat.getBitsPerPixel(ImageFormat.YUV_420_888) / 8];
+
+        // Natively when the chroma layout allows, the loop below is the fallback.
+        if (VideoRenderer.packFrame(planes[0].getBuffer(), planes[1].getBuffer(), planes[2].getBuffer(),
+                planes[0].getRowStride(), planes[1].getRowStride(), planes[1].getPixelStride(),
+                imageWidth, imageHeight, data)) {
+            return data;
+        }
+
         int offset = 0;
 
         for (int plane = 0; plane < planes.length; ++plane) {
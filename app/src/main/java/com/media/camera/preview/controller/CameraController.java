@@ -15,6 +15,7 @@ import android.hardware.camera2.CameraDevice;
 import android.hardware.camera2.CameraManager;
 import android.hardware.camera2.CaptureRequest;
 import android.hardware.camera2.params.StreamConfigurationMap;
+import android.media.Image;
 import android.media.ImageReader;
 import android.os.Handler;
 import android.os.HandlerThread;
@@ -37,7 +38,9 @@ import java.util.concurrent.TimeUnit;
 
 public class CameraController implements PreviewFrameHandler {
     private static final String TAG = CameraController.class.toString();
-    private static final int IMAGE_BUFFER_SIZE = 3;
+    // Images are rendered in place, the renderer holds up to two queued ones, the one on screen and
+    // one each for luma stats and motion detection. The camera needs the rest to keep streaming.
+    private static final int IMAGE_BUFFER_SIZE = 8;
 
     private static final SparseIntArray ORIENTATIONS = new SparseIntArray();
 
@@ -72,8 +75,13 @@ public class CameraController implements PreviewFrameHandler {
     }
 
     @Override
-    public void onPreviewFrame(byte[] data, int width, int height) {
-        mVideoRenderer.drawVideoFrame(data, width, height, getOrientation(), isMirrored());
+    public void onPreviewFrame(byte[] data, int width, int height, long timestamp) {
+        mVideoRenderer.drawVideoFrame(data, width, height, getOrientation(), isMirrored(), timestamp);
+    }
+
+    @Override
+    public boolean onPreviewImage(Image image, AutoCloseable owner) {
+        return mVideoRenderer.drawVideoImage(image, owner, getOrientation(), isMirrored());
     }
 
     public List<Size> getOutputSizes() {
@@ -165,7 +173,8 @@ public class CameraController implements PreviewFrameHandler {
                 mCameraDevice = null;
             }
             if (null != mImageReader) {
-                mImageReader.close();
+                // The renderer may still read from its images, the reader goes once they are back.
+                mVideoCapture.closeReader(mImageReader);
                 mImageReader = null;
             }
         } catch (InterruptedException e) {
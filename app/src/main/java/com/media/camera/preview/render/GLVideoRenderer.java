@@ -1,30 +1,27 @@
 package com.media.camera.preview.render;
 
-import android.opengl.GLSurfaceView;
+import android.content.Context;
+import android.support.annotation.NonNull;
+import android.view.SurfaceHolder;
+import android.view.SurfaceView;
 
-import javax.microedition.khronos.egl.EGLConfig;
-import javax.microedition.khronos.opengles.GL10;
+public class GLVideoRenderer extends VideoRenderer implements SurfaceHolder.Callback {
 
-public class GLVideoRenderer extends VideoRenderer implements GLSurfaceView.Renderer {
+    private final Context mContext;
 
-    private GLSurfaceView mGLSurface;
-
-    public GLVideoRenderer() {
+    public GLVideoRenderer(Context context) {
+        mContext = context;
         create(Type.GL_YUV420_FILTER.getValue());
     }
 
-    public void init(GLSurfaceView glSurface) {
-        mGLSurface = glSurface;
-        // Create an OpenGL ES 2 context.
-        mGLSurface.setEGLContextClientVersion(2);
-        mGLSurface.setRenderer(this);
-        mGLSurface.setRenderMode(GLSurfaceView.RENDERMODE_WHEN_DIRTY);
+    public void init(SurfaceView surface) {
+        // Rendering happens on a native thread with its own EGL context, see VideoRendererContext.
+        surface.getHolder().addCallback(this);
     }
 
     @Override
-    public void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror) {
-        draw(data, width, height, rotation, mirror);
-        requestRender();
+    public void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror, long timestamp) {
+        draw(data, width, height, rotation, mirror, timestamp);
     }
 
     public void setVideoParameters(int params) {
@@ -35,24 +32,57 @@ public class GLVideoRenderer extends VideoRenderer implements GLSurfaceView.Rend
         return getParameters();
     }
 
-    @Override
-    public void onDrawFrame(GL10 gl) {
-        render();
+    public void setVideoFilterParameters(int filter, float[] values) {
+        setFilterParameters(filter, values);
     }
 
-    @Override
-    public void onSurfaceChanged(GL10 gl, int width, int height) {
-        init(null, null, width, height);
+    /**
+     * Sets the row-major 4x4 matrix converting (Y, U, V, 1) to RGB.
+     */
+    public void setVideoColorMatrix(float[] matrix) {
+        setColorMatrix(matrix);
+    }
+
+    public void setVideoQuality(boolean highPrecision, int maxBlurTaps) {
+        setQuality(highPrecision, maxBlurTaps);
+    }
+
+    /**
+     * Magnifies the preview zoom (1 or more) times around (centerX, centerY), in [0, 1] across and
+     * down the camera frame. Only the part of the frame in view is uploaded.
+     */
+    public void setVideoZoom(float zoom, float centerX, float centerY) {
+        setZoom(zoom, centerX, centerY);
+    }
+
+    /**
+     * For fixed cameras: only the 64x64 tiles where some sample changed by more than threshold
+     * since the last upload are uploaded, nothing when the scene is static. Off by default.
+     */
+    public void setVideoTileUpdates(boolean enabled, int threshold) {
+        setTileUpdates(enabled, threshold);
+    }
+
+    /**
+     * Sets the EGL swap interval and how long after arrival a frame is presented, 0 for as soon
+     * as possible. A constant delay evens out camera frame jitter at the cost of latency.
+     */
+    public void setVideoPresentation(int swapInterval, long presentationDelayNs) {
+        setPresentation(swapInterval, presentationDelayNs);
     }
 
     @Override
-    public void onSurfaceCreated(GL10 gl, EGLConfig config) {
+    public void surfaceCreated(@NonNull SurfaceHolder holder) {
+    }
 
+    @Override
+    public void surfaceChanged(@NonNull SurfaceHolder holder, int format, int width, int height) {
+        init(holder.getSurface(), mContext.getAssets(), width, height);
     }
 
-    private void requestRender() {
-        if (mGLSurface != null) {
-            mGLSurface.requestRender();
-        }
+    @Override
+    public void surfaceDestroyed(@NonNull SurfaceHolder holder) {
+        // The render thread must let go of the surface before this returns.
+        stop();
     }
 }
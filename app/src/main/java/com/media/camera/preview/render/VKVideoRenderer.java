@@ -18,8 +18,24 @@ public class VKVideoRenderer extends VideoRenderer implements SurfaceHolder.Call
     }
 
     @Override
-    public void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror) {
-        draw(data, width, height, rotation, mirror);
+    public void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror, long timestamp) {
+        draw(data, width, height, rotation, mirror, timestamp);
+    }
+
+    /**
+     * Magnifies the preview zoom (1 or more) times around (centerX, centerY), in [0, 1] across and
+     * down the camera frame. Only the part of the frame in view is uploaded.
+     */
+    public void setVideoZoom(float zoom, float centerX, float centerY) {
+        setZoom(zoom, centerX, centerY);
+    }
+
+    /**
+     * For fixed cameras: only the 64x64 tiles where some sample changed by more than threshold
+     * since the last upload are uploaded, nothing when the scene is static. Off by default.
+     */
+    public void setVideoTileUpdates(boolean enabled, int threshold) {
+        setTileUpdates(enabled, threshold);
     }
 
     @Override
@@ -34,5 +50,7 @@ public class VKVideoRenderer extends VideoRenderer implements SurfaceHolder.Call
 
     @Override
     public void surfaceDestroyed(@NonNull SurfaceHolder holder) {
+        // The render thread must let go of the surface before this returns.
+        stop();
     }
 }
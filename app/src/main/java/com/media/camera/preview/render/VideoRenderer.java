@@ -1,8 +1,11 @@
 package com.media.camera.preview.render;
 
 import android.content.res.AssetManager;
+import android.media.Image;
 import android.view.Surface;
 
+import java.nio.ByteBuffer;
+
 /**
  * Created by oleg on 11/2/17.
  */
@@ -22,6 +25,40 @@ public abstract class VideoRenderer {
         }
     }
 
+    /**
+     * Values filled by {@link #getFrameLumaStats(float[])}.
+     */
+    public static final int LUMA_STATS_SIZE = 5 + 16 + 256;
+
+    /**
+     * Values filled by {@link #getGpuFrameStats(float[])}.
+     */
+    public static final int GPU_STATS_SIZE = 1 + 16 + 16;
+
+    /**
+     * Pixel formats of {@link #convertFrame}, without row padding. YUV is full range BT.601 and
+     * RGB565 little-endian.
+     */
+    public static final int FORMAT_I420 = 0;
+    public static final int FORMAT_NV12 = 1;
+    public static final int FORMAT_NV21 = 2;
+    public static final int FORMAT_YUYV = 3;
+    public static final int FORMAT_RGBA = 4;
+    public static final int FORMAT_RGB565 = 5;
+
+    /**
+     * Receives motion detected in the frames, see {@link #setMotionDetection}.
+     */
+    public interface MotionListener {
+        /**
+         * Called on a native worker thread when motion starts, and again with active false once it
+         * stopped. level is the share of the motion map blocks that moved, timestamp the one of the
+         * frame, boxes hold x, y, width and height of up to 8 moving regions, largest first, in
+         * pixels of the frame before rotation.
+         */
+        void onMotion(boolean active, float level, long timestamp, int[] boxes);
+    }
+
     private long mNativeContext; // using by native
 
     protected native void create(int type);
@@ -30,20 +67,197 @@ public abstract class VideoRenderer {
 
     protected native void init(Surface surface, AssetManager assetManager, int width, int height);
 
+    protected native void stop();
+
     protected native void render();
 
-    protected native void draw(byte[] data, int width, int height, int rotation, boolean mirror);
+    protected native void draw(byte[] data, int width, int height, int rotation, boolean mirror, long timestamp);
+
+    protected native boolean drawImage(AutoCloseable owner, ByteBuffer y, ByteBuffer u, ByteBuffer v, int strideY,
+                                       int strideUV, int pixelStrideUV, int width, int height, int rotation,
+                                       boolean mirror, long timestamp);
 
     protected native void setParameters(int params);
 
     protected native int getParameters();
 
-    public abstract void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror);
+    protected native void setFilterParameters(int filter, float[] values);
+
+    protected native void setColorMatrix(float[] matrix);
+
+    protected native void setQuality(boolean highPrecision, int maxBlurTaps);
+
+    protected native void setZoom(float zoom, float centerX, float centerY);
+
+    protected native void setTileUpdates(boolean enabled, int threshold);
+
+    protected native void setPresentation(int swapInterval, long presentationDelay);
+
+    protected native void setStatsEnabled(boolean enabled);
+
+    protected native float[] getStats();
+
+    protected native void setLumaStatsEnabled(boolean enabled, int step);
+
+    protected native boolean getLumaStats(float[] values);
+
+    protected native void setGpuStatsEnabled(boolean enabled);
+
+    protected native boolean getGpuStats(float[] values);
+
+    protected native void setMotionDetection(boolean enabled, int threshold, float trigger,
+                                             MotionListener listener);
+
+    protected native byte[] getMotionMap(int[] size);
+
+    protected static native void setTraceEnabled(boolean enabled);
+
+    protected static native boolean writeTrace(String path);
+
+    protected static native boolean convertPixels(byte[] src, int srcFormat, byte[] dst, int dstFormat, int width,
+                                                  int height, int rotation, boolean mirror);
+
+    protected static native boolean packPlanes(ByteBuffer y, ByteBuffer u, ByteBuffer v, int strideY, int strideUV,
+                                               int pixelStrideUV, int width, int height, byte[] dst);
+
+    /**
+     * Queues an I420 frame, timestamp is the sensor timestamp in nanoseconds.
+     */
+    public abstract void drawVideoFrame(byte[] data, int width, int height, int rotation, boolean mirror,
+                                        long timestamp);
+
+    /**
+     * Queues a YUV_420_888 image without copying it. owner is closed once the renderer is done with
+     * the planes, possibly on another thread and possibly before this returns. Returns false, leaving
+     * owner open, for a chroma layout that has to go through {@link #drawVideoFrame} instead.
+     */
+    public boolean drawVideoImage(Image image, AutoCloseable owner, int rotation, boolean mirror) {
+        final Image.Plane[] planes = image.getPlanes();
+
+        return drawImage(owner, planes[0].getBuffer(), planes[1].getBuffer(), planes[2].getBuffer(),
+                planes[0].getRowStride(), planes[1].getRowStride(), planes[1].getPixelStride(), image.getWidth(),
+                image.getHeight(), rotation, mirror, image.getTimestamp());
+    }
 
     public void destroyRenderer() {
         destroy();
     }
 
+    /**
+     * Starts or stops recording per stage latencies, off by default.
+     */
+    public void setRenderStatsEnabled(boolean enabled) {
+        setStatsEnabled(enabled);
+    }
+
+    /**
+     * Latencies over the last 256 frames, four values per stage: sample count, p50, p95 and p99 in
+     * microseconds. Stages in order: ingest, queue, plane copy, texture upload, render, GPU,
+     * present and draw to present. Four more values follow for the share of tiles uploaded with
+     * tile updates on, percentiles in percent.
+     */
+    public float[] getRenderStats() {
+        return getStats();
+    }
+
+    /**
+     * Starts or stops computing luma statistics of incoming frames in the background, off by
+     * default. Every step-th sample of every step-th row is read.
+     */
+    public void setFrameLumaStatsEnabled(boolean enabled, int step) {
+        setLumaStatsEnabled(enabled, step);
+    }
+
+    /**
+     * Statistics of the last analyzed frame into values, at least LUMA_STATS_SIZE long: sample
+     * count, mean luma, samples within 4 of black, samples within 4 of white, sharpness (variance of
+     * the Laplacian), 16 zone means of a 4x4 grid row by row, and the 256 histogram bins. Returns
+     * false, leaving values alone, until a frame was analyzed.
+     */
+    public boolean getFrameLumaStats(float[] values) {
+        return getLumaStats(values);
+    }
+
+    /**
+     * Starts or stops reducing luma statistics on the GPU instead, for when the CPU is the
+     * bottleneck. Off by default.
+     */
+    public void setGpuFrameStatsEnabled(boolean enabled) {
+        setGpuStatsEnabled(enabled);
+    }
+
+    /**
+     * GPU statistics of the part of the frame uploaded, a frame or two behind, into values at least
+     * GPU_STATS_SIZE long: mean luma, 16 zone means of a 4x4 grid row by row, and the share of
+     * samples in each of 16 bins of 16 code values. Returns false, leaving values alone, until
+     * results are in.
+     */
+    public boolean getGpuFrameStats(float[] values) {
+        return getGpuStats(values);
+    }
+
+    /**
+     * Starts or stops detecting motion in incoming frames, off by default. Frames are analyzed in the
+     * background at up to 480 pixels wide against a background that follows slow changes. Pixels
+     * more than threshold code values off it move, a block of 8x8 analyzed pixels moves with more
+     * than an eighth of them, and motion starts once a share of trigger (0 to 1) of the blocks moved.
+     */
+    public void setFrameMotionDetection(boolean enabled, int threshold, float trigger,
+                                        MotionListener listener) {
+        setMotionDetection(enabled, threshold, trigger, listener);
+    }
+
+    /**
+     * The motion map of the last analyzed frame, 1 for each block that moved row by row, with its
+     * columns and rows in size[0] and size[1]. Null while there is none.
+     */
+    public byte[] getFrameMotionMap(int[] size) {
+        return getMotionMap(size);
+    }
+
+    /**
+     * Starts or stops recording trace events in builds with native tracing, debug ones by default.
+     */
+    public static void setTracingEnabled(boolean enabled) {
+        setTraceEnabled(enabled);
+    }
+
+    /**
+     * Writes the trace events recorded since the last call as Chrome trace JSON, which
+     * chrome://tracing and ui.perfetto.dev open. Returns false without native tracing.
+     */
+    public static boolean writeTraceFile(String path) {
+        return writeTrace(path);
+    }
+
+    /**
+     * Converts a width x height frame between two of the FORMAT_ constants, both even. Returns false
+     * when a format is unknown or an array is too small.
+     */
+    public static boolean convertFrame(byte[] src, int srcFormat, byte[] dst, int dstFormat, int width,
+                                       int height) {
+        return convertPixels(src, srcFormat, dst, dstFormat, width, height, 0, false);
+    }
+
+    /**
+     * Like {@link #convertFrame(byte[], int, byte[], int, int, int)}, rotating the frame clockwise by
+     * rotation degrees, a multiple of 90, then mirroring it left to right if asked. dst is height x
+     * width for 90 and 270. YUYV frames can only be converted.
+     */
+    public static boolean convertFrame(byte[] src, int srcFormat, byte[] dst, int dstFormat, int width,
+                                       int height, int rotation, boolean mirror) {
+        return convertPixels(src, srcFormat, dst, dstFormat, width, height, (rotation % 360 + 360) % 360, mirror);
+    }
+
+    /**
+     * Packs the planes of a YUV_420_888 image, direct buffers as Image planes are, into I420 in dst.
+     * Returns false for chroma laid out in a way the native conversions don't know.
+     */
+    public static boolean packFrame(ByteBuffer y, ByteBuffer u, ByteBuffer v, int strideY, int strideUV,
+                                    int pixelStrideUV, int width, int height, byte[] dst) {
+        return packPlanes(y, u, v, strideY, strideUV, pixelStrideUV, width, height, dst);
+    }
+
     static {
         System.loadLibrary("media-lib");
     }
@@ -3,10 +3,35 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+layout (binding = 0) uniform UniformBufferObject
+{
+    mat4 rotation;
+    mat4 scale;
+    float lutSize;
+} ubo;
 layout (binding = 1) uniform sampler2D tex[3];
+layout (binding = 2) uniform sampler3D lut;
 layout (location = 0) in vec2 texcoord;
 layout (location = 0) out vec4 uFragColor;
 
+// Tetrahedral interpolation between the four lattice points around the color, as CubeLut::apply().
+vec3 lookupLut(vec3 color) {
+    vec3 scaled = clamp(color, 0.0, 1.0) * (ubo.lutSize - 1.0);
+    vec3 base = min(floor(scaled), ubo.lutSize - 2.0);
+    vec3 f = scaled - base;
+    vec3 g = vec3(step(f.yz, f.xy), 1.0 - step(f.z, f.x));
+    vec3 l = 1.0 - g;
+    vec3 i1 = min(g, l.zxy);
+    vec3 i2 = max(g, l.zxy);
+    float w1 = dot(f, i1);
+    float w12 = dot(f, i2);
+    float w3 = f.x + f.y + f.z - w12;
+    return (1.0 - w1) * texelFetch(lut, ivec3(base), 0).rgb +
+           (2.0 * w1 - w12) * texelFetch(lut, ivec3(base + i1), 0).rgb +
+           (w12 - w1 - w3) * texelFetch(lut, ivec3(base + i2), 0).rgb +
+           w3 * texelFetch(lut, ivec3(base + 1.0), 0).rgb;
+}
+
 void main() {
     float y, u, v, r, g, b;
     y = texture(tex[0], texcoord).r;
@@ -17,5 +42,10 @@ void main() {
     r = y + 1.403 * v;
     g = y - 0.344 * u - 0.714 * v;
     b = y + 1.770 * u;
-    uFragColor = vec4(r, g, b, 1.0);
+    vec3 color = vec3(r, g, b);
+    // Uniform across the draw, frames without a LUT skip the fetches.
+    if (ubo.lutSize > 0.0) {
+        color = lookupLut(color);
+    }
+    uFragColor = vec4(color, 1.0);
 }
@@ -9,6 +9,7 @@ layout (binding = 0) uniform UniformBufferObject
 {
     mat4 rotation;
     mat4 scale;
+    float lutSize;
 } ubo;
 layout (location = 0) out vec2 texcoord;
 
@@ -0,0 +1,549 @@
+#include "CommonUtils.h"
+#include "CubeLut.h"
+#include "HeadlessEGL.h"
+#include "VideoRenderer.h"
+#include "Y4m.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// Frames in flight between two stages, and output buffers shared by the process and write stages.
+static const size_t kQueueDepth = 4;
+static const size_t kOutputBuffers = 2 * kQueueDepth;
+
+// Frames the read stage advises the kernel to fetch ahead of the one it hands out.
+static const size_t kReadaheadFrames = 4;
+
+struct batch_options {
+    const char *input;
+    const char *output;
+    const char *lut;
+    size_t width;
+    size_t height;
+    bool semiPlanar;
+    bool gl;
+    size_t filter;
+    std::vector<float> filterValues;
+    float rotation;
+    bool mirror;
+    float zoom[3];
+    int tileThreshold;
+    int fps;
+};
+
+static bool is_y4m(const char *path) {
+    size_t length = strlen(path);
+
+    return length > 4 && !strcmp(path + length - 4, ".y4m");
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s --input frames.yuv|frames.y4m --output out.rgba|out.y4m [--size WxH] [--format i420|nv12]\n"
+            "          [--renderer software|gl] [--filter index] [--params a,b,...] [--rotate clockwise degrees]\n"
+            "          [--mirror] [--zoom factor[,centerX,centerY]] [--tile-updates threshold]\n"
+            "          [--lut grade.cube] [--fps n]\n"
+            "Raw input needs --size. Software rendering converts and grades, filters and transforms need gl.\n"
+            "The zoom centre is a point of the input frame, in [0, 1] across and down.\n",
+            name);
+}
+
+static bool parse_options(int argc, char **argv, batch_options &options) {
+    options = {};
+    options.zoom[0] = 1.0f;
+    options.zoom[1] = 0.5f;
+    options.zoom[2] = 0.5f;
+    options.tileThreshold = -1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (!strcmp(arg, "--mirror")) {
+            options.mirror = true;
+            continue;
+        }
+
+        if (!value) {
+            print_usage(argv[0]);
+            return false;
+        }
+        i++;
+
+        if (!strcmp(arg, "--input")) {
+            options.input = value;
+        } else if (!strcmp(arg, "--output")) {
+            options.output = value;
+        } else if (!strcmp(arg, "--lut")) {
+            options.lut = value;
+        } else if (!strcmp(arg, "--size")) {
+            if (sscanf(value, "%zux%zu", &options.width, &options.height) != 2) {
+                print_usage(argv[0]);
+                return false;
+            }
+        } else if (!strcmp(arg, "--format")) {
+            options.semiPlanar = !strcmp(value, "nv12");
+        } else if (!strcmp(arg, "--renderer")) {
+            options.gl = !strcmp(value, "gl");
+        } else if (!strcmp(arg, "--filter")) {
+            options.filter = (size_t) atoi(value);
+        } else if (!strcmp(arg, "--params")) {
+            for (const char *p = value; *p;) {
+                char *end;
+                options.filterValues.push_back(strtof(p, &end));
+                p = *end == ',' ? end + 1 : end + strlen(end);
+            }
+        } else if (!strcmp(arg, "--rotate")) {
+            options.rotation = (float) atoi(value);
+        } else if (!strcmp(arg, "--zoom")) {
+            if (sscanf(value, "%f,%f,%f", &options.zoom[0], &options.zoom[1], &options.zoom[2]) < 1) {
+                fprintf(stderr, "Invalid zoom %s.\n", value);
+                return false;
+            }
+        } else if (!strcmp(arg, "--tile-updates")) {
+            options.tileThreshold = atoi(value);
+        } else if (!strcmp(arg, "--fps")) {
+            options.fps = atoi(value);
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    bool sized = options.width && options.height && options.width % 2 == 0 && options.height % 2 == 0;
+    if (!options.input || !options.output || options.fps < 0 || !(sized || is_y4m(options.input))) {
+        print_usage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+// Blocking FIFO between two pipeline stages. pop() returns false once the queue is closed and empty,
+// push() once it is closed.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {
+
+    }
+
+    // Returns false once the queue is closed, the item is dropped then.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this]() { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) return false;
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+
+        return true;
+    }
+
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) return false;
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
+
+struct rgba_frame {
+    size_t index;
+    size_t width;
+    size_t height;
+    std::unique_ptr<uint8_t[]> pixels;
+};
+
+// Time each stage spent working, without waiting on its queues.
+struct stage_time {
+    double seconds = 0.0;
+
+    template<typename F>
+    void run(F &&work) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Raw 4:2:0 or Y4M input, mapped read only. Frames are views into the mapping, nothing is copied.
+class FrameSource {
+public:
+    FrameSource() : m_y4m(false), m_frameSize(0), m_frameCount(0), m_width(0), m_height(0), m_semiPlanar(false) {
+
+    }
+
+    bool open(const batch_options &options) {
+        m_y4m = is_y4m(options.input);
+        if (m_y4m) {
+            if (!m_reader.open(options.input)) return false;
+
+            m_width = m_reader.width();
+            m_height = m_reader.height();
+            m_frameCount = m_reader.frameCount();
+
+            if (m_width % 2 || m_height % 2) {
+                fprintf(stderr, "Odd frame sizes are not supported.\n");
+                return false;
+            }
+
+            return true;
+        }
+
+        if (!m_file.open(options.input)) return false;
+
+        m_width = options.width;
+        m_height = options.height;
+        m_semiPlanar = options.semiPlanar;
+        m_frameSize = m_width * m_height * 3 / 2;
+        m_frameCount = m_file.size() / m_frameSize;
+
+        if (m_file.size() % m_frameSize) {
+            fprintf(stderr, "Ignoring %zu trailing bytes of %s.\n", m_file.size() % m_frameSize, options.input);
+        }
+
+        return true;
+    }
+
+    size_t width() const { return m_width; }
+
+    size_t height() const { return m_height; }
+
+    size_t frameCount() const { return m_frameCount; }
+
+    int fps() const { return m_y4m ? std::max(m_reader.fpsNumerator() / m_reader.fpsDenominator(), 1) : 30; }
+
+    video_frame frame(size_t index) const {
+        video_frame frame{};
+        if (m_y4m) {
+            m_reader.frame(index, frame);
+            return frame;
+        }
+
+        auto *y = (uint8_t *) m_file.data() + index * m_frameSize;
+        uint8_t *u = y + m_width * m_height;
+
+        frame.width = m_width;
+        frame.height = m_height;
+        frame.stride_y = m_width;
+        frame.stride_uv = m_semiPlanar ? m_width : m_width / 2;
+        frame.pixel_stride_uv = m_semiPlanar ? 2 : 1;
+        frame.y = y;
+        frame.u = u;
+        frame.v = m_semiPlanar ? u + 1 : u + m_width * m_height / 4;
+
+        return frame;
+    }
+
+    // Starts reading frames ahead of index and faults index in, so that later stages never wait for I/O.
+    void prefetch(size_t index) const {
+        if (m_y4m) {
+            m_reader.prefetch(index + 1, kReadaheadFrames);
+        } else if (index + 1 < m_frameCount) {
+            m_file.willNeed((index + 1) * m_frameSize, kReadaheadFrames * m_frameSize);
+        }
+
+        video_frame view = frame(index);
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        const volatile uint8_t *p = view.y;
+        for (size_t offset = 0; offset < m_width * m_height * 3 / 2; offset += page) {
+            (void) p[offset];
+        }
+    }
+
+    // Drops a processed frame from the mapping, which keeps resident memory flat on long inputs.
+    void release(size_t index) const {
+        if (m_y4m) {
+            m_reader.release(index);
+            return;
+        }
+
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        size_t start = (index * m_frameSize + page - 1) / page * page;
+        size_t end = (index + 1) * m_frameSize / page * page;
+        if (end > start) m_file.dontNeed(start, end - start);
+    }
+
+private:
+    bool m_y4m;
+    MappedFile m_file;
+    Y4mReader m_reader;
+    size_t m_frameSize;
+    size_t m_frameCount;
+    size_t m_width;
+    size_t m_height;
+    bool m_semiPlanar;
+};
+
+// Writes RGBA frames as they are, or as I420 in a Y4M stream when the path ends in .y4m.
+class FrameWriter {
+public:
+    FrameWriter() : m_file(nullptr), m_y4m(false) {
+
+    }
+
+    ~FrameWriter() {
+        if (m_file) fclose(m_file);
+    }
+
+    bool open(const char *path, size_t width, size_t height, int fps) {
+        m_y4m = is_y4m(path);
+        if (m_y4m) {
+            // The renderers' conversion is full range BT.601.
+            return m_y4mWriter.open(path, width, height, fps, 1, true);
+        }
+
+        m_file = fopen(path, "wb");
+        if (!m_file) {
+            fprintf(stderr, "Could not open %s.\n", path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool write(const rgba_frame &frame) {
+        if (!m_y4m) {
+            return fwrite(frame.pixels.get(), frame.width * frame.height * 4, 1, m_file) == 1;
+        }
+
+        size_t sizeY = frame.width * frame.height;
+        m_planes.resize(sizeY * 3 / 2);
+
+        video_frame planes{};
+        planes.width = frame.width;
+        planes.height = frame.height;
+        planes.stride_y = frame.width;
+        planes.stride_uv = frame.width / 2;
+        planes.pixel_stride_uv = 1;
+        planes.y = m_planes.data();
+        planes.u = planes.y + sizeY;
+        planes.v = planes.u + sizeY / 4;
+        rgba_to_yuv420(frame.pixels.get(), frame.width * 4, frame.width, frame.height, planes.y, planes.stride_y,
+                       planes.u, planes.v, planes.stride_uv);
+
+        return m_y4mWriter.write(planes);
+    }
+
+    bool close() {
+        if (m_y4m) return m_y4mWriter.close();
+
+        bool written = !ferror(m_file);
+        written = !fclose(m_file) && written;
+        m_file = nullptr;
+
+        return written;
+    }
+
+private:
+    FILE *m_file;
+    bool m_y4m;
+    Y4mWriter m_y4mWriter;
+    std::vector<uint8_t> m_planes;
+};
+
+// Process stage on the renderers, in a headless GL context owned by the calling thread.
+class GLProcessor {
+public:
+    GLProcessor() : m_context(), m_current(nullptr) {
+
+    }
+
+    ~GLProcessor() {
+        if (!m_renderer) return;
+
+        m_renderer.reset();
+        destroy_context(m_context);
+    }
+
+    bool init(const batch_options &options, size_t width, size_t height) {
+        if (!create_context(m_context)) return false;
+
+        m_renderer = VideoRenderer::create(tYUV420_FILTER);
+        m_renderer->setOffscreen([this](const uint8_t *rgba, size_t w, size_t h) {
+            memcpy(m_current, rgba, w * h * 4);
+        });
+        m_renderer->init(nullptr, nullptr, width, height);
+        m_renderer->setParameters((uint32_t) options.filter);
+        if (!options.filterValues.empty()) {
+            m_renderer->setFilterParameters(options.filter, options.filterValues.data(), options.filterValues.size());
+        }
+        m_renderer->setZoom(options.zoom[0], options.zoom[1], options.zoom[2]);
+        if (options.tileThreshold >= 0) {
+            m_renderer->setTileUpdates(true, options.tileThreshold);
+        }
+
+        return true;
+    }
+
+    void process(const video_frame &frame, float rotation, bool mirror, uint8_t *rgba) {
+        m_current = rgba;
+        // The renderers turn camera frames by a half turn at rotation 0, and counter-clockwise. The
+        // mapping outlives the renderer, so the view needs no release.
+        m_renderer->draw(FrameRef::wrap(frame, 0, nullptr), 180.0f - rotation, mirror);
+        m_renderer->render();
+    }
+
+private:
+    headless_context m_context;
+    std::unique_ptr<VideoRenderer> m_renderer;
+    uint8_t *m_current;
+};
+
+int main(int argc, char **argv) {
+    batch_options options{};
+    if (!parse_options(argc, argv, options)) return 1;
+
+    FrameSource input;
+    if (!input.open(options)) return 1;
+
+    CubeLut lut;
+    if (options.lut) {
+        std::vector<char> text;
+        FILE *file = fopen(options.lut, "rb");
+        if (file) {
+            char chunk[4096];
+            size_t read;
+            while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+                text.insert(text.end(), chunk, chunk + read);
+            }
+            fclose(file);
+        }
+
+        if (text.empty() || !lut.load(text.data(), text.size())) {
+            fprintf(stderr, "Could not load LUT %s.\n", options.lut);
+            return 1;
+        }
+    }
+
+    // Quarter turns swap the output size.
+    bool quarterTurn = ((int) options.rotation / 90) % 2 != 0;
+    size_t outWidth = options.gl && quarterTurn ? input.height() : input.width();
+    size_t outHeight = options.gl && quarterTurn ? input.width() : input.height();
+    size_t frameCount = input.frameCount();
+
+    FrameWriter writer;
+    if (!writer.open(options.output, outWidth, outHeight, options.fps ? options.fps : input.fps())) return 1;
+
+    BoundedQueue<size_t> readQueue(kQueueDepth);
+    BoundedQueue<rgba_frame> writeQueue(kQueueDepth);
+    BoundedQueue<std::unique_ptr<uint8_t[]>> freeBuffers(kOutputBuffers);
+    for (size_t i = 0; i < kOutputBuffers; i++) {
+        freeBuffers.push(std::unique_ptr<uint8_t[]>(new uint8_t[outWidth * outHeight * 4]));
+    }
+
+    stage_time readTime;
+    stage_time processTime;
+    stage_time writeTime;
+    bool processed = true;
+    bool written = true;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread reader([&]() {
+        for (size_t i = 0; i < frameCount; i++) {
+            readTime.run([&]() { input.prefetch(i); });
+            if (!readQueue.push(i)) break;
+        }
+        readQueue.close();
+    });
+
+    std::thread processor([&]() {
+        float colorMatrix[16];
+        mat4f_load_yuv_to_rgb_mat(colorMatrix);
+
+        GLProcessor gl;
+        if (options.gl && !gl.init(options, outWidth, outHeight)) {
+            // Nothing gets rendered, the reader stops at its next frame and the writer right away.
+            processed = false;
+            readQueue.close();
+            writeQueue.close();
+            return;
+        }
+
+        size_t index;
+        while (readQueue.pop(index)) {
+            rgba_frame out{index, outWidth, outHeight, nullptr};
+            freeBuffers.pop(out.pixels);
+
+            processTime.run([&]() {
+                video_frame frame = input.frame(index);
+
+                if (options.gl) {
+                    gl.process(frame, options.rotation, options.mirror, out.pixels.get());
+                } else {
+                    yuv420_to_rgba(frame.y, frame.stride_y, frame.u, frame.v, frame.stride_uv, frame.pixel_stride_uv,
+                                   frame.width, frame.height, colorMatrix, out.pixels.get(), frame.width * 4);
+                }
+
+                if (options.lut) {
+                    lut.apply(out.pixels.get(), outWidth * outHeight);
+                }
+            });
+            input.release(index);
+
+            writeQueue.push(std::move(out));
+        }
+        writeQueue.close();
+    });
+
+    std::thread writerThread([&]() {
+        rgba_frame frame;
+        while (writeQueue.pop(frame)) {
+            writeTime.run([&]() { written = writer.write(frame) && written; });
+            freeBuffers.push(std::move(frame.pixels));
+        }
+    });
+
+    reader.join();
+    processor.join();
+    writerThread.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    written = writer.close() && written;
+
+    if (!processed || !written) {
+        fprintf(stderr, "Could not %s %s.\n", processed ? "write" : "render", options.output);
+        return 1;
+    }
+
+    double perFrame = frameCount ? 1e3 / (double) frameCount : 0.0;
+    fprintf(stderr, "%zu frames in %.2f s (%.1f fps), ms/frame: read %.2f, process %.2f, write %.2f\n",
+            frameCount, seconds, seconds > 0.0 ? (double) frameCount / seconds : 0.0,
+            readTime.seconds * perFrame, processTime.seconds * perFrame, writeTime.seconds * perFrame);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct benchmark_options {
+    // Only cases whose name contains filter run.
+    const char *filter;
+    double minSeconds;
+};
+
+struct benchmark_result {
+    size_t iterations;
+    double medianNs;
+    double minNs;
+};
+
+// Every case runs at least this often after its warm-up, however long an iteration takes.
+static const size_t kMinIterations = 5;
+
+static inline void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--filter name] [--min-time seconds]\n", name);
+}
+
+static inline bool parse_options(int argc, char **argv, benchmark_options &options) {
+    options.filter = "";
+    options.minSeconds = 0.2;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+            options.minSeconds = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Keeps the compiler from dropping work whose result is never read.
+static inline void do_not_optimize(const void *p) {
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+// Times body once per iteration after a warm-up call, until minSeconds passed.
+static inline benchmark_result run_benchmark(const std::function<void()> &body, double minSeconds) {
+    using clock = std::chrono::steady_clock;
+
+    body();
+
+    std::vector<double> samples;
+    double total = 0.0;
+
+    while (samples.size() < kMinIterations || total < minSeconds * 1e9) {
+        auto start = clock::now();
+        body();
+        double ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+        samples.push_back(ns);
+        total += ns;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    return {samples.size(), samples[samples.size() / 2], samples.front()};
+}
+
+// Collects results as JSON objects and prints them as one document.
+class BenchmarkReport {
+public:
+    explicit BenchmarkReport(const char *suite) : m_suite(suite) {
+
+    }
+
+    // fields is a JSON fragment such as "\"layout\":\"i420\"", bytes 0 for no throughput.
+    void add(const char *name, const std::string &fields, const benchmark_result &result, double bytes) {
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"%s\",%s%s\"iterations\":%zu,\"ns_per_frame\":%.1f,\"min_ns_per_frame\":%.1f",
+                 name, fields.c_str(), fields.empty() ? "" : ",", result.iterations, result.medianNs, result.minNs);
+
+        std::string entry = line;
+        if (bytes > 0.0) {
+            snprintf(line, sizeof(line), ",\"mb_per_s\":%.1f", bytes * 1e3 / result.medianNs);
+            entry += line;
+        }
+        entry += "}";
+
+        fprintf(stderr, "%s\n", entry.c_str());
+        m_entries.push_back(entry);
+    }
+
+    void print() const {
+        printf("{\"suite\":\"%s\",\"results\":[\n", m_suite.c_str());
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            printf("  %s%s\n", m_entries[i].c_str(), i + 1 < m_entries.size() ? "," : "");
+        }
+        printf("]}\n");
+    }
+
+private:
+    std::string m_suite;
+    std::vector<std::string> m_entries;
+};
+
+#endif //_BENCHMARK_H_
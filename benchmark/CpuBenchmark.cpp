@@ -0,0 +1,325 @@
+#include "Benchmark.h"
+#include "CommonUtils.h"
+#include "MotionDetector.h"
+#include "PixelFormat.h"
+#include "PixelKernels.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct resolution {
+    const char *name;
+    size_t width;
+    size_t height;
+};
+
+static const resolution kResolutions[] = {
+        {"480p",  640,  480},
+        {"720p",  1280, 720},
+        {"1080p", 1920, 1080},
+        {"4k",    3840, 2160},
+        {"8k",    7680, 4320},
+};
+
+// Row padding of "padded" planes, camera HALs typically align rows to 64 bytes or more.
+static const size_t kStridePadding = 64;
+
+// A 4:2:0 frame with rows stride bytes apart. Semi-planar frames keep interleaved chroma in u.
+struct yuv_frame {
+    yuv_frame(size_t frameWidth, size_t frameHeight, size_t stride, bool semiPlanar)
+            : width(frameWidth), height(frameHeight), strideY(stride),
+              strideUV(semiPlanar ? stride : stride / 2), semiPlanar(semiPlanar),
+              data(new uint8_t[stride * frameHeight * 3 / 2]) {
+        size_t size = stride * frameHeight * 3 / 2;
+        for (size_t i = 0; i < size; i++) {
+            data[i] = (uint8_t) (i * 7 + i / 4096);
+        }
+
+        y = data.get();
+        u = y + strideY * height;
+        v = semiPlanar ? u + 1 : u + strideUV * height / 2;
+    }
+
+    size_t width;
+    size_t height;
+    size_t strideY;
+    size_t strideUV;
+    bool semiPlanar;
+    std::unique_ptr<uint8_t[]> data;
+    uint8_t *y;
+    uint8_t *u;
+    uint8_t *v;
+};
+
+static std::string case_fields(const resolution &res, bool semiPlanar, bool padded) {
+    char fields[256];
+    snprintf(fields, sizeof(fields),
+             "\"resolution\":\"%s\",\"width\":%zu,\"height\":%zu,\"layout\":\"%s\",\"stride\":\"%s\"",
+             res.name, res.width, res.height, semiPlanar ? "nv12" : "i420", padded ? "padded" : "aligned");
+
+    return fields;
+}
+
+// GLVideoRendererYUV420::updateFrame(), camera planes into the tightly packed upload buffer.
+static void benchmark_copy_planes(BenchmarkReport &report, const benchmark_options &options) {
+    for (const auto &res: kResolutions) {
+        for (bool semiPlanar: {false, true}) {
+            for (bool padded: {false, true}) {
+                yuv_frame src(res.width, res.height, res.width + (padded ? kStridePadding : 0), semiPlanar);
+                size_t frameSize = res.width * res.height * 3 / 2;
+                std::unique_ptr<uint8_t[]> dst(new uint8_t[frameSize]);
+
+                size_t width = res.width;
+                size_t height = res.height;
+                benchmark_result result = run_benchmark([&]() {
+                    uint8_t *pY = dst.get();
+                    uint8_t *pU = pY + width * height;
+                    copy_plane(pY, width, src.y, src.strideY, width, height);
+
+                    if (semiPlanar) {
+                        copy_plane(pU, width, src.u, src.strideUV, width, height / 2);
+                    } else {
+                        uint8_t *pV = pU + width * height / 4;
+                        copy_plane(pU, width / 2, src.u, src.strideUV, width / 2, height / 2);
+                        copy_plane(pV, width / 2, src.v, src.strideUV, width / 2, height / 2);
+                    }
+                    do_not_optimize(dst.get());
+                }, options.minSeconds);
+
+                report.add("copy_planes", case_fields(res, semiPlanar, padded), result, (double) frameSize);
+            }
+        }
+    }
+}
+
+// VKVideoRendererYUV420::copyTextureData(), packed planes into linear images whose row pitch the
+// driver picks. Padded covers a row pitch above the plane width.
+static void benchmark_copy_texture_data(BenchmarkReport &report, const benchmark_options &options) {
+    for (const auto &res: kResolutions) {
+        for (bool padded: {false, true}) {
+            size_t width = res.width;
+            size_t height = res.height;
+            size_t pitchY = width + (padded ? kStridePadding : 0);
+            size_t pitchUV = width / 2 + (padded ? kStridePadding : 0);
+            size_t frameSize = width * height * 3 / 2;
+
+            yuv_frame src(width, height, width, false);
+            std::unique_ptr<uint8_t[]> textureY(new uint8_t[pitchY * height]);
+            std::unique_ptr<uint8_t[]> textureU(new uint8_t[pitchUV * height / 2]);
+            std::unique_ptr<uint8_t[]> textureV(new uint8_t[pitchUV * height / 2]);
+
+            benchmark_result result = run_benchmark([&]() {
+                copy_plane(textureY.get(), pitchY, src.y, width, width, height);
+                copy_plane(textureU.get(), pitchUV, src.u, width / 2, width / 2, height / 2);
+                copy_plane(textureV.get(), pitchUV, src.v, width / 2, width / 2, height / 2);
+                do_not_optimize(textureY.get());
+                do_not_optimize(textureU.get());
+                do_not_optimize(textureV.get());
+            }, options.minSeconds);
+
+            report.add("copy_texture_data", case_fields(res, false, padded), result, (double) frameSize);
+        }
+    }
+}
+
+static void benchmark_yuv_to_rgba(BenchmarkReport &report, const benchmark_options &options) {
+    float colorMatrix[16];
+    mat4f_load_yuv_to_rgb_mat(colorMatrix);
+
+    for (const auto &res: kResolutions) {
+        for (bool semiPlanar: {false, true}) {
+            for (bool padded: {false, true}) {
+                yuv_frame src(res.width, res.height, res.width + (padded ? kStridePadding : 0), semiPlanar);
+                std::unique_ptr<uint8_t[]> rgba(new uint8_t[res.width * res.height * 4]);
+
+                benchmark_result result = run_benchmark([&]() {
+                    yuv420_to_rgba(src.y, src.strideY, src.u, src.v, src.strideUV, semiPlanar ? 2 : 1,
+                                   src.width, src.height, colorMatrix, rgba.get(), src.width * 4);
+                    do_not_optimize(rgba.get());
+                }, options.minSeconds);
+
+                // Throughput counts the RGBA written.
+                report.add("yuv_to_rgba", case_fields(res, semiPlanar, padded), result,
+                           (double) (res.width * res.height * 4));
+            }
+        }
+    }
+}
+
+// The per-frame transform setup, timed over a batch of calls.
+static void benchmark_matrices(BenchmarkReport &report, const benchmark_options &options) {
+    static const size_t kCalls = 10000;
+    float m[16];
+
+    benchmark_result rotate = run_benchmark([&]() {
+        for (size_t i = 0; i < kCalls; i++) {
+            mat4f_load_rotate_mat(m, (float) (i % 360));
+            do_not_optimize(m);
+        }
+    }, options.minSeconds);
+
+    benchmark_result scale = run_benchmark([&]() {
+        for (size_t i = 0; i < kCalls; i++) {
+            mat4f_load_scale_mat(m, (int) (i % 4) * 90, 1080, 1920, 1920, 1080, (i & 1) != 0, true);
+            do_not_optimize(m);
+        }
+    }, options.minSeconds);
+
+    for (auto *result: {&rotate, &scale}) {
+        result->medianNs /= kCalls;
+        result->minNs /= kCalls;
+    }
+
+    report.add("mat4f_load_rotate_mat", "", rotate, 0.0);
+    report.add("mat4f_load_scale_mat", "", scale, 0.0);
+}
+
+// MotionDetector::update() on frames alternating between two scenes, so every frame has motion.
+static void benchmark_motion(BenchmarkReport &report, const benchmark_options &options) {
+    for (const auto &res: kResolutions) {
+        yuv_frame still(res.width, res.height, res.width, false);
+        yuv_frame moved(res.width, res.height, res.width, false);
+        for (size_t y = res.height / 4; y < res.height / 2; y++) {
+            memset(moved.y + y * moved.strideY + res.width / 4, 255, res.width / 4);
+        }
+
+        const video_frame planes[2] = {
+                {res.width, res.height, still.strideY, still.strideUV, 1, still.y, still.u, still.v},
+                {res.width, res.height, moved.strideY, moved.strideUV, 1, moved.y, moved.u, moved.v},
+        };
+
+        MotionDetector detector;
+        motion_event event;
+        size_t frame = 0;
+        benchmark_result result = run_benchmark([&]() {
+            detector.update(planes[frame++ & 1], 16, 0.01f, event);
+            do_not_optimize(&event);
+        }, options.minSeconds);
+
+        report.add("motion_detection", case_fields(res, false, false), result, (double) (res.width * res.height));
+    }
+}
+
+// Conversions between the camera, encoder and display formats on one thread, with every kernel set
+// this CPU runs.
+static void benchmark_pixel_formats(BenchmarkReport &report, const benchmark_options &options) {
+    static const struct {
+        const char *name;
+        PixelFormat src;
+        PixelFormat dst;
+    } kConversions[] = {
+            {"nv21_to_rgba",   pxNV21,   pxRGBA},
+            {"nv12_to_i420",   pxNV12,   pxI420},
+            {"i420_to_yuyv",   pxI420,   pxYUYV},
+            {"yuyv_to_nv12",   pxYUYV,   pxNV12},
+            {"rgba_to_i420",   pxRGBA,   pxI420},
+            {"rgba_to_rgb565", pxRGBA,   pxRGB565},
+    };
+
+    const pixel_kernels *sets[4];
+    size_t setCount = pixel_kernels_supported(sets, 4);
+
+    for (const auto &res: kResolutions) {
+        for (const auto &conversion: kConversions) {
+            std::vector<uint8_t> srcData(pixel_image_size(conversion.src, res.width, res.height));
+            std::vector<uint8_t> dstData(pixel_image_size(conversion.dst, res.width, res.height));
+            for (size_t i = 0; i < srcData.size(); i++) {
+                srcData[i] = (uint8_t) (i * 7 + i / 4096);
+            }
+            pixel_image src = pixel_image_packed(conversion.src, res.width, res.height, srcData.data());
+            pixel_image dst = pixel_image_packed(conversion.dst, res.width, res.height, dstData.data());
+
+            for (size_t set = 0; set < setCount; set++) {
+                benchmark_result result = run_benchmark([&]() {
+                    convert_pixel_rows(*sets[set], src, dst, 0, res.height);
+                    do_not_optimize(dstData.data());
+                }, options.minSeconds);
+
+                char fields[256];
+                snprintf(fields, sizeof(fields),
+                         "\"resolution\":\"%s\",\"width\":%zu,\"height\":%zu,\"conversion\":\"%s\",\"kernels\":\"%s\"",
+                         res.name, res.width, res.height, conversion.name, sets[set]->name);
+                report.add("pixel_format", fields, result, (double) (res.width * res.height));
+            }
+        }
+    }
+}
+
+// Rotations of camera frames for output, against the plain copy and conversion they sit next to.
+static void benchmark_rotation(BenchmarkReport &report, const benchmark_options &options) {
+    static const struct {
+        const char *name;
+        PixelFormat src;
+        PixelFormat dst;
+        int rotation;
+        bool mirror;
+    } kRotations[] = {
+            {"i420_copy",              pxI420, pxI420, 0,   false},
+            {"i420_rotate_90",         pxI420, pxI420, 90,  false},
+            {"i420_rotate_180",        pxI420, pxI420, 180, false},
+            {"i420_rotate_270_mirror", pxI420, pxI420, 270, true},
+            {"nv21_rotate_90",         pxNV21, pxNV21, 90,  false},
+            {"nv21_to_rgba",           pxNV21, pxRGBA, 0,   false},
+            {"nv21_rotate_90_to_rgba", pxNV21, pxRGBA, 90,  false},
+    };
+
+    const pixel_kernels *sets[4];
+    size_t setCount = pixel_kernels_supported(sets, 4);
+
+    for (const auto &res: kResolutions) {
+        for (const auto &rotation: kRotations) {
+            bool swap = rotation.rotation == 90 || rotation.rotation == 270;
+            size_t width = swap ? res.height : res.width;
+            size_t height = swap ? res.width : res.height;
+            std::vector<uint8_t> srcData(pixel_image_size(rotation.src, res.width, res.height));
+            std::vector<uint8_t> dstData(pixel_image_size(rotation.dst, width, height));
+            for (size_t i = 0; i < srcData.size(); i++) {
+                srcData[i] = (uint8_t) (i * 7 + i / 4096);
+            }
+            pixel_image src = pixel_image_packed(rotation.src, res.width, res.height, srcData.data());
+            pixel_image dst = pixel_image_packed(rotation.dst, width, height, dstData.data());
+
+            for (size_t set = 0; set < setCount; set++) {
+                benchmark_result result = run_benchmark([&]() {
+                    rotate_pixel_rows(*sets[set], src, dst, rotation.rotation, rotation.mirror, 0, height);
+                    do_not_optimize(dstData.data());
+                }, options.minSeconds);
+
+                char fields[256];
+                snprintf(fields, sizeof(fields),
+                         "\"resolution\":\"%s\",\"width\":%zu,\"height\":%zu,\"rotation\":\"%s\",\"kernels\":\"%s\"",
+                         res.name, res.width, res.height, rotation.name, sets[set]->name);
+                report.add("rotation", fields, result, (double) (res.width * res.height));
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    benchmark_options options{};
+    if (!parse_options(argc, argv, options)) return 1;
+
+    const struct {
+        const char *name;
+        void (*run)(BenchmarkReport &, const benchmark_options &);
+    } benchmarks[] = {
+            {"copy_planes",       benchmark_copy_planes},
+            {"copy_texture_data", benchmark_copy_texture_data},
+            {"yuv_to_rgba",       benchmark_yuv_to_rgba},
+            {"mat4f",             benchmark_matrices},
+            {"motion",            benchmark_motion},
+            {"pixel_format",      benchmark_pixel_formats},
+            {"rotation",          benchmark_rotation},
+    };
+
+    BenchmarkReport report("cpu");
+    for (const auto &benchmark: benchmarks) {
+        if (strstr(benchmark.name, options.filter)) {
+            benchmark.run(report, options);
+        }
+    }
+    report.print();
+
+    return 0;
+}
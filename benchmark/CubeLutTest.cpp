@@ -0,0 +1,229 @@
+#include "CommonUtils.h"
+#include "CubeLut.h"
+#include "GLShaders.h"
+#include "HeadlessEGL.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// .cube parsing, the tetrahedral reference and the GPU lookups against it.
+
+// Swaps the channels around, red gets green, green blue and blue red. CRLF, comments and the
+// optional keywords exercise the parser.
+static const char kSwapCube[] =
+        "# Channel swap\r\n"
+        "TITLE \"swap\"\r\n"
+        "LUT_3D_SIZE 2\r\n"
+        "DOMAIN_MIN 0.0 0.0 0.0\r\n"
+        "DOMAIN_MAX 1.0 1.0 1.0\r\n"
+        "\r\n"
+        "0.0 0.0 0.0\r\n"
+        "0.0 0.0 1.0\r\n"
+        "1.0 0.0 0.0\r\n"
+        "1.0 0.0 1.0\r\n"
+        "  0.0 1.0 0.0\r\n"
+        "0.0 1.0 1.0\r\n"
+        "1.0 1.0 0.0\r\n"
+        "1.0 1.0 1.0";
+
+static const char *const kMalformedCubes[] = {
+        "LUT_3D_SIZE 2\n0 0 0\n1 1 1\n",
+        "LUT_3D_SIZE 1\n0 0 0\n",
+        "LUT_3D_SIZE 65\n",
+        "LUT_1D_SIZE 16\n",
+        "LUT_3D_SIZE 2\nDOMAIN_MAX 2.0 2.0 2.0\n",
+        "0 0 0\n1 1 1\n",
+};
+
+static const size_t kLutSize = 9;
+static const GLsizei kFrameSize = 64;
+
+// Far from linear within a cell, so that trilinear and tetrahedral lookups differ. Entries are
+// rounded to what the 8-bit textures hold, the CPU reference then sees the same table.
+static void grade(const float in[3], float out[3]) {
+    out[0] = std::round(std::sqrt(in[0] * in[1]) * 255.0f) / 255.0f;
+    out[1] = std::round(in[1] * in[1] * in[2] * 255.0f) / 255.0f;
+    out[2] = std::round((0.5f + 0.5f * std::sin(6.0f * in[2] + 3.0f * in[0])) * 255.0f) / 255.0f;
+}
+
+static void test_parse() {
+    CubeLut lut;
+    expect(lut.load(kSwapCube, strlen(kSwapCube)), "swap cube did not load");
+    expect(lut.size() == 2, "swap cube size %zu", lut.size());
+
+    const float in[3] = {0.2f, 0.5f, 0.9f};
+    float out[3];
+    lut.apply(in, out);
+    expect(std::fabs(out[0] - 0.5f) < 1e-6f && std::fabs(out[1] - 0.9f) < 1e-6f && std::fabs(out[2] - 0.2f) < 1e-6f,
+           "swap cube maps (0.2, 0.5, 0.9) to (%f, %f, %f)", out[0], out[1], out[2]);
+
+    for (const char *cube: kMalformedCubes) {
+        CubeLut malformed;
+        expect(!malformed.load(cube, strlen(cube)), "malformed cube loaded: %s", cube);
+    }
+}
+
+static void test_apply() {
+    // Tetrahedral interpolation reproduces affine transforms exactly.
+    CubeLut affine;
+    affine.generate(5, [](const float in[3], float out[3]) {
+        out[0] = 0.1f + 0.5f * in[0] + 0.3f * in[2];
+        out[1] = 0.9f - 0.6f * in[1];
+        out[2] = 0.25f * (in[0] + in[1] + in[2]);
+    });
+
+    for (int i = 0; i < 1000; i++) {
+        const float in[3] = {(float) (i % 10) / 9.3f, (float) (i / 10 % 10) / 9.7f, (float) (i / 100) / 9.1f};
+        float out[3];
+        affine.apply(in, out);
+
+        float expected[3] = {0.1f + 0.5f * in[0] + 0.3f * in[2], 0.9f - 0.6f * in[1], 0.25f * (in[0] + in[1] + in[2])};
+        for (int c = 0; c < 3; c++) {
+            expect(std::fabs(out[c] - expected[c]) < 1e-5f, "affine LUT at (%f, %f, %f) channel %d: %f, expected %f",
+                   in[0], in[1], in[2], c, out[c], expected[c]);
+        }
+    }
+
+    // On the diagonal of a cell only its first and last corner contribute.
+    CubeLut lut;
+    lut.generate(kLutSize, grade);
+    float c000[3], c111[3];
+    const float corner0[3] = {3.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f};
+    const float corner1[3] = {4.0f / 8.0f, 4.0f / 8.0f, 4.0f / 8.0f};
+    lut.apply(corner0, c000);
+    lut.apply(corner1, c111);
+
+    const float in[3] = {3.25f / 8.0f, 3.25f / 8.0f, 3.25f / 8.0f};
+    float out[3];
+    lut.apply(in, out);
+    for (int c = 0; c < 3; c++) {
+        float expected = 0.75f * c000[c] + 0.25f * c111[c];
+        expect(std::fabs(out[c] - expected) < 1e-5f, "diagonal channel %d: %f, expected %f", c, out[c], expected);
+    }
+}
+
+// Renders the LUT shader of the context version over random colors and compares every pixel with
+// CubeLut::apply(). The colour matrix is the identity, Y, U and V are the red, green and blue input.
+static void test_gpu(EGLint maxVersion) {
+    headless_context ctx{};
+    if (!create_context(ctx, maxVersion)) {
+        fprintf(stderr, "No EGL context, GPU lookups not tested.\n");
+        return;
+    }
+
+    bool lut3D = context_version(ctx) >= 3;
+    const char *name = lut3D ? "3D" : "tiled";
+    if (lut3D != (maxVersion >= 3)) {
+        fprintf(stderr, "No GLES%d context, %s lookup not tested.\n", maxVersion, name);
+        destroy_context(ctx);
+        return;
+    }
+
+    std::vector<uint8_t> planes[3];
+    uint32_t seed = 12345;
+    for (auto &plane: planes) {
+        plane.resize((size_t) (kFrameSize * kFrameSize));
+        for (auto &value: plane) {
+            seed = seed * 1664525u + 1013904223u;
+            value = (uint8_t) (seed >> 24);
+        }
+    }
+
+    std::vector<GLuint> textures;
+    for (int i = 0; i < 3; i++) {
+        textures.push_back(create_texture(GL_TEXTURE0 + i, GL_LUMINANCE, kFrameSize, kFrameSize, GL_NEAREST,
+                                          planes[i].data()));
+    }
+
+    CubeLut lut;
+    lut.generate(kLutSize, grade);
+    std::vector<uint8_t> rgba;
+    auto size = (GLsizei) kLutSize;
+
+    if (lut3D) {
+        lut.toRGBA(rgba);
+
+        GLuint texture = 0;
+        glActiveTexture(GL_TEXTURE4);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, size, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        textures.push_back(texture);
+    } else {
+        lut.toTiledRGBA(rgba);
+        textures.push_back(create_texture(GL_TEXTURE4, GL_RGBA, size * size, size, GL_NEAREST, rgba.data()));
+    }
+
+    GLuint vertexShader;
+    GLuint pixelShader;
+    GLuint program = lut3D ? create_program(kVertexShader3, kFragmentShaderLut3D, vertexShader, pixelShader)
+                           : create_program(kVertexShader, kFragmentShaderLut, vertexShader, pixelShader);
+    GLuint framebuffer = 0;
+    GLuint target = 0;
+    glActiveTexture(GL_TEXTURE7);
+
+    if (expect(program != 0, "%s LUT program did not build", name) &&
+        expect(create_framebuffer(kFrameSize, kFrameSize, framebuffer, target), "no framebuffer")) {
+        glUseProgram(program);
+
+        auto position = (GLuint) glGetAttribLocation(program, "position");
+        auto texcoord = (GLuint) glGetAttribLocation(program, "texcoord");
+        glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
+        glEnableVertexAttribArray(position);
+        glVertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, 0, kTextureCoords);
+        glEnableVertexAttribArray(texcoord);
+
+        float identity[16];
+        load_identity(identity);
+        glUniformMatrix4fv(glGetUniformLocation(program, "rotation"), 1, GL_FALSE, identity);
+        glUniformMatrix4fv(glGetUniformLocation(program, "scale"), 1, GL_FALSE, identity);
+        glUniformMatrix4fv(glGetUniformLocation(program, "colorMatrix"), 1, GL_FALSE, identity);
+        glUniform1i(glGetUniformLocation(program, "s_textureY"), 0);
+        glUniform1i(glGetUniformLocation(program, "s_textureU"), 1);
+        glUniform1i(glGetUniformLocation(program, "s_textureV"), 2);
+        glUniform1i(glGetUniformLocation(program, "s_lut"), 4);
+        glUniform1f(glGetUniformLocation(program, "lutSize"), (float) kLutSize);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, kFrameSize, kFrameSize);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        std::vector<uint8_t> pixels((size_t) (kFrameSize * kFrameSize * 4));
+        glReadPixels(0, 0, kFrameSize, kFrameSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        check_gl_error(name);
+
+        // The texture holds the table exactly, only the float math of the shader may round otherwise.
+        int maxDifference = 0;
+        for (size_t i = 0; i < pixels.size() / 4; i++) {
+            uint8_t expected[4] = {planes[0][i], planes[1][i], planes[2][i], 255};
+            lut.apply(expected, 1);
+
+            for (int c = 0; c < 3; c++) {
+                maxDifference = std::max(maxDifference, std::abs((int) pixels[i * 4 + c] - (int) expected[c]));
+            }
+        }
+
+        fprintf(stderr, "%s lookup differs from CubeLut::apply() by up to %d.\n", name, maxDifference);
+        expect(maxDifference <= 1, "%s lookup differs from CubeLut::apply() by %d", name, maxDifference);
+    }
+
+    delete_framebuffer(framebuffer, target);
+    delete_program(program);
+    glDeleteTextures((GLsizei) textures.size(), textures.data());
+    destroy_context(ctx);
+}
+
+int main() {
+    test_parse();
+    test_apply();
+    test_gpu(2);
+    test_gpu(3);
+
+    return test_result("cube-lut-test");
+}
@@ -0,0 +1,358 @@
+#include "FrameRef.h"
+#include "LumaStats.h"
+#include "MotionDetector.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <vector>
+
+// LumaStats and MotionDetector, with the SIMD kernels this CPU runs, against straightforward scalar
+// versions of what they compute. Widths are no multiple of 16 so that the kernel tails run, and
+// frames are tall enough to be split into bands.
+
+// Luma sizes and sampling steps, step > 1 goes through the subsampling ring.
+static const size_t kLumaCases[][3] = {{17, 9, 1}, {203, 67, 1}, {203, 67, 2}, {333, 241, 3}, {1285, 97, 4}};
+
+// One per downscale of the motion detector: none, a power of two box and a 3x3 one.
+static const size_t kMotionSizes[][2] = {{470, 270}, {950, 542}, {1430, 810}};
+
+static const int kMotionThreshold = 20;
+static const size_t kMotionFrames = 6;
+
+static uint32_t s_seed = 1;
+
+static uint8_t random_byte() {
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (uint8_t) (s_seed >> 24);
+}
+
+// A frame whose luma rows are padded by an odd number of bytes and start off alignment. The chroma
+// planes are only there for FrameRef.
+struct test_frame {
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma;
+    video_frame planes;
+
+    test_frame(size_t width, size_t height) : luma(1 + (width + 13) * height), chroma((width / 2 + 1) * 2) {
+        planes = {width, height, width + 13, width / 2 + 1, 1, luma.data() + 1, chroma.data(),
+                  chroma.data() + chroma.size() / 2};
+    }
+
+    uint8_t &at(size_t x, size_t y) { return planes.y[y * planes.stride_y + x]; }
+};
+
+static luma_stats expected_luma_stats(const video_frame &frame, size_t step) {
+    const size_t zoneColumns = luma_stats::kZoneColumns;
+    const size_t zoneRows = luma_stats::kZoneRows;
+    size_t width = frame.width / step;
+    size_t height = frame.height / step;
+    auto sample = [&](size_t x, size_t y) -> int { return frame.y[y * step * frame.stride_y + x * step]; };
+
+    luma_stats stats{};
+    double zoneSums[zoneColumns * zoneRows] = {};
+    size_t zoneSamples[zoneColumns * zoneRows] = {};
+    double sum = 0.0;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            // Zone columns start at zoneColumn * width / zoneColumns, rounded down.
+            size_t zoneColumn = 0;
+            while ((zoneColumn + 1) * width / zoneColumns <= x) zoneColumn++;
+            size_t zone = y * zoneRows / height * zoneColumns + zoneColumn;
+
+            int luma = sample(x, y);
+            stats.histogram[luma]++;
+            zoneSums[zone] += luma;
+            zoneSamples[zone]++;
+            sum += luma;
+            if (luma <= luma_stats::kClipMargin) stats.shadows++;
+            if (luma >= 255 - luma_stats::kClipMargin) stats.highlights++;
+        }
+    }
+
+    for (size_t i = 0; i < zoneColumns * zoneRows; i++) {
+        stats.zoneMeans[i] = zoneSamples[i] ? (float) (zoneSums[i] / (double) zoneSamples[i]) : 0.0f;
+    }
+    stats.samples = (uint32_t) (width * height);
+    stats.mean = (float) (sum / (double) stats.samples);
+
+    double laplacianSum = 0.0;
+    double laplacianSquares = 0.0;
+    size_t laplacianSamples = 0;
+    for (size_t y = 1; y + 1 < height; y++) {
+        for (size_t x = 1; x + 1 < width; x++) {
+            double laplacian = 4 * sample(x, y) - sample(x - 1, y) - sample(x + 1, y) - sample(x, y - 1) -
+                               sample(x, y + 1);
+            laplacianSum += laplacian;
+            laplacianSquares += laplacian * laplacian;
+            laplacianSamples++;
+        }
+    }
+    if (laplacianSamples) {
+        double mean = laplacianSum / (double) laplacianSamples;
+        stats.sharpness = (float) (laplacianSquares / (double) laplacianSamples - mean * mean);
+    }
+
+    return stats;
+}
+
+static bool close_to(float value, float expected, float tolerance) {
+    return std::fabs(value - expected) <= tolerance * std::max(std::fabs(expected), 1.0f);
+}
+
+// Noise over the whole range, with a black and a white patch for the clipped counts.
+static void test_luma_stats() {
+    for (const auto &luma: kLumaCases) {
+        size_t width = luma[0];
+        size_t height = luma[1];
+        size_t step = luma[2];
+
+        test_frame frame(width, height);
+        std::generate(frame.luma.begin(), frame.luma.end(), random_byte);
+        for (size_t y = 0; y < height / 3; y++) {
+            for (size_t x = 0; x < width / 3; x++) {
+                frame.at(x, y) = 0;
+                frame.at(width - 1 - x, height - 1 - y) = 255;
+            }
+        }
+
+        LumaStats analyzer;
+        analyzer.setEnabled(true, step);
+        analyzer.analyze(FrameRef::wrap(frame.planes, 0, nullptr));
+
+        // The analysis runs on the JobSystem.
+        luma_stats stats{};
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!analyzer.snapshot(stats) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!expect(analyzer.snapshot(stats), "%zux%zu step %zu: no luma stats", width, height, step)) continue;
+
+        luma_stats expected = expected_luma_stats(frame.planes, step);
+        size_t histogramErrors = 0;
+        for (size_t i = 0; i < 256; i++) histogramErrors += stats.histogram[i] != expected.histogram[i];
+        expect(!histogramErrors, "%zux%zu step %zu: %zu histogram bins differ", width, height, step,
+               histogramErrors);
+        expect(stats.samples == expected.samples && stats.shadows == expected.shadows &&
+               stats.highlights == expected.highlights,
+               "%zux%zu step %zu: %u samples, %u shadows, %u highlights, expected %u, %u, %u", width, height, step,
+               stats.samples, stats.shadows, stats.highlights, expected.samples, expected.shadows,
+               expected.highlights);
+        expect(close_to(stats.mean, expected.mean, 1e-5f), "%zux%zu step %zu: mean %.4f, expected %.4f", width,
+               height, step, stats.mean, expected.mean);
+        for (size_t i = 0; i < luma_stats::kZoneColumns * luma_stats::kZoneRows; i++) {
+            expect(close_to(stats.zoneMeans[i], expected.zoneMeans[i], 1e-5f),
+                   "%zux%zu step %zu: zone %zu mean %.4f, expected %.4f", width, height, step, i,
+                   stats.zoneMeans[i], expected.zoneMeans[i]);
+        }
+        expect(close_to(stats.sharpness, expected.sharpness, 1e-4f), "%zux%zu step %zu: sharpness %.3f, expected %.3f",
+               width, height, step, stats.sharpness, expected.sharpness);
+    }
+}
+
+// Motion detection done the long way: the box filtered plane, the background it follows, moving
+// pixels counted per block, and the 4-connected groups of moving blocks.
+struct motion_reference {
+    size_t frameWidth;
+    size_t frameHeight;
+    size_t scale;
+    size_t width;
+    size_t height;
+    size_t columns;
+    size_t rows;
+    std::vector<uint8_t> background;
+    std::vector<uint8_t> map;
+    float level;
+    // Boxes in frame pixels with the number of blocks in their group.
+    std::vector<motion_box> boxes;
+    std::vector<size_t> boxBlocks;
+
+    motion_reference(size_t frameWidth, size_t frameHeight)
+            : frameWidth(frameWidth), frameHeight(frameHeight), level(0.0f) {
+        const size_t block = MotionDetector::kBlockSize;
+        scale = std::max((frameWidth + MotionDetector::kMaxWidth - 1) / MotionDetector::kMaxWidth, (size_t) 1);
+        width = frameWidth / scale;
+        height = frameHeight / scale;
+        columns = (width + block - 1) / block;
+        rows = (height + block - 1) / block;
+    }
+
+    // Rounded mean of the scale x scale box. The detector's fixed point division is exact for the
+    // scales tested here.
+    uint8_t downscaled(const video_frame &frame, size_t x, size_t y) const {
+        uint32_t sum = 0;
+        for (size_t j = 0; j < scale; j++) {
+            for (size_t i = 0; i < scale; i++) sum += frame.y[(y * scale + j) * frame.stride_y + x * scale + i];
+        }
+        uint32_t area = (uint32_t) (scale * scale);
+        return (uint8_t) ((sum + area / 2) / area);
+    }
+
+    void update(const video_frame &frame) {
+        const size_t block = MotionDetector::kBlockSize;
+        bool first = background.empty();
+        background.resize(width * height);
+        std::vector<uint32_t> counts(columns * rows);
+
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                uint8_t &model = background[y * width + x];
+                int luma = downscaled(frame, x, y);
+                if (first) {
+                    model = (uint8_t) luma;
+                    continue;
+                }
+
+                int difference = luma - model;
+                counts[y / block * columns + x / block] += std::abs(difference) > kMotionThreshold;
+                // Moves 1/16 of the way, rounded half up.
+                model = (uint8_t) (model + (int) std::floor(difference / 16.0 + 0.5));
+            }
+        }
+        if (first) return;
+
+        // A block moved when more than 1/8 of its pixels did.
+        map.assign(columns * rows, 0);
+        size_t moving = 0;
+        for (size_t row = 0; row < rows; row++) {
+            for (size_t column = 0; column < columns; column++) {
+                size_t pixels = std::min(block, width - column * block) * std::min(block, height - row * block);
+                map[row * columns + column] = counts[row * columns + column] * 8 > pixels;
+                moving += map[row * columns + column];
+            }
+        }
+        level = (float) moving / (float) (columns * rows);
+
+        boxes.clear();
+        boxBlocks.clear();
+        std::vector<bool> seen(map.size());
+        for (size_t start = 0; start < map.size(); start++) {
+            if (!map[start] || seen[start]) continue;
+
+            size_t x0 = columns, y0 = rows, x1 = 0, y1 = 0, blocks = 0;
+            std::deque<size_t> queue{start};
+            seen[start] = true;
+            while (!queue.empty()) {
+                size_t i = queue.front();
+                queue.pop_front();
+                size_t x = i % columns, y = i / columns;
+                x0 = std::min(x0, x);
+                y0 = std::min(y0, y);
+                x1 = std::max(x1, x + 1);
+                y1 = std::max(y1, y + 1);
+                blocks++;
+
+                auto visit = [&](size_t neighbour) {
+                    if (map[neighbour] && !seen[neighbour]) {
+                        seen[neighbour] = true;
+                        queue.push_back(neighbour);
+                    }
+                };
+                if (x > 0) visit(i - 1);
+                if (x + 1 < columns) visit(i + 1);
+                if (y > 0) visit(i - columns);
+                if (y + 1 < rows) visit(i + columns);
+            }
+
+            // The last row and column of blocks reach the frame edges the downscale left out.
+            size_t blockPixels = block * scale;
+            size_t right = x1 == columns ? frameWidth : std::min(x1 * blockPixels, frameWidth);
+            size_t bottom = y1 == rows ? frameHeight : std::min(y1 * blockPixels, frameHeight);
+            boxes.push_back({(uint32_t) (x0 * blockPixels), (uint32_t) (y0 * blockPixels),
+                             (uint32_t) (right - x0 * blockPixels), (uint32_t) (bottom - y0 * blockPixels)});
+            boxBlocks.push_back(blocks);
+        }
+    }
+
+    // Blocks in the group of box, 0 when no group has it.
+    size_t blocksOf(const motion_box &box) const {
+        for (size_t i = 0; i < boxes.size(); i++) {
+            if (boxes[i].x == box.x && boxes[i].y == box.y && boxes[i].width == box.width &&
+                boxes[i].height == box.height) {
+                return boxBlocks[i];
+            }
+        }
+        return 0;
+    }
+};
+
+// A textured scene with slight noise that brightens a little every frame, and three squares of
+// different sizes crossing it.
+static void draw_scene(test_frame &frame, size_t index) {
+    size_t width = frame.planes.width;
+    size_t height = frame.planes.height;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            frame.at(x, y) = (uint8_t) (60 + (x * 7 + y * 3) % 50 + index + random_byte() % 4);
+        }
+    }
+
+    const size_t sizes[3] = {height / 3, height / 5, height / 9};
+    for (size_t square = 0; square < 3; square++) {
+        size_t side = sizes[square];
+        size_t x0 = (width / 8 + square * width / 3 + index * side / 2) % (width - side);
+        size_t y0 = (square * height / 4 + index * side / 3) % (height - side);
+        for (size_t y = y0; y < y0 + side; y++) {
+            for (size_t x = x0; x < x0 + side; x++) frame.at(x, y) = (uint8_t) (200 + square * 20);
+        }
+    }
+}
+
+static void test_motion_detector() {
+    for (const auto &size: kMotionSizes) {
+        size_t width = size[0];
+        size_t height = size[1];
+        test_frame frame(width, height);
+
+        MotionDetector detector;
+        motion_reference expected(width, height);
+        for (size_t index = 0; index < kMotionFrames; index++) {
+            draw_scene(frame, index);
+
+            motion_event event{};
+            bool changed = detector.update(frame.planes, kMotionThreshold, 0.01f, event);
+            expected.update(frame.planes);
+            if (!index) {
+                expect(!changed, "%zux%zu: the first frame found motion", width, height);
+                continue;
+            }
+
+            // Motion starts with the first frame that moves, and goes on.
+            expect(changed == (index == 1), "%zux%zu frame %zu: motion %s", width, height, index,
+                   changed ? "changed" : "didn't change");
+            expect(event.level == expected.level, "%zux%zu frame %zu: level %.4f, expected %.4f", width, height,
+                   index, event.level, expected.level);
+
+            std::vector<uint8_t> map;
+            size_t columns = detector.snapshot(map);
+            expect(columns == expected.columns && map == expected.map, "%zux%zu frame %zu: motion map differs",
+                   width, height, index);
+
+            size_t boxCount = std::min(expected.boxes.size(), motion_event::kMaxBoxes);
+            if (!expect(event.boxCount == boxCount, "%zux%zu frame %zu: %zu boxes, expected %zu", width, height,
+                        index, event.boxCount, boxCount)) {
+                continue;
+            }
+            for (size_t i = 0; i < event.boxCount; i++) {
+                const motion_box &box = event.boxes[i];
+                size_t blocks = expected.blocksOf(box);
+                expect(blocks, "%zux%zu frame %zu: unexpected box %u,%u %ux%u", width, height, index, box.x, box.y,
+                       box.width, box.height);
+                expect(!i || blocks <= expected.blocksOf(event.boxes[i - 1]),
+                       "%zux%zu frame %zu: box %zu is larger than the one before", width, height, index, i);
+            }
+        }
+    }
+}
+
+int main() {
+    test_luma_stats();
+    test_motion_detector();
+
+    return test_result("frame-analysis-test");
+}
@@ -0,0 +1,302 @@
+#include "HeadlessEGL.h"
+#include "Test.h"
+#include "VideoRenderer.h"
+
+#if MEDIA_VULKAN
+#include "HeadlessVulkan.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Every filter of the GL renderer, and the conversion and grading of the Vulkan one, drawn offscreen
+// from one synthetic frame and compared with the images in golden/. golden/grade.cube is the only
+// LUT in the assets. Software drivers round differently between releases, channels may be off by a
+// few code values. "golden-image-test --update" writes what the GL renderer draws as the goldens.
+// Built with REQUIRE_VULKAN, the test fails rather than skips the Vulkan renderer.
+
+static const size_t kWidth = 48;
+static const size_t kHeight = 32;
+
+// Channels off by more than kTolerance code values, which at most one in kOutlierRatio may be.
+static const int kTolerance = 4;
+static const size_t kOutlierRatio = 100;
+
+// Luma ramps across, with a bright bar and a dark disc for the edge and stylizing filters to find.
+// Chroma changes slowly, so that the nearest sampling of the Vulkan renderer and the linear one of
+// GL stay within the tolerance.
+static video_frame synthetic_frame(std::vector<uint8_t> &data) {
+    const size_t chromaWidth = kWidth / 2;
+    const size_t chromaHeight = kHeight / 2;
+    data.resize(kWidth * kHeight + 2 * chromaWidth * chromaHeight);
+
+    video_frame frame{kWidth, kHeight, kWidth, chromaWidth, 1, data.data(), data.data() + kWidth * kHeight,
+                      data.data() + kWidth * kHeight + chromaWidth * chromaHeight};
+
+    for (size_t y = 0; y < kHeight; y++) {
+        for (size_t x = 0; x < kWidth; x++) {
+            int dx = (int) x - 32;
+            int dy = (int) y - 20;
+            int luma = 40 + (int) (x * 160 / kWidth) + (int) (y * 20 / kHeight);
+            if (x >= 8 && x < 14) luma = 235;
+            if (dx * dx + dy * dy < 49) luma = 16;
+            frame.y[y * frame.stride_y + x] = (uint8_t) luma;
+        }
+    }
+
+    for (size_t y = 0; y < chromaHeight; y++) {
+        for (size_t x = 0; x < chromaWidth; x++) {
+            frame.u[y * frame.stride_uv + x] = (uint8_t) (100 + x * 2 + y);
+            frame.v[y * frame.stride_uv + x] = (uint8_t) (160 - x - y * 2);
+        }
+    }
+
+    return frame;
+}
+
+// Draws the frame in a new renderer of the type with the parameters, as setParameters() takes them.
+// Returns its parameters, with the filter and LUT counts.
+static uint32_t render(int type, uint32_t params, const video_frame &frame, std::vector<uint8_t> &rgba) {
+    AAssetManager assets{ASSET_DIR};
+    std::unique_ptr<VideoRenderer> renderer = VideoRenderer::create(type);
+
+    rgba.clear();
+    renderer->setOffscreen([&rgba](const uint8_t *pixels, size_t width, size_t height) {
+        rgba.assign(pixels, pixels + width * height * 4);
+    });
+    renderer->init(nullptr, &assets, kWidth, kHeight);
+    renderer->setParameters(params);
+
+    // A half turn at rotation 0 draws the frame upright, see BatchRender. Its planes outlive the
+    // renderer. The Vulkan renderer submits in draw() already.
+    renderer->draw(FrameRef::wrap(frame, 0, nullptr), 180.0f, false);
+    if (type != tVK_YUV420) renderer->render();
+
+    return renderer->getParameters();
+}
+
+static std::string golden_path(const std::string &name) {
+    return std::string(GOLDEN_DIR) + "/" + name + ".ppm";
+}
+
+// Binary PPM, RGB of the drawn RGBA.
+static bool write_golden(const std::string &name, const std::vector<uint8_t> &rgba) {
+    FILE *file = fopen(golden_path(name).c_str(), "wb");
+    if (!file) return false;
+
+    fprintf(file, "P6\n%zu %zu\n255\n", kWidth, kHeight);
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        fwrite(&rgba[i], 1, 3, file);
+    }
+
+    return !fclose(file);
+}
+
+static bool read_golden(const std::string &name, std::vector<uint8_t> &rgb) {
+    FILE *file = fopen(golden_path(name).c_str(), "rb");
+    if (!file) return false;
+
+    size_t width = 0;
+    size_t height = 0;
+    int maxValue = 0;
+    bool read = fscanf(file, "P6 %zu %zu %d", &width, &height, &maxValue) == 3 && fgetc(file) == '\n' &&
+                width == kWidth && height == kHeight && maxValue == 255;
+    if (read) {
+        rgb.resize(kWidth * kHeight * 3);
+        read = fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    }
+
+    fclose(file);
+    return read;
+}
+
+// Compares what the renderer drew with the golden of the name, or writes it as that when updating.
+static void check_golden(const char *renderer, const std::string &name, const std::vector<uint8_t> &rgba,
+                         bool update) {
+    if (!expect(rgba.size() == kWidth * kHeight * 4, "%s %s drew nothing", renderer, name.c_str())) return;
+
+    if (update) {
+        expect(write_golden(name, rgba), "could not write %s", golden_path(name).c_str());
+        return;
+    }
+
+    std::vector<uint8_t> rgb;
+    if (!expect(read_golden(name, rgb), "could not read %s", golden_path(name).c_str())) return;
+
+    int worst = 0;
+    size_t outliers = 0;
+    for (size_t i = 0; i < kWidth * kHeight; i++) {
+        for (size_t c = 0; c < 3; c++) {
+            int difference = std::abs((int) rgba[i * 4 + c] - (int) rgb[i * 3 + c]);
+            worst = std::max(worst, difference);
+            if (difference > kTolerance) outliers++;
+        }
+    }
+
+    expect(outliers * kOutlierRatio <= rgb.size(), "%s %s differs from its golden in %zu channels, by up to %d",
+           renderer, name.c_str(), outliers, worst);
+}
+
+static std::string filter_name(size_t filter) {
+    char name[16];
+    snprintf(name, sizeof(name), "filter-%02zu", filter);
+
+    return name;
+}
+
+static bool test_gl(const video_frame &frame, bool update) {
+    headless_context ctx{};
+    if (!create_context(ctx)) return false;
+
+    std::vector<uint8_t> rgba;
+    uint32_t params = render(tYUV420_FILTER, 0, frame, rgba);
+    check_golden("GL", filter_name(0), rgba, update);
+
+    size_t filterCount = (params >> 4) & 0xF;
+    for (size_t filter = 1; filter < filterCount; filter++) {
+        render(tYUV420_FILTER, (uint32_t) filter, frame, rgba);
+        check_golden("GL", filter_name(filter), rgba, update);
+    }
+
+    params = render(tYUV420_FILTER, 1 << 16, frame, rgba);
+    if (expect(((params >> 20) & 0xF) == 1, "the GL renderer did not load golden/grade.cube")) {
+        check_golden("GL", "lut", rgba, update);
+    }
+
+    destroy_context(ctx);
+    return true;
+}
+
+#if MEDIA_VULKAN
+
+// What the stats pass reduces the frame to, every luma sample of it at this size.
+static gpu_luma_stats expected_luma_stats(const video_frame &frame) {
+    uint64_t zoneSums[gpu_luma_stats::kZoneCount] = {};
+    uint64_t zoneSamples[gpu_luma_stats::kZoneCount] = {};
+    uint64_t bins[gpu_luma_stats::kBinCount] = {};
+    for (size_t y = 0; y < kHeight; y++) {
+        for (size_t x = 0; x < kWidth; x++) {
+            uint8_t luma = frame.y[y * frame.stride_y + x];
+            size_t zone = y * 4 / kHeight * 4 + x * 4 / kWidth;
+            zoneSums[zone] += luma;
+            zoneSamples[zone]++;
+            bins[luma >> 4]++;
+        }
+    }
+
+    gpu_luma_stats stats{};
+    uint64_t sum = 0;
+    for (size_t i = 0; i < gpu_luma_stats::kZoneCount; i++) {
+        stats.zoneMeans[i] = (float) zoneSums[i] / (float) zoneSamples[i];
+        sum += zoneSums[i];
+    }
+    stats.mean = (float) sum / (float) (kWidth * kHeight);
+    for (size_t i = 0; i < gpu_luma_stats::kBinCount; i++) {
+        stats.histogram[i] = (float) bins[i] / (float) (kWidth * kHeight);
+    }
+
+    return stats;
+}
+
+// Draws the frame a few times with the stats on, offscreen or presented to a headless surface, so
+// that every swapchain image is rendered to more than once. The GPU stats have to match the frame,
+// and the GPU time is recorded where the device writes timestamps.
+static void check_vulkan_stats(const video_frame &frame, bool offscreen, bool timestamps) {
+    const char *mode = offscreen ? "offscreen" : "presented";
+    AAssetManager assets{ASSET_DIR};
+    std::unique_ptr<VideoRenderer> renderer = VideoRenderer::create(tVK_YUV420);
+
+    size_t frames = 0;
+    if (offscreen) {
+        renderer->setOffscreen([&frames](const uint8_t *, size_t, size_t) {
+            frames++;
+        });
+    }
+    renderer->init(nullptr, &assets, kWidth, kHeight);
+    renderer->getStats().setEnabled(true);
+    renderer->setGpuStats(true);
+
+    const size_t kFrames = 8;
+    for (size_t i = 0; i < kFrames; i++) {
+        renderer->draw(FrameRef::wrap(frame, 0, nullptr), 180.0f, false);
+    }
+    if (offscreen) expect(frames == kFrames, "Vulkan %s drew %zu of %zu frames", mode, frames, kFrames);
+
+    float values[gpu_luma_stats::kValueCount];
+    if (expect(renderer->getGpuStats(values), "Vulkan %s read back no GPU stats", mode)) {
+        gpu_luma_stats stats = expected_luma_stats(frame);
+        expect(std::fabs(values[0] - stats.mean) < 0.01f, "Vulkan %s mean %.3f, expected %.3f", mode,
+               values[0], stats.mean);
+        for (size_t i = 0; i < gpu_luma_stats::kZoneCount; i++) {
+            expect(std::fabs(values[1 + i] - stats.zoneMeans[i]) < 0.01f,
+                   "Vulkan %s zone %zu mean %.3f, expected %.3f", mode, i, values[1 + i], stats.zoneMeans[i]);
+        }
+        for (size_t i = 0; i < gpu_luma_stats::kBinCount; i++) {
+            float bin = values[1 + gpu_luma_stats::kZoneCount + i];
+            expect(std::fabs(bin - stats.histogram[i]) < 1e-4f, "Vulkan %s bin %zu %.4f, expected %.4f", mode, i,
+                   bin, stats.histogram[i]);
+        }
+    }
+
+    float snapshot[RenderStats::kValueCount];
+    renderer->getStats().snapshot(snapshot);
+    if (timestamps) {
+        expect(snapshot[RenderStats::sGpu * RenderStats::kValuesPerStage] > 0.0f, "Vulkan %s recorded no GPU time",
+               mode);
+    }
+}
+
+// The Vulkan renderer only converts and grades, it draws what the GL renderer does without a filter.
+static bool test_vulkan(const video_frame &frame) {
+    vulkan_device device = find_vulkan_device();
+    if (device.name.empty()) return false;
+
+    fprintf(stderr, "Vulkan device: %s\n", device.name.c_str());
+
+    std::vector<uint8_t> rgba;
+    render(tVK_YUV420, 0, frame, rgba);
+    check_golden("Vulkan", filter_name(0), rgba, false);
+
+    uint32_t params = render(tVK_YUV420, 1 << 16, frame, rgba);
+    if (expect(((params >> 20) & 0xF) == 1, "the Vulkan renderer did not load golden/grade.cube")) {
+        check_golden("Vulkan", "lut", rgba, false);
+    }
+
+    check_vulkan_stats(frame, true, device.timestamps);
+    check_vulkan_stats(frame, false, device.timestamps);
+
+    return true;
+}
+
+#endif
+
+int main(int argc, char **argv) {
+    bool update = argc > 1 && !strcmp(argv[1], "--update");
+
+    std::vector<uint8_t> data;
+    video_frame frame = synthetic_frame(data);
+
+    bool gl = test_gl(frame, update);
+    if (!gl) fprintf(stderr, "No EGL context, the GL renderer not tested.\n");
+
+    bool vulkan = false;
+#if MEDIA_VULKAN
+    vulkan = !update && test_vulkan(frame);
+    if (!vulkan && !update) {
+        expect(!REQUIRE_VULKAN, "no Vulkan device, the Vulkan renderer was required");
+        fprintf(stderr, "No Vulkan device, the Vulkan renderer not tested.\n");
+    }
+#else
+    expect(update || !REQUIRE_VULKAN, "the Vulkan renderer was required but not built, see the CMake output");
+    fprintf(stderr, "Built without Vulkan, the Vulkan renderer not tested.\n");
+#endif
+
+    if (!gl && !vulkan) return s_testFailures ? test_result("golden-image-test") : kTestSkipped;
+
+    return test_result("golden-image-test");
+}
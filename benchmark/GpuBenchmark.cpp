@@ -0,0 +1,362 @@
+#include "Benchmark.h"
+#include "CommonUtils.h"
+#include "CubeLut.h"
+#include "FilterParameters.h"
+#include "FilterTables.h"
+#include "GLShaders.h"
+#include "GLUtils.h"
+#include "HeadlessEGL.h"
+#include "VideoRenderer.h"
+#include "WarpMap.h"
+
+#if MEDIA_VULKAN
+#include "HeadlessVulkan.h"
+#endif
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_PROGRAM_BINARY_LENGTH_OES 0x8741
+#endif
+
+// Table sizes and blur tap limit of GLVideoRendererYUV420Filter.
+static const size_t kMaxBlurTaps = 16;
+static const size_t kPaletteSize = 256;
+static const size_t kQuantizationSize = 32;
+static const size_t kLutSize = 33;
+
+struct resolution {
+    const char *name;
+    GLsizei width;
+    GLsizei height;
+};
+
+// Software rasterizers make 4K runs take minutes, the relative cost shows at these already.
+static const resolution kResolutions[] = {
+        {"480p",  640,  480},
+        {"720p",  1280, 720},
+        {"1080p", 1920, 1080},
+};
+
+// Every program in GLShaders.h, with the filter whose parameters it reads. The warp program runs
+// once per distortion, its cost depends on the map.
+struct program_case {
+    const char *name;
+    const char *fragment;
+    size_t filter;
+    WarpMap::Type warp;
+};
+
+static const program_case kPrograms[] = {
+        {"yuv",             kFragmentShader,             0,  WarpMap::tNone},
+        {"lut",             kFragmentShaderLut,          0,  WarpMap::tNone},
+        {"blur_horizontal", kFragmentShader1,            1,  WarpMap::tNone},
+        {"blur_vertical",   kFragmentShaderBlurVertical, 1,  WarpMap::tNone},
+        {"swirl",           kFragmentShaderWarp,         2,  WarpMap::tSwirl},
+        {"magnifier",       kFragmentShaderWarp,         3,  WarpMap::tMagnifier},
+        {"fish_eye",        kFragmentShaderWarp,         4,  WarpMap::tFishEye},
+        {"lichtenstein",    kFragmentShader5,            5,  WarpMap::tNone},
+        {"triangles",       kFragmentShader6,            6,  WarpMap::tNone},
+        {"pixelate",        kFragmentShader7,            7,  WarpMap::tNone},
+        {"cross_stitch",    kFragmentShader8,            8,  WarpMap::tNone},
+        {"toon",            kFragmentShader9,            9,  WarpMap::tNone},
+        {"thermal",         kFragmentShader10,           10, WarpMap::tNone},
+        {"emboss",          kFragmentShader11,           11, WarpMap::tNone},
+        {"edge_detection",  kFragmentShader12,           12, WarpMap::tNone},
+};
+
+// Frame planes, filter tables and the render target of one resolution, bound to the texture
+// units the renderer uses.
+class BenchmarkScene {
+public:
+    BenchmarkScene(GLsizei width, GLsizei height) : m_width(width), m_height(height), m_framebuffer(0),
+                                                    m_target(0), m_intermediateFramebuffer(0),
+                                                    m_intermediate(0) {
+        std::vector<uint8_t> y((size_t) (width * height));
+        std::vector<uint8_t> u((size_t) (width * height / 4));
+        std::vector<uint8_t> v((size_t) (width * height / 4));
+
+        for (GLsizei row = 0; row < height; row++) {
+            for (GLsizei col = 0; col < width; col++) {
+                y[row * width + col] = (uint8_t) ((col * 255 / width + (row * col) % 37) & 0xFF);
+            }
+        }
+        for (size_t i = 0; i < u.size(); i++) {
+            u[i] = (uint8_t) (64 + i % 128);
+            v[i] = (uint8_t) (192 - i % 128);
+        }
+
+        m_textures.push_back(create_texture(GL_TEXTURE0, GL_LUMINANCE, width, height, GL_LINEAR, y.data()));
+        m_textures.push_back(create_texture(GL_TEXTURE1, GL_LUMINANCE, width / 2, height / 2, GL_LINEAR, u.data()));
+        m_textures.push_back(create_texture(GL_TEXTURE2, GL_LUMINANCE, width / 2, height / 2, GL_LINEAR, v.data()));
+
+        CubeLut lut;
+        lut.generate(kLutSize, [](const float in[3], float out[3]) {
+            out[0] = in[0] * in[0];
+            out[1] = in[1];
+            out[2] = 1.0f - in[2];
+        });
+        std::vector<uint8_t> lutRGBA;
+        lut.toTiledRGBA(lutRGBA);
+        m_textures.push_back(create_texture(GL_TEXTURE4, GL_RGBA, (GLsizei) (kLutSize * kLutSize),
+                                            (GLsizei) kLutSize, GL_NEAREST, lutRGBA.data()));
+
+        // Unit 6 holds the palette or the quantization table, whichever the program reads.
+        std::vector<uint8_t> palette(kPaletteSize * 4);
+        thermal_palette(palette.data(), kPaletteSize);
+        m_palette = create_texture(GL_TEXTURE6, GL_RGBA, (GLsizei) kPaletteSize, 1, GL_LINEAR, palette.data());
+        m_textures.push_back(m_palette);
+
+        CubeLut quantization;
+        toon_quantization_lut(quantization, kQuantizationSize);
+        std::vector<uint8_t> quantizationRGBA;
+        quantization.toTiledRGBA(quantizationRGBA);
+        m_quantization = create_texture(GL_TEXTURE6, GL_RGBA, (GLsizei) (kQuantizationSize * kQuantizationSize),
+                                        (GLsizei) kQuantizationSize, GL_NEAREST, quantizationRGBA.data());
+        m_textures.push_back(m_quantization);
+
+        m_warp = create_texture(GL_TEXTURE5, GL_RGBA, 1, 1, GL_NEAREST, nullptr);
+        m_textures.push_back(m_warp);
+
+        glActiveTexture(GL_TEXTURE3);
+        create_framebuffer(width, height, m_intermediateFramebuffer, m_intermediate);
+        glActiveTexture(GL_TEXTURE7);
+        create_framebuffer(width, height, m_framebuffer, m_target);
+    }
+
+    ~BenchmarkScene() {
+        glDeleteTextures((GLsizei) m_textures.size(), m_textures.data());
+        delete_framebuffer(m_intermediateFramebuffer, m_intermediate);
+        delete_framebuffer(m_framebuffer, m_target);
+    }
+
+    bool isComplete() const {
+        return m_framebuffer && m_intermediateFramebuffer;
+    }
+
+    // Uses program and sets everything the renderer would for it.
+    void setup(GLuint program, const program_case &programCase) {
+        glUseProgram(program);
+
+        GLint position = glGetAttribLocation(program, "position");
+        GLint texcoord = glGetAttribLocation(program, "texcoord");
+        glVertexAttribPointer((GLuint) position, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
+        glEnableVertexAttribArray((GLuint) position);
+        glVertexAttribPointer((GLuint) texcoord, 2, GL_FLOAT, GL_FALSE, 0, kTextureCoords);
+        glEnableVertexAttribArray((GLuint) texcoord);
+
+        float identity[16];
+        load_identity(identity);
+        glUniformMatrix4fv(glGetUniformLocation(program, "rotation"), 1, GL_FALSE, identity);
+        glUniformMatrix4fv(glGetUniformLocation(program, "scale"), 1, GL_FALSE, identity);
+
+        float colorMatrix[16];
+        mat4f_load_yuv_to_rgb_mat(colorMatrix);
+        glUniformMatrix4fv(glGetUniformLocation(program, "colorMatrix"), 1, GL_FALSE, colorMatrix);
+
+        glUniform1i(glGetUniformLocation(program, "s_textureY"), 0);
+        glUniform1i(glGetUniformLocation(program, "s_textureU"), 1);
+        glUniform1i(glGetUniformLocation(program, "s_textureV"), 2);
+        glUniform1i(glGetUniformLocation(program, "s_texture"), 3);
+        glUniform1i(glGetUniformLocation(program, "s_lut"), 4);
+        glUniform1i(glGetUniformLocation(program, "s_warp"), 5);
+        glUniform1i(glGetUniformLocation(program, "s_palette"), 6);
+        glUniform1i(glGetUniformLocation(program, "s_quantization"), 6);
+        glUniform2f(glGetUniformLocation(program, "texSize"), (float) m_width, (float) m_height);
+        glUniform1f(glGetUniformLocation(program, "lutSize"), (float) kLutSize);
+        glUniform1f(glGetUniformLocation(program, "paletteSize"), (float) kPaletteSize);
+        glUniform1f(glGetUniformLocation(program, "quantizationSize"), (float) kQuantizationSize);
+
+        size_t count;
+        const filter_parameter *parameters = filter_parameters(programCase.filter, count);
+        float values[kMaxFilterParameters] = {};
+        for (size_t i = 0; i < count; i++) {
+            values[i] = parameters[i].value;
+            glUniform1f(glGetUniformLocation(program, parameters[i].name), parameters[i].value);
+        }
+
+        if (programCase.fragment == kFragmentShader1 || programCase.fragment == kFragmentShaderBlurVertical) {
+            float offsets[kMaxBlurTaps];
+            float weights[kMaxBlurTaps];
+            auto taps = (GLint) gaussian_linear_kernel(values[0], offsets, weights, kMaxBlurTaps);
+            bool horizontal = programCase.fragment == kFragmentShader1;
+
+            glUniform2f(glGetUniformLocation(program, "texelStep"), horizontal ? 1.0f / (float) m_width : 0.0f,
+                        horizontal ? 0.0f : 1.0f / (float) m_height);
+            glUniform1fv(glGetUniformLocation(program, "offsets"), taps, offsets);
+            glUniform1fv(glGetUniformLocation(program, "weights"), taps, weights);
+            glUniform1i(glGetUniformLocation(program, "tapCount"), taps);
+        }
+
+        if (programCase.warp != WarpMap::tNone) {
+            m_warpMap.generate(programCase.warp, (size_t) m_width, (size_t) m_height, values);
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, m_warp);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei) m_warpMap.width(), (GLsizei) m_warpMap.height(), 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, m_warpMap.data());
+            glUniform2f(glGetUniformLocation(program, "warpSize"), (float) m_warpMap.width(),
+                        (float) m_warpMap.height());
+        }
+
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, programCase.fragment == kFragmentShader9 ? m_quantization : m_palette);
+    }
+
+    void draw() {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glViewport(0, 0, m_width, m_height);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+
+private:
+    GLsizei m_width;
+    GLsizei m_height;
+    std::vector<GLuint> m_textures;
+    GLuint m_palette;
+    GLuint m_quantization;
+    GLuint m_warp;
+    WarpMap m_warpMap;
+    GLuint m_framebuffer;
+    GLuint m_target;
+    GLuint m_intermediateFramebuffer;
+    GLuint m_intermediate;
+};
+
+#if MEDIA_VULKAN
+
+// Vulkan renderer parameters as setParameters() takes them. It only converts and grades, with the
+// LUTs in the host assets.
+struct vulkan_case {
+    const char *name;
+    uint32_t params;
+};
+
+static const vulkan_case kVulkanCases[] = {
+        {"vk_yuv", 0},
+        {"vk_lut", 1 << 16},
+};
+
+// The Vulkan pipeline has no programs to time on their own, the renderer runs as a whole through
+// its offscreen target. A draw uploads the frame, renders it and waits for the readback, so it
+// costs more than the GL programs above.
+static void benchmark_vulkan(const benchmark_options &options, BenchmarkReport &report) {
+    vulkan_device device = find_vulkan_device();
+    if (device.name.empty()) {
+        fprintf(stderr, "No Vulkan device, the Vulkan renderer not benchmarked.\n");
+        return;
+    }
+    fprintf(stderr, "Vulkan device: %s\n", device.name.c_str());
+
+    for (const auto &res: kResolutions) {
+        auto width = (size_t) res.width;
+        auto height = (size_t) res.height;
+        std::vector<uint8_t> planes(width * height * 3 / 2);
+        for (size_t i = 0; i < planes.size(); i++) {
+            planes[i] = (uint8_t) ((i * 7 + i / width) & 0xFF);
+        }
+        const video_frame frame{width, height, width, width / 2, 1, planes.data(), planes.data() + width * height,
+                                planes.data() + width * height * 5 / 4};
+
+        for (const auto &vulkanCase: kVulkanCases) {
+            if (!strstr(vulkanCase.name, options.filter)) continue;
+
+            AAssetManager assets{ASSET_DIR};
+            std::unique_ptr<VideoRenderer> renderer = VideoRenderer::create(tVK_YUV420);
+            renderer->setOffscreen([](const uint8_t *rgba, size_t, size_t) {
+                do_not_optimize(rgba);
+            });
+            renderer->init(nullptr, &assets, width, height);
+            renderer->setParameters(vulkanCase.params);
+            // GPU time from the timestamps the renderer writes, where the device has them.
+            renderer->getStats().setEnabled(device.timestamps);
+
+            // The planes outlive the renderer, the views need no release.
+            benchmark_result result = run_benchmark([&renderer, &frame]() {
+                renderer->draw(FrameRef::wrap(frame, 0, nullptr), 180.0f, false);
+            }, options.minSeconds);
+
+            // Median GPU time, the p50 of the stage in microseconds.
+            float stats[RenderStats::kValueCount];
+            renderer->getStats().snapshot(stats);
+            float gpuMs = stats[RenderStats::sGpu * RenderStats::kValuesPerStage + 1] / 1e3f;
+
+            char fields[512];
+            snprintf(fields, sizeof(fields),
+                     "\"filter\":0,\"resolution\":\"%s\",\"width\":%d,\"height\":%d,\"renderer\":\"%s\","
+                     "\"ms_per_frame\":%.3f,\"gpu_ms_per_frame\":%.3f",
+                     res.name, res.width, res.height, device.name.c_str(), result.medianNs / 1e6, gpuMs);
+            report.add(vulkanCase.name, fields, result, (double) res.width * res.height * 4);
+        }
+    }
+}
+
+#endif
+
+int main(int argc, char **argv) {
+    benchmark_options options{};
+    if (!parse_options(argc, argv, options)) return 1;
+
+    headless_context ctx{};
+    if (!create_context(ctx)) return 1;
+
+    auto renderer = (const char *) glGetString(GL_RENDERER);
+    auto extensions = (const char *) glGetString(GL_EXTENSIONS);
+    bool programBinary = has_extension(extensions, "GL_OES_get_program_binary");
+    fprintf(stderr, "Renderer: %s\n", renderer);
+
+    BenchmarkReport report("gpu");
+
+    for (const auto &res: kResolutions) {
+        BenchmarkScene scene(res.width, res.height);
+        if (!scene.isComplete()) continue;
+
+        for (const auto &programCase: kPrograms) {
+            if (!strstr(programCase.name, options.filter)) continue;
+
+            GLuint vertexShader;
+            GLuint pixelShader;
+            GLuint program = create_program(kVertexShader, programCase.fragment, vertexShader, pixelShader);
+            if (!program) {
+                fprintf(stderr, "Could not build %s.\n", programCase.name);
+                continue;
+            }
+
+            // Drivers don't report instruction counts through GL, binary size is the closest proxy.
+            GLint binaryLength = 0;
+            if (programBinary) {
+                glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &binaryLength);
+            }
+
+            scene.setup(program, programCase);
+            benchmark_result result = run_benchmark([&scene]() {
+                scene.draw();
+                glFinish();
+            }, options.minSeconds);
+            check_gl_error(programCase.name);
+
+            char fields[512];
+            snprintf(fields, sizeof(fields),
+                     "\"filter\":%zu,\"resolution\":\"%s\",\"width\":%d,\"height\":%d,\"renderer\":\"%s\","
+                     "\"binary_bytes\":%d,\"ms_per_frame\":%.3f",
+                     programCase.filter, res.name, res.width, res.height, renderer, binaryLength,
+                     result.medianNs / 1e6);
+            report.add(programCase.name, fields, result, (double) res.width * res.height * 4);
+
+            delete_program(program);
+        }
+    }
+
+#if MEDIA_VULKAN
+    benchmark_vulkan(options, report);
+#else
+    fprintf(stderr, "Built without Vulkan, the Vulkan renderer not benchmarked.\n");
+#endif
+
+    report.print();
+    destroy_context(ctx);
+
+    return 0;
+}
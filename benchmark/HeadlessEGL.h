@@ -0,0 +1,109 @@
+#ifndef _HEADLESS_EGL_H_
+#define _HEADLESS_EGL_H_
+
+#include "GLUtils.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <cstdio>
+
+// Full screen quad with the texture coordinates the renderer draws with.
+static const float kVertices[8] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+static const float kTextureCoords[8] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+
+struct headless_context {
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+};
+
+// A GLES3 context, or GLES2 where that is all there is or maxVersion asks for, current on a 1x1
+// pbuffer. Rendering goes to framebuffers.
+static inline bool create_context(headless_context &ctx, EGLint maxVersion = 3) {
+    ctx.display = EGL_NO_DISPLAY;
+
+    // Mesa's surfaceless platform needs no display server, the default display is the fallback.
+    auto clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_extension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            ctx.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+    }
+
+    if (ctx.display == EGL_NO_DISPLAY) {
+        ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, nullptr, nullptr)) {
+        fprintf(stderr, "Could not initialize EGL display (0x%x).\n", eglGetError());
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint count = 0;
+    if (!eglChooseConfig(ctx.display, configAttribs, &config, 1, &count) || !count) {
+        fprintf(stderr, "Could not find EGL config (0x%x).\n", eglGetError());
+        return false;
+    }
+
+    const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    ctx.surface = eglCreatePbufferSurface(ctx.display, config, pbufferAttribs);
+
+    // Like VideoRendererContext, GLES3 where the config allows it.
+    ctx.context = EGL_NO_CONTEXT;
+    for (EGLint version = maxVersion; version >= 2 && ctx.context == EGL_NO_CONTEXT; version--) {
+        const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE};
+        ctx.context = eglCreateContext(ctx.display, config, EGL_NO_CONTEXT, contextAttribs);
+    }
+
+    if (ctx.context == EGL_NO_CONTEXT || !eglMakeCurrent(ctx.display, ctx.surface, ctx.surface, ctx.context)) {
+        fprintf(stderr, "Could not create EGL context (0x%x).\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+// Client version of the current context.
+static inline EGLint context_version(const headless_context &ctx) {
+    EGLint version = 2;
+    eglQueryContext(ctx.display, ctx.context, EGL_CONTEXT_CLIENT_VERSION, &version);
+
+    return version;
+}
+
+static inline void destroy_context(headless_context &ctx) {
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(ctx.display, ctx.context);
+    eglDestroySurface(ctx.display, ctx.surface);
+    eglTerminate(ctx.display);
+}
+
+static inline GLuint create_texture(GLenum unit, GLint format, GLsizei width, GLsizei height, GLint filter,
+                                    const uint8_t *data) {
+    GLuint texture = 0;
+
+    glActiveTexture(unit);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, (GLenum) format, GL_UNSIGNED_BYTE, data);
+
+    return texture;
+}
+
+#endif //_HEADLESS_EGL_H_
@@ -0,0 +1,53 @@
+#ifndef _HEADLESS_VULKAN_H_
+#define _HEADLESS_VULKAN_H_
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+// The device the Vulkan renderer takes, the first one. The renderer asserts that there is a device,
+// host tools check first. Mesa's lavapipe is picked with
+// VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json.
+struct vulkan_device {
+    // Empty without a device.
+    std::string name;
+    // Whether the graphics queue writes timestamps, which the GPU time in the stats needs.
+    bool timestamps;
+};
+
+static inline vulkan_device find_vulkan_device() {
+    vulkan_device device{"", false};
+
+    const VkInstanceCreateInfo instanceCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pNext = nullptr,
+    };
+    VkInstance instance;
+    if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance) != VK_SUCCESS) return device;
+
+    uint32_t count = 1;
+    VkPhysicalDevice physicalDevice;
+    VkResult result = vkEnumeratePhysicalDevices(instance, &count, &physicalDevice);
+    if ((result == VK_SUCCESS || result == VK_INCOMPLETE) && count) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        device.name = properties.deviceName;
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+        for (const VkQueueFamilyProperties &family: families) {
+            if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                device.timestamps = family.timestampValidBits != 0;
+                break;
+            }
+        }
+    }
+
+    vkDestroyInstance(instance, nullptr);
+    return device;
+}
+
+#endif //_HEADLESS_VULKAN_H_
@@ -0,0 +1,261 @@
+#include "PixelFormat.h"
+#include "PixelKernels.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Every kernel set this CPU runs against the scalar one, byte for byte, and rotations against
+// moving elements one by one.
+
+static const PixelFormat kFormats[] = {pxI420, pxNV12, pxNV21, pxYUYV, pxRGBA, pxRGB565};
+static const char *const kFormatNames[] = {"I420", "NV12", "NV21", "YUYV", "RGBA", "RGB565"};
+
+// Widths around the register widths of the SIMD sets, so that their tails run, and a full HD row.
+static const size_t kSizes[][2] = {{2, 2}, {6, 4}, {18, 4}, {34, 6}, {66, 2}, {130, 10}, {1922, 8}};
+
+// Sizes whose sides are no multiple of the transpose tiles, so that partial tiles run at the edges.
+static const size_t kRotateSizes[][2] = {{2, 2}, {34, 18}, {18, 34}, {66, 50}, {130, 66}};
+
+// Destination bytes outside the image, which must stay as they are.
+static const uint8_t kFill = 0xAB;
+
+static uint32_t s_seed = 1;
+
+static uint8_t random_byte() {
+    s_seed = s_seed * 1664525u + 1013904223u;
+    return (uint8_t) (s_seed >> 24);
+}
+
+// An image whose rows are padded by an odd number of bytes and start off alignment, in data.
+static pixel_image padded_image(PixelFormat format, size_t width, size_t height, std::vector<uint8_t> &data) {
+    pixel_image packed = pixel_image_packed(format, width, height, nullptr);
+    size_t offsets[3] = {0, 0, 0};
+    size_t size = 1;
+
+    for (int p = 0; p < 3 && packed.strides[p]; p++) {
+        size_t rows = p ? height / 2 : height;
+        packed.strides[p] += 7;
+        offsets[p] = size;
+        size += packed.strides[p] * rows + 1;
+    }
+
+    data.assign(size, kFill);
+    for (int p = 0; p < 3 && packed.strides[p]; p++) {
+        packed.planes[p] = data.data() + offsets[p];
+    }
+
+    return packed;
+}
+
+static pixel_image random_image(PixelFormat format, size_t width, size_t height, std::vector<uint8_t> &data) {
+    pixel_image image = padded_image(format, width, height, data);
+    std::generate(data.begin(), data.end(), random_byte);
+
+    return image;
+}
+
+static void test_convert(const pixel_kernels *const *sets, size_t setCount) {
+    for (const auto &size: kSizes) {
+        size_t width = size[0];
+        size_t height = size[1];
+
+        for (int from = 0; from < 6; from++) {
+            std::vector<uint8_t> srcData;
+            pixel_image src = random_image(kFormats[from], width, height, srcData);
+
+            for (int to = 0; to < 6; to++) {
+                std::vector<uint8_t> reference;
+                pixel_image dst = padded_image(kFormats[to], width, height, reference);
+                expect(convert_pixel_rows(*sets[0], src, dst, 0, height), "scalar %s to %s failed",
+                       kFormatNames[from], kFormatNames[to]);
+
+                for (size_t s = 1; s < setCount; s++) {
+                    // In bands of two rows, the smallest the converter takes.
+                    std::vector<uint8_t> data;
+                    dst = padded_image(kFormats[to], width, height, data);
+                    for (size_t row = 0; row < height; row += 2) {
+                        expect(convert_pixel_rows(*sets[s], src, dst, row, 2), "%s %s to %s failed", sets[s]->name,
+                               kFormatNames[from], kFormatNames[to]);
+                    }
+
+                    auto mismatch = std::mismatch(data.begin(), data.end(), reference.begin());
+                    expect(mismatch.first == data.end(), "%s %s to %s %zux%zu differs from scalar at byte %zu",
+                           sets[s]->name, kFormatNames[from], kFormatNames[to], width, height,
+                           (size_t) (mismatch.first - data.begin()));
+                }
+            }
+        }
+    }
+}
+
+// The whole image on the JobSystem with the best set, against scalar in one go.
+static void test_convert_image() {
+    const size_t width = 642;
+    const size_t height = 482;
+
+    for (int from = 0; from < 6; from++) {
+        std::vector<uint8_t> srcData;
+        pixel_image src = random_image(kFormats[from], width, height, srcData);
+
+        for (int to = 0; to < 6; to++) {
+            std::vector<uint8_t> reference;
+            std::vector<uint8_t> data;
+            pixel_image expected = padded_image(kFormats[to], width, height, reference);
+            pixel_image dst = padded_image(kFormats[to], width, height, data);
+
+            convert_pixel_rows(*pixel_kernels_scalar(), src, expected, 0, height);
+            expect(convert_pixel_image(src, dst) && data == reference, "%s to %s image differs from scalar",
+                   kFormatNames[from], kFormatNames[to]);
+        }
+    }
+}
+
+static size_t element_size(PixelFormat format, int plane) {
+    switch (format) {
+        case pxNV12:
+        case pxNV21:
+            return plane ? 2 : 1;
+        case pxRGBA:
+            return 4;
+        case pxRGB565:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// src rotated clockwise and mirrored into dst of the same format, an element at a time.
+static void rotate_reference(const pixel_image &src, const pixel_image &dst, int rotation, bool mirror) {
+    for (int p = 0; p < 3 && src.planes[p]; p++) {
+        size_t subsampling = p ? 2 : 1;
+        size_t width = src.width / subsampling;
+        size_t height = src.height / subsampling;
+        size_t dstWidth = dst.width / subsampling;
+        size_t dstHeight = dst.height / subsampling;
+        size_t size = element_size(src.format, p);
+
+        for (size_t y = 0; y < dstHeight; y++) {
+            for (size_t x = 0; x < dstWidth; x++) {
+                size_t rotatedX = mirror ? dstWidth - 1 - x : x;
+                size_t srcX;
+                size_t srcY;
+
+                switch (rotation) {
+                    case 90:
+                        srcX = y;
+                        srcY = height - 1 - rotatedX;
+                        break;
+                    case 180:
+                        srcX = width - 1 - rotatedX;
+                        srcY = height - 1 - y;
+                        break;
+                    case 270:
+                        srcX = width - 1 - y;
+                        srcY = rotatedX;
+                        break;
+                    default:
+                        srcX = rotatedX;
+                        srcY = y;
+                        break;
+                }
+
+                std::copy_n(src.planes[p] + srcY * src.strides[p] + srcX * size, size,
+                            dst.planes[p] + y * dst.strides[p] + x * size);
+            }
+        }
+    }
+}
+
+// Rotation fused with conversion gives what rotating and then converting with scalar gives.
+static void test_rotate(const pixel_kernels *const *sets, size_t setCount) {
+    for (const auto &size: kRotateSizes) {
+        for (int from = 0; from < 6; from++) {
+            // YUYV pixels share chroma, those sources only convert.
+            if (kFormats[from] == pxYUYV) continue;
+
+            for (int rotation = 0; rotation < 360; rotation += 90) {
+                for (int mirror = 0; mirror < 2; mirror++) {
+                    size_t width = size[0];
+                    size_t height = size[1];
+                    bool quarterTurn = rotation == 90 || rotation == 270;
+                    size_t dstWidth = quarterTurn ? height : width;
+                    size_t dstHeight = quarterTurn ? width : height;
+
+                    std::vector<uint8_t> srcData;
+                    std::vector<uint8_t> rotatedData;
+                    pixel_image src = random_image(kFormats[from], width, height, srcData);
+                    pixel_image rotated = padded_image(kFormats[from], dstWidth, dstHeight, rotatedData);
+                    rotate_reference(src, rotated, rotation, mirror != 0);
+
+                    for (int to = 0; to < 6; to++) {
+                        std::vector<uint8_t> reference;
+                        pixel_image expected = padded_image(kFormats[to], dstWidth, dstHeight, reference);
+                        convert_pixel_rows(*sets[0], rotated, expected, 0, dstHeight);
+
+                        for (size_t s = 0; s < setCount; s++) {
+                            // In bands of six rows, which split the transpose tiles.
+                            std::vector<uint8_t> data;
+                            pixel_image dst = padded_image(kFormats[to], dstWidth, dstHeight, data);
+                            bool done = true;
+                            for (size_t row = 0; row < dstHeight; row += 6) {
+                                done = rotate_pixel_rows(*sets[s], src, dst, rotation, mirror != 0, row,
+                                                         std::min<size_t>(6, dstHeight - row)) && done;
+                            }
+
+                            expect(done && data == reference, "%s %s to %s %zux%zu rotated by %d%s is wrong",
+                                   sets[s]->name, kFormatNames[from], kFormatNames[to], width, height, rotation,
+                                   mirror ? " and mirrored" : "");
+                        }
+
+                        std::vector<uint8_t> data;
+                        pixel_image dst = padded_image(kFormats[to], dstWidth, dstHeight, data);
+                        expect(rotate_pixel_image(src, dst, rotation, mirror != 0) && data == reference,
+                               "%s to %s %zux%zu image rotated by %d%s is wrong", kFormatNames[from],
+                               kFormatNames[to], width, height, rotation, mirror ? " and mirrored" : "");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// RGB565 holds fewer bits than RGBA, expanding it and packing it again gives it back.
+static void test_rgb565_round_trip() {
+    const size_t width = 66;
+    const size_t height = 2;
+
+    std::vector<uint8_t> srcData;
+    std::vector<uint8_t> rgbaData;
+    std::vector<uint8_t> backData;
+    pixel_image src = random_image(pxRGB565, width, height, srcData);
+    pixel_image rgba = padded_image(pxRGBA, width, height, rgbaData);
+    pixel_image back = padded_image(pxRGB565, width, height, backData);
+
+    convert_pixel_image(src, rgba);
+    convert_pixel_image(rgba, back);
+
+    bool same = true;
+    for (size_t y = 0; y < height; y++) {
+        same = same && std::equal(src.planes[0] + y * src.strides[0], src.planes[0] + y * src.strides[0] + width * 2,
+                                  back.planes[0] + y * back.strides[0]);
+    }
+    expect(same, "RGB565 to RGBA and back changed the image");
+}
+
+int main() {
+    const pixel_kernels *sets[4];
+    size_t setCount = pixel_kernels_supported(sets, 4);
+
+    for (size_t s = 0; s < setCount; s++) {
+        fprintf(stderr, "Testing %s kernels.\n", sets[s]->name);
+    }
+
+    test_convert(sets, setCount);
+    test_convert_image();
+    test_rgb565_round_trip();
+    test_rotate(sets, setCount);
+
+    return test_result("pixel-format-test");
+}
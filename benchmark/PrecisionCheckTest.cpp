@@ -0,0 +1,162 @@
+#include "CommonUtils.h"
+#include "FilterParameters.h"
+#include "GLShaders.h"
+#include "GLVideoRendererYUV420Filter.h"
+#include "HeadlessEGL.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The mediump precision check of every filter program, with the lookup tables the programs sample.
+// Mesa's mediump is highp, so every variant passes here, what is tested is that each check renders
+// the filter rather than a flat frame.
+
+// Offscreen target of the renderer, the checks render to their own.
+static const size_t kTargetSize = 64;
+
+struct check_program {
+    const char *name;
+    const char *vertex;
+    const char *fragment;
+    size_t filter;
+};
+
+// Fragment shaders by filter as GLVideoRendererYUV420Filter selects them.
+static const check_program kPrograms[] = {
+        {"conversion",    kVertexShader, kFragmentShader,             0},
+        {"blur",          kVertexShader, kFragmentShader1,            1},
+        {"blur vertical", kVertexShader, kFragmentShaderBlurVertical, 1},
+        {"swirl",         kVertexShader, kFragmentShaderWarp,         2},
+        {"magnifier",     kVertexShader, kFragmentShaderWarp,         3},
+        {"fish eye",      kVertexShader, kFragmentShaderWarp,         4},
+        {"filter 5",      kVertexShader, kFragmentShader5,            5},
+        {"filter 6",      kVertexShader, kFragmentShader6,            6},
+        {"filter 7",      kVertexShader, kFragmentShader7,            7},
+        {"filter 8",      kVertexShader, kFragmentShader8,            8},
+        {"toon",          kVertexShader, kFragmentShader9,            9},
+        {"thermal",       kVertexShader, kFragmentShader10,           10},
+        {"filter 11",     kVertexShader, kFragmentShader11,           11},
+        {"filter 12",     kVertexShader, kFragmentShader12,           12},
+};
+
+// Exposes the check of the renderer, which draws with its own frame and tables.
+class PrecisionCheck : public GLVideoRendererYUV420Filter {
+public:
+    using GLVideoRendererYUV420::renderPrecisionCheck;
+    using GLVideoRendererYUV420::comparePrecision;
+};
+
+static void default_parameters(render_parameters &params) {
+    memset(&params, 0, sizeof(params));
+    mat4f_load_yuv_to_rgb_mat(params.colorMatrix);
+
+    for (size_t filter = 0; filter < kMaxFilters; filter++) {
+        size_t count;
+        const filter_parameter *parameters = filter_parameters(filter, count);
+        for (size_t i = 0; i < count && i < kMaxFilterParameters; i++) {
+            params.filterValues[filter][i] = parameters[i].value;
+        }
+    }
+}
+
+// Largest difference between two pixels of a channel, flat frames are what unbound tables give.
+static int channel_range(const std::vector<uint8_t> &rgba) {
+    int range = 0;
+    for (int c = 0; c < 3; c++) {
+        int low = 255;
+        int high = 0;
+        for (size_t i = (size_t) c; i < rgba.size(); i += 4) {
+            low = std::min(low, (int) rgba[i]);
+            high = std::max(high, (int) rgba[i]);
+        }
+        range = std::max(range, high - low);
+    }
+    return range;
+}
+
+static void test_program(const PrecisionCheck &renderer, const render_parameters &params,
+                         const check_program &program) {
+    GLuint vertexShader;
+    GLuint pixelShader;
+    GLuint reference = create_program(program.vertex, program.fragment, vertexShader, pixelShader);
+    std::string variantSource = shader_with_precision(program.fragment, pMediump);
+    GLuint variant = create_program(program.vertex, variantSource.c_str(), vertexShader, pixelShader);
+
+    std::vector<uint8_t> referenceRGBA;
+    std::vector<uint8_t> variantRGBA;
+
+    if (expect(reference && variant, "%s programs did not build", program.name) &&
+        expect(renderer.renderPrecisionCheck(reference, variant, params, program.filter, referenceRGBA,
+                                             variantRGBA), "%s check did not render", program.name)) {
+        int range = channel_range(referenceRGBA);
+        expect(range > 32, "%s check renders a flat frame, range %d", program.name, range);
+        expect(PrecisionCheck::comparePrecision(referenceRGBA, variantRGBA), "%s mediump variant failed",
+               program.name);
+    }
+
+    expect(glGetError() == GL_NO_ERROR, "%s check left a GL error", program.name);
+
+    delete_program(reference);
+    delete_program(variant);
+}
+
+static void test_compare() {
+    std::vector<uint8_t> reference(256 * 4);
+    for (size_t i = 0; i < reference.size(); i++) {
+        reference[i] = (uint8_t) (i / 4);
+    }
+
+    std::vector<uint8_t> close = reference;
+    close[40] ^= 1;
+    expect(PrecisionCheck::comparePrecision(reference, close), "a one code value error failed");
+
+    std::vector<uint8_t> off = reference;
+    for (size_t i = 0; i < off.size(); i += 4) {
+        off[i] = (uint8_t) std::min(off[i] + 3, 255);
+    }
+    expect(!PrecisionCheck::comparePrecision(reference, off), "a three code value error passed");
+    expect(!PrecisionCheck::comparePrecision(reference, std::vector<uint8_t>()), "nothing rendered passed");
+}
+
+// Checks every program in a context of the version, which decides between the tiled and 3D LUTs.
+static bool test_context(EGLint maxVersion) {
+    headless_context ctx{};
+    if (!create_context(ctx, maxVersion)) return false;
+
+    bool lut3D = context_version(ctx) >= 3;
+    if (lut3D == (maxVersion >= 3)) {
+        render_parameters params;
+        default_parameters(params);
+
+        PrecisionCheck renderer;
+        renderer.setOffscreen([](const uint8_t *, size_t, size_t) {});
+        renderer.init(nullptr, nullptr, kTargetSize, kTargetSize);
+
+        for (const auto &program: kPrograms) {
+            test_program(renderer, params, program);
+        }
+
+        const check_program lut = lut3D ? check_program{"LUT 3D", kVertexShader3, kFragmentShaderLut3D, 0}
+                                        : check_program{"LUT tiled", kVertexShader, kFragmentShaderLut, 0};
+        test_program(renderer, params, lut);
+    } else {
+        fprintf(stderr, "No GLES%d context, its LUT check not tested.\n", maxVersion);
+    }
+
+    destroy_context(ctx);
+    return true;
+}
+
+int main() {
+    test_compare();
+
+    if (!test_context(2) || !test_context(3)) {
+        fprintf(stderr, "No EGL context, precision checks not tested.\n");
+        return s_testFailures ? test_result("precision-check-test") : kTestSkipped;
+    }
+
+    return test_result("precision-check-test");
+}
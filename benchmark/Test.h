@@ -0,0 +1,39 @@
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <cstdarg>
+#include <cstdio>
+
+// Checks of the host tests run by ctest. Failures are printed and counted, main() returns
+// test_result() so that any of them fails the test.
+
+// Exit code of a test that could not run here, see SKIP_RETURN_CODE in CMakeLists.txt.
+static const int kTestSkipped = 77;
+
+static int s_testFailures = 0;
+
+static inline bool expect(bool condition, const char *format, ...) {
+    if (condition) return true;
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "FAILED: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    s_testFailures++;
+    return false;
+}
+
+static inline int test_result(const char *name) {
+    if (s_testFailures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, s_testFailures);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: passed\n", name);
+    return 0;
+}
+
+#endif //_TEST_H_
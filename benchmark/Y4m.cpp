@@ -0,0 +1,357 @@
+#include "Y4m.h"
+#include "CommonUtils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kStreamMagic[] = "YUV4MPEG2";
+static const char kFrameMagic[] = "FRAME";
+static const char kFrameLine[] = "FRAME\n";
+
+// Longest header or FRAME line accepted, parameters beyond the ones read here are skipped.
+static const size_t kMaxLineLength = 1024;
+
+static size_t page_size() {
+    static const size_t size = (size_t) sysconf(_SC_PAGESIZE);
+
+    return size;
+}
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0) {
+
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char *path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) || st.st_size == 0) {
+        fprintf(stderr, "Could not read %s.\n", path);
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s.\n", path);
+        return false;
+    }
+
+    m_data = (uint8_t *) data;
+    m_size = (size_t) st.st_size;
+
+    // Frames are read front to back, which lets the kernel read ahead and drop pages behind.
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (!m_data) return;
+
+    munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void MappedFile::willNeed(size_t offset, size_t length) const {
+    if (offset >= m_size) return;
+
+    size_t start = offset / page_size() * page_size();
+    size_t end = std::min(offset + length, m_size);
+    madvise(m_data + start, end - start, MADV_WILLNEED);
+}
+
+void MappedFile::dontNeed(size_t offset, size_t length) const {
+    if (offset >= m_size) return;
+
+    size_t start = offset / page_size() * page_size();
+    size_t end = std::min(offset + length, m_size);
+    madvise(m_data + start, end - start, MADV_DONTNEED);
+}
+
+Y4mReader::Y4mReader()
+        : m_width(0), m_height(0), m_fpsNumerator(30), m_fpsDenominator(1), m_fullRange(false),
+          m_frameSize(0), m_frameCount(0), m_firstFrame(0), m_frameStride(0) {
+
+}
+
+bool Y4mReader::open(const char *path) {
+    if (!m_file.open(path)) return false;
+
+    const auto *data = (const char *) m_file.data();
+    size_t size = m_file.size();
+
+    const auto *end = (const char *) memchr(data, '\n', std::min(size, kMaxLineLength));
+    if (!end || strncmp(data, kStreamMagic, sizeof(kStreamMagic) - 1) ||
+        !parseHeader(data, (size_t) (end - data))) {
+        fprintf(stderr, "%s is not an 8-bit 4:2:0 Y4M file.\n", path);
+        m_file.close();
+        return false;
+    }
+
+    size_t chromaSize = ((m_width + 1) / 2) * ((m_height + 1) / 2);
+    m_frameSize = m_width * m_height + 2 * chromaSize;
+    m_frameCount = 0;
+    m_frameOffsets.clear();
+
+    // Only the FRAME lines are read, so this touches a page per frame and none of the pixels.
+    size_t offset = (size_t) (end - data) + 1;
+    while (offset < size) {
+        size_t remaining = size - offset;
+        const auto *line = data + offset;
+        const auto *lineEnd = (const char *) memchr(line, '\n', std::min(remaining, kMaxLineLength));
+
+        if (!lineEnd || strncmp(line, kFrameMagic, std::min(remaining, sizeof(kFrameMagic) - 1))) {
+            fprintf(stderr, "Malformed frame %zu in %s, reading %zu frames.\n", m_frameCount, path,
+                    m_frameCount);
+            break;
+        }
+
+        size_t frameStart = offset + (size_t) (lineEnd - line) + 1;
+        if (frameStart + m_frameSize > size) {
+            fprintf(stderr, "Truncated frame %zu in %s, reading %zu frames.\n", m_frameCount, path,
+                    m_frameCount);
+            break;
+        }
+
+        if (m_frameCount == 0) {
+            m_firstFrame = frameStart;
+        } else if (m_frameCount == 1) {
+            m_frameStride = frameStart - m_firstFrame;
+        }
+
+        // A FRAME line of another length ends the fixed stride, the table takes over from there.
+        if (m_frameOffsets.empty() && m_frameCount > 1 && frameStart != frameOffset(m_frameCount)) {
+            m_frameOffsets.reserve(m_frameCount + 1);
+            for (size_t i = 0; i < m_frameCount; i++) {
+                m_frameOffsets.push_back(m_firstFrame + i * m_frameStride);
+            }
+        }
+
+        if (!m_frameOffsets.empty()) {
+            m_frameOffsets.push_back(frameStart);
+        }
+
+        m_frameCount++;
+        offset = frameStart + m_frameSize;
+    }
+
+    return true;
+}
+
+bool Y4mReader::parseHeader(const char *line, size_t length) {
+    std::string header(line, length);
+    bool planar420 = true;
+
+    m_width = 0;
+    m_height = 0;
+    m_fullRange = false;
+
+    for (size_t start = header.find(' '); start != std::string::npos;) {
+        size_t next = header.find(' ', start + 1);
+        std::string token = header.substr(start + 1, next == std::string::npos ? next : next - start - 1);
+        start = next;
+
+        if (token.empty()) continue;
+
+        const char *value = token.c_str() + 1;
+        switch (token[0]) {
+            case 'W':
+                m_width = (size_t) strtoul(value, nullptr, 10);
+                break;
+            case 'H':
+                m_height = (size_t) strtoul(value, nullptr, 10);
+                break;
+            case 'F':
+                if (sscanf(value, "%d:%d", &m_fpsNumerator, &m_fpsDenominator) != 2 || m_fpsNumerator <= 0 ||
+                    m_fpsDenominator <= 0) {
+                    m_fpsNumerator = 30;
+                    m_fpsDenominator = 1;
+                }
+                break;
+            case 'C':
+                // 420jpeg, 420mpeg2 and 420paldv only differ in chroma siting.
+                planar420 = !strcmp(value, "420") || !strcmp(value, "420jpeg") || !strcmp(value, "420mpeg2") ||
+                            !strcmp(value, "420paldv");
+                break;
+            case 'X':
+                if (token == "XCOLORRANGE=FULL") m_fullRange = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return planar420 && m_width && m_height;
+}
+
+size_t Y4mReader::frameOffset(size_t index) const {
+    if (!m_frameOffsets.empty()) return m_frameOffsets[index];
+
+    return m_firstFrame + index * m_frameStride;
+}
+
+bool Y4mReader::frame(size_t index, video_frame &frame) const {
+    if (index >= m_frameCount) return false;
+
+    size_t chromaWidth = (m_width + 1) / 2;
+    size_t chromaHeight = (m_height + 1) / 2;
+
+    // The mapping is read only, views never write through these.
+    auto *y = (uint8_t *) m_file.data() + frameOffset(index);
+
+    frame.width = m_width;
+    frame.height = m_height;
+    frame.stride_y = m_width;
+    frame.stride_uv = chromaWidth;
+    frame.pixel_stride_uv = 1;
+    frame.y = y;
+    frame.u = y + m_width * m_height;
+    frame.v = frame.u + chromaWidth * chromaHeight;
+
+    return true;
+}
+
+void Y4mReader::prefetch(size_t index, size_t count) const {
+    if (index >= m_frameCount || count == 0) return;
+
+    size_t last = std::min(index + count, m_frameCount) - 1;
+    m_file.willNeed(frameOffset(index), frameOffset(last) + m_frameSize - frameOffset(index));
+}
+
+void Y4mReader::release(size_t index) const {
+    if (index >= m_frameCount) return;
+
+    // Whole pages inside the frame only, its neighbours may still be in use.
+    size_t start = (frameOffset(index) + page_size() - 1) / page_size() * page_size();
+    size_t end = (frameOffset(index) + m_frameSize) / page_size() * page_size();
+    if (end > start) m_file.dontNeed(start, end - start);
+}
+
+Y4mWriter::Y4mWriter() : m_fd(-1), m_width(0), m_height(0) {
+
+}
+
+Y4mWriter::~Y4mWriter() {
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+bool Y4mWriter::open(const char *path, size_t width, size_t height, int fpsNumerator, int fpsDenominator,
+                     bool fullRange) {
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+
+    // C420jpeg is the centred chroma siting of the renderers' 2x2 averaging.
+    char header[128];
+    int length = snprintf(header, sizeof(header), "%s W%zu H%zu F%d:%d Ip A1:1 C420jpeg%s\n", kStreamMagic,
+                          width, height, fpsNumerator, fpsDenominator, fullRange ? " XCOLORRANGE=FULL" : "");
+
+    iovec iov{header, (size_t) length};
+    return writeAll(&iov, 1);
+}
+
+void Y4mWriter::addPlane(const uint8_t *plane, size_t stride, size_t width, size_t height) {
+    if (stride == width) {
+        m_iov.push_back({(void *) plane, width * height});
+        return;
+    }
+
+    for (size_t row = 0; row < height; row++) {
+        m_iov.push_back({(void *) (plane + row * stride), width});
+    }
+}
+
+bool Y4mWriter::write(const video_frame &frame) {
+    if (m_fd < 0 || frame.width != m_width || frame.height != m_height) return false;
+
+    size_t chromaWidth = (m_width + 1) / 2;
+    size_t chromaHeight = (m_height + 1) / 2;
+
+    m_iov.clear();
+    m_iov.push_back({(void *) kFrameLine, sizeof(kFrameLine) - 1});
+    addPlane(frame.y, frame.stride_y, m_width, m_height);
+
+    if (frame.pixel_stride_uv == 2) {
+        // Y4M has no semi-planar layout, interleaved chroma is split into a scratch frame.
+        // NV21 interleaves from v, whichever plane comes first starts the pairs.
+        m_chroma.resize(2 * chromaWidth * chromaHeight);
+        uint8_t *u = m_chroma.data();
+        uint8_t *v = u + chromaWidth * chromaHeight;
+        if (frame.v < frame.u) {
+            split_uv_plane(v, u, chromaWidth, frame.v, frame.stride_uv, chromaWidth, chromaHeight);
+        } else {
+            split_uv_plane(u, v, chromaWidth, frame.u, frame.stride_uv, chromaWidth, chromaHeight);
+        }
+
+        addPlane(u, chromaWidth, chromaWidth, 2 * chromaHeight);
+    } else {
+        addPlane(frame.u, frame.stride_uv, chromaWidth, chromaHeight);
+        addPlane(frame.v, frame.stride_uv, chromaWidth, chromaHeight);
+    }
+
+    return writeAll(m_iov.data(), m_iov.size());
+}
+
+bool Y4mWriter::close() {
+    if (m_fd < 0) return false;
+
+    bool closed = ::close(m_fd) == 0;
+    m_fd = -1;
+
+    return closed;
+}
+
+bool Y4mWriter::writeAll(iovec *iov, size_t count) {
+    while (count) {
+        ssize_t written = writev(m_fd, iov, (int) std::min(count, (size_t) IOV_MAX));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+
+            fprintf(stderr, "Could not write Y4M frame: %s.\n", strerror(errno));
+            return false;
+        }
+
+        // Short writes resume inside the first unfinished buffer.
+        auto left = (size_t) written;
+        while (count && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count) {
+            iov->iov_base = (uint8_t *) iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef _Y4M_H_
+#define _Y4M_H_
+
+#include "FrameRef.h"
+
+#include <cstdint>
+#include <vector>
+#include <sys/uio.h>
+
+// A file mapped read only, for handing out views of it without copies.
+class MappedFile {
+public:
+    MappedFile();
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const char *path);
+
+    void close();
+
+    const uint8_t *data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+    // Starts reading [offset, offset + length) in the background.
+    void willNeed(size_t offset, size_t length) const;
+
+    // Lets the kernel drop [offset, offset + length) from the page cache once it was used.
+    void dontNeed(size_t offset, size_t length) const;
+
+private:
+    uint8_t *m_data;
+    size_t m_size;
+};
+
+// YUV4MPEG2 stream of 8-bit 4:2:0 frames, parsed once. Frames are views into the mapped file.
+class Y4mReader {
+public:
+    Y4mReader();
+
+    bool open(const char *path);
+
+    size_t frameCount() const { return m_frameCount; }
+
+    size_t width() const { return m_width; }
+
+    size_t height() const { return m_height; }
+
+    int fpsNumerator() const { return m_fpsNumerator; }
+
+    int fpsDenominator() const { return m_fpsDenominator; }
+
+    bool isFullRange() const { return m_fullRange; }
+
+    bool frame(size_t index, video_frame &frame) const;
+
+    // Advises the kernel to read count frames from index ahead.
+    void prefetch(size_t index, size_t count) const;
+
+    // Unmaps the pages of a frame that was used, they fault back in from the file if touched again.
+    void release(size_t index) const;
+
+private:
+    bool parseHeader(const char *line, size_t length);
+
+    size_t frameOffset(size_t index) const;
+
+    MappedFile m_file;
+    size_t m_width;
+    size_t m_height;
+    int m_fpsNumerator;
+    int m_fpsDenominator;
+    bool m_fullRange;
+    size_t m_frameSize;
+    size_t m_frameCount;
+
+    // Frames usually sit at a fixed stride, only FRAME lines of varying length need a table.
+    size_t m_firstFrame;
+    size_t m_frameStride;
+    std::vector<size_t> m_frameOffsets;
+};
+
+// Streams 4:2:0 frames to a Y4M file, one vectored write per frame straight from the planes. NV12
+// and NV21 chroma is split into planes first.
+class Y4mWriter {
+public:
+    Y4mWriter();
+
+    ~Y4mWriter();
+
+    Y4mWriter(const Y4mWriter &) = delete;
+
+    Y4mWriter &operator=(const Y4mWriter &) = delete;
+
+    // Full range is flagged with XCOLORRANGE, which is what the renderers' conversion expects.
+    bool open(const char *path, size_t width, size_t height, int fpsNumerator, int fpsDenominator,
+              bool fullRange);
+
+    bool write(const video_frame &frame);
+
+    bool close();
+
+private:
+    void addPlane(const uint8_t *plane, size_t stride, size_t width, size_t height);
+
+    bool writeAll(iovec *iov, size_t count);
+
+    int m_fd;
+    size_t m_width;
+    size_t m_height;
+    std::vector<iovec> m_iov;
+    std::vector<uint8_t> m_chroma;
+};
+
+#endif //_Y4M_H_
@@ -0,0 +1,258 @@
+#include "Test.h"
+#include "Y4m.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The reader's frame index over FRAME lines of varying length and truncated files, and the writer
+// over every chroma layout and short writes.
+
+static const size_t kWidth = 18;
+static const size_t kHeight = 10;
+static const size_t kChromaWidth = kWidth / 2;
+static const size_t kChromaHeight = kHeight / 2;
+static const size_t kFrameSize = kWidth * kHeight + 2 * kChromaWidth * kChromaHeight;
+
+static const char kHeader[] = "YUV4MPEG2 W18 H10 F25:1 Ip A1:1 C420jpeg\n";
+
+// Bytes writev() moves per call while limited, and every how many calls it is interrupted instead.
+static size_t s_writeLimit = 0;
+static int s_interruptEvery = 0;
+static int s_writeCalls = 0;
+
+// Replaces the libc writev() for Y4m.cpp, linked into this binary, so that short writes happen
+// on demand. Unlimited calls go straight to the kernel.
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int count) {
+    if (!s_writeLimit) return syscall(SYS_writev, fd, iov, count);
+
+    if (s_interruptEvery && ++s_writeCalls % s_interruptEvery == 0) {
+        errno = EINTR;
+        return -1;
+    }
+
+    size_t left = s_writeLimit;
+    std::vector<iovec> limited;
+    for (int i = 0; i < count && left; i++) {
+        size_t length = std::min(iov[i].iov_len, left);
+        limited.push_back({iov[i].iov_base, length});
+        left -= length;
+    }
+
+    return syscall(SYS_writev, fd, limited.data(), (int) limited.size());
+}
+
+static std::string temp_path() {
+    char path[] = "/tmp/y4m-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+
+    return path;
+}
+
+static void write_file(const std::string &path, const std::string &contents) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) return;
+
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+}
+
+static std::string read_file(const std::string &path) {
+    std::string contents;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return contents;
+
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, length);
+    }
+    fclose(file);
+
+    return contents;
+}
+
+// Planes of frame index, every byte telling the frame and its position apart.
+static std::string frame_pixels(size_t index) {
+    std::string pixels(kFrameSize, '\0');
+    for (size_t i = 0; i < kFrameSize; i++) {
+        pixels[i] = (char) ((index * 131 + i * 7) & 0xFF);
+    }
+
+    return pixels;
+}
+
+static bool frame_matches(const Y4mReader &reader, size_t index, size_t pixelsIndex) {
+    video_frame frame{};
+    if (!reader.frame(index, frame)) return false;
+
+    std::string pixels = frame_pixels(pixelsIndex);
+    return frame.width == kWidth && frame.height == kHeight &&
+           std::equal(frame.y, frame.y + kFrameSize, (const uint8_t *) pixels.data());
+}
+
+// A file of frames, each after the FRAME line given for it.
+static std::string stream(const std::vector<std::string> &frameLines) {
+    std::string contents = kHeader;
+    for (size_t i = 0; i < frameLines.size(); i++) {
+        contents += frameLines[i];
+        contents += frame_pixels(i);
+    }
+
+    return contents;
+}
+
+static void test_index() {
+    const std::string path = temp_path();
+
+    // Fixed stride, the line changing after the stride is known, and changing right at the second
+    // frame, which the stride is taken from.
+    const std::vector<std::vector<std::string>> layouts = {
+            {"FRAME\n", "FRAME\n", "FRAME\n", "FRAME\n"},
+            {"FRAME\n", "FRAME\n", "FRAME\n", "FRAME Ixyz\n", "FRAME\n", "FRAME Ip\n"},
+            {"FRAME\n", "FRAME Ip\n", "FRAME\n", "FRAME\n", "FRAME Ip\n"},
+            {"FRAME Ip\n", "FRAME\n"},
+    };
+
+    for (size_t l = 0; l < layouts.size(); l++) {
+        write_file(path, stream(layouts[l]));
+
+        Y4mReader reader;
+        if (!expect(reader.open(path.c_str()), "layout %zu did not open", l)) continue;
+
+        expect(reader.frameCount() == layouts[l].size(), "layout %zu has %zu frames, expected %zu", l,
+               reader.frameCount(), layouts[l].size());
+        for (size_t i = 0; i < reader.frameCount(); i++) {
+            expect(frame_matches(reader, i, i), "layout %zu frame %zu is read from the wrong offset", l, i);
+        }
+
+        video_frame frame{};
+        expect(!reader.frame(reader.frameCount(), frame), "layout %zu reads past its last frame", l);
+    }
+
+    unlink(path.c_str());
+}
+
+static void test_truncated() {
+    const std::string path = temp_path();
+    const std::string whole = stream({"FRAME\n", "FRAME Ip\n", "FRAME\n"});
+    const size_t lastFrame = whole.size() - kFrameSize - 6;
+
+    // Cut inside the last frame's pixels, inside its FRAME line and right before it.
+    const size_t cuts[] = {whole.size() - 1, lastFrame + kFrameSize / 2, lastFrame + 3, lastFrame};
+    for (size_t cut: cuts) {
+        write_file(path, whole.substr(0, cut));
+
+        Y4mReader reader;
+        if (!expect(reader.open(path.c_str()), "file cut at %zu did not open", cut)) continue;
+
+        expect(reader.frameCount() == 2, "file cut at %zu has %zu frames, expected 2", cut, reader.frameCount());
+        for (size_t i = 0; i < std::min<size_t>(reader.frameCount(), 2); i++) {
+            expect(frame_matches(reader, i, i), "file cut at %zu reads frame %zu wrongly", cut, i);
+        }
+    }
+
+    // Garbage where a FRAME line belongs ends the stream there too.
+    write_file(path, stream({"FRAME\n", "FRAME\n"}) + "FRAMX\n" + frame_pixels(2));
+    Y4mReader reader;
+    expect(reader.open(path.c_str()) && reader.frameCount() == 2, "a malformed FRAME line was read");
+
+    // Headers the reader cannot use are refused.
+    const char *const headers[] = {"YUV4MPEG2 W18 H10 C444\n", "YUV4MPEG2 H10\n", "YUV4MPEG W18 H10\n",
+                                   "YUV4MPEG2 W0 H10\n"};
+    for (const char *header: headers) {
+        write_file(path, std::string(header) + "FRAME\n" + frame_pixels(0));
+        Y4mReader refused;
+        expect(!refused.open(path.c_str()), "header %s was read", header);
+    }
+
+    unlink(path.c_str());
+}
+
+struct chroma_layout {
+    const char *name;
+    size_t pixelStride;
+    size_t uOffset;
+    size_t vOffset;
+};
+
+// Chroma offsets within a padded scratch plane, interleaved ones start from whichever comes first.
+static const chroma_layout kLayouts[] = {
+        {"I420", 1, 0, 64},
+        {"NV12", 2, 0, 1},
+        {"NV21", 2, 1, 0},
+};
+
+// Writes frames with padded rows in the layout and reads them back as I420.
+static void test_write(const chroma_layout &layout, size_t writeLimit, int interruptEvery) {
+    const std::string path = temp_path();
+    const size_t strideY = kWidth + 5;
+    const size_t strideUV = kChromaWidth * layout.pixelStride + 3;
+    const size_t frameCount = 3;
+
+    std::vector<uint8_t> y(strideY * kHeight, 0xEE);
+    std::vector<uint8_t> chroma(64 + strideUV * kChromaHeight, 0xEE);
+
+    Y4mWriter writer;
+    bool written = writer.open(path.c_str(), kWidth, kHeight, 25, 1, false);
+
+    s_writeLimit = writeLimit;
+    s_interruptEvery = interruptEvery;
+    s_writeCalls = 0;
+
+    for (size_t f = 0; f < frameCount && written; f++) {
+        std::string pixels = frame_pixels(f);
+        const auto *planeU = (const uint8_t *) pixels.data() + kWidth * kHeight;
+        const auto *planeV = planeU + kChromaWidth * kChromaHeight;
+
+        video_frame frame{kWidth, kHeight, strideY, strideUV, layout.pixelStride, y.data(),
+                          chroma.data() + layout.uOffset, chroma.data() + layout.vOffset};
+
+        for (size_t row = 0; row < kHeight; row++) {
+            std::copy_n(pixels.data() + row * kWidth, kWidth, y.data() + row * strideY);
+        }
+        for (size_t row = 0; row < kChromaHeight; row++) {
+            for (size_t x = 0; x < kChromaWidth; x++) {
+                frame.u[row * strideUV + x * layout.pixelStride] = planeU[row * kChromaWidth + x];
+                frame.v[row * strideUV + x * layout.pixelStride] = planeV[row * kChromaWidth + x];
+            }
+        }
+
+        written = writer.write(frame);
+    }
+
+    s_writeLimit = 0;
+    s_interruptEvery = 0;
+
+    const char *how = writeLimit ? "in short writes" : "at once";
+    if (expect(writer.close() && written, "%s written %s failed", layout.name, how)) {
+        std::string expected = "YUV4MPEG2 W18 H10 F25:1 Ip A1:1 C420jpeg\n";
+        for (size_t f = 0; f < frameCount; f++) {
+            expected += "FRAME\n" + frame_pixels(f);
+        }
+
+        expect(read_file(path) == expected, "%s written %s differs from the frames", layout.name, how);
+    }
+
+    unlink(path.c_str());
+}
+
+int main() {
+    test_index();
+    test_truncated();
+
+    for (const auto &layout: kLayouts) {
+        test_write(layout, 0, 0);
+        // A few bytes at a time, ending inside the FRAME line, rows and planes, with interruptions.
+        test_write(layout, 5, 0);
+        test_write(layout, 37, 3);
+    }
+
+    return test_result("y4m-test");
+}
@@ -0,0 +1,98 @@
+#ifndef _COMPAT_ANDROID_ASSET_MANAGER_H_
+#define _COMPAT_ANDROID_ASSET_MANAGER_H_
+
+// Host stand-in for the asset calls of the shared sources. Host tools have no APK, an asset manager
+// names a directory laid out like its assets/ instead, e.g. the SPIR-V shaders under shaders/.
+// Renderers given none run without assets.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+struct AAssetManager {
+    std::string root;
+};
+
+struct AAssetDir {
+    DIR *dir;
+    std::string path;
+};
+
+struct AAsset {
+    std::vector<char> data;
+    size_t position;
+};
+
+enum {
+    AASSET_MODE_UNKNOWN = 0, AASSET_MODE_RANDOM = 1, AASSET_MODE_STREAMING = 2, AASSET_MODE_BUFFER = 3
+};
+
+static inline AAssetDir *AAssetManager_openDir(AAssetManager *manager, const char *dirName) {
+    if (!manager) return nullptr;
+
+    std::string path = manager->root + "/" + dirName;
+    DIR *dir = opendir(path.c_str());
+
+    return dir ? new AAssetDir{dir, path} : nullptr;
+}
+
+// Regular files only, as in an APK, where directories hold nothing but files.
+static inline const char *AAssetDir_getNextFileName(AAssetDir *assetDir) {
+    while (dirent *entry = readdir(assetDir->dir)) {
+        struct stat info{};
+        std::string path = assetDir->path + "/" + entry->d_name;
+        if (!stat(path.c_str(), &info) && S_ISREG(info.st_mode)) return entry->d_name;
+    }
+
+    return nullptr;
+}
+
+static inline void AAssetDir_close(AAssetDir *assetDir) {
+    closedir(assetDir->dir);
+    delete assetDir;
+}
+
+// Reads the whole file, assets are small.
+static inline AAsset *AAssetManager_open(AAssetManager *manager, const char *fileName, int) {
+    if (!manager) return nullptr;
+
+    FILE *file = fopen((manager->root + "/" + fileName).c_str(), "rb");
+    if (!file) return nullptr;
+
+    auto *asset = new AAsset{{}, 0};
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        asset->data.insert(asset->data.end(), buffer, buffer + length);
+    }
+    fclose(file);
+
+    return asset;
+}
+
+static inline const void *AAsset_getBuffer(AAsset *asset) {
+    return asset->data.data();
+}
+
+static inline long AAsset_getLength(AAsset *asset) {
+    return (long) asset->data.size();
+}
+
+static inline int AAsset_read(AAsset *asset, void *buffer, size_t count) {
+    count = std::min(count, asset->data.size() - asset->position);
+    memcpy(buffer, asset->data.data() + asset->position, count);
+    asset->position += count;
+
+    return (int) count;
+}
+
+static inline void AAsset_close(AAsset *asset) {
+    delete asset;
+}
+
+#endif //_COMPAT_ANDROID_ASSET_MANAGER_H_
@@ -0,0 +1,24 @@
+#ifndef _COMPAT_ANDROID_LOG_H_
+#define _COMPAT_ANDROID_LOG_H_
+
+// Host stand-in for the NDK log calls made by the shared sources, prints to stderr.
+
+#include <cstdarg>
+#include <cstdio>
+
+enum {
+    ANDROID_LOG_INFO = 4, ANDROID_LOG_ERROR = 6
+};
+
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s %s: ", prio >= ANDROID_LOG_ERROR ? "E" : "I", tag);
+    int written = vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+
+    return written;
+}
+
+#endif //_COMPAT_ANDROID_LOG_H_
@@ -0,0 +1,8 @@
+#ifndef _COMPAT_ANDROID_NATIVE_WINDOW_H_
+#define _COMPAT_ANDROID_NATIVE_WINDOW_H_
+
+// Host stand-in, host tools only render offscreen and never pass a window.
+
+struct ANativeWindow;
+
+#endif //_COMPAT_ANDROID_NATIVE_WINDOW_H_